@@ -0,0 +1,186 @@
+/**
+ * Benchmark Input Generator
+ *
+ * Writes a synthetic C source in the subset accepted by CComp. The shape
+ * selects what dominates the file, the size is the approximate output
+ * size in bytes, and the seed makes every run reproducible.
+ *
+ * Usage: gen_bench <functions|nesting|expressions|comments> <bytes> [seed]
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Input shapes
+typedef enum {
+    SHAPE_FUNCTIONS,    // Many small functions
+    SHAPE_NESTING,      // Deeply nested if/while blocks
+    SHAPE_EXPRESSIONS,  // Long expressions
+    SHAPE_COMMENTS      // Code buried in comments
+} Shape;
+
+#define MAX_NESTING 64
+#define EXPRESSION_TERMS 200
+
+static unsigned long rng_state;
+static long bytes_written;
+
+static const char *binary_ops[] = {
+    "+", "-", "*", "/", "%", "==", "!=", "<", ">", "<=", ">=",
+    "&&", "||", "&", "|", "^", "<<", ">>"
+};
+
+// xorshift64 generator, identical output on every platform
+static unsigned long next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state & 0xffffffffUL;
+}
+
+// Random number in [0, bound)
+static int random_below(int bound) {
+    return (int)(next_random() % (unsigned long)bound);
+}
+
+// Write formatted output and track the size
+static void emit(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    if (written > 0) bytes_written += written;
+}
+
+// Write indentation
+static void emit_indent(int depth) {
+    for (int i = 0; i < depth; i++) emit("    ");
+}
+
+// Write an expression over the locals a, b and c with the given number of terms
+static void emit_expression(int terms) {
+    emit("a");
+    for (int i = 1; i < terms; i++) {
+        const char *op = binary_ops[random_below((int)(sizeof(binary_ops) / sizeof(binary_ops[0])))];
+        switch (random_below(4)) {
+            case 0: emit(" %s b", op); break;
+            case 1: emit(" %s (c %s %d)", op, binary_ops[random_below(4)], random_below(1000) + 1); break;
+            case 2: emit(" %s %d", op, random_below(100000)); break;
+            default: emit(" %s -c", op); break;
+        }
+    }
+}
+
+// Write the common locals of a function body
+static void emit_locals(int depth) {
+    emit_indent(depth);
+    emit("int a = %d;\n", random_below(100));
+    emit_indent(depth);
+    emit("int b = a * %d;\n", random_below(10) + 1);
+    emit_indent(depth);
+    emit("char c = 'x';\n");
+    emit_indent(depth);
+    emit("char buffer[%d];\n", random_below(64) + 1);
+}
+
+// Write one small function with a loop and a call to the previous one
+static void emit_small_function(int index) {
+    emit("int function_%d(int first, int second) {\n", index);
+    emit_locals(1);
+    emit("    while (a < first) {\n");
+    emit("        a = a + second;\n");
+    emit("        if (a == %d) {\n", random_below(50));
+    emit("            buffer[0] = c;\n");
+    emit("        } else {\n");
+    emit("            b = b - 1;\n");
+    emit("        }\n");
+    emit("    }\n");
+    if (index > 0) {
+        emit("    return function_%d(a, b) + %d;\n", index - 1, random_below(10));
+    } else {
+        emit("    return a + b;\n");
+    }
+    emit("}\n\n");
+}
+
+// Write a function whose body nests if/while blocks
+static void emit_nested_function(int index) {
+    emit("int nested_%d(int first) {\n", index);
+    emit_locals(1);
+    int depth = MAX_NESTING / 2 + random_below(MAX_NESTING / 2);
+    for (int i = 1; i <= depth; i++) {
+        emit_indent(i);
+        if (i % 2) {
+            emit("if (a < %d) {\n", random_below(1000));
+        } else {
+            emit("while (b > %d) {\n", random_below(1000));
+        }
+        emit_indent(i + 1);
+        emit("b = b - first;\n");
+    }
+    for (int i = depth; i >= 1; i--) {
+        emit_indent(i);
+        emit("}\n");
+    }
+    emit("    return a;\n}\n\n");
+}
+
+// Write a function made of long expressions
+static void emit_expression_function(int index) {
+    emit("int expression_%d(int first) {\n", index);
+    emit_locals(1);
+    for (int i = 0; i < 4; i++) {
+        emit("    a = ");
+        emit_expression(EXPRESSION_TERMS);
+        emit(";\n");
+    }
+    emit("    return a;\n}\n\n");
+}
+
+// Write a function surrounded by large comments
+static void emit_commented_function(int index) {
+    emit("/*\n");
+    for (int i = 0; i < 20; i++) {
+        emit(" * Generated documentation line %d for function %d, describing nothing in particular.\n", i, index);
+    }
+    emit(" */\n");
+    emit("// Single line comment before function %d\n", index);
+    emit("int commented_%d(int first) { // trailing comment\n", index);
+    emit("    int a = first; /* inline comment */\n");
+    emit("    // comment inside the body\n");
+    emit("    return a;\n}\n\n");
+}
+
+// Parse the shape name
+static int parse_shape(const char *name, Shape *shape) {
+    if (strcmp(name, "functions") == 0) *shape = SHAPE_FUNCTIONS;
+    else if (strcmp(name, "nesting") == 0) *shape = SHAPE_NESTING;
+    else if (strcmp(name, "expressions") == 0) *shape = SHAPE_EXPRESSIONS;
+    else if (strcmp(name, "comments") == 0) *shape = SHAPE_COMMENTS;
+    else return 0;
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    Shape shape;
+    if (argc < 3 || !parse_shape(argv[1], &shape)) {
+        fprintf(stderr, "usage: %s <functions|nesting|expressions|comments> <bytes> [seed]\n", argv[0]);
+        return 1;
+    }
+    long target = atol(argv[2]);
+    rng_state = argc > 3 ? strtoul(argv[3], NULL, 10) : 1;
+    if (rng_state == 0) rng_state = 1;
+    
+    for (int index = 0; bytes_written < target; index++) {
+        switch (shape) {
+            case SHAPE_FUNCTIONS: emit_small_function(index); break;
+            case SHAPE_NESTING: emit_nested_function(index); break;
+            case SHAPE_EXPRESSIONS: emit_expression_function(index); break;
+            case SHAPE_COMMENTS: emit_commented_function(index); break;
+        }
+    }
+    emit("int main() {\n    return 0;\n}\n");
+    return 0;
+}
@@ -0,0 +1,79 @@
+#!/bin/sh
+# Benchmark harness: generates the synthetic inputs, runs CComp on each
+# with -ftime-report and reports lexing and parsing throughput. The AST
+# dump is turned off so printing does not weigh on the measured run.
+#
+# Usage: run_bench.sh <ccomp> <gen_bench> <baseline> [--update-baseline]
+#
+# Each input is compiled BENCH_RUNS times and the fastest run is kept.
+# The baseline stores one "shape MB/s tokens/s nodes/s" line per shape.
+
+set -e
+
+CCOMP=$1
+GEN=$2
+BASELINE=$3
+UPDATE=$4
+
+BENCH_SIZE=${BENCH_SIZE:-4000000}
+BENCH_RUNS=${BENCH_RUNS:-3}
+BENCH_SEED=${BENCH_SEED:-42}
+WORK_DIR=${BENCH_WORK_DIR:-bin/bench}
+SHAPES="functions nesting expressions comments"
+
+mkdir -p "$WORK_DIR"
+RESULTS="$WORK_DIR/results.txt"
+: > "$RESULTS"
+
+for shape in $SHAPES; do
+    input="$WORK_DIR/$shape.c"
+    "$GEN" "$shape" "$BENCH_SIZE" "$BENCH_SEED" > "$input"
+    
+    run=0
+    while [ "$run" -lt "$BENCH_RUNS" ]; do
+        "$CCOMP" -ftime-report --dump-ast=none "$input" 2> "$WORK_DIR/$shape.report" > /dev/null
+        awk -v shape="$shape" '
+            $1 == "lex" { lex = $4 }
+            $1 == "parse" { parse = $4 }
+            $1 == "tokens" { tokens = $3 }
+            $1 == "bytes" { bytes = $4 }
+            $1 == "ast" { nodes = $4 }
+            END { printf "%s %.9f %.9f %d %d %d\n", shape, lex, parse, bytes, tokens, nodes }
+        ' "$WORK_DIR/$shape.report" >> "$RESULTS"
+        run=$((run + 1))
+    done
+done
+
+# Keep the fastest run of every shape and turn it into rates
+awk '
+    {
+        total = $2 + $3
+        if (!($1 in best) || total < best[$1]) {
+            best[$1] = total; lex[$1] = $2; parse[$1] = $3
+            bytes[$1] = $4; tokens[$1] = $5; nodes[$1] = $6
+        }
+    }
+    END {
+        for (shape in best) {
+            l = lex[shape] > 0 ? lex[shape] : 1e-9
+            p = parse[shape] > 0 ? parse[shape] : 1e-9
+            printf "%s %.2f %.0f %.0f\n", shape, bytes[shape] / l / 1e6, tokens[shape] / l, nodes[shape] / p
+        }
+    }
+' "$RESULTS" | sort > "$WORK_DIR/current.txt"
+
+if [ "$UPDATE" = "--update-baseline" ]; then
+    cp "$WORK_DIR/current.txt" "$BASELINE"
+    echo "Baseline written to $BASELINE"
+fi
+
+printf "%-12s %10s %14s %14s %10s\n" "shape" "MB/s lexed" "tokens/s" "nodes/s" "vs base"
+while read -r shape mbs tps nps; do
+    base=$(awk -v shape="$shape" '$1 == shape { print $2 }' "$BASELINE" 2>/dev/null || true)
+    if [ -n "$base" ]; then
+        ratio=$(awk -v now="$mbs" -v base="$base" 'BEGIN { printf "%.2fx", now / base }')
+    else
+        ratio="-"
+    fi
+    printf "%-12s %10s %14s %14s %10s\n" "$shape" "$mbs" "$tps" "$nps" "$ratio"
+done < "$WORK_DIR/current.txt"
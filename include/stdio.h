@@ -0,0 +1,13 @@
+/**
+ * Standard I/O Header
+ *
+ * Declarations of the library functions the compiler knows about.
+ */
+
+#ifndef STDIO_H
+#define STDIO_H
+
+int printf(char format[]);
+int putchar(int c);
+
+#endif // STDIO_H
@@ -0,0 +1,129 @@
+/**
+ * Arena Allocator Implementation
+ *
+ * Allocations are carved out of large chunks by bumping an offset.
+ * Chunks are only returned to the system when the arena is destroyed,
+ * a reset just rewinds them so they can be filled again.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define DEFAULT_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+// Chunk of arena memory
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t used;
+    size_t capacity;
+    unsigned char data[];
+};
+
+// Allocate a chunk able to hold at least size bytes after alignment
+static ArenaChunk* new_chunk(Arena *arena, size_t size) {
+    size_t capacity = arena->chunk_size;
+    if (size + ARENA_ALIGNMENT > capacity) capacity = size + ARENA_ALIGNMENT;
+    
+    ArenaChunk *chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + capacity);
+    if (!chunk) return NULL;
+    
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    arena->bytes_reserved += capacity;
+    return chunk;
+}
+
+// Offset of the next allocation with the given alignment in a chunk
+static size_t aligned_offset(ArenaChunk *chunk, size_t alignment) {
+    uintptr_t address = (uintptr_t)(chunk->data + chunk->used);
+    uintptr_t aligned = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    return chunk->used + (size_t)(aligned - address);
+}
+
+// Create an arena (chunk_size 0 selects the default)
+Arena* arena_create(size_t chunk_size) {
+    Arena *arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) return NULL;
+    
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE;
+    arena->bytes_used = 0;
+    arena->bytes_reserved = 0;
+    arena->peak_bytes = 0;
+    return arena;
+}
+
+// Free the arena with every chunk it owns
+void arena_destroy(Arena *arena) {
+    if (!arena) return;
+    
+    ArenaChunk *chunk = arena->first;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
+
+// Release every allocation at once, keeping the chunks for reuse
+void arena_reset(Arena *arena) {
+    for (ArenaChunk *chunk = arena->first; chunk; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = arena->first;
+    arena->bytes_used = 0;
+}
+
+// Allocate size bytes with a power-of-two alignment
+static void* arena_alloc_aligned(Arena *arena, size_t size, size_t alignment) {
+    ArenaChunk *chunk = arena->current;
+    
+    // Move on to the next (reused or new) chunk until the request fits
+    while (!chunk || aligned_offset(chunk, alignment) + size > chunk->capacity) {
+        ArenaChunk *next = chunk ? chunk->next : arena->first;
+        if (next && size + ARENA_ALIGNMENT > next->capacity) {
+            next = NULL;  // Too small to ever hold this request, insert a new chunk
+        }
+        if (!next) {
+            next = new_chunk(arena, size);
+            if (!next) return NULL;
+            if (chunk) {
+                next->next = chunk->next;
+                chunk->next = next;
+            } else {
+                next->next = arena->first;
+                arena->first = next;
+            }
+        }
+        next->used = 0;
+        chunk = next;
+    }
+    arena->current = chunk;
+    
+    size_t offset = aligned_offset(chunk, alignment);
+    chunk->used = offset + size;
+    
+    arena->bytes_used += size;
+    if (arena->bytes_used > arena->peak_bytes) arena->peak_bytes = arena->bytes_used;
+    return chunk->data + offset;
+}
+
+// Allocate size bytes, aligned for any object type
+void* arena_alloc(Arena *arena, size_t size) {
+    return arena_alloc_aligned(arena, size, ARENA_ALIGNMENT);
+}
+
+// Copy a text slice into the arena and terminate it (strings need no alignment)
+char* arena_strndup(Arena *arena, const char *text, size_t length) {
+    char *copy = (char*)arena_alloc_aligned(arena, length + 1, 1);
+    if (!copy) return NULL;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
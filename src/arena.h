@@ -0,0 +1,32 @@
+/**
+ * Arena Allocator Header
+ *
+ * Bump allocator with chunked growth. Everything allocated from an
+ * arena is released at once by arena_reset or arena_destroy.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaChunk ArenaChunk;
+
+// Arena structure
+typedef struct {
+    ArenaChunk *first;      // First chunk, chunks are kept for reuse after a reset
+    ArenaChunk *current;    // Chunk allocations are served from
+    size_t chunk_size;      // Default size of a new chunk
+    size_t bytes_used;      // Bytes handed out since the last reset
+    size_t bytes_reserved;  // Bytes held in chunks
+    size_t peak_bytes;      // Highest bytes_used seen
+} Arena;
+
+// Arena functions
+Arena* arena_create(size_t chunk_size);
+void arena_destroy(Arena *arena);
+void arena_reset(Arena *arena);
+void* arena_alloc(Arena *arena, size_t size);
+char* arena_strndup(Arena *arena, const char *text, size_t length);
+
+#endif // ARENA_H
@@ -0,0 +1,384 @@
+/**
+ * ARM Backend Implementation
+ *
+ * Instruction buffers and the GNU as writer. The writer targets unified
+ * syntax Thumb-2 code; labels print as .L<function>_<label> and string
+ * literals as .LC<index>, both local to the object file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm.h"
+
+// Grow a module or function array by doubling, returns 0 on failure
+#define GROW(array, count, capacity) \
+    ((count) < (capacity) || grow_array((void**)&(array), &(capacity), sizeof(*(array))))
+
+// Double the capacity of an array
+static int grow_array(void **array, int *capacity, size_t element_size) {
+    int grown = *capacity ? *capacity * 2 : 16;
+    void *items = realloc(*array, (size_t)grown * element_size);
+    if (!items) return 0;
+    *array = items;
+    *capacity = grown;
+    return 1;
+}
+
+// Create an empty module
+ArmModule* arm_module_create(void) {
+    return (ArmModule*)calloc(1, sizeof(ArmModule));
+}
+
+// Free a module and its instruction buffers
+void arm_module_free(ArmModule *module) {
+    if (!module) return;
+    for (int i = 0; i < module->num_functions; i++) {
+        free(module->functions[i].insns);
+    }
+    free(module->functions);
+    free(module->globals);
+    free(module->strings);
+    free(module);
+}
+
+// Start the code of a function; the pointer is valid until the next function is added
+ArmFunction* arm_add_function(ArmModule *module, const char *name) {
+    if (!GROW(module->functions, module->num_functions, module->functions_capacity)) {
+        module->failed = 1;
+        return NULL;
+    }
+    ArmFunction *function = &module->functions[module->num_functions++];
+    memset(function, 0, sizeof(ArmFunction));
+    function->name = name;
+    return function;
+}
+
+// Add a global variable, zero-initialized until its fields are set
+ArmGlobal* arm_add_global(ArmModule *module, const char *name) {
+    if (!GROW(module->globals, module->num_globals, module->globals_capacity)) {
+        module->failed = 1;
+        return NULL;
+    }
+    ArmGlobal *global = &module->globals[module->num_globals++];
+    memset(global, 0, sizeof(ArmGlobal));
+    global->name = name;
+    global->size = 4;
+    global->align = 4;
+    return global;
+}
+
+// Add a string literal, returns its index or -1
+int arm_add_string(ArmModule *module, const char *literal) {
+    if (!GROW(module->strings, module->num_strings, module->strings_capacity)) {
+        module->failed = 1;
+        return -1;
+    }
+    module->strings[module->num_strings] = literal;
+    return module->num_strings++;
+}
+
+// Allocate a label number
+int arm_new_label(ArmFunction *function) {
+    return function->num_labels++;
+}
+
+// Append an instruction with every field cleared; once the buffer failed
+// to grow, a scratch instruction is returned and the function is marked failed
+ArmInsn* arm_emit(ArmFunction *function, ArmOp op) {
+    if (!GROW(function->insns, function->num_insns, function->capacity)) {
+        function->failed = 1;
+        return memset(&function->discard, 0, sizeof(ArmInsn));
+    }
+    ArmInsn *insn = &function->insns[function->num_insns++];
+    memset(insn, 0, sizeof(ArmInsn));
+    insn->op = (uint8_t)op;
+    insn->cond = ARM_AL;
+    return insn;
+}
+
+// Append an instruction whose last operand is a register
+void arm_emit_reg(ArmFunction *function, ArmOp op, int rd, int rn, int rm) {
+    ArmInsn *insn = arm_emit(function, op);
+    insn->form = ARM_OPERAND_REG;
+    insn->rd = (uint8_t)rd;
+    insn->rn = (uint8_t)rn;
+    insn->rm = (uint8_t)rm;
+}
+
+// Append an instruction whose last operand is an immediate
+void arm_emit_imm(ArmFunction *function, ArmOp op, int rd, int rn, int32_t imm) {
+    ArmInsn *insn = arm_emit(function, op);
+    insn->form = ARM_OPERAND_IMM;
+    insn->rd = (uint8_t)rd;
+    insn->rn = (uint8_t)rn;
+    insn->imm = imm;
+}
+
+// Place a label
+void arm_emit_label(ArmFunction *function, int label) {
+    arm_emit(function, ARM_LABEL)->imm = label;
+}
+
+// Branch to a label when cond holds
+void arm_emit_branch(ArmFunction *function, ArmCond cond, int label) {
+    ArmInsn *insn = arm_emit(function, ARM_B);
+    insn->cond = (uint8_t)cond;
+    insn->imm = label;
+}
+
+// Call a function by name
+void arm_emit_call(ArmFunction *function, const char *symbol) {
+    arm_emit(function, ARM_BL)->symbol = symbol;
+}
+
+// Load the address of a symbol (movw/movt pair)
+void arm_emit_address(ArmFunction *function, int rd, const char *symbol) {
+    ArmInsn *insn = arm_emit(function, ARM_MOVW);
+    insn->rd = (uint8_t)rd;
+    insn->symbol = symbol;
+    insn = arm_emit(function, ARM_MOVT);
+    insn->rd = (uint8_t)rd;
+    insn->symbol = symbol;
+}
+
+// Load a 32-bit constant in the fewest instructions
+void arm_emit_constant(ArmFunction *function, int rd, int32_t value) {
+    uint32_t bits = (uint32_t)value;
+    if (bits <= 0xff) {
+        arm_emit_imm(function, ARM_MOV, rd, 0, value);
+    } else if (~bits <= 0xff) {
+        arm_emit_imm(function, ARM_MVN, rd, 0, (int32_t)~bits);
+    } else {
+        arm_emit_imm(function, ARM_MOVW, rd, 0, (int32_t)(bits & 0xffff));
+        if (bits >> 16) arm_emit_imm(function, ARM_MOVT, rd, 0, (int32_t)(bits >> 16));
+    }
+}
+
+// Mnemonics, in ArmOp order
+static const char *mnemonics[ARM_NUM_OPS] = {
+    "", "add", "sub", "rsb", "mul", "and", "orr", "eor", "lsl", "lsr", "asr",
+    "mov", "mvn", "cmp", "clz", "movw", "movt", "ldr", "ldrb", "str", "strb",
+    "push", "pop", "b", "bl", "it", "cbz", "cbnz"
+};
+
+// Condition suffixes, in ArmCond order
+static const char *conditions[] = {
+    "eq", "ne", "hs", "lo", "mi", "pl", "vs", "vc",
+    "hi", "ls", "ge", "lt", "gt", "le", ""
+};
+
+// Register names
+static const char *registers[16] = {
+    "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+    "r8", "r9", "r10", "r11", "ip", "sp", "lr", "pc"
+};
+
+// Write a label reference
+static void write_label(Emitter *out, int function, int label) {
+    emit_str(out, ".L");
+    emit_int(out, function);
+    emit_char(out, '_');
+    emit_int(out, label);
+}
+
+// Write "#imm"
+static void write_imm(Emitter *out, int32_t imm) {
+    emit_char(out, '#');
+    emit_int(out, imm);
+}
+
+// Write "{r4, r7, lr}"
+static void write_register_list(Emitter *out, int32_t mask) {
+    emit_char(out, '{');
+    int first = 1;
+    for (int r = 0; r < 16; r++) {
+        if (!(mask & (1 << r))) continue;
+        if (!first) emit_str(out, ", ");
+        emit_str(out, registers[r]);
+        first = 0;
+    }
+    emit_char(out, '}');
+}
+
+// Write one instruction line
+static void write_insn(Emitter *out, int function, const ArmInsn *insn) {
+    if (insn->op == ARM_LABEL) {
+        write_label(out, function, insn->imm);
+        emit_str(out, ":\n");
+        return;
+    }
+    if (insn->op == ARM_IT) {
+        // "ite eq": the condition is an operand, the slots follow the mnemonic
+        emit_str(out, "\tit");
+        for (int k = 1; k < insn->rn; k++) emit_char(out, insn->imm & (1 << k) ? 'e' : 't');
+        emit_char(out, '\t');
+        emit_str(out, conditions[insn->cond]);
+        emit_char(out, '\n');
+        return;
+    }
+
+    emit_char(out, '\t');
+    emit_str(out, mnemonics[insn->op]);
+    emit_str(out, conditions[insn->cond]);
+    emit_char(out, '\t');
+
+    const char *rd = registers[insn->rd & 15];
+    const char *rn = registers[insn->rn & 15];
+    const char *rm = registers[insn->rm & 15];
+    switch ((ArmOp)insn->op) {
+        case ARM_MOV:
+        case ARM_MVN:
+        case ARM_CLZ:
+            emit_str(out, rd);
+            emit_str(out, ", ");
+            if (insn->form == ARM_OPERAND_IMM) write_imm(out, insn->imm);
+            else emit_str(out, rm);
+            break;
+        case ARM_CMP:
+            emit_str(out, rn);
+            emit_str(out, ", ");
+            if (insn->form == ARM_OPERAND_IMM) write_imm(out, insn->imm);
+            else emit_str(out, rm);
+            break;
+        case ARM_MOVW:
+        case ARM_MOVT:
+            emit_str(out, rd);
+            emit_str(out, ", #");
+            if (insn->symbol) {
+                emit_str(out, insn->op == ARM_MOVW ? ":lower16:" : ":upper16:");
+                emit_str(out, insn->symbol);
+            } else {
+                emit_int(out, insn->imm);
+            }
+            break;
+        case ARM_LDR:
+        case ARM_LDRB:
+        case ARM_STR:
+        case ARM_STRB:
+            emit_str(out, rd);
+            emit_str(out, ", [");
+            emit_str(out, rn);
+            emit_str(out, ", ");
+            if (insn->form == ARM_OPERAND_IMM) write_imm(out, insn->imm);
+            else emit_str(out, rm);
+            emit_char(out, ']');
+            break;
+        case ARM_PUSH:
+        case ARM_POP:
+            write_register_list(out, insn->imm);
+            break;
+        case ARM_B:
+            write_label(out, function, insn->imm);
+            break;
+        case ARM_CBZ:
+        case ARM_CBNZ:
+            emit_str(out, rn);
+            emit_str(out, ", ");
+            write_label(out, function, insn->imm);
+            break;
+        case ARM_BL:
+            emit_str(out, insn->symbol);
+            break;
+        default:
+            // Three-operand data processing
+            emit_str(out, rd);
+            emit_str(out, ", ");
+            emit_str(out, rn);
+            emit_str(out, ", ");
+            if (insn->form == ARM_OPERAND_IMM) write_imm(out, insn->imm);
+            else emit_str(out, rm);
+            break;
+    }
+    emit_char(out, '\n');
+}
+
+// Write a string literal, turning C escapes GNU as does not know into octal
+static void write_string(Emitter *out, const char *literal) {
+    emit_str(out, "\t.asciz\t\"");
+    for (const char *p = literal; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            const char *octal = NULL;
+            switch (p[1]) {
+                case 'a': octal = "\\007"; break;
+                case 'v': octal = "\\013"; break;
+                case '\'': octal = "\\047"; break;
+                case '?': octal = "\\077"; break;
+                default: break;
+            }
+            if (octal) {
+                emit_str(out, octal);
+            } else {
+                emit_char(out, p[0]);
+                emit_char(out, p[1]);
+            }
+            p++;
+        } else {
+            emit_char(out, *p);
+        }
+    }
+    emit_str(out, "\"\n");
+}
+
+// Write the module as GNU assembler source, returns 0 if the stream failed
+int arm_write_assembly(const ArmModule *module, Emitter *out) {
+    emit_str(out, "\t.syntax unified\n\t.cpu cortex-m3\n\t.thumb\n\t.text\n");
+
+    for (int i = 0; i < module->num_functions; i++) {
+        const ArmFunction *function = &module->functions[i];
+        emit_str(out, "\t.align\t1\n\t.global\t");
+        emit_str(out, function->name);
+        emit_str(out, "\n\t.thumb_func\n\t.type\t");
+        emit_str(out, function->name);
+        emit_str(out, ", %function\n");
+        emit_str(out, function->name);
+        emit_str(out, ":\n");
+        for (int j = 0; j < function->num_insns; j++) {
+            write_insn(out, i, &function->insns[j]);
+        }
+        emit_str(out, "\t.size\t");
+        emit_str(out, function->name);
+        emit_str(out, ", .-");
+        emit_str(out, function->name);
+        emit_char(out, '\n');
+    }
+
+    for (int i = 0; i < module->num_globals; i++) {
+        const ArmGlobal *global = &module->globals[i];
+        emit_str(out, global->has_value ? "\t.data\n" : "\t.bss\n");
+        emit_str(out, "\t.align\t");
+        emit_int(out, global->align == 4 ? 2 : 0);
+        emit_str(out, "\n\t.global\t");
+        emit_str(out, global->name);
+        emit_str(out, "\n\t.type\t");
+        emit_str(out, global->name);
+        emit_str(out, ", %object\n\t.size\t");
+        emit_str(out, global->name);
+        emit_str(out, ", ");
+        emit_int(out, global->size);
+        emit_char(out, '\n');
+        emit_str(out, global->name);
+        emit_str(out, ":\n");
+        if (!global->has_value) {
+            emit_str(out, "\t.space\t");
+            emit_int(out, global->size);
+        } else {
+            emit_str(out, global->size == 1 ? "\t.byte\t" : "\t.word\t");
+            emit_int(out, global->size == 1 ? (uint8_t)global->value : global->value);
+        }
+        emit_char(out, '\n');
+    }
+
+    if (module->num_strings > 0) {
+        emit_str(out, "\t.section\t.rodata\n\t.align\t2\n");
+        for (int i = 0; i < module->num_strings; i++) {
+            emit_str(out, ".LC");
+            emit_int(out, i);
+            emit_str(out, ":\n");
+            write_string(out, module->strings[i]);
+        }
+    }
+
+    return !out->failed;
+}
@@ -0,0 +1,143 @@
+/**
+ * ARM Backend Header
+ *
+ * Machine-level form of a translation unit for ARMv7-M (Thumb-2): every
+ * function is a flat buffer of fixed-size instructions with symbolic
+ * labels, and the module holds the data the code refers to. Code
+ * generation fills the buffers; the assembly writer turns them into GNU
+ * as text in one pass over each buffer.
+ */
+
+#ifndef ARM_H
+#define ARM_H
+
+#include <stdint.h>
+#include "emit.h"
+
+// Core registers with a fixed role
+#define ARM_IP 12      // Scratch register, free between instructions
+#define ARM_SP 13
+#define ARM_LR 14
+#define ARM_PC 15
+#define ARM_FP 7       // Frame pointer of Thumb code
+
+// Condition codes, in encoding order
+typedef enum {
+    ARM_EQ, ARM_NE, ARM_HS, ARM_LO, ARM_MI, ARM_PL, ARM_VS, ARM_VC,
+    ARM_HI, ARM_LS, ARM_GE, ARM_LT, ARM_GT, ARM_LE, ARM_AL
+} ArmCond;
+
+// Operations
+//   data processing: rd = rn op (rm, or imm with ARM_OPERAND_IMM)
+//   MOV/MVN: rd = operand; CMP: flags of rn - operand; CLZ: rd = clz(rm)
+//   MOVW/MOVT: low/high half of rd = imm, or of the address of symbol
+//   loads/stores: rd <-> [rn, #imm], or [rn, rm] with ARM_OPERAND_REG
+//   PUSH/POP: imm is the register mask
+//   B: branch to label imm if cond holds; BL: call symbol
+//   IT: make the next rn instructions conditional, bit k of imm set when
+//       the k-th of them takes the inverse of cond (an "else" slot)
+//   CBZ/CBNZ: branch forward to label imm if rn is (not) zero, r0-r7 only
+typedef enum {
+    ARM_LABEL,
+    ARM_ADD,
+    ARM_SUB,
+    ARM_RSB,
+    ARM_MUL,
+    ARM_AND,
+    ARM_ORR,
+    ARM_EOR,
+    ARM_LSL,
+    ARM_LSR,
+    ARM_ASR,
+    ARM_MOV,
+    ARM_MVN,
+    ARM_CMP,
+    ARM_CLZ,
+    ARM_MOVW,
+    ARM_MOVT,
+    ARM_LDR,
+    ARM_LDRB,
+    ARM_STR,
+    ARM_STRB,
+    ARM_PUSH,
+    ARM_POP,
+    ARM_B,
+    ARM_BL,
+    ARM_IT,
+    ARM_CBZ,
+    ARM_CBNZ,
+    ARM_NUM_OPS
+} ArmOp;
+
+// Form of the last operand
+#define ARM_OPERAND_REG 0
+#define ARM_OPERAND_IMM 1
+
+// One instruction
+typedef struct {
+    uint8_t op;          // ArmOp
+    uint8_t cond;        // ArmCond, ARM_AL unless conditional
+    uint8_t form;        // ARM_OPERAND_REG or ARM_OPERAND_IMM
+    uint8_t rd;
+    uint8_t rn;
+    uint8_t rm;
+    int32_t imm;         // Immediate, offset, label number or register mask
+    const char *symbol;  // Interned symbol of BL and MOVW/MOVT, else NULL
+} ArmInsn;
+
+// Code of one function
+typedef struct {
+    const char *name;    // Interned
+    ArmInsn *insns;
+    int num_insns;
+    int capacity;
+    int num_labels;
+    int failed;          // Set when an instruction could not be stored
+    ArmInsn discard;     // Written instead once failed
+} ArmFunction;
+
+// Global variable; arrays and uninitialized scalars go to .bss
+typedef struct {
+    const char *name;    // Interned
+    int size;            // Bytes
+    int align;
+    int has_value;
+    int32_t value;       // Initial value of a scalar
+} ArmGlobal;
+
+// Whole translation unit
+typedef struct {
+    ArmFunction *functions;
+    int num_functions;
+    int functions_capacity;
+    ArmGlobal *globals;
+    int num_globals;
+    int globals_capacity;
+    const char **strings;  // String literals as written between the quotes; .LC<index>
+    int num_strings;
+    int strings_capacity;
+    int failed;
+} ArmModule;
+
+// Module construction
+ArmModule* arm_module_create(void);
+void arm_module_free(ArmModule *module);
+ArmFunction* arm_add_function(ArmModule *module, const char *name);
+ArmGlobal* arm_add_global(ArmModule *module, const char *name);
+int arm_add_string(ArmModule *module, const char *literal);
+
+// Instruction buffers
+int arm_new_label(ArmFunction *function);
+ArmInsn* arm_emit(ArmFunction *function, ArmOp op);
+void arm_emit_reg(ArmFunction *function, ArmOp op, int rd, int rn, int rm);
+void arm_emit_imm(ArmFunction *function, ArmOp op, int rd, int rn, int32_t imm);
+void arm_emit_label(ArmFunction *function, int label);
+void arm_emit_branch(ArmFunction *function, ArmCond cond, int label);
+void arm_emit_call(ArmFunction *function, const char *symbol);
+void arm_emit_address(ArmFunction *function, int rd, const char *symbol);
+void arm_emit_constant(ArmFunction *function, int rd, int32_t value);
+
+// Write the module as GNU assembler source
+int arm_write_assembly(const ArmModule *module, Emitter *out);
+
+#endif // ARM_H
@@ -1,5 +1,6 @@
 /** Abstract Syntax Tree Implementation 
  * Implements functions for creating, manipulating, and freeing
+ * Nodes and child arrays live in an arena and are freed together with it
 */
 
 #include <stdio.h>
@@ -10,12 +11,14 @@
 // Initial capacity for child nodes
 #define INITIAL_CHILDREN_CAPACITY 4
 
-// Create a new AST node of the specified type
-ASTNode* create_ast_node(ASTNodeType type) {
-    ASTNode *node = (ASTNode*)malloc(sizeof(ASTNode));
+// Create a new AST node of the specified type, allocated from the arena
+ASTNode* create_ast_node(Arena *arena, ASTNodeType type) {
+    ASTNode *node = (ASTNode*)arena_alloc(arena, sizeof(ASTNode));
     if (!node) return NULL;
     
     node->type = type;
+    node->span.start = 0;  // Set by the parser
+    node->span.end = 0;
     node->children = NULL;
     node->num_children = 0;
     node->children_capacity = 0;
@@ -28,11 +31,8 @@ ASTNode* create_ast_node(ASTNodeType type) {
         case AST_EXPR_STMT:
         case AST_ARG_LIST:
             // These nodes can have multiple children, allocate array
-            node->children = (ASTNode**)malloc(INITIAL_CHILDREN_CAPACITY * sizeof(ASTNode*));
-            if (!node->children) {
-                free(node);
-                return NULL;
-            }
+            node->children = (ASTNode**)arena_alloc(arena, INITIAL_CHILDREN_CAPACITY * sizeof(ASTNode*));
+            if (!node->children) return NULL;
             node->children_capacity = INITIAL_CHILDREN_CAPACITY;
             break;
         
@@ -105,89 +105,8 @@ ASTNode* create_ast_node(ASTNodeType type) {
     return node;
 }
 
-// Free an AST node and all its children
-void free_ast(ASTNode *node) {
-    if (!node) return;
-    
-    // Free children first
-    if (node->children) {
-        for (int i = 0; i < node->num_children; i++) {
-            free_ast(node->children[i]);
-        }
-        free(node->children);
-    }
-    
-    // Free node-specific data
-    switch (node->type) {
-        case AST_FUNCTION:
-            if (node->data.function.name) free(node->data.function.name);
-            if (node->data.function.parameters) free_ast(node->data.function.parameters);
-            if (node->data.function.body) free_ast(node->data.function.body);
-            break;
-        
-        case AST_PARAMETER:
-            if (node->data.parameter.name) free(node->data.parameter.name);
-            break;
-        
-        case AST_VARIABLE_DECL:
-            if (node->data.variable_decl.name) free(node->data.variable_decl.name);
-            if (node->data.variable_decl.initializer) free_ast(node->data.variable_decl.initializer);
-            break;
-        
-        case AST_IF_STMT:
-            if (node->data.if_stmt.condition) free_ast(node->data.if_stmt.condition);
-            if (node->data.if_stmt.if_branch) free_ast(node->data.if_stmt.if_branch);
-            if (node->data.if_stmt.else_branch) free_ast(node->data.if_stmt.else_branch);
-            break;
-        
-        case AST_WHILE_STMT:
-            if (node->data.while_stmt.condition) free_ast(node->data.while_stmt.condition);
-            if (node->data.while_stmt.body) free_ast(node->data.while_stmt.body);
-            break;
-        
-        case AST_RETURN_STMT:
-            if (node->data.return_stmt.value) free_ast(node->data.return_stmt.value);
-            break;
-        
-        case AST_BINARY_EXPR:
-        case AST_ASSIGN_EXPR:
-            if (node->data.binary_expr.left) free_ast(node->data.binary_expr.left);
-            if (node->data.binary_expr.right) free_ast(node->data.binary_expr.right);
-            break;
-        
-        case AST_UNARY_EXPR:
-            if (node->data.unary_expr.operand) free_ast(node->data.unary_expr.operand);
-            break;
-        
-        case AST_CALL_EXPR:
-            if (node->data.call_expr.function) free_ast(node->data.call_expr.function);
-            if (node->data.call_expr.arguments) free_ast(node->data.call_expr.arguments);
-            break;
-        
-        case AST_SUBSCRIPT_EXPR:
-            if (node->data.subscript_expr.array) free_ast(node->data.subscript_expr.array);
-            if (node->data.subscript_expr.index) free_ast(node->data.subscript_expr.index);
-            break;
-        
-        case AST_IDENTIFIER:
-            if (node->data.identifier.name) free(node->data.identifier.name);
-            break;
-        
-        case AST_STRING:
-            if (node->data.string.value) free(node->data.string.value);
-            break;
-        
-        default:
-            // Other node types don't have pointers to free
-            break;
-    }
-    
-    // Free the node itself
-    free(node);
-}
-
 // Add a child node to a parent node
-void add_child(ASTNode *parent, ASTNode *child) {
+void add_child(Arena *arena, ASTNode *parent, ASTNode *child) {
     if (!parent || !child) return;
     
     // Check if we need to resize the children array
@@ -195,9 +114,12 @@ void add_child(ASTNode *parent, ASTNode *child) {
         int new_capacity = parent->children_capacity * 2;
         if (new_capacity == 0) new_capacity = INITIAL_CHILDREN_CAPACITY;
         
-        ASTNode **new_children = (ASTNode**)realloc(parent->children, 
-                                                   new_capacity * sizeof(ASTNode*));
+        // The old array stays in the arena, growth is geometric so the waste is bounded
+        ASTNode **new_children = (ASTNode**)arena_alloc(arena, new_capacity * sizeof(ASTNode*));
         if (!new_children) return;
+        if (parent->num_children > 0) {
+            memcpy(new_children, parent->children, parent->num_children * sizeof(ASTNode*));
+        }
         
         parent->children = new_children;
         parent->children_capacity = new_capacity;
@@ -207,282 +129,151 @@ void add_child(ASTNode *parent, ASTNode *child) {
     parent->children[parent->num_children++] = child;
 }
 
-// Get string representation of data type
-static const char* data_type_str(DataType type) {
-    switch (type) {
-        case TYPE_VOID: return "void";
-        case TYPE_INT: return "int";
-        case TYPE_CHAR: return "char";
-        default: return "unknown";
-    }
-}
+// Initial capacity of the walk stack, enough for most trees without allocating
+#define WALK_STACK_FRAMES 64
 
-// Get string representation of binary operator
-static const char* binary_op_str(BinaryOp op) {
-    switch (op) {
-        case OP_ADD: return "+";
-        case OP_SUBTRACT: return "-";
-        case OP_MULTIPLY: return "*";
-        case OP_DIVIDE: return "/";
-        case OP_MODULO: return "%";
-        case OP_EQ: return "==";
-        case OP_NEQ: return "!=";
-        case OP_LT: return "<";
-        case OP_GT: return ">";
-        case OP_LTE: return "<=";
-        case OP_GTE: return ">=";
-        case OP_LOGICAL_AND: return "&&";
-        case OP_LOGICAL_OR: return "||";
-        case OP_BITWISE_AND: return "&";
-        case OP_BITWISE_OR: return "|";
-        case OP_BITWISE_XOR: return "^";
-        case OP_SHL: return "<<";
-        case OP_SHR: return ">>";
-        default: return "unknown";
-    }
-}
+// Node on the walk stack, waiting for its enter or its leave callback
+typedef struct {
+    ASTVisit visit;
+    int entered;
+} WalkFrame;
 
-// Get string representation of unary operator
-static const char* unary_op_str(UnaryOp op) {
-    switch (op) {
-        case OP_NEGATE: return "-";
-        case OP_NOT: return "!";
-        case OP_BITWISE_NOT: return "~";
-        case OP_PRE_INC: return "++";
-        case OP_PRE_DEC: return "--";
-        case OP_POST_INC: return "++ (post)";
-        case OP_POST_DEC: return "-- (post)";
-        default: return "unknown";
-    }
-}
+// Explicit stack of ast_walk, on the heap once the local frames are full
+typedef struct {
+    WalkFrame *frames;
+    int count;
+    int capacity;
+    WalkFrame local[WALK_STACK_FRAMES];
+} WalkStack;
 
-// Print indentation for AST visualization
-static void print_indent(int indent) {
-    for (int i = 0; i < indent; i++) {
-        printf("  ");
+// Push a slot of a node, 0 on allocation failure
+static int walk_push(WalkStack *stack, ASTNode *node, const ASTVisit *parent, ASTSlot slot, int flags) {
+    if (!node && !(flags & AST_WALK_NULLS)) return 1;
+    if (stack->count == stack->capacity) {
+        int capacity = stack->capacity * 2;
+        WalkFrame *frames = (WalkFrame*)malloc(capacity * sizeof(WalkFrame));
+        if (!frames) return 0;
+        memcpy(frames, stack->frames, stack->count * sizeof(WalkFrame));
+        if (stack->frames != stack->local) free(stack->frames);
+        stack->frames = frames;
+        stack->capacity = capacity;
     }
+    WalkFrame *frame = &stack->frames[stack->count++];
+    frame->visit.node = node;
+    frame->visit.parent = parent ? parent->node : NULL;
+    frame->visit.slot = slot;
+    frame->visit.depth = parent ? parent->depth + 1 : 0;
+    frame->visit.value = 0;
+    frame->visit.parent_value = parent ? parent->value : 0;
+    frame->entered = 0;
+    return 1;
 }
 
-// Print AST for debugging
-void print_ast(ASTNode *node, int indent) {
-    if (!node) {
-        print_indent(indent);
-        printf("NULL\n");
-        return;
-    }
-    
-    print_indent(indent);
-    
+// Fixed slots of a node in visiting order, returns their number
+static int node_slots(ASTNode *node, ASTNode **nodes, ASTSlot *slots) {
     switch (node->type) {
-        case AST_PROGRAM:
-            printf("Program (%d children)\n", node->num_children);
-            for (int i = 0; i < node->num_children; i++) {
-                print_ast(node->children[i], indent + 1);
-            }
-            break;
-        
         case AST_FUNCTION:
-            printf("Function: %s, Return Type: %s\n", 
-                   node->data.function.name, 
-                   data_type_str(node->data.function.return_type));
-            
-            print_indent(indent + 1);
-            printf("Parameters:\n");
-            if (node->data.function.parameters) {
-                print_ast(node->data.function.parameters, indent + 2);
-            } else {
-                print_indent(indent + 2);
-                printf("(none)\n");
-            }
-            
-            print_indent(indent + 1);
-            printf("Body:\n");
-            if (node->data.function.body) {
-                print_ast(node->data.function.body, indent + 2);
-            } else {
-                print_indent(indent + 2);
-                printf("(none - function declaration only)\n");
-            }
-            break;
-        
-        case AST_PARAM_LIST:
-            printf("Parameter List (%d parameters)\n", node->num_children);
-            for (int i = 0; i < node->num_children; i++) {
-                print_ast(node->children[i], indent + 1);
-            }
-            break;
-        
-        case AST_PARAMETER:
-            printf("Parameter: %s, Type: %s%s\n", 
-                   node->data.parameter.name, 
-                   data_type_str(node->data.parameter.type),
-                   node->data.parameter.is_array ? "[]" : "");
-            break;
-        
-        case AST_COMPOUND_STMT:
-            printf("Compound Statement (%d statements)\n", node->num_children);
-            for (int i = 0; i < node->num_children; i++) {
-                print_ast(node->children[i], indent + 1);
-            }
-            break;
-        
+            nodes[0] = node->data.function.parameters; slots[0] = AST_SLOT_PARAMETERS;
+            nodes[1] = node->data.function.body; slots[1] = AST_SLOT_BODY;
+            return 2;
         case AST_VARIABLE_DECL:
-            printf("Variable Declaration: %s, Type: %s%s", 
-                   node->data.variable_decl.name, 
-                   data_type_str(node->data.variable_decl.type),
-                   node->data.variable_decl.is_array ? "[]" : "");
-            
-            if (node->data.variable_decl.is_array && node->data.variable_decl.array_size > 0) {
-                printf("[%d]", node->data.variable_decl.array_size);
-            }
-            
-            printf("\n");
-            
-            if (node->data.variable_decl.initializer) {
-                print_indent(indent + 1);
-                printf("Initializer:\n");
-                print_ast(node->data.variable_decl.initializer, indent + 2);
-            }
-            break;
-        
+            nodes[0] = node->data.variable_decl.initializer; slots[0] = AST_SLOT_INITIALIZER;
+            return 1;
         case AST_IF_STMT:
-            printf("If Statement\n");
-            
-            print_indent(indent + 1);
-            printf("Condition:\n");
-            print_ast(node->data.if_stmt.condition, indent + 2);
-            
-            print_indent(indent + 1);
-            printf("If Branch:\n");
-            print_ast(node->data.if_stmt.if_branch, indent + 2);
-            
-            if (node->data.if_stmt.else_branch) {
-                print_indent(indent + 1);
-                printf("Else Branch:\n");
-                print_ast(node->data.if_stmt.else_branch, indent + 2);
-            }
-            break;
-        
+            nodes[0] = node->data.if_stmt.condition; slots[0] = AST_SLOT_CONDITION;
+            nodes[1] = node->data.if_stmt.if_branch; slots[1] = AST_SLOT_THEN;
+            nodes[2] = node->data.if_stmt.else_branch; slots[2] = AST_SLOT_ELSE;
+            return 3;
         case AST_WHILE_STMT:
-            printf("While Statement\n");
-            
-            print_indent(indent + 1);
-            printf("Condition:\n");
-            print_ast(node->data.while_stmt.condition, indent + 2);
-            
-            print_indent(indent + 1);
-            printf("Body:\n");
-            print_ast(node->data.while_stmt.body, indent + 2);
-            break;
-        
+            nodes[0] = node->data.while_stmt.condition; slots[0] = AST_SLOT_CONDITION;
+            nodes[1] = node->data.while_stmt.body; slots[1] = AST_SLOT_BODY;
+            return 2;
         case AST_RETURN_STMT:
-            printf("Return Statement\n");
-            
-            if (node->data.return_stmt.value) {
-                print_indent(indent + 1);
-                printf("Value:\n");
-                print_ast(node->data.return_stmt.value, indent + 2);
-            }
-            break;
-        
-        case AST_EXPR_STMT:
-            printf("Expression Statement\n");
-            
-            if (node->num_children > 0) {
-                print_ast(node->children[0], indent + 1);
-            }
-            break;
-        
+            nodes[0] = node->data.return_stmt.value; slots[0] = AST_SLOT_VALUE;
+            return 1;
         case AST_BINARY_EXPR:
-            printf("Binary Expression: %s\n", binary_op_str(node->data.binary_expr.op));
-            
-            print_indent(indent + 1);
-            printf("Left:\n");
-            print_ast(node->data.binary_expr.left, indent + 2);
-            
-            print_indent(indent + 1);
-            printf("Right:\n");
-            print_ast(node->data.binary_expr.right, indent + 2);
-            break;
-        
         case AST_ASSIGN_EXPR:
-            printf("Assignment Expression\n");
-            
-            print_indent(indent + 1);
-            printf("Left (target):\n");
-            print_ast(node->data.binary_expr.left, indent + 2);
-            
-            print_indent(indent + 1);
-            printf("Right (value):\n");
-            print_ast(node->data.binary_expr.right, indent + 2);
-            break;
-        
+            nodes[0] = node->data.binary_expr.left; slots[0] = AST_SLOT_LEFT;
+            nodes[1] = node->data.binary_expr.right; slots[1] = AST_SLOT_RIGHT;
+            return 2;
         case AST_UNARY_EXPR:
-            printf("Unary Expression: %s\n", unary_op_str(node->data.unary_expr.op));
-            
-            print_indent(indent + 1);
-            printf("Operand:\n");
-            print_ast(node->data.unary_expr.operand, indent + 2);
-            break;
-        
+            nodes[0] = node->data.unary_expr.operand; slots[0] = AST_SLOT_OPERAND;
+            return 1;
         case AST_CALL_EXPR:
-            printf("Function Call\n");
-            
-            print_indent(indent + 1);
-            printf("Function:\n");
-            print_ast(node->data.call_expr.function, indent + 2);
-            
-            print_indent(indent + 1);
-            printf("Arguments:\n");
-            if (node->data.call_expr.arguments) {
-                print_ast(node->data.call_expr.arguments, indent + 2);
-            } else {
-                print_indent(indent + 2);
-                printf("(none)\n");
-            }
-            break;
-        
-        case AST_ARG_LIST:
-            printf("Argument List (%d arguments)\n", node->num_children);
-            for (int i = 0; i < node->num_children; i++) {
-                print_ast(node->children[i], indent + 1);
-            }
-            break;
-        
+            nodes[0] = node->data.call_expr.function; slots[0] = AST_SLOT_CALLEE;
+            nodes[1] = node->data.call_expr.arguments; slots[1] = AST_SLOT_ARGUMENTS;
+            return 2;
         case AST_SUBSCRIPT_EXPR:
-            printf("Array Subscript\n");
-            
-            print_indent(indent + 1);
-            printf("Array:\n");
-            print_ast(node->data.subscript_expr.array, indent + 2);
-            
-            print_indent(indent + 1);
-            printf("Index:\n");
-            print_ast(node->data.subscript_expr.index, indent + 2);
-            break;
-        
-        case AST_IDENTIFIER:
-            printf("Identifier: %s\n", node->data.identifier.name);
-            break;
-        
-        case AST_INTEGER:
-            printf("Integer: %d\n", node->data.integer.value);
-            break;
-        
-        case AST_CHARACTER:
-            if (node->data.character.value >= 32 && node->data.character.value <= 126) {
-                printf("Character: '%c'\n", node->data.character.value);
-            } else {
-                printf("Character: '\\x%02X'\n", (unsigned char)node->data.character.value);
-            }
-            break;
-        
-        case AST_STRING:
-            printf("String: \"%s\"\n", node->data.string.value);
-            break;
-        
+            nodes[0] = node->data.subscript_expr.array; slots[0] = AST_SLOT_ARRAY;
+            nodes[1] = node->data.subscript_expr.index; slots[1] = AST_SLOT_INDEX;
+            return 2;
         default:
-            printf("Unknown AST node type: %d\n", node->type);
-            break;
+            return 0;
     }
 }
+
+// Walk a tree depth-first with an explicit stack, children array first;
+// either callback may be NULL, returns 0 on allocation failure
+int ast_walk(ASTNode *root, int flags, ASTEnterFn enter, ASTLeaveFn leave, void *context) {
+    WalkStack stack;
+    stack.frames = stack.local;
+    stack.count = 0;
+    stack.capacity = WALK_STACK_FRAMES;
+    int ok = walk_push(&stack, root, NULL, AST_SLOT_ROOT, flags);
+
+    while (ok && stack.count > 0) {
+        int top = stack.count - 1;
+        WalkFrame *frame = &stack.frames[top];
+        if (frame->entered) {
+            if (leave) leave(&frame->visit, context);
+            stack.count--;
+            continue;
+        }
+        frame->entered = 1;
+        if (enter && !enter(&frame->visit, context)) continue;
+        ASTNode *node = frame->visit.node;
+        if (!node) continue;
+
+        // Pushed in reverse so they come off the stack in order; the
+        // parent is copied since pushing may move the frames
+        ASTVisit parent = frame->visit;
+        ASTNode *nodes[3];
+        ASTSlot slots[3];
+        for (int i = node_slots(node, nodes, slots) - 1; ok && i >= 0; i--) {
+            ok = walk_push(&stack, nodes[i], &parent, slots[i], flags);
+        }
+        for (int i = node->num_children - 1; ok && i >= 0; i--) {
+            ok = walk_push(&stack, node->children[i], &parent, AST_SLOT_ELEMENT, flags);
+        }
+    }
+
+    if (stack.frames != stack.local) free(stack.frames);
+    return ok;
+}
+
+// Count one node
+static int count_node(ASTVisit *visit, void *context) {
+    (void)visit;
+    (*(int*)context)++;
+    return 1;
+}
+
+// Count the nodes of a tree, including the node itself
+int ast_count_nodes(const ASTNode *node) {
+    int count = 0;
+    ast_walk((ASTNode*)node, 0, count_node, NULL, &count);
+    return count;
+}
+
+// Move the span of one node
+static int shift_node(ASTVisit *visit, void *context) {
+    int delta = *(int*)context;
+    visit->node->span.start += delta;
+    visit->node->span.end += delta;
+    return 1;
+}
+
+// Move the spans of a subtree by delta bytes, for text edited before it
+void ast_shift_spans(ASTNode *node, int delta) {
+    ast_walk(node, 0, shift_node, NULL, &delta);
+}
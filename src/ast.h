@@ -1,6 +1,9 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdio.h>
+#include "arena.h"
+
 // AST node types
 typedef enum {
     AST_PROGRAM,
@@ -74,7 +77,7 @@ typedef struct {
 
 // Function node
 typedef struct {
-    char *name;
+    const char *name;   // Interned
     DataType return_type;
     ASTNode *parameters;  // AST_PARAM_LIST
     ASTNode *body;        // AST_COMPOUND_STMT
@@ -87,7 +90,7 @@ typedef struct {
 
 // Parameter node
 typedef struct {
-    char *name;
+    const char *name;   // Interned
     DataType type;
     int is_array;
 } ParameterData;
@@ -99,7 +102,7 @@ typedef struct {
 
 // Variable declaration node
 typedef struct {
-    char *name;
+    const char *name;   // Interned
     DataType type;
     int is_array;
     int array_size;
@@ -161,7 +164,7 @@ typedef struct {
 
 // Identifier node
 typedef struct {
-    char *name;
+    const char *name;   // Interned
 } IdentifierData;
 
 // Integer literal node
@@ -176,12 +179,19 @@ typedef struct {
 
 // String literal node
 typedef struct {
-    char *value;
+    const char *value;  // Interned
 } StringData;
 
+// Byte range [start, end) of a node in the token offset space
+typedef struct {
+    unsigned start;
+    unsigned end;
+} SourceSpan;
+
 // AST node structure
 struct ASTNode {
     ASTNodeType type;
+    SourceSpan span;
     union {
         ProgramData program;
         FunctionData function;
@@ -208,10 +218,50 @@ struct ASTNode {
     int children_capacity;
 };
 
+// Place of a node within its parent
+typedef enum {
+    AST_SLOT_ROOT,
+    AST_SLOT_ELEMENT,      // Entry of the children array
+    AST_SLOT_PARAMETERS,
+    AST_SLOT_BODY,
+    AST_SLOT_INITIALIZER,
+    AST_SLOT_CONDITION,
+    AST_SLOT_THEN,
+    AST_SLOT_ELSE,
+    AST_SLOT_VALUE,
+    AST_SLOT_LEFT,
+    AST_SLOT_RIGHT,
+    AST_SLOT_OPERAND,
+    AST_SLOT_CALLEE,
+    AST_SLOT_ARGUMENTS,
+    AST_SLOT_ARRAY,
+    AST_SLOT_INDEX
+} ASTSlot;
+
+// Also visit the empty slots of a node, with a NULL node
+#define AST_WALK_NULLS 1
+
+// Node being visited by ast_walk
+typedef struct {
+    ASTNode *node;       // NULL for an empty slot
+    ASTNode *parent;     // NULL for the root
+    ASTSlot slot;
+    int depth;           // 0 for the root
+    long value;          // Free for the callbacks, starts at 0
+    long parent_value;   // What the parent's callbacks left in value
+} ASTVisit;
+
+// Called before the children of a node, returns 0 to skip them
+typedef int (*ASTEnterFn)(ASTVisit *visit, void *context);
+
+// Called after the children of a node
+typedef void (*ASTLeaveFn)(ASTVisit *visit, void *context);
+
 // Function prototypes
-ASTNode* create_ast_node(ASTNodeType type);
-void free_ast(ASTNode *node);
-void add_child(ASTNode *parent, ASTNode *child);
-void print_ast(ASTNode *node, int indent);
+ASTNode* create_ast_node(Arena *arena, ASTNodeType type);
+void add_child(Arena *arena, ASTNode *parent, ASTNode *child);
+int ast_count_nodes(const ASTNode *node);
+void ast_shift_spans(ASTNode *node, int delta);
+int ast_walk(ASTNode *root, int flags, ASTEnterFn enter, ASTLeaveFn leave, void *context);
 
 #endif
\ No newline at end of file
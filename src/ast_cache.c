@@ -0,0 +1,353 @@
+/**
+ * AST Cache Implementation
+ *
+ * Entry layout, in host byte order (the cache is local to one machine):
+ *
+ *   CacheHeader
+ *   dependency records: CacheDep followed by the path, padded to 8 bytes
+ *   kind[num_nodes] padded to 4 bytes, then data, aux, first_edge, name
+ *   offsets and num_edges (num_nodes words each), span[num_nodes] (two
+ *   words each), edges[num_edges]
+ *   string table of '\0'-terminated names
+ *
+ * A hit maps the file and points the flat AST straight at it; only the
+ * names are resolved, through the interner. Entries are written to a
+ * temporary file and renamed, so readers never see a partial entry.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ast_cache.h"
+#include "intern.h"
+
+// Bumped whenever the layout or the meaning of a field changes
+#define AST_CACHE_MAGIC "CCAST02"
+
+// Fixed part of an entry
+typedef struct {
+    char magic[8];
+    uint64_t key;
+    uint32_t num_nodes;
+    uint32_t num_edges;
+    uint32_t num_deps;
+    uint32_t deps_size;        // Bytes of the dependency records
+    uint32_t strings_size;     // Bytes of the string table
+    uint32_t reserved;
+} CacheHeader;
+
+// Header the unit included, as it was when the entry was stored
+typedef struct {
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+    uint32_t path_length;      // Path bytes that follow, without padding
+    uint32_t reserved;
+} CacheDep;
+
+// FNV-1a over a byte range, continuing from hash
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t length) {
+    const unsigned char *p = (const unsigned char*)bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Round a size up to a multiple of align (a power of two)
+static size_t align_up(size_t size, size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+// Key of a source text compiled with the given include directories
+unsigned long long ast_cache_key(const char *text, size_t size, const PreprocOptions *options) {
+    uint64_t hash = hash_bytes(1469598103934665603ULL, AST_CACHE_MAGIC, sizeof(AST_CACHE_MAGIC));
+
+    // A rebuilt compiler may parse differently
+    struct stat info;
+    if (stat("/proc/self/exe", &info) == 0) {
+        int64_t stamp[3] = { (int64_t)info.st_mtim.tv_sec, (int64_t)info.st_mtim.tv_nsec, (int64_t)info.st_size };
+        hash = hash_bytes(hash, stamp, sizeof(stamp));
+    }
+
+    for (int i = 0; options && i < options->num_include_dirs; i++) {
+        hash = hash_bytes(hash, options->include_dirs[i], strlen(options->include_dirs[i]) + 1);
+    }
+    return hash_bytes(hash, text, size);
+}
+
+// Path of the entry of a key
+static char* entry_path(const char *dir, unsigned long long key) {
+    char *path = (char*)malloc(strlen(dir) + 32);
+    if (path) sprintf(path, "%s/%016llx.ast", dir, key);
+    return path;
+}
+
+// Check that every recorded header still has its recorded stat data
+static int deps_unchanged(const unsigned char *records, uint32_t num_deps, size_t deps_size) {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < num_deps; i++) {
+        if (offset + sizeof(CacheDep) > deps_size) return 0;
+        CacheDep dep;
+        memcpy(&dep, records + offset, sizeof(dep));
+        offset += sizeof(CacheDep);
+
+        size_t padded = align_up((size_t)dep.path_length + 1, 8);
+        if (offset + padded > deps_size || records[offset + dep.path_length] != '\0') return 0;
+
+        struct stat info;
+        const char *path = (const char*)records + offset;
+        if (stat(path, &info) != 0 || info.st_mtim.tv_sec != dep.mtime_sec
+            || info.st_mtim.tv_nsec != dep.mtime_nsec || info.st_size != dep.size) {
+            return 0;
+        }
+        offset += padded;
+    }
+    return offset == deps_size;
+}
+
+// Check that a mapped entry describes a well-formed tree
+static int check_arrays(const FlatAST *flat, const uint32_t *name_offsets, const char *strings,
+                        uint32_t strings_size) {
+    if (strings_size > 0 && strings[strings_size - 1] != '\0') return 0;
+
+    for (uint32_t id = 0; id < flat->num_nodes; id++) {
+        if (flat->kind[id] > AST_STRING) return 0;
+        if (name_offsets[id] != FLAT_NONE && name_offsets[id] >= strings_size) return 0;
+        if (flat->first_edge[id] > flat->num_edge_slots
+            || flat->num_edges[id] > flat->num_edge_slots - flat->first_edge[id]) {
+            return 0;
+        }
+
+        // Children come after their parent in pre-order, so there is no cycle
+        for (uint32_t i = 0; i < flat->num_edges[id]; i++) {
+            FlatNodeId child = flat->edges[flat->first_edge[id] + i];
+            if (child != FLAT_NONE && (child <= id || child >= flat->num_nodes)) return 0;
+        }
+    }
+    return 1;
+}
+
+// Map the entry of a key, NULL on a miss or an invalid entry
+FlatAST* ast_cache_load(const char *dir, unsigned long long key) {
+    char *path = entry_path(dir, key);
+    if (!path) return NULL;
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) return NULL;
+
+    struct stat info;
+    void *mapping = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(CacheHeader)) {
+        size = (size_t)info.st_size;
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    const unsigned char *bytes = (const unsigned char*)mapping;
+    CacheHeader header;
+    memcpy(&header, bytes, sizeof(header));
+
+    size_t nodes = header.num_nodes;
+    size_t deps_offset = sizeof(CacheHeader);
+    size_t kind_offset = deps_offset + header.deps_size;
+    size_t words_offset = kind_offset + align_up(nodes, 4);
+    size_t edges_offset = words_offset + 7 * nodes * sizeof(uint32_t);
+    size_t strings_offset = edges_offset + (size_t)header.num_edges * sizeof(uint32_t);
+
+    FlatAST *flat = NULL;
+    if (memcmp(header.magic, AST_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.key != key
+        || nodes == 0 || header.deps_size % 8 != 0
+        || strings_offset + header.strings_size != size
+        || !deps_unchanged(bytes + deps_offset, header.num_deps, header.deps_size)
+        || !(flat = (FlatAST*)calloc(1, sizeof(FlatAST)))) {
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    uint32_t *words = (uint32_t*)(void*)((unsigned char*)mapping + words_offset);
+    const uint32_t *name_offsets = words + 3 * nodes;
+    const char *strings = (const char*)bytes + strings_offset;
+    flat->mapping = mapping;
+    flat->mapping_size = size;
+    flat->num_nodes = header.num_nodes;
+    flat->node_capacity = header.num_nodes;
+    flat->kind = (uint8_t*)mapping + kind_offset;
+    flat->data = words;
+    flat->aux = (int32_t*)(words + nodes);
+    flat->first_edge = words + 2 * nodes;
+    flat->num_edges = words + 4 * nodes;
+    flat->span = (SourceSpan*)(void*)(words + 5 * nodes);
+    flat->num_edge_slots = header.num_edges;
+    flat->edge_capacity = header.num_edges;
+    flat->edges = (FlatNodeId*)(void*)((unsigned char*)mapping + edges_offset);
+
+    flat->name = (const char**)malloc(nodes * sizeof(const char*));
+    int ok = flat->name && check_arrays(flat, name_offsets, strings, header.strings_size);
+    for (size_t id = 0; ok && id < nodes; id++) {
+        flat->name[id] = NULL;
+        if (name_offsets[id] != FLAT_NONE) {
+            flat->name[id] = intern_cstr(strings + name_offsets[id]);
+            ok = flat->name[id] != NULL;
+        }
+    }
+    if (!ok) {
+        free_flat_ast(flat);
+        return NULL;
+    }
+    return flat;
+}
+
+// Growable byte buffer an entry is assembled in
+typedef struct {
+    unsigned char *bytes;
+    size_t size;
+    size_t capacity;
+    int failed;
+} ByteBuffer;
+
+// Append bytes, then zeros up to the alignment
+static void buffer_append(ByteBuffer *buffer, const void *bytes, size_t length, size_t align) {
+    if (buffer->failed) return;
+    size_t padded = align_up(length, align);
+    if (buffer->size + padded > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (buffer->size + padded > capacity) capacity *= 2;
+        unsigned char *grown = (unsigned char*)realloc(buffer->bytes, capacity);
+        if (!grown) {
+            buffer->failed = 1;
+            return;
+        }
+        buffer->bytes = grown;
+        buffer->capacity = capacity;
+    }
+    if (length) memcpy(buffer->bytes + buffer->size, bytes, length);
+    memset(buffer->bytes + buffer->size + length, 0, padded - length);
+    buffer->size += padded;
+}
+
+// Record the extra sources of the unit that are files on disk
+static uint32_t append_deps(ByteBuffer *buffer, const Lexer *lexer) {
+    uint32_t num_deps = 0;
+    for (int i = 0; i < lexer->num_sources; i++) {
+        const char *filename = lexer->sources[i].filename;
+        if (filename[0] == '<') continue;  // Built-in text
+
+        char *path = realpath(filename, NULL);
+        struct stat info;
+        if (!path || stat(path, &info) != 0) {
+            free(path);
+            buffer->failed = 1;
+            return 0;
+        }
+
+        CacheDep dep = { (int64_t)info.st_mtim.tv_sec, (int64_t)info.st_mtim.tv_nsec,
+                         (int64_t)info.st_size, (uint32_t)strlen(path), 0 };
+        buffer_append(buffer, &dep, sizeof(dep), 8);
+        buffer_append(buffer, path, dep.path_length + 1, 8);
+        free(path);
+        num_deps++;
+    }
+    return num_deps;
+}
+
+// Offset of a name in the string table, adding it on first use
+static uint32_t intern_offset(ByteBuffer *strings, const char **slots, uint32_t *offsets,
+                              size_t capacity, const char *name) {
+    // Names are interned, so the pointer identifies the text
+    size_t slot = ((uintptr_t)name >> 3) & (capacity - 1);
+    while (slots[slot] && slots[slot] != name) slot = (slot + 1) & (capacity - 1);
+    if (!slots[slot]) {
+        slots[slot] = name;
+        offsets[slot] = (uint32_t)strings->size;
+        buffer_append(strings, name, strlen(name) + 1, 1);
+    }
+    return offsets[slot];
+}
+
+// Store the flat AST of a unit, its headers taken from the lexer's extra sources
+int ast_cache_store(const char *dir, unsigned long long key, const FlatAST *flat, const Lexer *lexer) {
+    ByteBuffer entry = { NULL, 0, 0, 0 };
+    ByteBuffer strings = { NULL, 0, 0, 0 };
+    size_t nodes = flat->num_nodes;
+
+    // Header first as a placeholder, completed once the sizes are known
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    buffer_append(&entry, &header, sizeof(header), 8);
+    header.num_deps = append_deps(&entry, lexer);
+    header.deps_size = (uint32_t)(entry.size - sizeof(CacheHeader));
+
+    // Name offsets, each distinct name stored once
+    size_t capacity = 64;
+    while (capacity < nodes * 2) capacity *= 2;
+    const char **slots = (const char**)calloc(capacity, sizeof(const char*));
+    uint32_t *offsets = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    uint32_t *name_offsets = (uint32_t*)malloc(nodes * sizeof(uint32_t));
+    if (!slots || !offsets || !name_offsets) entry.failed = 1;
+    for (size_t id = 0; !entry.failed && id < nodes; id++) {
+        name_offsets[id] = FLAT_NONE;
+        if (flat->name[id]) name_offsets[id] = intern_offset(&strings, slots, offsets, capacity, flat->name[id]);
+    }
+
+    buffer_append(&entry, flat->kind, nodes, 4);
+    buffer_append(&entry, flat->data, nodes * sizeof(uint32_t), 4);
+    buffer_append(&entry, flat->aux, nodes * sizeof(int32_t), 4);
+    buffer_append(&entry, flat->first_edge, nodes * sizeof(uint32_t), 4);
+    buffer_append(&entry, name_offsets, nodes * sizeof(uint32_t), 4);
+    buffer_append(&entry, flat->num_edges, nodes * sizeof(uint32_t), 4);
+    buffer_append(&entry, flat->span, nodes * sizeof(SourceSpan), 4);
+    buffer_append(&entry, flat->edges, flat->num_edge_slots * sizeof(FlatNodeId), 4);
+    buffer_append(&entry, strings.bytes, strings.size, 1);
+    free(slots);
+    free(offsets);
+    free(name_offsets);
+
+    int ok = !entry.failed && !strings.failed;
+    if (ok) {
+        memcpy(header.magic, AST_CACHE_MAGIC, sizeof(header.magic));
+        header.key = key;
+        header.num_nodes = flat->num_nodes;
+        header.num_edges = flat->num_edge_slots;
+        header.strings_size = (uint32_t)strings.size;
+        memcpy(entry.bytes, &header, sizeof(header));
+    }
+    free(strings.bytes);
+
+    // Write aside and rename, concurrent stores of one key are harmless
+    char *path = ok ? entry_path(dir, key) : NULL;
+    char *temp = path ? (char*)malloc(strlen(dir) + 16) : NULL;
+    int fd = -1;
+    if (temp) {
+        sprintf(temp, "%s/.ast-XXXXXX", dir);
+        fd = mkstemp(temp);
+    }
+    ok = fd >= 0;
+    if (ok) {
+        size_t written = 0;
+        while (ok && written < entry.size) {
+            ssize_t count = write(fd, entry.bytes + written, entry.size - written);
+            ok = count > 0;
+            if (ok) written += (size_t)count;
+        }
+        ok = close(fd) == 0 && ok;
+        if (ok) ok = rename(temp, path) == 0;
+        if (!ok) unlink(temp);
+    }
+
+    free(temp);
+    free(path);
+    free(entry.bytes);
+    return ok;
+}
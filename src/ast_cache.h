@@ -0,0 +1,27 @@
+/**
+ * AST Cache Header
+ *
+ * On-disk cache of parsed translation units. An entry holds the flat AST
+ * of an error-free compilation as its raw arrays, filed under a key that
+ * hashes the source text, the compiler binary and the include directories.
+ * The headers the unit included are recorded with their stat data, and
+ * the entry is only used while all of them are unchanged.
+ */
+
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include "flat_ast.h"
+#include "lexeme.h"
+#include "preproc.h"
+
+// Key of a source text compiled with the given include directories
+unsigned long long ast_cache_key(const char *text, size_t size, const PreprocOptions *options);
+
+// Map the entry of a key, NULL on a miss or an invalid entry
+FlatAST* ast_cache_load(const char *dir, unsigned long long key);
+
+// Store the flat AST of a unit, its headers taken from the lexer's extra sources
+int ast_cache_store(const char *dir, unsigned long long key, const FlatAST *flat, const Lexer *lexer);
+
+#endif // AST_CACHE_H
@@ -0,0 +1,526 @@
+/**
+ * AST Dump Implementation
+ *
+ * Both writers walk the tree with ast_walk and format straight into the
+ * emission buffer. Indentation is copied from a precomputed run of
+ * spaces rather than written space by space.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast_dump.h"
+
+// Spaces copied for indentation, two per level
+static const char spaces[] = "                                                                "
+                             "                                                                ";
+
+// Get string representation of data type
+static const char* data_type_str(DataType type) {
+    switch (type) {
+        case TYPE_VOID: return "void";
+        case TYPE_INT: return "int";
+        case TYPE_CHAR: return "char";
+        default: return "unknown";
+    }
+}
+
+// Get string representation of binary operator
+static const char* binary_op_str(BinaryOp op) {
+    switch (op) {
+        case OP_ADD: return "+";
+        case OP_SUBTRACT: return "-";
+        case OP_MULTIPLY: return "*";
+        case OP_DIVIDE: return "/";
+        case OP_MODULO: return "%";
+        case OP_EQ: return "==";
+        case OP_NEQ: return "!=";
+        case OP_LT: return "<";
+        case OP_GT: return ">";
+        case OP_LTE: return "<=";
+        case OP_GTE: return ">=";
+        case OP_LOGICAL_AND: return "&&";
+        case OP_LOGICAL_OR: return "||";
+        case OP_BITWISE_AND: return "&";
+        case OP_BITWISE_OR: return "|";
+        case OP_BITWISE_XOR: return "^";
+        case OP_SHL: return "<<";
+        case OP_SHR: return ">>";
+        default: return "unknown";
+    }
+}
+
+// Get string representation of unary operator
+static const char* unary_op_str(UnaryOp op) {
+    switch (op) {
+        case OP_NEGATE: return "-";
+        case OP_NOT: return "!";
+        case OP_BITWISE_NOT: return "~";
+        case OP_PRE_INC: return "++";
+        case OP_PRE_DEC: return "--";
+        case OP_POST_INC: return "++ (post)";
+        case OP_POST_DEC: return "-- (post)";
+        default: return "unknown";
+    }
+}
+
+// Write indentation
+static void emit_indent(Emitter *out, int indent) {
+    size_t length = indent > 0 ? 2 * (size_t)indent : 0;
+    while (length > 0) {
+        size_t chunk = length < sizeof(spaces) - 1 ? length : sizeof(spaces) - 1;
+        emit_bytes(out, spaces, chunk);
+        length -= chunk;
+    }
+}
+
+// Write one line, indented
+static void emit_line(Emitter *out, int indent, const char *text) {
+    emit_indent(out, indent);
+    emit_str(out, text);
+    emit_char(out, '\n');
+}
+
+// State of the text dump
+typedef struct {
+    Emitter *out;
+    int indent;    // Of the root
+} TextDump;
+
+// Label written before the node of a slot, NULL for unlabelled slots
+static const char* slot_label(const ASTVisit *visit) {
+    int assign = visit->parent && visit->parent->type == AST_ASSIGN_EXPR;
+    switch (visit->slot) {
+        case AST_SLOT_PARAMETERS: return "Parameters:";
+        case AST_SLOT_BODY: return "Body:";
+        case AST_SLOT_INITIALIZER: return "Initializer:";
+        case AST_SLOT_CONDITION: return "Condition:";
+        case AST_SLOT_THEN: return "If Branch:";
+        case AST_SLOT_ELSE: return "Else Branch:";
+        case AST_SLOT_VALUE: return "Value:";
+        case AST_SLOT_LEFT: return assign ? "Left (target):" : "Left:";
+        case AST_SLOT_RIGHT: return assign ? "Right (value):" : "Right:";
+        case AST_SLOT_OPERAND: return "Operand:";
+        case AST_SLOT_CALLEE: return "Function:";
+        case AST_SLOT_ARGUMENTS: return "Arguments:";
+        case AST_SLOT_ARRAY: return "Array:";
+        case AST_SLOT_INDEX: return "Index:";
+        default: return NULL;
+    }
+}
+
+// Write a character literal the way the text dump shows it
+static void emit_character(Emitter *out, char value) {
+    static const char hex[] = "0123456789ABCDEF";
+    emit_str(out, "Character: '");
+    if (value >= 32 && value <= 126) {
+        emit_char(out, value);
+    } else {
+        unsigned char byte = (unsigned char)value;
+        emit_str(out, "\\x");
+        emit_char(out, hex[byte >> 4]);
+        emit_char(out, hex[byte & 15]);
+    }
+    emit_str(out, "'\n");
+}
+
+// Write the line of one node, its slot label first
+static int dump_text_node(ASTVisit *visit, void *context) {
+    TextDump *dump = (TextDump*)context;
+    Emitter *out = dump->out;
+    ASTNode *node = visit->node;
+    const char *label = slot_label(visit);
+
+    // Labelled children sit one level below their label
+    int indent = visit->slot == AST_SLOT_ROOT ? dump->indent : (int)visit->parent_value + (label ? 2 : 1);
+    visit->value = indent;
+
+    if (!node) {
+        // Optional parts are left out when missing
+        if (visit->slot == AST_SLOT_INITIALIZER || visit->slot == AST_SLOT_ELSE ||
+            visit->slot == AST_SLOT_VALUE) {
+            return 0;
+        }
+        if (label) emit_line(out, indent - 1, label);
+        if (visit->slot == AST_SLOT_PARAMETERS || visit->slot == AST_SLOT_ARGUMENTS) {
+            emit_line(out, indent, "(none)");
+        } else if (visit->slot == AST_SLOT_BODY && visit->parent->type == AST_FUNCTION) {
+            emit_line(out, indent, "(none - function declaration only)");
+        } else {
+            emit_line(out, indent, "NULL");
+        }
+        return 0;
+    }
+
+    if (label) emit_line(out, indent - 1, label);
+    emit_indent(out, indent);
+    
+    switch (node->type) {
+        case AST_PROGRAM:
+            emit_str(out, "Program (");
+            emit_int(out, node->num_children);
+            emit_str(out, " children)\n");
+            break;
+        
+        case AST_FUNCTION:
+            emit_format(out, "Function: %s, Return Type: %s\n", 
+                        node->data.function.name, 
+                        data_type_str(node->data.function.return_type));
+            break;
+        
+        case AST_PARAM_LIST:
+            emit_str(out, "Parameter List (");
+            emit_int(out, node->num_children);
+            emit_str(out, " parameters)\n");
+            break;
+        
+        case AST_PARAMETER:
+            emit_format(out, "Parameter: %s, Type: %s%s\n", 
+                        node->data.parameter.name, 
+                        data_type_str(node->data.parameter.type),
+                        node->data.parameter.is_array ? "[]" : "");
+            break;
+        
+        case AST_COMPOUND_STMT:
+            emit_str(out, "Compound Statement (");
+            emit_int(out, node->num_children);
+            emit_str(out, " statements)\n");
+            break;
+        
+        case AST_VARIABLE_DECL:
+            emit_format(out, "Variable Declaration: %s, Type: %s%s", 
+                        node->data.variable_decl.name, 
+                        data_type_str(node->data.variable_decl.type),
+                        node->data.variable_decl.is_array ? "[]" : "");
+            
+            if (node->data.variable_decl.is_array && node->data.variable_decl.array_size > 0) {
+                emit_char(out, '[');
+                emit_int(out, node->data.variable_decl.array_size);
+                emit_char(out, ']');
+            }
+            
+            emit_char(out, '\n');
+            break;
+        
+        case AST_IF_STMT:
+            emit_str(out, "If Statement\n");
+            break;
+        
+        case AST_WHILE_STMT:
+            emit_str(out, "While Statement\n");
+            break;
+        
+        case AST_RETURN_STMT:
+            emit_str(out, "Return Statement\n");
+            break;
+        
+        case AST_EXPR_STMT:
+            emit_str(out, "Expression Statement\n");
+            break;
+        
+        case AST_BINARY_EXPR:
+            emit_str(out, "Binary Expression: ");
+            emit_str(out, binary_op_str(node->data.binary_expr.op));
+            emit_char(out, '\n');
+            break;
+        
+        case AST_ASSIGN_EXPR:
+            emit_str(out, "Assignment Expression\n");
+            break;
+        
+        case AST_UNARY_EXPR:
+            emit_str(out, "Unary Expression: ");
+            emit_str(out, unary_op_str(node->data.unary_expr.op));
+            emit_char(out, '\n');
+            break;
+        
+        case AST_CALL_EXPR:
+            emit_str(out, "Function Call\n");
+            break;
+        
+        case AST_ARG_LIST:
+            emit_str(out, "Argument List (");
+            emit_int(out, node->num_children);
+            emit_str(out, " arguments)\n");
+            break;
+        
+        case AST_SUBSCRIPT_EXPR:
+            emit_str(out, "Array Subscript\n");
+            break;
+        
+        case AST_IDENTIFIER:
+            emit_str(out, "Identifier: ");
+            emit_str(out, node->data.identifier.name);
+            emit_char(out, '\n');
+            break;
+        
+        case AST_INTEGER:
+            emit_str(out, "Integer: ");
+            emit_int(out, node->data.integer.value);
+            emit_char(out, '\n');
+            break;
+        
+        case AST_CHARACTER:
+            emit_character(out, node->data.character.value);
+            break;
+        
+        case AST_STRING:
+            emit_str(out, "String: \"");
+            emit_str(out, node->data.string.value);
+            emit_str(out, "\"\n");
+            break;
+        
+        default:
+            emit_str(out, "Unknown AST node type: ");
+            emit_int(out, node->type);
+            emit_char(out, '\n');
+            break;
+    }
+    return 1;
+}
+
+// Write the text dump of a tree
+void ast_dump_text(Emitter *out, ASTNode *node, int indent) {
+    TextDump dump;
+    dump.out = out;
+    dump.indent = indent;
+    ast_walk(node, AST_WALK_NULLS, dump_text_node, NULL, &dump);
+}
+
+// Text dump to a stdio stream
+void print_ast(FILE *out, ASTNode *node, int indent) {
+    Emitter *emitter = emitter_create(-1);
+    if (!emitter) return;
+    emitter_set_file(emitter, out);
+    ast_dump_text(emitter, node, indent);
+    emitter_destroy(emitter);
+}
+
+// Open members of the JSON objects on the walk path, one per depth
+typedef struct {
+    int in_children;     // The "children" array is open
+    int elements;        // Entries written to it
+} JsonObject;
+
+// State of the JSON dump
+typedef struct {
+    Emitter *out;
+    JsonObject *objects;
+    int capacity;
+    int failed;
+} JsonDump;
+
+// JSON name of a node kind
+static const char* json_kind(ASTNodeType type) {
+    switch (type) {
+        case AST_PROGRAM: return "Program";
+        case AST_FUNCTION: return "Function";
+        case AST_PARAM_LIST: return "ParamList";
+        case AST_PARAMETER: return "Parameter";
+        case AST_COMPOUND_STMT: return "Compound";
+        case AST_VARIABLE_DECL: return "VariableDecl";
+        case AST_ASSIGN_EXPR: return "Assign";
+        case AST_IF_STMT: return "If";
+        case AST_WHILE_STMT: return "While";
+        case AST_RETURN_STMT: return "Return";
+        case AST_EXPR_STMT: return "ExprStmt";
+        case AST_BINARY_EXPR: return "Binary";
+        case AST_UNARY_EXPR: return "Unary";
+        case AST_CALL_EXPR: return "Call";
+        case AST_ARG_LIST: return "ArgList";
+        case AST_SUBSCRIPT_EXPR: return "Subscript";
+        case AST_IDENTIFIER: return "Identifier";
+        case AST_INTEGER: return "Integer";
+        case AST_CHARACTER: return "Character";
+        case AST_STRING: return "String";
+        default: return "Unknown";
+    }
+}
+
+// JSON member name of a slot
+static const char* json_slot(ASTSlot slot) {
+    switch (slot) {
+        case AST_SLOT_PARAMETERS: return "parameters";
+        case AST_SLOT_BODY: return "body";
+        case AST_SLOT_INITIALIZER: return "initializer";
+        case AST_SLOT_CONDITION: return "condition";
+        case AST_SLOT_THEN: return "then";
+        case AST_SLOT_ELSE: return "else";
+        case AST_SLOT_VALUE: return "value";
+        case AST_SLOT_LEFT: return "left";
+        case AST_SLOT_RIGHT: return "right";
+        case AST_SLOT_OPERAND: return "operand";
+        case AST_SLOT_CALLEE: return "callee";
+        case AST_SLOT_ARGUMENTS: return "arguments";
+        case AST_SLOT_ARRAY: return "array";
+        case AST_SLOT_INDEX: return "index";
+        default: return "children";
+    }
+}
+
+// Write a JSON string literal
+static void emit_json_string(Emitter *out, const char *text) {
+    static const char hex[] = "0123456789abcdef";
+    emit_char(out, '"');
+    if (!text) text = "";
+    for (const unsigned char *c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            emit_char(out, '\\');
+            emit_char(out, (char)*c);
+        } else if (*c < 0x20) {
+            emit_str(out, "\\u00");
+            emit_char(out, hex[*c >> 4]);
+            emit_char(out, hex[*c & 15]);
+        } else {
+            emit_char(out, (char)*c);
+        }
+    }
+    emit_char(out, '"');
+}
+
+// Write a string member
+static void emit_json_member(Emitter *out, const char *name, const char *value) {
+    emit_str(out, ",\"");
+    emit_str(out, name);
+    emit_str(out, "\":");
+    emit_json_string(out, value);
+}
+
+// Write an integer member
+static void emit_json_int(Emitter *out, const char *name, long value) {
+    emit_str(out, ",\"");
+    emit_str(out, name);
+    emit_str(out, "\":");
+    emit_int(out, value);
+}
+
+// Write the attributes of a node, after its kind and span
+static void emit_json_attributes(Emitter *out, const ASTNode *node) {
+    switch (node->type) {
+        case AST_FUNCTION:
+            emit_json_member(out, "name", node->data.function.name);
+            emit_json_member(out, "returnType", data_type_str(node->data.function.return_type));
+            break;
+        case AST_PARAMETER:
+            emit_json_member(out, "name", node->data.parameter.name);
+            emit_json_member(out, "type", data_type_str(node->data.parameter.type));
+            emit_str(out, node->data.parameter.is_array ? ",\"isArray\":true" : ",\"isArray\":false");
+            break;
+        case AST_VARIABLE_DECL:
+            emit_json_member(out, "name", node->data.variable_decl.name);
+            emit_json_member(out, "type", data_type_str(node->data.variable_decl.type));
+            emit_str(out, node->data.variable_decl.is_array ? ",\"isArray\":true" : ",\"isArray\":false");
+            if (node->data.variable_decl.is_array) {
+                emit_json_int(out, "arraySize", node->data.variable_decl.array_size);
+            }
+            break;
+        case AST_BINARY_EXPR:
+            emit_json_member(out, "op", binary_op_str(node->data.binary_expr.op));
+            break;
+        case AST_UNARY_EXPR:
+            emit_json_member(out, "op", unary_op_str(node->data.unary_expr.op));
+            break;
+        case AST_IDENTIFIER:
+            emit_json_member(out, "name", node->data.identifier.name);
+            break;
+        case AST_INTEGER:
+            emit_json_int(out, "value", node->data.integer.value);
+            break;
+        case AST_CHARACTER:
+            emit_json_int(out, "value", (unsigned char)node->data.character.value);
+            break;
+        case AST_STRING:
+            emit_json_member(out, "value", node->data.string.value);
+            break;
+        default:
+            break;
+    }
+}
+
+// Check whether a node kind holds its children in the children array
+static int has_children_array(ASTNodeType type) {
+    return type == AST_PROGRAM || type == AST_PARAM_LIST || type == AST_COMPOUND_STMT ||
+           type == AST_EXPR_STMT || type == AST_ARG_LIST;
+}
+
+// Open the object of a node, or write null for an empty slot
+static int dump_json_enter(ASTVisit *visit, void *context) {
+    JsonDump *dump = (JsonDump*)context;
+    Emitter *out = dump->out;
+    ASTNode *node = visit->node;
+
+    if (visit->depth > 0) {
+        JsonObject *parent = &dump->objects[visit->depth - 1];
+        if (visit->slot == AST_SLOT_ELEMENT) {
+            if (parent->elements++ > 0) emit_char(out, ',');
+        } else {
+            if (parent->in_children) {
+                emit_char(out, ']');
+                parent->in_children = 0;
+            }
+            emit_str(out, ",\"");
+            emit_str(out, json_slot(visit->slot));
+            emit_str(out, "\":");
+        }
+    }
+    if (!node) {
+        emit_str(out, "null");
+        return 0;
+    }
+
+    if (visit->depth >= dump->capacity) {
+        int capacity = dump->capacity ? dump->capacity * 2 : 64;
+        JsonObject *objects = (JsonObject*)realloc(dump->objects, capacity * sizeof(JsonObject));
+        if (!objects) {
+            dump->failed = 1;
+            return 0;
+        }
+        dump->objects = objects;
+        dump->capacity = capacity;
+    }
+
+    emit_str(out, "{\"kind\":");
+    emit_json_string(out, json_kind(node->type));
+    emit_str(out, ",\"span\":[");
+    emit_int(out, node->span.start);
+    emit_char(out, ',');
+    emit_int(out, node->span.end);
+    emit_char(out, ']');
+    emit_json_attributes(out, node);
+
+    // List nodes always carry the array, empty or not
+    JsonObject *object = &dump->objects[visit->depth];
+    object->in_children = has_children_array(node->type);
+    object->elements = 0;
+    if (object->in_children) emit_str(out, ",\"children\":[");
+    return 1;
+}
+
+// Close the object of a node
+static void dump_json_leave(ASTVisit *visit, void *context) {
+    JsonDump *dump = (JsonDump*)context;
+    if (!visit->node || visit->depth >= dump->capacity) return;
+    if (dump->objects[visit->depth].in_children) emit_char(dump->out, ']');
+    emit_char(dump->out, '}');
+}
+
+// Write the JSON dump of a unit
+void ast_dump_json(Emitter *out, const char *file, ASTNode *node) {
+    JsonDump dump;
+    dump.out = out;
+    dump.objects = NULL;
+    dump.capacity = 0;
+    dump.failed = 0;
+
+    emit_str(out, "{\"file\":");
+    emit_json_string(out, file);
+    emit_str(out, ",\"ast\":");
+    if (node) {
+        if (!ast_walk(node, AST_WALK_NULLS, dump_json_enter, dump_json_leave, &dump)) dump.failed = 1;
+    } else {
+        emit_str(out, "null");
+    }
+    emit_str(out, "}\n");
+    if (dump.failed) out->failed = 1;  // A truncated document must not pass for a whole one
+    free(dump.objects);
+}
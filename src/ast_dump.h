@@ -0,0 +1,32 @@
+/**
+ * AST Dump Header
+ *
+ * Writers of a whole tree into an emission stream (emit.h): the indented
+ * text form meant for people, and a JSON form meant for tools, one
+ * object per translation unit on a single line.
+ */
+
+#ifndef AST_DUMP_H
+#define AST_DUMP_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "emit.h"
+
+// Format of the AST dump of a compilation
+typedef enum {
+    AST_DUMP_NONE,
+    AST_DUMP_TEXT,
+    AST_DUMP_JSON
+} ASTDumpFormat;
+
+// Write the text dump of a tree, its root indent levels deep
+void ast_dump_text(Emitter *out, ASTNode *node, int indent);
+
+// Write the JSON dump of a unit as one line: {"file":...,"ast":{...}}
+void ast_dump_json(Emitter *out, const char *file, ASTNode *node);
+
+// Text dump to a stdio stream, for debugging
+void print_ast(FILE *out, ASTNode *node, int indent);
+
+#endif // AST_DUMP_H
@@ -0,0 +1,467 @@
+/**
+ * Code Generator Implementation
+ *
+ * Allocates the registers of each IR function (regalloc.h) and selects
+ * Thumb-2 instructions. Virtual registers left without a core
+ * register live in frame slots and pass through ip and lr, which the
+ * allocator never hands out. The frame, addressed from r7:
+ *
+ *   [r7, #0 ...]                  spill slots, one word each
+ *   [r7, #4 * slots ...]          local arrays
+ *   [r7, #frame ...]              saved registers, then r7 and lr
+ *   [r7, #frame + saved + 8 ...]  parameters five and up, pushed by the caller
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "codegen.h"
+#include "regalloc.h"
+
+// Largest offset of the imm12 load/store and add/sub forms
+#define MAX_IMM12 4095
+
+// Registers saved by the callee that the allocator may hand out
+#define CALLEE_SAVED_MASK 0x0f70
+
+// State of one function
+typedef struct {
+    const IRFunction *ir;
+    ArmFunction *function;
+    Allocation allocation;
+    int frame_size;          // Bytes below the saved registers
+    int saved_mask;          // Callee-saved registers pushed by the prologue
+    int saved_bytes;         // Bytes pushed by the prologue, r7 and lr included
+    int return_label;
+} CodeGen;
+
+// Move sp by delta bytes
+static void adjust_sp(CodeGen *cg, int delta) {
+    ArmOp op = delta < 0 ? ARM_SUB : ARM_ADD;
+    int amount = delta < 0 ? -delta : delta;
+    if (amount == 0) return;
+    if (amount <= MAX_IMM12) {
+        arm_emit_imm(cg->function, op, ARM_SP, ARM_SP, amount);
+    } else {
+        arm_emit_constant(cg->function, ARM_IP, amount);
+        arm_emit_reg(cg->function, op, ARM_SP, ARM_SP, ARM_IP);
+    }
+}
+
+// Load rd from a frame offset, rd doubling as the index register when far
+static void frame_load(CodeGen *cg, int rd, int offset) {
+    if (offset <= MAX_IMM12) {
+        arm_emit_imm(cg->function, ARM_LDR, rd, ARM_FP, offset);
+    } else {
+        arm_emit_constant(cg->function, rd, offset);
+        arm_emit_reg(cg->function, ARM_LDR, rd, ARM_FP, rd);
+    }
+}
+
+// Store rs at a frame offset, through whichever of ip and lr rs is not when far
+static void frame_store(CodeGen *cg, int rs, int offset) {
+    if (offset <= MAX_IMM12) {
+        arm_emit_imm(cg->function, ARM_STR, rs, ARM_FP, offset);
+    } else {
+        int index = rs == ARM_IP ? ARM_LR : ARM_IP;
+        arm_emit_constant(cg->function, index, offset);
+        arm_emit_reg(cg->function, ARM_STR, rs, ARM_FP, index);
+    }
+}
+
+// Frame offset of the slot of a spilled virtual register
+static int slot_offset(const CodeGen *cg, int vreg) {
+    return 4 * cg->allocation.slots[vreg];
+}
+
+// Register holding a virtual register, loaded into scratch when spilled
+static int use_reg(CodeGen *cg, int vreg, int scratch) {
+    int reg = cg->allocation.registers[vreg];
+    if (reg != REG_SPILLED) return reg;
+    frame_load(cg, scratch, slot_offset(cg, vreg));
+    return scratch;
+}
+
+// Register to compute a virtual register into, ip when spilled
+static int def_reg(const CodeGen *cg, int vreg) {
+    int reg = cg->allocation.registers[vreg];
+    return reg != REG_SPILLED ? reg : ARM_IP;
+}
+
+// Write back a value computed into def_reg
+static void finish_def(CodeGen *cg, int vreg, int reg) {
+    if (cg->allocation.registers[vreg] == REG_SPILLED) frame_store(cg, reg, slot_offset(cg, vreg));
+}
+
+// Set a virtual register from a core register
+static void move_to_vreg(CodeGen *cg, int vreg, int rs) {
+    int reg = cg->allocation.registers[vreg];
+    if (reg == REG_SPILLED) {
+        frame_store(cg, rs, slot_offset(cg, vreg));
+    } else if (reg != rs) {
+        arm_emit_reg(cg->function, ARM_MOV, reg, 0, rs);
+    }
+}
+
+// Emit moves dst[i] <- src[i] as if all happened at once; ip breaks cycles
+static void parallel_move(CodeGen *cg, int *dst, int *src, int count) {
+    int pending = count;
+    while (pending > 0) {
+        int progress = 0;
+        for (int i = 0; i < pending; ) {
+            if (dst[i] == src[i]) {
+                dst[i] = dst[--pending];
+                src[i] = src[pending];
+                continue;
+            }
+            // Safe once no other pending move still reads the destination
+            int blocked = 0;
+            for (int j = 0; j < pending; j++) {
+                if (j != i && src[j] == dst[i]) blocked = 1;
+            }
+            if (blocked) {
+                i++;
+                continue;
+            }
+            arm_emit_reg(cg->function, ARM_MOV, dst[i], 0, src[i]);
+            dst[i] = dst[--pending];
+            src[i] = src[pending];
+            progress = 1;
+        }
+        if (!progress && pending > 0) {
+            // Only cycles remain: park one destination's value in ip
+            int saved = dst[0];
+            arm_emit_reg(cg->function, ARM_MOV, ARM_IP, 0, saved);
+            for (int j = 0; j < pending; j++) {
+                if (src[j] == saved) src[j] = ARM_IP;
+            }
+        }
+    }
+}
+
+// Check whether a value fits the Thumb-2 modified immediate of data processing
+static int is_modified_imm(uint32_t value) {
+    if (value <= 0xff) return 1;
+    uint32_t low = value & 0xff;
+    if (value == (low | low << 16) || value == low * 0x01010101u) return 1;
+    uint32_t high = (value >> 8) & 0xff;
+    if (value == (high << 8 | high << 24)) return 1;
+    // An 8-bit value with its top bit set, rotated right
+    for (int rotation = 8; rotation < 32; rotation++) {
+        uint32_t unrotated = value << rotation | value >> (32 - rotation);
+        if (unrotated >= 0x80 && unrotated <= 0xff) return 1;
+    }
+    return 0;
+}
+
+// Machine operation of an IR binary operator
+static ArmOp binary_op(BinaryOp op) {
+    switch (op) {
+        case OP_ADD: return ARM_ADD;
+        case OP_SUBTRACT: return ARM_SUB;
+        case OP_MULTIPLY: return ARM_MUL;
+        case OP_BITWISE_AND: return ARM_AND;
+        case OP_BITWISE_OR: return ARM_ORR;
+        case OP_BITWISE_XOR: return ARM_EOR;
+        case OP_SHL: return ARM_LSL;
+        default: return ARM_ASR;
+    }
+}
+
+// Condition that holds when a comparison is true
+static ArmCond comparison_cond(BinaryOp op) {
+    switch (op) {
+        case OP_EQ: return ARM_EQ;
+        case OP_NEQ: return ARM_NE;
+        case OP_LT: return ARM_LT;
+        case OP_GT: return ARM_GT;
+        case OP_LTE: return ARM_LE;
+        case OP_GTE: return ARM_GE;
+        default: return ARM_AL;
+    }
+}
+
+// d = a op imm
+static void select_binary_imm(CodeGen *cg, const IRInsn *insn, int rd, int rn) {
+    ArmFunction *f = cg->function;
+    BinaryOp op = (BinaryOp)insn->subop;
+    int32_t imm = insn->b;
+
+    if (op == OP_ADD || op == OP_SUBTRACT) {
+        // Negative steps flip the operation so the imm12 form applies
+        ArmOp arm = op == OP_ADD ? ARM_ADD : ARM_SUB;
+        if (imm < 0 && imm > -MAX_IMM12 - 1) {
+            arm = arm == ARM_ADD ? ARM_SUB : ARM_ADD;
+            imm = -imm;
+        }
+        if (imm >= 0 && imm <= MAX_IMM12) {
+            arm_emit_imm(f, arm, rd, rn, imm);
+            return;
+        }
+    } else if (op == OP_SHL || op == OP_SHR) {
+        if ((imm & 31) == 0) {
+            if (rd != rn) arm_emit_reg(f, ARM_MOV, rd, 0, rn);
+        } else {
+            arm_emit_imm(f, binary_op(op), rd, rn, imm & 31);
+        }
+        return;
+    } else if (op != OP_MULTIPLY && is_modified_imm((uint32_t)imm)) {
+        arm_emit_imm(f, binary_op(op), rd, rn, imm);
+        return;
+    }
+
+    arm_emit_constant(f, ARM_LR, imm);
+    arm_emit_reg(f, binary_op(op), rd, rn, ARM_LR);
+}
+
+// Compare a with b, register or immediate
+static void select_compare(CodeGen *cg, const IRInsn *insn) {
+    int rn = use_reg(cg, insn->a, ARM_IP);
+    if (!(insn->flags & IR_IMM_B)) {
+        arm_emit_reg(cg->function, ARM_CMP, 0, rn, use_reg(cg, insn->b, ARM_LR));
+    } else if (is_modified_imm((uint32_t)insn->b)) {
+        arm_emit_imm(cg->function, ARM_CMP, 0, rn, insn->b);
+    } else {
+        arm_emit_constant(cg->function, ARM_LR, insn->b);
+        arm_emit_reg(cg->function, ARM_CMP, 0, rn, ARM_LR);
+    }
+}
+
+// Call a function following the AAPCS
+static void select_call(CodeGen *cg, const IRInsn *insn) {
+    ArmFunction *f = cg->function;
+    const int32_t *args = cg->ir->args + insn->a;
+    int count = insn->imm;
+    int in_registers = count < 4 ? count : 4;
+
+    // Stacked arguments first, sp stays 8-byte aligned at the call
+    int stack_bytes = count > 4 ? ((count - 4) * 4 + 7) & ~7 : 0;
+    adjust_sp(cg, -stack_bytes);
+    for (int i = 4; i < count; i++) {
+        arm_emit_imm(f, ARM_STR, use_reg(cg, args[i], ARM_IP), ARM_SP, 4 * (i - 4));
+    }
+
+    // Register arguments, spilled ones loaded once the moves are done
+    int dst[4];
+    int src[4];
+    int moves = 0;
+    for (int i = 0; i < in_registers; i++) {
+        int reg = cg->allocation.registers[args[i]];
+        if (reg == REG_SPILLED) continue;
+        dst[moves] = i;
+        src[moves] = reg;
+        moves++;
+    }
+    parallel_move(cg, dst, src, moves);
+    for (int i = 0; i < in_registers; i++) {
+        if (cg->allocation.registers[args[i]] == REG_SPILLED) frame_load(cg, i, slot_offset(cg, args[i]));
+    }
+
+    arm_emit_call(f, insn->symbol);
+    adjust_sp(cg, stack_bytes);
+    if (insn->dst != IR_NONE) move_to_vreg(cg, insn->dst, insn->flags & IR_RESULT1 ? 1 : 0);
+}
+
+// Move the incoming parameters to their allocated locations
+static void select_parameters(CodeGen *cg) {
+    const IRFunction *ir = cg->ir;
+    int dst[4];
+    int src[4];
+    int moves = 0;
+
+    // Spilled register parameters go out before r0-r3 are overwritten
+    for (int i = 0; i < ir->num_insns && ir->insns[i].op == IR_PARAM; i++) {
+        const IRInsn *insn = &ir->insns[i];
+        if (insn->imm >= 4) continue;
+        int reg = cg->allocation.registers[insn->dst];
+        if (reg == REG_SPILLED) {
+            if (cg->allocation.slots[insn->dst] >= 0) frame_store(cg, insn->imm, slot_offset(cg, insn->dst));
+        } else {
+            dst[moves] = reg;
+            src[moves] = insn->imm;
+            moves++;
+        }
+    }
+    parallel_move(cg, dst, src, moves);
+
+    for (int i = 0; i < ir->num_insns && ir->insns[i].op == IR_PARAM; i++) {
+        const IRInsn *insn = &ir->insns[i];
+        if (insn->imm < 4) continue;
+        int reg = cg->allocation.registers[insn->dst];
+        if (reg == REG_SPILLED && cg->allocation.slots[insn->dst] < 0) continue;
+        int rd = def_reg(cg, insn->dst);
+        frame_load(cg, rd, cg->frame_size + cg->saved_bytes + 4 * (insn->imm - 4));
+        finish_def(cg, insn->dst, rd);
+    }
+}
+
+// Select the instructions of one IR instruction
+static void select_insn(CodeGen *cg, const IRInsn *insn, int is_last) {
+    ArmFunction *f = cg->function;
+    switch ((IROp)insn->op) {
+        case IR_CONST: {
+            int rd = def_reg(cg, insn->dst);
+            arm_emit_constant(f, rd, insn->imm);
+            finish_def(cg, insn->dst, rd);
+            break;
+        }
+        case IR_ADDR: {
+            int rd = def_reg(cg, insn->dst);
+            arm_emit_address(f, rd, insn->symbol);
+            finish_def(cg, insn->dst, rd);
+            break;
+        }
+        case IR_FRAME_ADDR: {
+            int rd = def_reg(cg, insn->dst);
+            int offset = 4 * cg->allocation.num_slots + insn->imm;
+            if (offset <= MAX_IMM12) {
+                arm_emit_imm(f, ARM_ADD, rd, ARM_FP, offset);
+            } else {
+                arm_emit_constant(f, rd, offset);
+                arm_emit_reg(f, ARM_ADD, rd, ARM_FP, rd);
+            }
+            finish_def(cg, insn->dst, rd);
+            break;
+        }
+        case IR_COPY: {
+            int rs = use_reg(cg, insn->a, ARM_IP);
+            move_to_vreg(cg, insn->dst, rs);
+            break;
+        }
+        case IR_BINARY: {
+            int rn = use_reg(cg, insn->a, ARM_IP);
+            int rd = def_reg(cg, insn->dst);
+            if (insn->flags & IR_IMM_B) {
+                select_binary_imm(cg, insn, rd, rn);
+            } else {
+                arm_emit_reg(f, binary_op((BinaryOp)insn->subop), rd, rn, use_reg(cg, insn->b, ARM_LR));
+            }
+            finish_def(cg, insn->dst, rd);
+            break;
+        }
+        case IR_UNARY: {
+            int rn = use_reg(cg, insn->a, ARM_IP);
+            int rd = def_reg(cg, insn->dst);
+            if (insn->subop == OP_NEGATE) arm_emit_imm(f, ARM_RSB, rd, rn, 0);
+            else arm_emit_reg(f, ARM_MVN, rd, 0, rn);
+            finish_def(cg, insn->dst, rd);
+            break;
+        }
+        case IR_LOAD: {
+            int rn = use_reg(cg, insn->a, ARM_IP);
+            int rd = def_reg(cg, insn->dst);
+            arm_emit_imm(f, insn->flags & IR_BYTE ? ARM_LDRB : ARM_LDR, rd, rn, insn->imm);
+            finish_def(cg, insn->dst, rd);
+            break;
+        }
+        case IR_STORE: {
+            int rn = use_reg(cg, insn->a, ARM_IP);
+            int rs = use_reg(cg, insn->b, ARM_LR);
+            arm_emit_imm(f, insn->flags & IR_BYTE ? ARM_STRB : ARM_STR, rs, rn, insn->imm);
+            break;
+        }
+        case IR_CALL:
+            select_call(cg, insn);
+            break;
+        case IR_PARAM:
+            // Handled by select_parameters
+            break;
+        case IR_LABEL:
+            arm_emit_label(f, insn->imm);
+            break;
+        case IR_JUMP:
+            arm_emit_branch(f, ARM_AL, insn->imm);
+            break;
+        case IR_BRANCH:
+            select_compare(cg, insn);
+            arm_emit_branch(f, comparison_cond((BinaryOp)insn->subop), insn->imm);
+            break;
+        case IR_RETURN:
+            if (insn->a != IR_NONE) {
+                int rs = use_reg(cg, insn->a, 0);
+                if (rs != 0) arm_emit_reg(f, ARM_MOV, 0, 0, rs);
+            }
+            if (!is_last) arm_emit_branch(f, ARM_AL, cg->return_label);
+            break;
+        default:
+            break;
+    }
+}
+
+// Count the registers of a mask
+static int count_registers(int mask) {
+    int count = 0;
+    for (; mask; mask &= mask - 1) count++;
+    return count;
+}
+
+// Generate one function from its IR
+static int gen_function(ArmModule *module, const IRFunction *ir) {
+    CodeGen cg;
+    memset(&cg, 0, sizeof(cg));
+    cg.ir = ir;
+    if (ir->failed || ir->in_ssa) return 0;
+    cg.function = arm_add_function(module, ir->name);
+    if (!cg.function || !regalloc_function(ir, &cg.allocation)) return 0;
+    ArmFunction *f = cg.function;
+
+    // IR labels keep their numbers, the epilogue takes the next one
+    for (int i = 0; i < ir->num_labels; i++) arm_new_label(f);
+    cg.return_label = arm_new_label(f);
+
+    // Whole frame 8-byte aligned, saved registers included
+    cg.saved_mask = (int)cg.allocation.used & CALLEE_SAVED_MASK;
+    cg.saved_bytes = 4 * (count_registers(cg.saved_mask) + 2);
+    int frame = 4 * cg.allocation.num_slots + ir->array_bytes;
+    cg.frame_size = ((frame + cg.saved_bytes + 7) & ~7) - cg.saved_bytes;
+
+    int pushed = cg.saved_mask | (1 << ARM_FP) | (1 << ARM_LR);
+    arm_emit_imm(f, ARM_PUSH, 0, 0, pushed);
+    adjust_sp(&cg, -cg.frame_size);
+    arm_emit_reg(f, ARM_MOV, ARM_FP, 0, ARM_SP);
+    select_parameters(&cg);
+
+    for (int i = 0; i < ir->num_insns; i++) {
+        select_insn(&cg, &ir->insns[i], i + 1 == ir->num_insns);
+    }
+
+    arm_emit_label(f, cg.return_label);
+    arm_emit_reg(f, ARM_MOV, ARM_SP, 0, ARM_FP);
+    adjust_sp(&cg, cg.frame_size);
+    arm_emit_imm(f, ARM_POP, 0, 0, cg.saved_mask | (1 << ARM_FP) | (1 << ARM_PC));
+
+    regalloc_free(&cg.allocation);
+    return !f->failed;
+}
+
+// Generate the code of a program
+ArmModule* codegen_program(const IRProgram *ir) {
+    if (!ir) return NULL;
+
+    ArmModule *module = arm_module_create();
+    int ok = module != NULL;
+    for (int i = 0; ok && i < ir->num_globals; i++) {
+        const IRGlobal *source = &ir->globals[i];
+        ArmGlobal *global = arm_add_global(module, source->name);
+        if (!global) {
+            ok = 0;
+            break;
+        }
+        global->size = source->size;
+        global->align = source->align;
+        global->has_value = source->has_value;
+        global->value = source->value;
+    }
+    for (int i = 0; ok && i < ir->num_strings; i++) {
+        ok = arm_add_string(module, ir->strings[i]) >= 0;
+    }
+    for (int i = 0; ok && i < ir->num_functions; i++) {
+        ok = gen_function(module, &ir->functions[i]);
+    }
+
+    if (!ok || module->failed) {
+        arm_module_free(module);
+        return NULL;
+    }
+    return module;
+}
@@ -0,0 +1,18 @@
+/**
+ * Code Generator Header
+ *
+ * Generates ARM Thumb-2 code (see arm.h) from the IR of a translation unit
+ * (see lower.h), following the AAPCS calling convention: arguments in r0-r3
+ * then on the stack, result in r0, r7 as frame pointer.
+ */
+
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "arm.h"
+#include "ir.h"
+
+// Generate the code of a program outside SSA form, NULL on allocation failure
+ArmModule* codegen_program(const IRProgram *program);
+
+#endif // CODEGEN_H
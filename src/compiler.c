@@ -1,30 +1,41 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "lexeme.h"
-#include "parser.h"
-#include "ast.h"
+#include "driver.h"
+#include "intern.h"
+#include "preproc.h"
+#include "server.h"
 
 int main(int argc, char **argv){
-    if (argc <1){
-        fprintf(stderr, "argument manquant");
-        exit(1);
+    // Compile server: requests over stdin/stdout or a Unix socket
+    if (argc == 2 && strcmp(argv[1], "--server") == 0) {
+        int status = run_server_stdio();
+        free_include_cache();
+        free_interner();
+        return status;
+    }
+    if (argc == 2 && strncmp(argv[1], "--server=", 9) == 0) {
+        int status = run_server_socket(argv[1] + 9);
+        free_include_cache();
+        free_interner();
+        return status;
+    }
+    
+    CompileOptions options;
+    InputList inputs = { NULL, 0, 0 };
+    init_compile_options(&options);
+    if (!parse_arguments(argc, argv, &options, &inputs, stderr)) {
+        free_input_list(&inputs);
+        return 1;
     }
-    FILE *F = fopen(argv[1],"r"); 
-    printf("le fichier :%s\n", argv[1]);
     
-    Lexer *LC = init_lexer(F, argv[1]);
-    Parser *parse = init_parser(LC); 
-    ASTNode *as = parse_program(parse);
-    print_ast(as, 10);
-    /*do
-    {
-        parse->current_token = peek_token(LC);
-        print_token(parse->current_token);
-        advance_token(LC);
-    } while (parse->current_token.type!= TOKEN_EOF);    
-    */
-    free_lexer(LC);
-    return 0;
+    Driver *driver = driver_create();
+    int status = driver ? driver_compile(driver, &options, &inputs, stdout, stderr) : 1;
+    
+    driver_destroy(driver);
+    free_include_cache();
+    free_interner();
+    free_input_list(&inputs);
+    return status;
 }
-
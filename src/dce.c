@@ -0,0 +1,367 @@
+/**
+ * Dead Code Elimination Implementation
+ *
+ * Statements are pruned first, so calls that only appear in dead code do
+ * not keep their callee alive. Like the folder, the pruner never drops
+ * code whose names lowering would report: it tracks the names in scope
+ * the way lowering declares them, and keeps a dead subtree that reads an
+ * undeclared one. Reachability then follows the calls from main by name;
+ * names are interned, so functions are sorted by pointer and looked up
+ * with a binary search. Functions are only dropped in whole-program
+ * builds, since another unit may call any of them.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dce.h"
+#include "intern.h"
+#include "symtab.h"
+
+// State of the pruning of one program
+typedef struct {
+    Arena *arena;
+    SymbolTable symbols;   // Names in scope at the statement being pruned
+    int failed;            // A declaration could not be recorded, nothing may be dropped
+} Pruner;
+
+// Names of an expression checked against a scope
+typedef struct {
+    const SymbolTable *symbols;
+    int undeclared;
+} NameCheck;
+
+// Table of the defined functions of a program, sorted by name
+typedef struct {
+    ASTNode **functions;
+    char *reachable;
+    int count;
+    int *worklist;
+    int pending;
+} CallGraph;
+
+// Integer value of a literal node, 0 if it is not one
+static int literal_value(const ASTNode *node, int *value) {
+    if (!node) return 0;
+    if (node->type == AST_INTEGER) {
+        *value = node->data.integer.value;
+        return 1;
+    }
+    if (node->type == AST_CHARACTER) {
+        *value = (unsigned char)node->data.character.value;
+        return 1;
+    }
+    return 0;
+}
+
+// Record a declaration in the innermost scope
+static void declare(Pruner *pruner, const char *name) {
+    if (!symtab_declare(&pruner->symbols, name, SYM_LOCAL)) pruner->failed = 1;
+}
+
+// Flag an identifier lowering would report as undeclared
+static int find_undeclared(ASTVisit *visit, void *context) {
+    NameCheck *check = (NameCheck*)context;
+    const ASTNode *node = visit->node;
+    if (node->type != AST_IDENTIFIER) return 1;
+    // Callees are not looked up, they may be defined by another unit
+    const ASTNode *parent = visit->parent;
+    if (parent && parent->type == AST_CALL_EXPR && parent->data.call_expr.function == node) return 1;
+    if (!symtab_lookup(check->symbols, node->data.identifier.name)) check->undeclared = 1;
+    return 1;
+}
+
+// Check that every name an expression reads is in scope
+static int names_resolve(Pruner *pruner, ASTNode *node) {
+    if (!node) return 1;
+    NameCheck check = { &pruner->symbols, 0 };
+    if (!ast_walk(node, 0, find_undeclared, NULL, &check)) return 0;
+    return !check.undeclared;
+}
+
+// Check the names of a statement, declaring its locals as lowering would
+static int statement_resolves(Pruner *pruner, ASTNode *node) {
+    if (!node) return 1;
+    switch (node->type) {
+        case AST_COMPOUND_STMT: {
+            int mark = symtab_open_scope(&pruner->symbols);
+            int resolved = 1;
+            for (int i = 0; resolved && i < node->num_children; i++) {
+                resolved = statement_resolves(pruner, node->children[i]);
+            }
+            symtab_close_scope(&pruner->symbols, mark);
+            return resolved;
+        }
+        case AST_VARIABLE_DECL:
+            // The initializer cannot see the variable it initializes yet
+            if (!names_resolve(pruner, node->data.variable_decl.initializer)) return 0;
+            declare(pruner, node->data.variable_decl.name);
+            return !pruner->failed;
+        case AST_EXPR_STMT:
+            return node->num_children == 0 || names_resolve(pruner, node->children[0]);
+        case AST_IF_STMT:
+            return names_resolve(pruner, node->data.if_stmt.condition) &&
+                   statement_resolves(pruner, node->data.if_stmt.if_branch) &&
+                   statement_resolves(pruner, node->data.if_stmt.else_branch);
+        case AST_WHILE_STMT:
+            return names_resolve(pruner, node->data.while_stmt.condition) &&
+                   statement_resolves(pruner, node->data.while_stmt.body);
+        case AST_RETURN_STMT:
+            return names_resolve(pruner, node->data.return_stmt.value);
+        default:
+            return 1;
+    }
+}
+
+// Check whether dead code can go without hiding a diagnostic; its locals do not stay in scope
+static int droppable(Pruner *pruner, ASTNode *node) {
+    if (pruner->failed) return 0;
+    int mark = symtab_open_scope(&pruner->symbols);
+    int resolved = statement_resolves(pruner, node);
+    symtab_close_scope(&pruner->symbols, mark);
+    return resolved;
+}
+
+// Turn a statement into an empty block, keeping its span
+static void make_empty(ASTNode *node) {
+    node->type = AST_COMPOUND_STMT;
+    node->children = NULL;
+    node->num_children = 0;
+    node->children_capacity = 0;
+}
+
+// Replace a statement by the branch that survives it
+static void replace_statement(ASTNode *node, ASTNode *with, Arena *arena) {
+    if (with->type != AST_VARIABLE_DECL) {
+        *node = *with;
+        return;
+    }
+    // A declaration keeps its own scope, the one the branch gave it
+    make_empty(node);
+    add_child(arena, node, with);
+}
+
+// Check whether control never reaches the end of a statement
+static int never_completes(const ASTNode *node) {
+    int value;
+    switch (node->type) {
+        case AST_RETURN_STMT:
+            return 1;
+        case AST_COMPOUND_STMT:
+            return node->num_children > 0 && never_completes(node->children[node->num_children - 1]);
+        case AST_IF_STMT:
+            return node->data.if_stmt.else_branch && never_completes(node->data.if_stmt.if_branch) &&
+                   never_completes(node->data.if_stmt.else_branch);
+        case AST_WHILE_STMT:
+            // There is no break, so only a return leaves an infinite loop
+            return literal_value(node->data.while_stmt.condition, &value) && value != 0;
+        default:
+            return 0;
+    }
+}
+
+// Prune a statement in place, returns 0 when nothing of it is left
+static int prune_statement(Pruner *pruner, ASTNode *node) {
+    int value;
+    switch (node->type) {
+        case AST_COMPOUND_STMT: {
+            int mark = symtab_open_scope(&pruner->symbols);
+            int kept = 0;
+            int i = 0;
+            while (i < node->num_children) {
+                ASTNode *child = node->children[i++];
+                if (prune_statement(pruner, child)) node->children[kept++] = child;
+                if (never_completes(child)) break;
+            }
+            // The rest can never run, but an undeclared name in it is still an error
+            int rest = node->num_children - i;
+            ASTNode rest_block = *node;
+            rest_block.children = node->children + i;
+            rest_block.num_children = rest;
+            if (rest > 0 && !droppable(pruner, &rest_block)) {
+                memmove(node->children + kept, node->children + i, rest * sizeof(ASTNode*));
+                kept += rest;
+            }
+            symtab_close_scope(&pruner->symbols, mark);
+            node->num_children = kept;
+            return kept > 0;
+        }
+        case AST_VARIABLE_DECL:
+            declare(pruner, node->data.variable_decl.name);
+            return 1;
+        case AST_IF_STMT: {
+            if (!literal_value(node->data.if_stmt.condition, &value)) {
+                prune_statement(pruner, node->data.if_stmt.if_branch);
+                if (node->data.if_stmt.else_branch) prune_statement(pruner, node->data.if_stmt.else_branch);
+                return 1;
+            }
+            ASTNode *live = value ? node->data.if_stmt.if_branch : node->data.if_stmt.else_branch;
+            ASTNode *dead = value ? node->data.if_stmt.else_branch : node->data.if_stmt.if_branch;
+            if (dead && !droppable(pruner, dead)) return 1;
+            // A declaration left alone gets a block of its own, so nothing stays in scope
+            int mark = symtab_open_scope(&pruner->symbols);
+            int live_kept = live && prune_statement(pruner, live);
+            symtab_close_scope(&pruner->symbols, mark);
+            if (!live_kept) {
+                make_empty(node);
+                return 0;
+            }
+            replace_statement(node, live, pruner->arena);
+            return 1;
+        }
+        case AST_WHILE_STMT:
+            if (literal_value(node->data.while_stmt.condition, &value) && value == 0) {
+                if (!droppable(pruner, node->data.while_stmt.body)) return 1;
+                make_empty(node);
+                return 0;
+            }
+            prune_statement(pruner, node->data.while_stmt.body);
+            return 1;
+        case AST_EXPR_STMT: {
+            // Empty statements and bare literals do nothing
+            if (node->num_children == 0) return 0;
+            ASTNodeType type = node->children[0]->type;
+            return type != AST_INTEGER && type != AST_CHARACTER && type != AST_STRING;
+        }
+        default:
+            return 1;
+    }
+}
+
+// Order functions by the address of their interned name
+static int compare_functions(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)(*(ASTNode* const*)a)->data.function.name;
+    uintptr_t y = (uintptr_t)(*(ASTNode* const*)b)->data.function.name;
+    return x < y ? -1 : x > y;
+}
+
+// Index of the function defined under a name, -1 if there is none
+static int find_function(const CallGraph *graph, const char *name) {
+    int low = 0;
+    int high = graph->count - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const char *key = graph->functions[middle]->data.function.name;
+        if (key == name) return middle;
+        if ((uintptr_t)key < (uintptr_t)name) low = middle + 1;
+        else high = middle - 1;
+    }
+    return -1;
+}
+
+// Mark a function as reachable and queue its body
+static void reach(CallGraph *graph, const char *name) {
+    int index = find_function(graph, name);
+    if (index < 0 || graph->reachable[index]) return;
+    graph->reachable[index] = 1;
+    graph->worklist[graph->pending++] = index;
+}
+
+// Mark the callee of a call
+static int reach_call(ASTVisit *visit, void *context) {
+    const ASTNode *node = visit->node;
+    if (node->type == AST_CALL_EXPR) {
+        const ASTNode *callee = node->data.call_expr.function;
+        if (callee && callee->type == AST_IDENTIFIER) reach((CallGraph*)context, callee->data.identifier.name);
+    }
+    return 1;
+}
+
+// Declare a top-level name; lowering makes a function visible before its body
+static void declare_top_level(Pruner *pruner, const ASTNode *node) {
+    if (node->type == AST_FUNCTION) declare(pruner, node->data.function.name);
+    else if (node->type == AST_VARIABLE_DECL) declare(pruner, node->data.variable_decl.name);
+}
+
+// Open the scope of a function with its parameters declared, returns its mark
+static int open_function(Pruner *pruner, const ASTNode *node) {
+    int mark = symtab_open_scope(&pruner->symbols);
+    const ASTNode *parameters = node->data.function.parameters;
+    for (int i = 0; parameters && i < parameters->num_children; i++) {
+        declare(pruner, parameters->children[i]->data.parameter.name);
+    }
+    return mark;
+}
+
+// Check whether a whole function can go without hiding a diagnostic
+static int function_droppable(Pruner *pruner, const ASTNode *node) {
+    int mark = open_function(pruner, node);
+    int resolved = !pruner->failed && statement_resolves(pruner, node->data.function.body);
+    symtab_close_scope(&pruner->symbols, mark);
+    return resolved && !pruner->failed;
+}
+
+// Drop the function definitions main never reaches
+static void remove_unreachable_functions(Pruner *pruner, ASTNode *program) {
+    CallGraph graph;
+    graph.count = 0;
+    graph.pending = 0;
+    for (int i = 0; i < program->num_children; i++) {
+        ASTNode *node = program->children[i];
+        if (node->type == AST_FUNCTION && node->data.function.body) graph.count++;
+    }
+    if (graph.count == 0) return;
+
+    graph.functions = (ASTNode**)malloc(graph.count * sizeof(ASTNode*));
+    graph.reachable = (char*)calloc(graph.count, 1);
+    graph.worklist = (int*)malloc(graph.count * sizeof(int));
+    if (graph.functions && graph.reachable && graph.worklist) {
+        int n = 0;
+        for (int i = 0; i < program->num_children; i++) {
+            ASTNode *node = program->children[i];
+            if (node->type == AST_FUNCTION && node->data.function.body) graph.functions[n++] = node;
+        }
+        qsort(graph.functions, graph.count, sizeof(ASTNode*), compare_functions);
+
+        if (find_function(&graph, intern_cstr("main")) >= 0) {
+            reach(&graph, intern_cstr("main"));
+            while (graph.pending > 0) {
+                ASTNode *body = graph.functions[graph.worklist[--graph.pending]]->data.function.body;
+                if (!ast_walk(body, 0, reach_call, NULL, &graph)) {
+                    // Without the whole call graph, every function has to stay
+                    memset(graph.reachable, 1, graph.count);
+                    break;
+                }
+            }
+
+            // Top-level names come back into scope in source order, as each function saw them
+            symtab_close_scope(&pruner->symbols, 0);
+            int kept = 0;
+            for (int i = 0; i < program->num_children; i++) {
+                ASTNode *node = program->children[i];
+                declare_top_level(pruner, node);
+                if (node->type == AST_FUNCTION && node->data.function.body &&
+                    !graph.reachable[find_function(&graph, node->data.function.name)] &&
+                    function_droppable(pruner, node)) {
+                    continue;
+                }
+                program->children[kept++] = node;
+            }
+            program->num_children = kept;
+        }
+    }
+    free(graph.functions);
+    free(graph.reachable);
+    free(graph.worklist);
+}
+
+// Remove the dead code of a program
+void eliminate_dead_code(ASTNode *program, Arena *arena, int whole_program) {
+    if (!program) return;
+    Pruner pruner;
+    pruner.arena = arena;
+    pruner.failed = 0;
+    symtab_init(&pruner.symbols);
+    for (int i = 0; i < program->num_children; i++) {
+        ASTNode *node = program->children[i];
+        declare_top_level(&pruner, node);
+        if (node->type == AST_FUNCTION && node->data.function.body) {
+            int mark = open_function(&pruner, node);
+            prune_statement(&pruner, node->data.function.body);
+            symtab_close_scope(&pruner.symbols, mark);
+        }
+    }
+    if (whole_program) remove_unreachable_functions(&pruner, program);
+    symtab_free(&pruner.symbols);
+}
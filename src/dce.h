@@ -0,0 +1,20 @@
+/**
+ * Dead Code Elimination Header
+ *
+ * Prunes a folded AST (fold.h) before it is lowered: branches behind a
+ * constant condition, loops that never run, statements that follow a
+ * return, and in whole-program builds functions that main never calls.
+ * Dead code naming an undeclared identifier is kept for lowering to report.
+ */
+
+#ifndef DCE_H
+#define DCE_H
+
+#include "arena.h"
+#include "ast.h"
+
+// Remove the dead code of a program in place. Unreachable functions are only
+// removed when whole_program says no other unit can call them.
+void eliminate_dead_code(ASTNode *program, Arena *arena, int whole_program);
+
+#endif // DCE_H
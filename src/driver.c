@@ -0,0 +1,466 @@
+/**
+ * Compiler Driver Implementation
+ *
+ * Several inputs are compiled on the work-stealing pool, each job writing
+ * into memory streams that are emitted in input order afterwards, so the
+ * output never depends on scheduling.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "driver.h"
+#include "lexeme.h"
+#include "parser.h"
+#include "preproc.h"
+#include "ast.h"
+#include "ast_cache.h"
+#include "flat_ast.h"
+#include "intern.h"
+#include "stats.h"
+#include "error.h"
+#include "pool.h"
+#include "codegen.h"
+#include "emit.h"
+#include "lower.h"
+#include "ssa.h"
+#include "fold.h"
+#include "dce.h"
+#include "peephole.h"
+#include "elf.h"
+
+// One input of a parallel run, with its buffered output
+typedef struct {
+    const char *input;
+    char *out_text;      // What the compilation wrote to stdout
+    size_t out_size;
+    char *err_text;      // What the compilation wrote to stderr
+    size_t err_size;
+    int status;          // 0 on success, 1 if errors were reported
+} CompileJob;
+
+// Work shared by the pool jobs of a run
+typedef struct {
+    Driver *driver;
+    const CompileOptions *options;
+    CompileJob *jobs;
+} DriverContext;
+
+// Create a driver with no warm state yet
+Driver* driver_create(void) {
+    Driver *driver = (Driver*)calloc(1, sizeof(Driver));
+    return driver;
+}
+
+// Free a driver and its arenas
+void driver_destroy(Driver *driver) {
+    if (!driver) return;
+    for (int i = 0; i < driver->num_arenas; i++) {
+        arena_destroy(driver->arenas[i]);
+        emitter_destroy(driver->dumpers[i]);
+    }
+    free(driver->arenas);
+    free(driver->dumpers);
+    free(driver);
+}
+
+// Make sure there is one arena and one dump stream per compile thread
+static int reserve_arenas(Driver *driver, int count) {
+    if (count <= driver->num_arenas) return 1;
+    
+    Arena **arenas = (Arena**)realloc(driver->arenas, count * sizeof(Arena*));
+    if (!arenas) return 0;
+    driver->arenas = arenas;
+    Emitter **dumpers = (Emitter**)realloc(driver->dumpers, count * sizeof(Emitter*));
+    if (!dumpers) return 0;
+    driver->dumpers = dumpers;
+    
+    while (driver->num_arenas < count) {
+        Arena *arena = arena_create(0);
+        Emitter *dumper = emitter_create(-1);
+        if (!arena || !dumper) {
+            arena_destroy(arena);
+            emitter_destroy(dumper);
+            return 0;
+        }
+        driver->arenas[driver->num_arenas] = arena;
+        driver->dumpers[driver->num_arenas++] = dumper;
+    }
+    return 1;
+}
+
+// Path of the output written for an input: its base name with a .s or .o suffix
+static char* output_path(const char *input, const char *suffix) {
+    const char *base = strrchr(input, '/');
+    base = base ? base + 1 : input;
+    const char *dot = strrchr(base, '.');
+    size_t length = dot && dot != base ? (size_t)(dot - base) : strlen(base);
+    
+    char *path = (char*)malloc(length + 3);
+    if (!path) return NULL;
+    memcpy(path, base, length);
+    memcpy(path + length, suffix, 3);
+    return path;
+}
+
+// Fold, prune and lower a unit to IR, in SSA form with -fssa; NULL once errors were reported
+static IRProgram* lower_unit(const CompileOptions *options, ASTNode *program, Lexer *lexer,
+                             Arena *arena) {
+    fold_program(program, arena);
+    eliminate_dead_code(program, arena, options->whole_program);
+    IRProgram *ir = lower_program(program, lexer);
+    if (!ir || !options->ssa) return ir;
+    for (int i = 0; i < ir->num_functions; i++) {
+        if (ssa_construct(&ir->functions[i])) ssa_propagate_copies(&ir->functions[i]);
+    }
+    return ir;
+}
+
+// Generate the code of a unit and write it as assembly or as an object, returns 0 on failure
+static int write_output(const CompileOptions *options, const char *input, IRProgram *ir,
+                          DiagEngine *diag) {
+    for (int i = 0; i < ir->num_functions; i++) {
+        if (!ssa_destruct(&ir->functions[i])) {
+            diag_report(diag, DIAG_ERROR, DIAG_INTERNAL_ERROR, NULL, 0, 0, "SSA destruction");
+            return 0;
+        }
+    }
+    ArmModule *module = codegen_program(ir);
+    if (!module) {
+        diag_report(diag, DIAG_ERROR, DIAG_INTERNAL_ERROR, NULL, 0, 0, "code generation");
+        return 0;
+    }
+    peephole_module(module);
+    
+    char *derived = options->output ? NULL : output_path(input, options->emit_object ? ".o" : ".s");
+    const char *path = options->output ? options->output : derived;
+    int ok = path != NULL;
+    int fd = ok ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    Emitter *out = fd >= 0 ? emitter_create(fd) : NULL;
+    ok = out != NULL;
+    const char *unencodable = NULL;
+    if (ok) ok = options->emit_object ? arm_write_object(module, out, &unencodable) : arm_write_assembly(module, out);
+    if (out && !emitter_destroy(out)) ok = 0;
+    if (fd >= 0 && close(fd) != 0) ok = 0;
+    if (!ok && fd >= 0) unlink(path);  // No partial output for a failed unit
+    if (unencodable) {
+        diag_report(diag, DIAG_ERROR, DIAG_CANNOT_ENCODE, NULL, 0, 0, unencodable);
+    } else if (!ok) {
+        diag_report(diag, DIAG_ERROR, DIAG_CANNOT_WRITE_FILE, NULL, 0, 0, path ? path : input);
+    }
+    
+    free(derived);
+    arm_module_free(module);
+    return ok;
+}
+
+// Compile one file into the AST arena, writing the dump to out through dumper and
+// diagnostics to err
+static int compile_file(const CompileOptions *options, const char *input, Arena *arena,
+                        Emitter *dumper, FILE *out, FILE *err) {
+    CompileStats stats;
+    init_stats(&stats);
+    
+    DiagEngine *diag = diag_create(err);
+    if (!diag) return 1;
+    if (options->max_errors >= 0) diag_set_max_errors(diag, options->max_errors);
+    
+    StatsTimer timer = stats_timer_start();
+    FILE *F = fopen(input, "r");
+    if (!F) {
+        diag_report(diag, DIAG_ERROR, DIAG_CANNOT_OPEN_FILE, NULL, 0, 0, input);
+        diag_flush(diag);
+        diag_destroy(diag);
+        return 1;
+    }
+    // The JSON dump names its file itself, one document per line
+    if (options->dump_ast != AST_DUMP_JSON) fprintf(out, "le fichier :%s\n", input);
+    
+    Lexer *LC = init_lexer(F, (char*)input, diag);
+    stats_timer_stop(&stats, PHASE_READ, timer);
+    if (!LC) {
+        fclose(F);
+        diag_destroy(diag);
+        return 1;
+    }
+    if (options->time_report) LC->stats = &stats;
+    
+    timer = stats_timer_start();
+    arena_reset(arena);  // The previous input's AST is no longer referenced
+    arena->peak_bytes = 0;  // Report the peak of this input only
+    
+    // An unchanged unit is rebuilt from its cached tree instead of being parsed
+    unsigned long long key = 0;
+    ASTNode *as = NULL;
+    Parser *parse = NULL;
+    if (options->cache_dir) {
+        key = ast_cache_key(LC->buffer, (size_t)LC->buffer_size, &options->preproc);
+        FlatAST *cached = ast_cache_load(options->cache_dir, key);
+        as = flat_ast_to_tree(cached, arena);
+        if (as) stats.cache_hits++;
+        free_flat_ast(cached);
+    }
+    
+    if (!as) {
+        // Large inputs can be lexed up front on several threads, which parsing
+        // function bodies in parallel also needs
+        if (options->lex_threads > 1 || options->parse_threads > 1) {
+            lexer_lex_all(LC, options->lex_threads);
+        }
+        preprocess(LC, &options->preproc, options->lex_threads);
+        parse = init_parser(LC, arena); 
+        as = parse_program_parallel(parse, options->parse_threads);
+    }
+    stats_timer_stop(&stats, PHASE_PARSE, timer);
+    diag_flush(diag);
+    
+    // Only error-free units are cached, a hit has no diagnostics to replay
+    if (options->cache_dir && parse && as && diag_error_count(diag) == 0) {
+        FlatAST *flat = flat_ast_from_tree(as);
+        if (flat) ast_cache_store(options->cache_dir, key, flat, LC);
+        free_flat_ast(flat);
+    }
+    
+    int failed = 0;  // The backend gave up on the unit
+    if (options->emit_assembly || options->emit_object || options->dump_ir) {
+        // Only error-free units reach the backend
+        if (diag_error_count(diag) == 0) {
+            timer = stats_timer_start();
+            IRProgram *ir = lower_unit(options, as, LC, arena);
+            if (ir && options->dump_ir) ir_print_program(out, ir);
+            if (ir && (options->emit_assembly || options->emit_object) && !write_output(options, input, ir, diag)) {
+                failed = 1;
+            }
+            ir_free_program(ir);
+            stats_timer_stop(&stats, PHASE_CODEGEN, timer);
+        }
+    } else if (options->dump_ast != AST_DUMP_NONE) {
+        timer = stats_timer_start();
+        emitter_set_file(dumper, out);
+        if (options->dump_ast == AST_DUMP_JSON) ast_dump_json(dumper, input, as);
+        else ast_dump_text(dumper, as, 10);
+        emitter_flush(dumper);
+        emitter_set_file(dumper, NULL);
+        stats_timer_stop(&stats, PHASE_DUMP, timer);
+    }
+    
+    if (options->time_report) {
+        fflush(out);
+        stats.tokens = LC->num_tokens;
+        stats.bytes_scanned = (unsigned long)LC->buffer_size;
+        stats.buffer_reads = LC->num_reads;
+        stats.ast_nodes = (unsigned long)ast_count_nodes(as);
+        stats.peak_bytes = (size_t)LC->buffer_size + arena->peak_bytes + intern_memory_usage();
+        stats_report(&stats, err);
+    }
+    
+    free_parser(parse);
+    free_lexer(LC);
+    fclose(F);
+    
+    int status = failed || diag_error_count(diag) > 0 ? 1 : 0;
+    diag_flush(diag);
+    diag_destroy(diag);
+    return status;
+}
+
+// Pool job: compile one input into memory buffers, emitted later in input order
+static void compile_job(void *context, size_t index, int worker) {
+    DriverContext *run = (DriverContext*)context;
+    CompileJob *job = &run->jobs[index];
+    
+    FILE *out = open_memstream(&job->out_text, &job->out_size);
+    FILE *err = open_memstream(&job->err_text, &job->err_size);
+    if (!out || !err) {
+        if (out) fclose(out);
+        if (err) fclose(err);
+        job->status = 1;
+        return;
+    }
+    
+    job->status = compile_file(run->options, job->input, run->driver->arenas[worker],
+                               run->driver->dumpers[worker], out, err);
+    fclose(out);
+    fclose(err);
+}
+
+// Compile every input, returns 0 if all of them compiled without errors
+int driver_compile(Driver *driver, const CompileOptions *options, const InputList *inputs,
+                   FILE *out, FILE *err) {
+    int threads = options->jobs > 0 ? options->jobs : pool_cpu_count();
+    if (threads > inputs->count) threads = inputs->count;
+    if (threads < 1) threads = 1;
+    
+    if (!reserve_arenas(driver, threads)) {
+        fprintf(err, "mémoire insuffisante\n");
+        return 1;
+    }
+    
+    int status = 0;
+    if (threads == 1) {
+        // Sequential: write straight to the destination streams, file by file
+        for (int i = 0; i < inputs->count; i++) {
+            if (compile_file(options, inputs->paths[i], driver->arenas[0], driver->dumpers[0], out, err) != 0) status = 1;
+            fflush(out);
+        }
+        return status;
+    }
+    
+    CompileJob *jobs = (CompileJob*)calloc(inputs->count, sizeof(CompileJob));
+    if (!jobs) {
+        fprintf(err, "mémoire insuffisante\n");
+        return 1;
+    }
+    for (int i = 0; i < inputs->count; i++) jobs[i].input = inputs->paths[i];
+    
+    DriverContext run = { driver, options, jobs };
+    pool_run(threads, (size_t)inputs->count, compile_job, &run);
+    
+    // Emit in input order so the output does not depend on scheduling
+    for (int i = 0; i < inputs->count; i++) {
+        fwrite(jobs[i].err_text, 1, jobs[i].err_size, err);
+        fwrite(jobs[i].out_text, 1, jobs[i].out_size, out);
+        fflush(out);
+        if (jobs[i].status != 0) status = 1;
+        free(jobs[i].out_text);
+        free(jobs[i].err_text);
+    }
+    free(jobs);
+    return status;
+}
+
+// Default options of a run
+void init_compile_options(CompileOptions *options) {
+    options->time_report = 0;
+    options->max_errors = -1;
+    options->lex_threads = 1;
+    options->parse_threads = 1;
+    options->jobs = 0;
+    options->preproc.num_include_dirs = 0;
+    options->cache_dir = NULL;
+    options->emit_assembly = 0;
+    options->emit_object = 0;
+    options->output = NULL;
+    options->ssa = 0;
+    options->whole_program = 0;
+    options->dump_ir = 0;
+    options->dump_ast = AST_DUMP_TEXT;
+}
+
+// Append an input path to the list, growing it as needed
+static int add_input(InputList *inputs, const char *path) {
+    if (inputs->count == inputs->capacity) {
+        int capacity = inputs->capacity ? inputs->capacity * 2 : 16;
+        char **paths = (char**)realloc(inputs->paths, capacity * sizeof(char*));
+        if (!paths) return 0;
+        inputs->paths = paths;
+        inputs->capacity = capacity;
+    }
+    char *copy = strdup(path);
+    if (!copy) return 0;
+    inputs->paths[inputs->count++] = copy;
+    return 1;
+}
+
+// Add every whitespace-separated path of a response file
+static int read_response_file(const char *path, InputList *inputs, FILE *err) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(err, "impossible d'ouvrir le fichier de réponse %s\n", path);
+        return 0;
+    }
+    
+    char word[4096];
+    int ok = 1;
+    while (ok && fscanf(file, "%4095s", word) == 1) {
+        ok = add_input(inputs, word);
+    }
+    fclose(file);
+    return ok;
+}
+
+// Parse options and inputs, argv[0] being the program name. Returns 0 on a usage error.
+int parse_arguments(int argc, char **argv, CompileOptions *options, InputList *inputs, FILE *err) {
+    for (int i = 1; i < argc; i++) {
+        int ok = 1;
+        if (strcmp(argv[i], "-ftime-report") == 0) {
+            options->time_report = 1;
+        } else if (strncmp(argv[i], "-fmax-errors=", 13) == 0) {
+            options->max_errors = atoi(argv[i] + 13);
+        } else if (strncmp(argv[i], "-flex-threads=", 14) == 0) {
+            options->lex_threads = atoi(argv[i] + 14);
+        } else if (strncmp(argv[i], "-fparse-threads=", 16) == 0) {
+            options->parse_threads = atoi(argv[i] + 16);
+        } else if (strncmp(argv[i], "-fjobs=", 7) == 0) {
+            options->jobs = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "-fcache-dir=", 12) == 0) {
+            options->cache_dir = argv[i] + 12;
+        } else if (strcmp(argv[i], "-fssa") == 0) {
+            options->ssa = 1;
+        } else if (strcmp(argv[i], "-fwhole-program") == 0) {
+            options->whole_program = 1;
+        } else if (strcmp(argv[i], "-fdump-ir") == 0) {
+            options->dump_ir = 1;
+        } else if (strncmp(argv[i], "--dump-ast=", 11) == 0) {
+            const char *format = argv[i] + 11;
+            if (strcmp(format, "none") == 0) {
+                options->dump_ast = AST_DUMP_NONE;
+            } else if (strcmp(format, "text") == 0) {
+                options->dump_ast = AST_DUMP_TEXT;
+            } else if (strcmp(format, "json") == 0) {
+                options->dump_ast = AST_DUMP_JSON;
+            } else {
+                fprintf(err, "option --dump-ast invalide : %s\n", format);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "-S") == 0) {
+            options->emit_assembly = 1;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            options->emit_object = 1;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 == argc) {
+                fprintf(err, "option -o invalide\n");
+                return 0;
+            }
+            options->output = argv[++i];
+        } else if (strncmp(argv[i], "-I", 2) == 0) {
+            // -Idir or -I dir
+            const char *dir = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : NULL);
+            PreprocOptions *preproc = &options->preproc;
+            if (!dir || preproc->num_include_dirs == MAX_INCLUDE_DIRS) {
+                fprintf(err, "option -I invalide\n");
+                return 0;
+            }
+            preproc->include_dirs[preproc->num_include_dirs++] = dir;
+        } else if (argv[i][0] == '@') {
+            ok = read_response_file(argv[i] + 1, inputs, err);
+        } else {
+            ok = add_input(inputs, argv[i]);
+        }
+        if (!ok) return 0;
+    }
+    
+    if (inputs->count == 0) {
+        fprintf(err, "argument manquant\n");
+        return 0;
+    }
+    if (options->output && inputs->count > 1) {
+        fprintf(err, "option -o invalide avec plusieurs fichiers\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Free the paths of an input list
+void free_input_list(InputList *inputs) {
+    for (int i = 0; i < inputs->count; i++) free(inputs->paths[i]);
+    free(inputs->paths);
+    inputs->paths = NULL;
+    inputs->count = 0;
+    inputs->capacity = 0;
+}
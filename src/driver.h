@@ -0,0 +1,62 @@
+/**
+ * Compiler Driver Header
+ *
+ * Turns a command line into compilations: option parsing, response files,
+ * and running one or many inputs with deterministic, ordered output. A
+ * Driver keeps its per-thread arenas between runs so a long-lived process
+ * (the compile server) compiles with warm allocators.
+ */
+
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stdio.h>
+#include "arena.h"
+#include "ast_dump.h"
+#include "emit.h"
+#include "preproc.h"
+
+// Options shared by every compilation of a run
+typedef struct {
+    int time_report;
+    int max_errors;      // -1 keeps the engine default
+    int lex_threads;
+    int parse_threads;
+    int jobs;            // Threads compiling inputs in parallel, 0 = one per processor
+    PreprocOptions preproc;  // -I directories, pointing into argv
+    const char *cache_dir;   // -fcache-dir, NULL disables the AST cache
+    int emit_assembly;       // -S: write ARM assembly instead of the AST dump
+    int emit_object;         // -c: write an ELF object, bypassing the assembler
+    const char *output;      // -o, NULL derives <input base name>.s, or .o with -c
+    int ssa;                 // -fssa: run the IR through SSA form before code generation
+    int whole_program;       // -fwhole-program: the unit with main is the program, unreached functions go
+    int dump_ir;             // -fdump-ir: print the IR instead of the AST dump
+    ASTDumpFormat dump_ast;  // --dump-ast=none|text|json, text by default
+} CompileOptions;
+
+// Input files of a run
+typedef struct {
+    char **paths;
+    int count;
+    int capacity;
+} InputList;
+
+// State kept between runs
+typedef struct {
+    Arena **arenas;      // One AST arena per compile thread, reset for every input
+    Emitter **dumpers;   // One AST dump stream per compile thread, its buffer reused
+    int num_arenas;
+} Driver;
+
+// Driver functions
+Driver* driver_create(void);
+void driver_destroy(Driver *driver);
+int driver_compile(Driver *driver, const CompileOptions *options, const InputList *inputs,
+                   FILE *out, FILE *err);
+
+// Command line handling (err receives usage errors)
+void init_compile_options(CompileOptions *options);
+int parse_arguments(int argc, char **argv, CompileOptions *options, InputList *inputs, FILE *err);
+void free_input_list(InputList *inputs);
+
+#endif // DRIVER_H
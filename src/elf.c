@@ -0,0 +1,464 @@
+/**
+ * ELF Object Writer Implementation
+ *
+ * Every section is built in memory first, then the file is written in
+ * one go: header, section contents and section header table. The
+ * sections are always the same ten, empty ones included. Symbols of the
+ * code and data are defined by the module; names only referenced by the
+ * code become undefined globals for the linker to resolve. Relocations
+ * are REL ones, their addend left inside the instruction.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "ir.h"
+#include "thumb.h"
+
+// Header values
+#define ELF_HEADER_SIZE 52
+#define SECTION_HEADER_SIZE 40
+#define SYMBOL_SIZE 16
+#define REL_SIZE 8
+#define ET_REL 1
+#define EM_ARM 40
+#define EF_ARM_EABI_VER5 0x05000000
+#define EF_ARM_ABI_FLOAT_SOFT 0x00000200
+
+// Section types and flags
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_NOBITS 8
+#define SHT_REL 9
+#define SHT_ARM_ATTRIBUTES 0x70000003
+#define SHF_WRITE 0x1
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_INFO_LINK 0x40
+
+// Symbol bindings and types
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_NOTYPE 0
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define SYMBOL_INFO(bind, type) ((bind) << 4 | (type))
+
+// Relocation types
+#define R_ARM_THM_CALL 10
+#define R_ARM_THM_MOVW_ABS_NC 47
+#define R_ARM_THM_MOVT_ABS 48
+
+// Sections, in file order
+typedef enum {
+    SEC_NULL,
+    SEC_TEXT,
+    SEC_REL_TEXT,
+    SEC_DATA,
+    SEC_BSS,
+    SEC_RODATA,
+    SEC_ATTRIBUTES,
+    SEC_SYMTAB,
+    SEC_STRTAB,
+    SEC_SHSTRTAB,
+    NUM_SECTIONS
+} SectionIndex;
+
+// Section names, in SectionIndex order
+static const char *section_names[NUM_SECTIONS] = {
+    "", ".text", ".rel.text", ".data", ".bss", ".rodata",
+    ".ARM.attributes", ".symtab", ".strtab", ".shstrtab"
+};
+
+// Build attributes of a Cortex-M3 object: "aeabi" vendor, file scope,
+// CPU name, v7 architecture, M profile, no ARM code, Thumb-2
+static const uint8_t attributes[] = {
+    'A', 34, 0, 0, 0, 'a', 'e', 'a', 'b', 'i', 0,
+    1, 24, 0, 0, 0,
+    5, 'c', 'o', 'r', 't', 'e', 'x', '-', 'm', '3', 0,
+    6, 10, 7, 'M', 8, 0, 9, 2
+};
+
+// Growable byte buffer of a section
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+    int failed;
+} Buffer;
+
+// Section header fields
+typedef struct {
+    uint32_t name;
+    uint32_t type;
+    uint32_t flags;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t link;
+    uint32_t info;
+    uint32_t align;
+    uint32_t entsize;
+    const uint8_t *contents;  // NULL for sections without file contents
+} Section;
+
+// Object under construction
+typedef struct {
+    ThumbCode code;
+    Buffer rel;
+    Buffer data;
+    uint32_t bss_size;
+    Buffer rodata;
+    Buffer symbols;
+    Buffer names;            // .strtab
+    Buffer section_names;    // .shstrtab
+    int num_symbols;
+    int first_global;
+    const char **keys;       // Hash of the symbol names, interned
+    int *indices;
+    int keys_capacity;       // Power of two
+} Object;
+
+// Append bytes to a buffer
+static void put_bytes(Buffer *buffer, const void *bytes, uint32_t length) {
+    if (buffer->failed) return;
+    if (buffer->size + length > buffer->capacity) {
+        uint32_t capacity = buffer->capacity ? buffer->capacity : 256;
+        while (capacity < buffer->size + length) capacity *= 2;
+        uint8_t *data = (uint8_t*)realloc(buffer->data, capacity);
+        if (!data) {
+            buffer->failed = 1;
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    if (length > 0) memcpy(buffer->data + buffer->size, bytes, length);
+    buffer->size += length;
+}
+
+// Append a byte
+static void put_u8(Buffer *buffer, uint32_t value) {
+    uint8_t byte = (uint8_t)value;
+    put_bytes(buffer, &byte, 1);
+}
+
+// Append a little-endian halfword
+static void put_u16(Buffer *buffer, uint32_t value) {
+    uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+    put_bytes(buffer, bytes, 2);
+}
+
+// Append a little-endian word
+static void put_u32(Buffer *buffer, uint32_t value) {
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    put_bytes(buffer, bytes, 4);
+}
+
+// Pad a buffer with zeros to a multiple of align
+static void put_padding(Buffer *buffer, uint32_t align) {
+    while (buffer->size % align != 0) put_u8(buffer, 0);
+}
+
+// Append a NUL-terminated name to a string table, returns its offset
+static uint32_t put_name(Buffer *buffer, const char *name) {
+    uint32_t offset = buffer->size;
+    put_bytes(buffer, name, (uint32_t)strlen(name) + 1);
+    return offset;
+}
+
+// Append a string literal as written between the quotes, escapes decoded
+static void put_string(Buffer *buffer, const char *literal) {
+    for (const char *p = literal; *p; p++) {
+        int c = (unsigned char)*p;
+        if (c == '\\' && p[1]) {
+            p++;
+            switch (*p) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'a': c = '\a'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'v': c = '\v'; break;
+                case 'x':
+                    c = 0;
+                    while (isxdigit((unsigned char)p[1])) {
+                        p++;
+                        c = c * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+                    }
+                    break;
+                default:
+                    if (*p >= '0' && *p <= '7') {
+                        // Up to three octal digits
+                        c = *p - '0';
+                        for (int k = 1; k < 3 && p[1] >= '0' && p[1] <= '7'; k++) c = c * 8 + (*++p - '0');
+                    } else {
+                        c = (unsigned char)*p;
+                    }
+                    break;
+            }
+        }
+        put_u8(buffer, (uint32_t)c);
+    }
+    put_u8(buffer, 0);
+}
+
+// Slot of a name in the symbol hash, or the free slot where it would go
+static int find_key(const Object *object, const char *name) {
+    unsigned mask = (unsigned)object->keys_capacity - 1;
+    unsigned slot = (unsigned)(((uintptr_t)name >> 3) * 2654435761u) & mask;
+    while (object->keys[slot] && object->keys[slot] != name) slot = (slot + 1) & mask;
+    return (int)slot;
+}
+
+// Index of the symbol of an interned name, -1 if it has none yet
+static int symbol_index(const Object *object, const char *name) {
+    int slot = find_key(object, name);
+    return object->keys[slot] ? object->indices[slot] : -1;
+}
+
+// Add a symbol, keyed by its name unless it is a mapping symbol; returns its index
+static int add_symbol(Object *object, const char *name, uint32_t value, uint32_t size, uint32_t info,
+                      uint32_t section, int keyed) {
+    if (keyed) {
+        int slot = find_key(object, name);
+        object->keys[slot] = name;
+        object->indices[slot] = object->num_symbols;
+    }
+    put_u32(&object->symbols, put_name(&object->names, name));
+    put_u32(&object->symbols, value);
+    put_u32(&object->symbols, size);
+    put_u8(&object->symbols, info);
+    put_u8(&object->symbols, 0);
+    put_u16(&object->symbols, section);
+    return object->num_symbols++;
+}
+
+// Symbol hash with room for every defined name and the references
+static int init_keys(Object *object, const ArmModule *module) {
+    int needed = 2 * (module->num_functions + module->num_globals + module->num_strings + object->code.num_relocs) + 1;
+    object->keys_capacity = 64;
+    while (object->keys_capacity < needed) object->keys_capacity *= 2;
+    object->keys = (const char**)calloc(object->keys_capacity, sizeof(const char*));
+    object->indices = (int*)malloc(object->keys_capacity * sizeof(int));
+    return object->keys && object->indices;
+}
+
+// Encode the functions, returns 0 if one could not be encoded, naming
+// it in *unencodable unless memory ran out
+static int build_text(Object *object, const ArmModule *module, uint32_t *starts, const char **unencodable) {
+    for (int i = 0; i < module->num_functions; i++) {
+        starts[i] = object->code.size;
+        if (!thumb_encode_function(&object->code, &module->functions[i])) {
+            if (!object->code.failed && !module->functions[i].failed) *unencodable = module->functions[i].name;
+            return 0;
+        }
+    }
+    starts[module->num_functions] = object->code.size;
+    return 1;
+}
+
+// Lay out the globals and string literals, then define every symbol
+static void build_symbols(Object *object, const ArmModule *module, const uint32_t *starts) {
+    uint32_t *offsets = (uint32_t*)malloc((module->num_globals + module->num_strings + 1) * sizeof(uint32_t));
+    if (!offsets) {
+        object->symbols.failed = 1;
+        return;
+    }
+
+    for (int i = 0; i < module->num_globals; i++) {
+        const ArmGlobal *global = &module->globals[i];
+        uint32_t align = global->align > 0 ? (uint32_t)global->align : 1;
+        if (global->has_value) {
+            put_padding(&object->data, align);
+            offsets[i] = object->data.size;
+            if (global->size == 1) put_u8(&object->data, (uint32_t)global->value);
+            else put_u32(&object->data, (uint32_t)global->value);
+            while (object->data.size < offsets[i] + (uint32_t)global->size) put_u8(&object->data, 0);
+        } else {
+            object->bss_size = (object->bss_size + align - 1) / align * align;
+            offsets[i] = object->bss_size;
+            object->bss_size += (uint32_t)global->size;
+        }
+    }
+    for (int i = 0; i < module->num_strings; i++) {
+        offsets[module->num_globals + i] = object->rodata.size;
+        put_string(&object->rodata, module->strings[i]);
+    }
+
+    // Locals first: mapping symbols marking Thumb code and data, then the literals
+    add_symbol(object, "", 0, 0, 0, SEC_NULL, 0);
+    if (object->code.size > 0) add_symbol(object, "$t", 0, 0, SYMBOL_INFO(STB_LOCAL, STT_NOTYPE), SEC_TEXT, 0);
+    if (object->data.size > 0) add_symbol(object, "$d", 0, 0, SYMBOL_INFO(STB_LOCAL, STT_NOTYPE), SEC_DATA, 0);
+    if (object->rodata.size > 0) add_symbol(object, "$d", 0, 0, SYMBOL_INFO(STB_LOCAL, STT_NOTYPE), SEC_RODATA, 0);
+    for (int i = 0; i < module->num_strings; i++) {
+        uint32_t offset = offsets[module->num_globals + i];
+        uint32_t end = i + 1 < module->num_strings ? offsets[module->num_globals + i + 1] : object->rodata.size;
+        add_symbol(object, ir_string_symbol(i), offset, end - offset, SYMBOL_INFO(STB_LOCAL, STT_OBJECT),
+                   SEC_RODATA, 1);
+    }
+
+    object->first_global = object->num_symbols;
+    for (int i = 0; i < module->num_functions; i++) {
+        // Bit 0 of a Thumb function address is set
+        add_symbol(object, module->functions[i].name, starts[i] | 1, starts[i + 1] - starts[i],
+                   SYMBOL_INFO(STB_GLOBAL, STT_FUNC), SEC_TEXT, 1);
+    }
+    for (int i = 0; i < module->num_globals; i++) {
+        const ArmGlobal *global = &module->globals[i];
+        add_symbol(object, global->name, offsets[i], (uint32_t)global->size, SYMBOL_INFO(STB_GLOBAL, STT_OBJECT),
+                   global->has_value ? SEC_DATA : SEC_BSS, 1);
+    }
+    free(offsets);
+}
+
+// Write the relocations of the code, adding the symbols it needs from elsewhere
+static void build_relocations(Object *object) {
+    for (int i = 0; i < object->code.num_relocs; i++) {
+        const ThumbReloc *reloc = &object->code.relocs[i];
+        int symbol = symbol_index(object, reloc->symbol);
+        if (symbol < 0) {
+            symbol = add_symbol(object, reloc->symbol, 0, 0, SYMBOL_INFO(STB_GLOBAL, STT_NOTYPE), SEC_NULL, 1);
+        }
+        uint32_t type = reloc->kind == THUMB_RELOC_CALL ? R_ARM_THM_CALL :
+                        reloc->kind == THUMB_RELOC_MOVW ? R_ARM_THM_MOVW_ABS_NC : R_ARM_THM_MOVT_ABS;
+        put_u32(&object->rel, reloc->offset);
+        put_u32(&object->rel, (uint32_t)symbol << 8 | type);
+    }
+}
+
+// Fill a section header
+static void set_section(Section *section, uint32_t type, uint32_t flags, uint32_t align,
+                        const uint8_t *contents, uint32_t size) {
+    section->type = type;
+    section->flags = flags;
+    section->align = align;
+    section->contents = contents;
+    section->size = size;
+    section->link = 0;
+    section->info = 0;
+    section->entsize = 0;
+}
+
+// Write a little-endian word to the stream
+static void emit_u32(Emitter *out, uint32_t value) {
+    char bytes[4] = { (char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24) };
+    emit_bytes(out, bytes, 4);
+}
+
+// Write a little-endian halfword to the stream
+static void emit_u16(Emitter *out, uint32_t value) {
+    char bytes[2] = { (char)value, (char)(value >> 8) };
+    emit_bytes(out, bytes, 2);
+}
+
+// Write the file: header, section contents, section header table
+static void write_file(Emitter *out, Object *object) {
+    Section sections[NUM_SECTIONS];
+    memset(sections, 0, sizeof(sections));
+    for (int i = 0; i < NUM_SECTIONS; i++) sections[i].name = put_name(&object->section_names, section_names[i]);
+
+    set_section(&sections[SEC_TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4, object->code.bytes,
+                object->code.size);
+    set_section(&sections[SEC_REL_TEXT], SHT_REL, SHF_INFO_LINK, 4, object->rel.data, object->rel.size);
+    sections[SEC_REL_TEXT].link = SEC_SYMTAB;
+    sections[SEC_REL_TEXT].info = SEC_TEXT;
+    sections[SEC_REL_TEXT].entsize = REL_SIZE;
+    set_section(&sections[SEC_DATA], SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 4, object->data.data, object->data.size);
+    set_section(&sections[SEC_BSS], SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 4, NULL, object->bss_size);
+    set_section(&sections[SEC_RODATA], SHT_PROGBITS, SHF_ALLOC, 4, object->rodata.data, object->rodata.size);
+    set_section(&sections[SEC_ATTRIBUTES], SHT_ARM_ATTRIBUTES, 0, 1, attributes, sizeof(attributes));
+    set_section(&sections[SEC_SYMTAB], SHT_SYMTAB, 0, 4, object->symbols.data, object->symbols.size);
+    sections[SEC_SYMTAB].link = SEC_STRTAB;
+    sections[SEC_SYMTAB].info = (uint32_t)object->first_global;
+    sections[SEC_SYMTAB].entsize = SYMBOL_SIZE;
+    set_section(&sections[SEC_STRTAB], SHT_STRTAB, 0, 1, object->names.data, object->names.size);
+    set_section(&sections[SEC_SHSTRTAB], SHT_STRTAB, 0, 1, object->section_names.data,
+                object->section_names.size);
+
+    // Contents follow the header in section order, each aligned
+    uint32_t position = ELF_HEADER_SIZE;
+    for (int i = 1; i < NUM_SECTIONS; i++) {
+        position = (position + sections[i].align - 1) / sections[i].align * sections[i].align;
+        sections[i].offset = position;
+        if (sections[i].type != SHT_NOBITS) position += sections[i].size;
+    }
+    uint32_t table = (position + 3) / 4 * 4;
+
+    static const char ident[16] = { 0x7f, 'E', 'L', 'F', 1, 1, 1 };
+    emit_bytes(out, ident, sizeof(ident));
+    emit_u16(out, ET_REL);
+    emit_u16(out, EM_ARM);
+    emit_u32(out, 1);             // Version
+    emit_u32(out, 0);             // Entry
+    emit_u32(out, 0);             // Program headers
+    emit_u32(out, table);
+    emit_u32(out, EF_ARM_EABI_VER5 | EF_ARM_ABI_FLOAT_SOFT);
+    emit_u16(out, ELF_HEADER_SIZE);
+    emit_u16(out, 0);
+    emit_u16(out, 0);
+    emit_u16(out, SECTION_HEADER_SIZE);
+    emit_u16(out, NUM_SECTIONS);
+    emit_u16(out, SEC_SHSTRTAB);
+
+    position = ELF_HEADER_SIZE;
+    for (int i = 1; i < NUM_SECTIONS; i++) {
+        if (sections[i].type == SHT_NOBITS) continue;
+        for (; position < sections[i].offset; position++) emit_char(out, 0);
+        if (sections[i].size > 0) emit_bytes(out, (const char*)sections[i].contents, sections[i].size);
+        position += sections[i].size;
+    }
+    for (; position < table; position++) emit_char(out, 0);
+
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        const Section *section = &sections[i];
+        emit_u32(out, section->name);
+        emit_u32(out, section->type);
+        emit_u32(out, section->flags);
+        emit_u32(out, 0);         // Address
+        emit_u32(out, i == SEC_NULL ? 0 : section->offset);
+        emit_u32(out, section->size);
+        emit_u32(out, section->link);
+        emit_u32(out, section->info);
+        emit_u32(out, i == SEC_NULL ? 0 : section->align);
+        emit_u32(out, section->entsize);
+    }
+}
+
+// Write the module as an ELF object, returns 0 on failure
+int arm_write_object(const ArmModule *module, Emitter *out, const char **unencodable) {
+    Object object;
+    memset(&object, 0, sizeof(Object));
+    *unencodable = NULL;
+    thumb_code_init(&object.code);
+    put_u8(&object.names, 0);
+
+    uint32_t *starts = (uint32_t*)malloc((module->num_functions + 1) * sizeof(uint32_t));
+    int ok = starts && !module->failed && build_text(&object, module, starts, unencodable) && init_keys(&object, module);
+    if (ok) {
+        build_symbols(&object, module, starts);
+        build_relocations(&object);
+        ok = !object.rel.failed && !object.data.failed && !object.rodata.failed && !object.symbols.failed &&
+             !object.names.failed;
+    }
+    if (ok) {
+        write_file(out, &object);
+        ok = !object.section_names.failed && !out->failed;
+    }
+
+    free(starts);
+    thumb_code_free(&object.code);
+    free(object.rel.data);
+    free(object.data.data);
+    free(object.rodata.data);
+    free(object.symbols.data);
+    free(object.names.data);
+    free(object.section_names.data);
+    free(object.keys);
+    free(object.indices);
+    return ok;
+}
@@ -0,0 +1,21 @@
+/**
+ * ELF Object Writer Header
+ *
+ * Writes a module of the ARM backend (arm.h) as an ELF32 relocatable
+ * object for ARM EABI, the code encoded by the Thumb-2 encoder
+ * (thumb.h), so that no assembler has to run between code generation
+ * and the linker.
+ */
+
+#ifndef ELF_H
+#define ELF_H
+
+#include "arm.h"
+#include "emit.h"
+
+// Write the module as an ELF object, returns 0 on failure. When an
+// instruction has no encoding, *unencodable is set to the name of its
+// function; otherwise it is left NULL and the failure is the stream's.
+int arm_write_object(const ArmModule *module, Emitter *out, const char **unencodable);
+
+#endif // ELF_H
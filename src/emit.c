@@ -0,0 +1,152 @@
+/**
+ * Emission Stream Implementation
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emit.h"
+
+// Create a stream writing to fd
+Emitter* emitter_create(int fd) {
+    Emitter *emitter = (Emitter*)malloc(sizeof(Emitter));
+    if (!emitter) return NULL;
+
+    emitter->buffer = (char*)malloc(EMIT_BUFFER_SIZE);
+    if (!emitter->buffer) {
+        free(emitter);
+        return NULL;
+    }
+    emitter->fd = fd;
+    emitter->file = NULL;
+    emitter->length = 0;
+    emitter->capacity = EMIT_BUFFER_SIZE;
+    emitter->failed = 0;
+    emitter->num_writes = 0;
+    return emitter;
+}
+
+// Write the pending bytes, looping over partial writes to a descriptor
+int emitter_flush(Emitter *emitter) {
+    if (emitter->file && !emitter->failed) {
+        if (fwrite(emitter->buffer, 1, emitter->length, emitter->file) != emitter->length) emitter->failed = 1;
+        emitter->num_writes++;
+        emitter->length = 0;
+        return !emitter->failed;
+    }
+    if (emitter->fd < 0 || emitter->failed) return !emitter->failed;
+
+    size_t done = 0;
+    while (done < emitter->length) {
+        ssize_t written = write(emitter->fd, emitter->buffer + done, emitter->length - done);
+        if (written < 0 && errno == EINTR) continue;
+        emitter->num_writes++;
+        if (written <= 0) {
+            emitter->failed = 1;
+            break;
+        }
+        done += (size_t)written;
+    }
+    emitter->length = 0;
+    return !emitter->failed;
+}
+
+// Flush and free a stream
+int emitter_destroy(Emitter *emitter) {
+    if (!emitter) return 0;
+    int ok = emitter_flush(emitter);
+    free(emitter->buffer);
+    free(emitter);
+    return ok;
+}
+
+// Point a stream at a stdio stream
+void emitter_set_file(Emitter *emitter, FILE *file) {
+    emitter->file = file;
+    emitter->length = 0;
+    emitter->failed = 0;
+}
+
+// Make room for length more bytes: flush to the descriptor, or grow an in-memory stream
+static int reserve(Emitter *emitter, size_t length) {
+    if (emitter->failed) return 0;
+    if (emitter->length + length <= emitter->capacity) return 1;
+
+    if (emitter->fd >= 0 || emitter->file) {
+        if (!emitter_flush(emitter)) return 0;
+        if (length <= emitter->capacity) return 1;
+    }
+
+    size_t capacity = emitter->capacity;
+    while (emitter->length + length > capacity) capacity *= 2;
+    char *buffer = (char*)realloc(emitter->buffer, capacity);
+    if (!buffer) {
+        emitter->failed = 1;
+        return 0;
+    }
+    emitter->buffer = buffer;
+    emitter->capacity = capacity;
+    return 1;
+}
+
+// Append raw bytes
+void emit_bytes(Emitter *emitter, const char *bytes, size_t length) {
+    if (!reserve(emitter, length)) return;
+    memcpy(emitter->buffer + emitter->length, bytes, length);
+    emitter->length += length;
+}
+
+// Append a '\0'-terminated string
+void emit_str(Emitter *emitter, const char *text) {
+    emit_bytes(emitter, text, strlen(text));
+}
+
+// Append one character
+void emit_char(Emitter *emitter, char c) {
+    if (!reserve(emitter, 1)) return;
+    emitter->buffer[emitter->length++] = c;
+}
+
+// Append a decimal integer
+void emit_int(Emitter *emitter, long value) {
+    char digits[24];
+    int count = 0;
+    unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+
+    do {
+        digits[sizeof(digits) - 1 - count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) digits[sizeof(digits) - 1 - count++] = '-';
+
+    emit_bytes(emitter, digits + sizeof(digits) - count, (size_t)count);
+}
+
+// Append printf-style formatted text, rendered in place when it fits
+void emit_format(Emitter *emitter, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+
+    int length = reserve(emitter, 0) ? vsnprintf(emitter->buffer + emitter->length,
+                                                 emitter->capacity - emitter->length, format, args) : -1;
+    if (length >= 0 && (size_t)length >= emitter->capacity - emitter->length) {
+        // Too long for the space left: make room and render again
+        if (reserve(emitter, (size_t)length + 1)) {
+            vsnprintf(emitter->buffer + emitter->length, (size_t)length + 1, format, copy);
+        } else {
+            length = -1;
+        }
+    }
+    if (length > 0) emitter->length += (size_t)length;
+
+    va_end(copy);
+    va_end(args);
+}
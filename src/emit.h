@@ -0,0 +1,48 @@
+/**
+ * Emission Stream Header
+ *
+ * Output text is appended to one large in-memory buffer and written to
+ * the destination file descriptor in big write calls, only when the
+ * buffer is full or on an explicit flush. Formatting helpers write
+ * straight into the buffer so emitting an instruction costs a few
+ * copies and no stdio call.
+ */
+
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Default buffer size, flushed whenever it fills up
+#define EMIT_BUFFER_SIZE (1 << 20)
+
+// Buffered output stream over a file descriptor or a stdio stream
+typedef struct {
+    int fd;                  // Destination, -1 to keep everything in memory
+    FILE *file;              // Destination instead of fd when set
+    char *buffer;
+    size_t length;           // Bytes pending in buffer
+    size_t capacity;
+    int failed;              // Set once an allocation or a write failed
+    unsigned long num_writes;  // write calls issued so far
+} Emitter;
+
+// Stream lifetime; destroying flushes but leaves the descriptor open.
+// Both return 0 if anything written so far was lost.
+Emitter* emitter_create(int fd);
+int emitter_flush(Emitter *emitter);
+int emitter_destroy(Emitter *emitter);
+
+// Send what is emitted from now on to a stdio stream, clearing a previous
+// failure; lets one stream and its buffer serve many destinations
+void emitter_set_file(Emitter *emitter, FILE *file);
+
+// Append text
+void emit_bytes(Emitter *emitter, const char *bytes, size_t length);
+void emit_str(Emitter *emitter, const char *text);
+void emit_char(Emitter *emitter, char c);
+void emit_int(Emitter *emitter, long value);
+void emit_format(Emitter *emitter, const char *format, ...);
+
+#endif // EMIT_H
@@ -1,54 +1,292 @@
 /**
  * Error Handling Implementation
  * 
- * Implements functions for reporting and handling errors
- * during compilation.
+ * Diagnostics are buffered as records and only formatted when they
+ * are flushed: each batch is sorted by location and written with a
+ * single fwrite, instead of one unbuffered stderr write per error.
  */
 
  #include <stdio.h>
  #include <stdlib.h>
+ #include <string.h>
  #include "error.h"
  
- // Count of errors encountered
- static int error_count = 0;
+ // Records kept before a batch is flushed
+ #define DIAG_BATCH_SIZE 256
  
- // Report an error without location information
- void error_report(const char *filename, const char *message) {
-     if (filename) {
-         fprintf(stderr, "Error in %s: %s\n", filename, message);
-     } else {
-         fprintf(stderr, "Error: %s\n", message);
+ // Default cap on errors, stops runaway cascades on broken inputs
+ #define DEFAULT_MAX_ERRORS 20
+ 
+ // Message formats, indexed by DiagId
+ static const char *diag_formats[DIAG_COUNT] = {
+     [DIAG_UNEXPECTED_CHARACTER] = "Unexpected character: '%c'",
+     [DIAG_UNTERMINATED_COMMENT] = "Unterminated multi-line comment",
+     [DIAG_UNTERMINATED_CHARACTER] = "Unterminated character literal",
+     [DIAG_UNTERMINATED_STRING] = "Unterminated string literal",
+     [DIAG_INVALID_ESCAPE] = "Invalid escape sequence",
+     [DIAG_EXPECTED_TOKEN] = "Expected token %s, got %s",
+     [DIAG_EXPECTED_TYPE] = "Expected type specifier",
+     [DIAG_EXPECTED_IDENTIFIER_AFTER_TYPE] = "Expected identifier after type specifier",
+     [DIAG_EXPECTED_IDENTIFIER_IN_DECL] = "Expected identifier in variable declaration",
+     [DIAG_EXPECTED_EXPRESSION] = "Expected expression",
+     [DIAG_CANNOT_OPEN_FILE] = "Cannot open file '%s'",
+     [DIAG_INCLUDE_NOT_FOUND] = "Include file '%s' not found",
+     [DIAG_INCLUDE_DEPTH] = "#include nested too deeply",
+     [DIAG_EXPECTED_HEADER_NAME] = "Expected \"FILENAME\" or <FILENAME> after #include",
+     [DIAG_INVALID_DIRECTIVE] = "Invalid preprocessing directive '#%.*s'",
+     [DIAG_EXPECTED_MACRO_NAME] = "Macro name missing",
+     [DIAG_MACRO_ARGUMENTS] = "Macro '%s' expects %d arguments, got %d",
+     [DIAG_UNTERMINATED_MACRO_CALL] = "Unterminated call of macro '%s'",
+     [DIAG_UNMATCHED_CONDITIONAL] = "#%s without #if",
+     [DIAG_UNTERMINATED_CONDITIONAL] = "Unterminated conditional directive",
+     [DIAG_INVALID_CONDITION] = "Invalid expression in preprocessor condition",
+     [DIAG_ERROR_DIRECTIVE] = "#error %.*s",
+     [DIAG_UNDECLARED_IDENTIFIER] = "Use of undeclared identifier '%s'",
+     [DIAG_REDECLARED] = "Redeclaration of '%s' in the same scope",
+     [DIAG_NOT_ASSIGNABLE] = "Expression is not assignable",
+     [DIAG_UNSUPPORTED_CONSTRUCT] = "Code generation does not support %s",
+     [DIAG_CANNOT_WRITE_FILE] = "Cannot write file '%s'",
+     [DIAG_INTERNAL_ERROR] = "Internal compiler error: %s failed",
+     [DIAG_CANNOT_ENCODE] = "Cannot encode function '%s': offset or immediate out of range",
+     [DIAG_TOO_MANY_ERRORS] = "Too many errors (limit %d), stopping",
+ };
+ 
+ // Printable severity names
+ static const char *severity_names[] = {
+     [DIAG_NOTE] = "Note",
+     [DIAG_WARNING] = "Warning",
+     [DIAG_ERROR] = "Error",
+     [DIAG_FATAL] = "Fatal error",
+ };
+ 
+ // Create an engine writing to out, or only collecting records for diag_merge if out is NULL
+ DiagEngine* diag_create(FILE *out) {
+     DiagEngine *diag = (DiagEngine*)calloc(1, sizeof(DiagEngine));
+     if (!diag) return NULL;
+     
+     diag->arena = arena_create(0);
+     if (!diag->arena) {
+         free(diag);
+         return NULL;
      }
-     error_count++;
+     diag->out = out;
+     diag->max_errors = DEFAULT_MAX_ERRORS;
+     return diag;
+ }
+ 
+ // Free an engine, pending records are discarded
+ void diag_destroy(DiagEngine *diag) {
+     if (!diag) return;
+     free(diag->records);
+     arena_destroy(diag->arena);
+     free(diag);
+ }
+ 
+ // Set the error cap (0 disables it)
+ void diag_set_max_errors(DiagEngine *diag, int max_errors) {
+     diag->max_errors = max_errors;
+ }
+ 
+ // Get the engine-owned copy of a filename
+ static const char* copy_filename(DiagEngine *diag, const char *filename) {
+     if (!filename) return NULL;
+     if (filename != diag->last_filename) {
+         diag->last_filename = filename;
+         diag->last_filename_copy = arena_strndup(diag->arena, filename, strlen(filename));
+     }
+     return diag->last_filename_copy;
+ }
+ 
+ // Flush the batch when it is full (engines without output keep everything).
+ // Must run before a record's strings are copied, as flushing resets the arena.
+ static void make_room(DiagEngine *diag) {
+     if (diag->out && diag->num_records >= DIAG_BATCH_SIZE) {
+         diag_flush(diag);
+     }
+ }
+ 
+ // Append a record whose strings already live in the engine arena
+ static void push_record(DiagEngine *diag, const DiagRecord *record) {
+     if (diag->num_records == diag->capacity) {
+         int capacity = diag->capacity ? diag->capacity * 2 : 16;
+         DiagRecord *records = (DiagRecord*)realloc(diag->records, capacity * sizeof(DiagRecord));
+         if (!records) return;
+         diag->records = records;
+         diag->capacity = capacity;
+     }
+     diag->records[diag->num_records++] = *record;
+ }
+ 
+ // Record a diagnostic with the arguments of its message format
+ void diag_report(DiagEngine *diag, DiagSeverity severity, DiagId id,
+                  const char *filename, int line, int column, ...) {
+     va_list args;
+     va_start(args, column);
+     diag_vreport(diag, severity, id, filename, line, column, args);
+     va_end(args);
+ }
+ 
+ // Cap the cascade: after the error that reaches the limit, one fatal record
+ // (filename is the caller's string: the record's copy does not survive a flush)
+ static void check_error_limit(DiagEngine *diag, const DiagRecord *record, const char *filename) {
+     if (diag->max_errors <= 0 || diag->error_count < diag->max_errors) return;
+     
+     char message[256];
+     diag->limit_reached = 1;
+     make_room(diag);
+     DiagRecord fatal = *record;
+     fatal.filename = copy_filename(diag, filename);
+     fatal.severity = DIAG_FATAL;
+     fatal.id = DIAG_TOO_MANY_ERRORS;
+     fatal.sequence = diag->sequence++;
+     snprintf(message, sizeof(message), diag_formats[DIAG_TOO_MANY_ERRORS], diag->max_errors);
+     fatal.message = arena_strndup(diag->arena, message, strlen(message));
+     push_record(diag, &fatal);
+ }
+ 
+ // Record a diagnostic, va_list version
+ void diag_vreport(DiagEngine *diag, DiagSeverity severity, DiagId id,
+                   const char *filename, int line, int column, va_list args) {
+     if (severity >= DIAG_ERROR) {
+         diag->error_count++;
+         if (diag->limit_reached) return;
+     } else if (severity == DIAG_WARNING) {
+         diag->warning_count++;
+     }
+     
+     char message[256];
+     vsnprintf(message, sizeof(message), diag_formats[id], args);
+     
+     make_room(diag);
+     DiagRecord record;
+     record.severity = severity;
+     record.id = id;
+     record.filename = copy_filename(diag, filename);
+     record.line = line;
+     record.column = column;
+     record.sequence = diag->sequence++;
+     record.message = arena_strndup(diag->arena, message, strlen(message));
+     push_record(diag, &record);
+     
+     if (severity >= DIAG_ERROR) check_error_limit(diag, &record, filename);
+ }
+ 
+ // Copy all records and counts of another engine into this one, leaving it as is.
+ // Records are replayed against this engine's error cap, in their original order.
+ void diag_replay(DiagEngine *diag, const DiagEngine *other) {
+     int recorded_errors = 0;
+     for (int i = 0; i < other->num_records; i++) {
+         DiagRecord record = other->records[i];
+         if (record.id == DIAG_TOO_MANY_ERRORS) continue;  // Re-derived below
+         
+         if (record.severity >= DIAG_ERROR) {
+             recorded_errors++;
+             diag->error_count++;
+             if (diag->limit_reached) continue;
+         }
+         
+         make_room(diag);
+         record.filename = copy_filename(diag, record.filename);
+         record.message = arena_strndup(diag->arena, record.message, strlen(record.message));
+         record.sequence = diag->sequence++;
+         push_record(diag, &record);
+         
+         if (record.severity >= DIAG_ERROR) check_error_limit(diag, &record, other->records[i].filename);
+     }
+     
+     // Errors the other engine counted but dropped past its own cap
+     diag->error_count += other->error_count - recorded_errors;
+     diag->warning_count += other->warning_count;
+     if (other->limit_reached && diag->max_errors > 0) {
+         diag->limit_reached = 1;
+     }
+ }
+ 
+ // Move all records and counts of another engine (e.g. a worker's) into this one
+ void diag_merge(DiagEngine *diag, DiagEngine *other) {
+     diag_replay(diag, other);
+     other->num_records = 0;
+     other->error_count = 0;
+     other->warning_count = 0;
  }
  
- // Report an error with line and column information
- void error_report_location(const char *filename, int line, int column, const char *message) {
-     if (filename) {
-         fprintf(stderr, "Error in %s:%d:%d: %s\n", filename, line, column, message);
-     } else {
-         fprintf(stderr, "Error at line %d, column %d: %s\n", line, column, message);
+ // Order records by file, line, column, then report order
+ static int compare_records(const void *a, const void *b) {
+     const DiagRecord *left = (const DiagRecord*)a;
+     const DiagRecord *right = (const DiagRecord*)b;
+     
+     if (left->filename != right->filename) {
+         if (!left->filename) return -1;
+         if (!right->filename) return 1;
+         int order = strcmp(left->filename, right->filename);
+         if (order != 0) return order;
      }
-     error_count++;
+     if (left->line != right->line) return left->line < right->line ? -1 : 1;
+     if (left->column != right->column) return left->column < right->column ? -1 : 1;
+     return left->sequence < right->sequence ? -1 : (left->sequence > right->sequence);
  }
  
- // Report an error with token information
- void error_report_with_token(const char *filename, int line, int column, const char *token, const char *message) {
-     if (filename) {
-         fprintf(stderr, "Error in %s:%d:%d: %s: '%s'\n", filename, line, column, message, token);
-     } else {
-         fprintf(stderr, "Error at line %d, column %d: %s: '%s'\n", line, column, message, token);
+ // Sort the pending records and write them with one fwrite
+ void diag_flush(DiagEngine *diag) {
+     if (diag->num_records == 0 || !diag->out) return;
+     
+     qsort(diag->records, diag->num_records, sizeof(DiagRecord), compare_records);
+     
+     size_t capacity = (size_t)diag->num_records * 128;
+     size_t length = 0;
+     char *text = (char*)malloc(capacity);
+     if (!text) return;
+     
+     for (int i = 0; i < diag->num_records; i++) {
+         const DiagRecord *record = &diag->records[i];
+         const char *severity = severity_names[record->severity];
+         
+         for (;;) {
+             int written;
+             if (record->filename && record->line > 0) {
+                 written = snprintf(text + length, capacity - length, "%s in %s:%d:%d: %s\n",
+                                    severity, record->filename, record->line, record->column,
+                                    record->message);
+             } else if (record->filename) {
+                 written = snprintf(text + length, capacity - length, "%s in %s: %s\n",
+                                    severity, record->filename, record->message);
+             } else if (record->line > 0) {
+                 written = snprintf(text + length, capacity - length, "%s at line %d, column %d: %s\n",
+                                    severity, record->line, record->column, record->message);
+             } else {
+                 written = snprintf(text + length, capacity - length, "%s: %s\n",
+                                    severity, record->message);
+             }
+             if (written < 0) break;
+             if ((size_t)written < capacity - length) {
+                 length += (size_t)written;
+                 break;
+             }
+             
+             // Not enough room for this record, grow and format it again
+             char *grown = (char*)realloc(text, capacity * 2 + (size_t)written);
+             if (!grown) break;
+             text = grown;
+             capacity = capacity * 2 + (size_t)written;
+         }
      }
-     error_count++;
+     
+     fwrite(text, 1, length, diag->out);
+     fflush(diag->out);
+     free(text);
+     
+     // Messages of a flushed batch are no longer referenced
+     diag->num_records = 0;
+     arena_reset(diag->arena);
+     diag->last_filename = NULL;
  }
  
- // Get the total number of errors encountered
- int get_error_count() {
-     return error_count;
+ // Get the number of errors reported
+ int diag_error_count(const DiagEngine *diag) {
+     return diag->error_count;
  }
  
- // Reset the error count
- void reset_error_count() {
-     error_count = 0;
+ // Whether the error cap was hit and compilation should stop
+ int diag_limit_reached(const DiagEngine *diag) {
+     return diag->limit_reached;
  }
- 
\ No newline at end of file
@@ -1,23 +1,102 @@
 /**
  * Error Handling Header
  * 
- * Defines functions for reporting and handling errors
- * during compilation.
+ * Defines the diagnostics engine used to report errors
+ * during compilation. Diagnostics are collected as structured
+ * records per compilation and written out in sorted batches.
  */
 
  #ifndef ERROR_H
  #define ERROR_H
  
- // Function prototypes
- void error_report(const char *filename, const char *message);
- void error_report_location(const char *filename, int line, int column, const char *message);
- void error_report_with_token(const char *filename, int line, int column, const char *token, const char *message);
+ #include <stdarg.h>
+ #include <stdio.h>
+ #include "arena.h"
  
- // Get total error count
- int get_error_count();
+ // Diagnostic severity
+ typedef enum {
+     DIAG_NOTE,
+     DIAG_WARNING,
+     DIAG_ERROR,
+     DIAG_FATAL
+ } DiagSeverity;
  
- // Reset error count
- void reset_error_count();
+ // Diagnostic message IDs, the catalogue of formats lives in error.c
+ typedef enum {
+     DIAG_UNEXPECTED_CHARACTER,     // char
+     DIAG_UNTERMINATED_COMMENT,
+     DIAG_UNTERMINATED_CHARACTER,
+     DIAG_UNTERMINATED_STRING,
+     DIAG_INVALID_ESCAPE,
+     DIAG_EXPECTED_TOKEN,           // expected token name, found token name
+     DIAG_EXPECTED_TYPE,
+     DIAG_EXPECTED_IDENTIFIER_AFTER_TYPE,
+     DIAG_EXPECTED_IDENTIFIER_IN_DECL,
+     DIAG_EXPECTED_EXPRESSION,
+     DIAG_CANNOT_OPEN_FILE,         // filename
+     DIAG_INCLUDE_NOT_FOUND,        // header name
+     DIAG_INCLUDE_DEPTH,
+     DIAG_EXPECTED_HEADER_NAME,
+     DIAG_INVALID_DIRECTIVE,        // directive length, directive text
+     DIAG_EXPECTED_MACRO_NAME,
+     DIAG_MACRO_ARGUMENTS,          // macro name, expected count, actual count
+     DIAG_UNTERMINATED_MACRO_CALL,  // macro name
+     DIAG_UNMATCHED_CONDITIONAL,    // directive name
+     DIAG_UNTERMINATED_CONDITIONAL,
+     DIAG_INVALID_CONDITION,
+     DIAG_ERROR_DIRECTIVE,          // message length, message text
+     DIAG_UNDECLARED_IDENTIFIER,    // name
+     DIAG_REDECLARED,               // name
+     DIAG_NOT_ASSIGNABLE,
+     DIAG_UNSUPPORTED_CONSTRUCT,    // description
+     DIAG_CANNOT_WRITE_FILE,        // filename
+     DIAG_INTERNAL_ERROR,           // failed step
+     DIAG_CANNOT_ENCODE,            // function name
+     DIAG_TOO_MANY_ERRORS,          // error limit
+     DIAG_COUNT
+ } DiagId;
+ 
+ // One diagnostic
+ typedef struct {
+     DiagSeverity severity;
+     DiagId id;
+     const char *filename;  // Copy owned by the engine, NULL if unknown
+     int line;              // 0 if unknown
+     int column;
+     unsigned sequence;     // Report order, keeps sorting stable
+     const char *message;   // Rendered message, owned by the engine
+ } DiagRecord;
+ 
+ // Diagnostics engine, one per compilation (or per worker thread)
+ typedef struct {
+     DiagRecord *records;   // Pending records, not yet flushed
+     int num_records;
+     int capacity;
+     Arena *arena;          // Storage for messages and filenames
+     const char *last_filename;       // Last filename seen and its copy
+     const char *last_filename_copy;
+     FILE *out;             // Destination of flushed diagnostics, NULL to only collect
+     unsigned sequence;
+     int error_count;       // Errors reported, including dropped ones
+     int warning_count;
+     int max_errors;        // Stop recording after this many errors, 0 = no limit
+     int limit_reached;
+ } DiagEngine;
+ 
+ // Engine functions
+ DiagEngine* diag_create(FILE *out);
+ void diag_destroy(DiagEngine *diag);
+ void diag_set_max_errors(DiagEngine *diag, int max_errors);
+ void diag_report(DiagEngine *diag, DiagSeverity severity, DiagId id,
+                  const char *filename, int line, int column, ...);
+ void diag_vreport(DiagEngine *diag, DiagSeverity severity, DiagId id,
+                   const char *filename, int line, int column, va_list args);
+ void diag_replay(DiagEngine *diag, const DiagEngine *other);
+ void diag_merge(DiagEngine *diag, DiagEngine *other);
+ void diag_flush(DiagEngine *diag);
+ 
+ // Error counters
+ int diag_error_count(const DiagEngine *diag);
+ int diag_limit_reached(const DiagEngine *diag);
  
  #endif // ERROR_H
- 
\ No newline at end of file
@@ -0,0 +1,386 @@
+/**
+ * Flat AST Implementation
+ *
+ * Converts the pointer-based AST into the struct-of-arrays layout and
+ * back. Nodes are numbered in pre-order and every node reserves its child
+ * range before its children are converted, keeping ranges contiguous.
+ * Both directions work from an explicit heap stack, so a deep expression
+ * costs heap rather than C stack.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "flat_ast.h"
+
+#define INITIAL_FLAT_CAPACITY 256
+
+// Node waiting to be converted: a tree node and the edge slot receiving its
+// id, or a flat node and the tree node it becomes child number position of
+typedef struct {
+    const ASTNode *tree;
+    FlatNodeId flat;
+    ASTNode *parent;
+    uint32_t position;
+} FlatWork;
+
+// Stack of pending conversions
+typedef struct {
+    FlatWork *items;
+    size_t count;
+    size_t capacity;
+} WorkStack;
+
+// Push one pending conversion, 0 on allocation failure
+static int work_push(WorkStack *stack, FlatWork work) {
+    if (stack->count == stack->capacity) {
+        size_t capacity = stack->capacity ? stack->capacity * 2 : INITIAL_FLAT_CAPACITY;
+        FlatWork *grown = (FlatWork*)realloc(stack->items, capacity * sizeof(FlatWork));
+        if (!grown) return 0;
+        stack->items = grown;
+        stack->capacity = capacity;
+    }
+    stack->items[stack->count++] = work;
+    return 1;
+}
+
+// Grow one node array to the new capacity
+#define GROW_ARRAY(array, capacity) do { \
+        void *grown = realloc((array), (capacity) * sizeof(*(array))); \
+        if (!grown) return 0; \
+        (array) = grown; \
+    } while (0)
+
+// Make room for one more node
+static int reserve_node(FlatAST *flat) {
+    if (flat->num_nodes < flat->node_capacity) return 1;
+    
+    uint32_t capacity = flat->node_capacity ? flat->node_capacity * 2 : INITIAL_FLAT_CAPACITY;
+    GROW_ARRAY(flat->kind, capacity);
+    GROW_ARRAY(flat->data, capacity);
+    GROW_ARRAY(flat->aux, capacity);
+    GROW_ARRAY(flat->name, capacity);
+    GROW_ARRAY(flat->span, capacity);
+    GROW_ARRAY(flat->first_edge, capacity);
+    GROW_ARRAY(flat->num_edges, capacity);
+    flat->node_capacity = capacity;
+    return 1;
+}
+
+// Reserve a range of edge slots, returns its start or FLAT_NONE on failure
+static uint32_t reserve_edges(FlatAST *flat, uint32_t count) {
+    if (flat->num_edge_slots + count > flat->edge_capacity) {
+        uint32_t capacity = flat->edge_capacity ? flat->edge_capacity : INITIAL_FLAT_CAPACITY;
+        while (flat->num_edge_slots + count > capacity) capacity *= 2;
+        FlatNodeId *grown = (FlatNodeId*)realloc(flat->edges, capacity * sizeof(FlatNodeId));
+        if (!grown) return FLAT_NONE;
+        flat->edges = grown;
+        flat->edge_capacity = capacity;
+    }
+    
+    uint32_t start = flat->num_edge_slots;
+    flat->num_edge_slots += count;
+    return start;
+}
+
+// Collect the children of a tree node in their flat order
+static int tree_children(const ASTNode *node, const ASTNode **out, int max) {
+    switch (node->type) {
+        case AST_FUNCTION:
+            out[0] = node->data.function.parameters;
+            out[1] = node->data.function.body;
+            return 2;
+        case AST_IF_STMT:
+            out[0] = node->data.if_stmt.condition;
+            out[1] = node->data.if_stmt.if_branch;
+            out[2] = node->data.if_stmt.else_branch;
+            return 3;
+        case AST_WHILE_STMT:
+            out[0] = node->data.while_stmt.condition;
+            out[1] = node->data.while_stmt.body;
+            return 2;
+        case AST_RETURN_STMT:
+            out[0] = node->data.return_stmt.value;
+            return 1;
+        case AST_VARIABLE_DECL:
+            out[0] = node->data.variable_decl.initializer;
+            return 1;
+        case AST_BINARY_EXPR:
+        case AST_ASSIGN_EXPR:
+            out[0] = node->data.binary_expr.left;
+            out[1] = node->data.binary_expr.right;
+            return 2;
+        case AST_UNARY_EXPR:
+            out[0] = node->data.unary_expr.operand;
+            return 1;
+        case AST_CALL_EXPR:
+            out[0] = node->data.call_expr.function;
+            out[1] = node->data.call_expr.arguments;
+            return 2;
+        case AST_SUBSCRIPT_EXPR:
+            out[0] = node->data.subscript_expr.array;
+            out[1] = node->data.subscript_expr.index;
+            return 2;
+        default: {
+            int count = node->num_children < max ? node->num_children : max;
+            for (int i = 0; i < count; i++) out[i] = node->children[i];
+            return count;
+        }
+    }
+}
+
+// Encode the scalar payload of a tree node
+static void encode_payload(FlatAST *flat, FlatNodeId id, const ASTNode *node) {
+    flat->data[id] = 0;
+    flat->aux[id] = 0;
+    flat->name[id] = NULL;
+    
+    switch (node->type) {
+        case AST_FUNCTION:
+            flat->data[id] = node->data.function.return_type;
+            flat->name[id] = node->data.function.name;
+            break;
+        case AST_PARAMETER:
+            flat->data[id] = node->data.parameter.type |
+                             (node->data.parameter.is_array ? FLAT_ARRAY_FLAG : 0);
+            flat->name[id] = node->data.parameter.name;
+            break;
+        case AST_VARIABLE_DECL:
+            flat->data[id] = node->data.variable_decl.type |
+                             (node->data.variable_decl.is_array ? FLAT_ARRAY_FLAG : 0);
+            flat->aux[id] = node->data.variable_decl.array_size;
+            flat->name[id] = node->data.variable_decl.name;
+            break;
+        case AST_BINARY_EXPR:
+            flat->data[id] = node->data.binary_expr.op;
+            break;
+        case AST_UNARY_EXPR:
+            flat->data[id] = node->data.unary_expr.op;
+            break;
+        case AST_IDENTIFIER:
+            flat->name[id] = node->data.identifier.name;
+            break;
+        case AST_INTEGER:
+            flat->aux[id] = node->data.integer.value;
+            break;
+        case AST_CHARACTER:
+            flat->aux[id] = node->data.character.value;
+            break;
+        case AST_STRING:
+            flat->name[id] = node->data.string.value;
+            break;
+        default:
+            break;
+    }
+}
+
+// Append one tree node, queueing its children; 0 on failure
+static int append_node(FlatAST *flat, const ASTNode *node, uint32_t edge, WorkStack *stack) {
+    if (!reserve_node(flat)) return 0;
+    
+    FlatNodeId id = flat->num_nodes++;
+    flat->kind[id] = (uint8_t)node->type;
+    flat->span[id] = node->span;
+    encode_payload(flat, id, node);
+    if (edge != FLAT_NONE) flat->edges[edge] = id;
+    
+    // Fixed-role nodes have at most 3 children, list nodes use the heap
+    const ASTNode *fixed[3];
+    const ASTNode **children = fixed;
+    int max = 3;
+    if (node->num_children > 3) {
+        children = (const ASTNode**)malloc(node->num_children * sizeof(ASTNode*));
+        if (!children) return 0;
+        max = node->num_children;
+    }
+    int count = tree_children(node, children, max);
+    
+    uint32_t start = reserve_edges(flat, (uint32_t)count);
+    flat->first_edge[id] = start;
+    flat->num_edges[id] = (uint32_t)count;
+    
+    // Pushed in reverse so the children are numbered in order
+    int ok = start != FLAT_NONE;
+    for (int i = count - 1; ok && i >= 0; i--) {
+        flat->edges[start + i] = FLAT_NONE;
+        if (children[i]) {
+            FlatWork work = { children[i], FLAT_NONE, NULL, start + (uint32_t)i };
+            ok = work_push(stack, work);
+        }
+    }
+    
+    if (children != fixed) free((void*)children);
+    return ok;
+}
+
+// Build the flat form of a tree
+FlatAST* flat_ast_from_tree(const ASTNode *root) {
+    if (!root) return NULL;
+    
+    FlatAST *flat = (FlatAST*)calloc(1, sizeof(FlatAST));
+    if (!flat) return NULL;
+    
+    WorkStack stack = { NULL, 0, 0 };
+    int ok = append_node(flat, root, FLAT_NONE, &stack);
+    while (ok && stack.count > 0) {
+        FlatWork work = stack.items[--stack.count];
+        ok = append_node(flat, work.tree, work.position, &stack);
+    }
+    free(stack.items);
+    
+    if (!ok) {
+        free_flat_ast(flat);
+        return NULL;
+    }
+    return flat;
+}
+
+// Decode the scalar payload of a flat node into a tree node
+static void decode_payload(const FlatAST *flat, FlatNodeId id, ASTNode *node) {
+    uint32_t data = flat->data[id];
+    switch (node->type) {
+        case AST_FUNCTION:
+            node->data.function.return_type = (DataType)data;
+            node->data.function.name = flat->name[id];
+            break;
+        case AST_PARAMETER:
+            node->data.parameter.type = (DataType)(data & ~FLAT_ARRAY_FLAG);
+            node->data.parameter.is_array = (data & FLAT_ARRAY_FLAG) != 0;
+            node->data.parameter.name = flat->name[id];
+            break;
+        case AST_VARIABLE_DECL:
+            node->data.variable_decl.type = (DataType)(data & ~FLAT_ARRAY_FLAG);
+            node->data.variable_decl.is_array = (data & FLAT_ARRAY_FLAG) != 0;
+            node->data.variable_decl.array_size = flat->aux[id];
+            node->data.variable_decl.name = flat->name[id];
+            break;
+        case AST_BINARY_EXPR:
+            node->data.binary_expr.op = (BinaryOp)data;
+            break;
+        case AST_UNARY_EXPR:
+            node->data.unary_expr.op = (UnaryOp)data;
+            break;
+        case AST_IDENTIFIER:
+            node->data.identifier.name = flat->name[id];
+            break;
+        case AST_INTEGER:
+            node->data.integer.value = flat->aux[id];
+            break;
+        case AST_CHARACTER:
+            node->data.character.value = (char)flat->aux[id];
+            break;
+        case AST_STRING:
+            node->data.string.value = flat->name[id];
+            break;
+        default:
+            break;
+    }
+}
+
+// Store child number index of a tree node, 0 on failure
+static int attach_child(Arena *arena, ASTNode *node, uint32_t index, ASTNode *child) {
+    // List nodes take their children in flat order
+    if (node->children) {
+        add_child(arena, node, child);
+        return node->num_children == (int)index + 1;
+    }
+    
+    switch (node->type) {
+        case AST_FUNCTION:
+            if (index == 0) node->data.function.parameters = child;
+            else if (index == 1) node->data.function.body = child;
+            break;
+        case AST_IF_STMT:
+            if (index == 0) node->data.if_stmt.condition = child;
+            else if (index == 1) node->data.if_stmt.if_branch = child;
+            else if (index == 2) node->data.if_stmt.else_branch = child;
+            break;
+        case AST_WHILE_STMT:
+            if (index == 0) node->data.while_stmt.condition = child;
+            else if (index == 1) node->data.while_stmt.body = child;
+            break;
+        case AST_RETURN_STMT:
+            if (index == 0) node->data.return_stmt.value = child;
+            break;
+        case AST_VARIABLE_DECL:
+            if (index == 0) node->data.variable_decl.initializer = child;
+            break;
+        case AST_BINARY_EXPR:
+        case AST_ASSIGN_EXPR:
+            if (index == 0) node->data.binary_expr.left = child;
+            else if (index == 1) node->data.binary_expr.right = child;
+            break;
+        case AST_UNARY_EXPR:
+            if (index == 0) node->data.unary_expr.operand = child;
+            break;
+        case AST_CALL_EXPR:
+            if (index == 0) node->data.call_expr.function = child;
+            else if (index == 1) node->data.call_expr.arguments = child;
+            break;
+        case AST_SUBSCRIPT_EXPR:
+            if (index == 0) node->data.subscript_expr.array = child;
+            else if (index == 1) node->data.subscript_expr.index = child;
+            break;
+        default:
+            break;
+    }
+    return 1;
+}
+
+// Rebuild the tree node of a flat node, queueing its children; NULL on failure
+static ASTNode* build_node(const FlatAST *flat, FlatNodeId id, Arena *arena, WorkStack *stack) {
+    ASTNode *node = create_ast_node(arena, (ASTNodeType)flat->kind[id]);
+    if (!node) return NULL;
+    node->span = flat->span[id];
+    decode_payload(flat, id, node);
+    
+    // Absent optional children are queued too, so list nodes get their NULLs in order
+    for (uint32_t i = flat->num_edges[id]; i-- > 0;) {
+        FlatWork work = { NULL, flat_ast_child(flat, id, i), node, i };
+        if (!work_push(stack, work)) return NULL;
+    }
+    return node;
+}
+
+// Rebuild the pointer-based tree of a flat AST in an arena
+ASTNode* flat_ast_to_tree(const FlatAST *flat, Arena *arena) {
+    if (!flat || flat->num_nodes == 0) return NULL;
+    
+    WorkStack stack = { NULL, 0, 0 };
+    ASTNode *root = build_node(flat, 0, arena, &stack);
+    int ok = root != NULL;
+    while (ok && stack.count > 0) {
+        FlatWork work = stack.items[--stack.count];
+        ASTNode *child = NULL;
+        if (work.flat != FLAT_NONE) {
+            child = build_node(flat, work.flat, arena, &stack);
+            ok = child != NULL;
+        }
+        ok = ok && attach_child(arena, work.parent, work.position, child);
+    }
+    free(stack.items);
+    return ok ? root : NULL;
+}
+
+// Free a flat AST
+void free_flat_ast(FlatAST *flat) {
+    if (!flat) return;
+    if (flat->mapping) {
+        // Loaded arrays point into the mapped file
+        munmap(flat->mapping, flat->mapping_size);
+        free(flat->name);
+        free(flat);
+        return;
+    }
+    free(flat->kind);
+    free(flat->data);
+    free(flat->aux);
+    free(flat->name);
+    free(flat->span);
+    free(flat->first_edge);
+    free(flat->num_edges);
+    free(flat->edges);
+    free(flat);
+}
@@ -0,0 +1,66 @@
+/**
+ * Flat AST Header
+ *
+ * Compact struct-of-arrays form of the AST. Nodes are 32-bit indices,
+ * and the children of a node are a contiguous range of one shared edge
+ * array, so passes walk a few dense arrays instead of chasing pointers.
+ */
+
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <stdint.h>
+#include "ast.h"
+
+typedef uint32_t FlatNodeId;
+
+// Marks an absent optional child (else branch, initializer, ...)
+#define FLAT_NONE UINT32_MAX
+
+// Flat AST structure, node 0 is the root
+//
+// Per-kind payload:
+//   data: operator for expressions, DataType (| 0x100 if array) for
+//         functions, parameters and declarations
+//   aux:  integer/character value, array size of declarations
+//   name: interned name or string literal value, NULL otherwise
+//
+// Children with a fixed role keep their position and use FLAT_NONE when
+// absent: FUNCTION [params, body], IF [cond, then, else], WHILE [cond, body],
+// RETURN [value], VARIABLE_DECL [init], BINARY/ASSIGN [left, right],
+// UNARY [operand], CALL [function, args], SUBSCRIPT [array, index].
+// List nodes (PROGRAM, PARAM_LIST, COMPOUND_STMT, EXPR_STMT, ARG_LIST)
+// store their children in order.
+typedef struct {
+    uint32_t num_nodes;
+    uint32_t node_capacity;
+    uint8_t *kind;             // ASTNodeType of each node
+    uint32_t *data;
+    int32_t *aux;
+    const char **name;
+    SourceSpan *span;          // Source range of each node
+    uint32_t *first_edge;      // Start of the child range in edges
+    uint32_t *num_edges;       // Length of the child range
+    
+    uint32_t num_edge_slots;
+    uint32_t edge_capacity;
+    FlatNodeId *edges;         // Child ids of every node, range by range
+    
+    void *mapping;             // Loaded file holding every array but name, NULL if built
+    size_t mapping_size;
+} FlatAST;
+
+#define FLAT_ARRAY_FLAG 0x100
+
+// Flat AST functions
+FlatAST* flat_ast_from_tree(const ASTNode *root);
+ASTNode* flat_ast_to_tree(const FlatAST *flat, Arena *arena);
+void free_flat_ast(FlatAST *flat);
+
+// Get child number index of a node (FLAT_NONE if out of range or absent)
+static inline FlatNodeId flat_ast_child(const FlatAST *flat, FlatNodeId node, uint32_t index) {
+    if (index >= flat->num_edges[node]) return FLAT_NONE;
+    return flat->edges[flat->first_edge[node] + index];
+}
+
+#endif // FLAT_AST_H
@@ -0,0 +1,377 @@
+/**
+ * Constant Folding Implementation
+ *
+ * Nodes are rewritten in place, children first, so a folded node can
+ * enable the folding of its parent. Arithmetic wraps like the 32-bit
+ * target's; divisions by zero and out-of-range shifts are left for the
+ * program to perform. A subtree is only dropped when doing so loses no
+ * side effect and no name a diagnostic would be reported for.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "fold.h"
+
+// State of one pass
+typedef struct {
+    Arena *arena;
+} Folder;
+
+// Integer value of a literal node, 0 if it is not one
+static int literal_value(const ASTNode *node, int32_t *value) {
+    if (!node) return 0;
+    if (node->type == AST_INTEGER) {
+        *value = node->data.integer.value;
+        return 1;
+    }
+    if (node->type == AST_CHARACTER) {
+        *value = (unsigned char)node->data.character.value;
+        return 1;
+    }
+    return 0;
+}
+
+// Turn a node into an integer literal, keeping its span
+static void make_integer(ASTNode *node, int32_t value) {
+    node->type = AST_INTEGER;
+    node->data.integer.value = value;
+    node->children = NULL;
+    node->num_children = 0;
+    node->children_capacity = 0;
+}
+
+// Replace a node by one of its operands
+static void replace(ASTNode *node, const ASTNode *with) {
+    *node = *with;
+}
+
+// New integer literal spanning like another node
+static ASTNode* new_integer(Folder *folder, int32_t value, const ASTNode *like) {
+    ASTNode *node = create_ast_node(folder->arena, AST_INTEGER);
+    if (!node) return NULL;
+    node->span = like->span;
+    node->data.integer.value = value;
+    return node;
+}
+
+// New binary expression spanning like another node
+static ASTNode* new_binary(Folder *folder, BinaryOp op, ASTNode *left, ASTNode *right, const ASTNode *like) {
+    if (!left || !right) return NULL;
+    ASTNode *node = create_ast_node(folder->arena, AST_BINARY_EXPR);
+    if (!node) return NULL;
+    node->span = like->span;
+    node->data.binary_expr.op = op;
+    node->data.binary_expr.left = left;
+    node->data.binary_expr.right = right;
+    return node;
+}
+
+// Copy of a leaf node
+static ASTNode* copy_leaf(Folder *folder, const ASTNode *node) {
+    ASTNode *copy = create_ast_node(folder->arena, node->type);
+    if (copy) *copy = *node;
+    return copy;
+}
+
+// Arithmetic shift right, whatever the host does with negative values
+static int32_t shift_right(int32_t value, int count) {
+    return value < 0 ? ~(~value >> count) : value >> count;
+}
+
+// Evaluate a binary operator on literals, 0 if the result is not a constant
+static int evaluate_binary(BinaryOp op, int32_t a, int32_t b, int32_t *result) {
+    uint32_t x = (uint32_t)a;
+    uint32_t y = (uint32_t)b;
+    switch (op) {
+        case OP_ADD: *result = (int32_t)(x + y); return 1;
+        case OP_SUBTRACT: *result = (int32_t)(x - y); return 1;
+        case OP_MULTIPLY: *result = (int32_t)(x * y); return 1;
+        case OP_DIVIDE:
+        case OP_MODULO:
+            if (b == 0 || (a == INT32_MIN && b == -1)) return 0;
+            *result = op == OP_DIVIDE ? a / b : a % b;
+            return 1;
+        case OP_EQ: *result = a == b; return 1;
+        case OP_NEQ: *result = a != b; return 1;
+        case OP_LT: *result = a < b; return 1;
+        case OP_GT: *result = a > b; return 1;
+        case OP_LTE: *result = a <= b; return 1;
+        case OP_GTE: *result = a >= b; return 1;
+        case OP_LOGICAL_AND: *result = a && b; return 1;
+        case OP_LOGICAL_OR: *result = a || b; return 1;
+        case OP_BITWISE_AND: *result = (int32_t)(x & y); return 1;
+        case OP_BITWISE_OR: *result = (int32_t)(x | y); return 1;
+        case OP_BITWISE_XOR: *result = (int32_t)(x ^ y); return 1;
+        case OP_SHL:
+        case OP_SHR:
+            if (b < 0 || b > 31) return 0;
+            *result = op == OP_SHL ? (int32_t)(x << b) : shift_right(a, b);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Stop at the first name of a variable; callees do not count
+static int find_variable(ASTVisit *visit, void *context) {
+    if (visit->node->type == AST_IDENTIFIER && visit->slot != AST_SLOT_CALLEE) *(int*)context = 1;
+    return !*(int*)context;
+}
+
+// Check whether a subtree names a variable
+static int mentions_variables(const ASTNode *node) {
+    int found = 0;
+    if (!ast_walk((ASTNode*)node, 0, find_variable, NULL, &found)) return 1;
+    return found;
+}
+
+// Stop at the first node that does more than compute a value
+static int find_side_effect(ASTVisit *visit, void *context) {
+    const ASTNode *node = visit->node;
+    if (node->type == AST_ASSIGN_EXPR || node->type == AST_CALL_EXPR ||
+        (node->type == AST_UNARY_EXPR && node->data.unary_expr.op >= OP_PRE_INC)) {
+        *(int*)context = 1;
+    }
+    return !*(int*)context;
+}
+
+// Check whether evaluating a subtree may do anything besides compute a value
+static int has_side_effects(const ASTNode *node) {
+    int found = 0;
+    if (!ast_walk((ASTNode*)node, 0, find_side_effect, NULL, &found)) return 1;
+    return found;
+}
+
+// A subtree whose value is not needed and that may go unevaluated
+static int droppable(const ASTNode *node) {
+    return !has_side_effects(node) && !mentions_variables(node);
+}
+
+// Exponent of a positive power of two, -1 otherwise
+static int power_of_two(int32_t value) {
+    if (value <= 0 || (value & (value - 1)) != 0) return -1;
+    int exponent = 0;
+    while ((1 << exponent) != value) exponent++;
+    return exponent;
+}
+
+// Turn a node into "operand != 0", the value of operand as a truth value
+static void make_truth_value(Folder *folder, ASTNode *node, ASTNode *operand, int boolean) {
+    if (boolean) {
+        replace(node, operand);
+        return;
+    }
+    ASTNode *zero = new_integer(folder, 0, node);
+    if (!zero) return;
+    node->data.binary_expr.op = OP_NEQ;
+    node->data.binary_expr.left = operand;
+    node->data.binary_expr.right = zero;
+}
+
+// x / 2^k rounds toward zero: (x + ((x >> 31) & (2^k - 1))) >> k
+static ASTNode* biased_dividend(Folder *folder, ASTNode *x, int exponent, const ASTNode *like) {
+    ASTNode *sign = new_binary(folder, OP_SHR, copy_leaf(folder, x), new_integer(folder, 31, like), like);
+    ASTNode *bias = new_binary(folder, OP_BITWISE_AND, sign, new_integer(folder, (1 << exponent) - 1, like), like);
+    return new_binary(folder, OP_ADD, copy_leaf(folder, x), bias, like);
+}
+
+// Strength-reduce a division or modulo of a variable by 2^k, k >= 1
+static void reduce_division(Folder *folder, ASTNode *node, BinaryOp op, int exponent) {
+    ASTNode *x = node->data.binary_expr.left;
+    ASTNode *biased = biased_dividend(folder, x, exponent, node);
+    if (!biased) return;
+
+    if (op == OP_DIVIDE) {
+        ASTNode *count = new_integer(folder, exponent, node);
+        if (!count) return;
+        node->data.binary_expr.op = OP_SHR;
+        node->data.binary_expr.left = biased;
+        node->data.binary_expr.right = count;
+        return;
+    }
+    // x % 2^k == x - ((x + bias) & -2^k)
+    ASTNode *rounded = new_binary(folder, OP_BITWISE_AND, biased, new_integer(folder, -(1 << exponent), node), node);
+    if (!rounded) return;
+    node->data.binary_expr.op = OP_SUBTRACT;
+    node->data.binary_expr.right = rounded;
+}
+
+// Simplify a binary expression with at most one literal operand
+static void simplify_binary(Folder *folder, ASTNode *node, int boolean) {
+    ASTNode *left = node->data.binary_expr.left;
+    ASTNode *right = node->data.binary_expr.right;
+    int32_t lv = 0;
+    int32_t rv = 0;
+    int lk = literal_value(left, &lv);
+    int rk = literal_value(right, &rv);
+    if (!left || !right || (!lk && !rk)) return;
+
+    switch (node->data.binary_expr.op) {
+        case OP_ADD:
+            if (rk && rv == 0) replace(node, left);
+            else if (lk && lv == 0) replace(node, right);
+            break;
+        case OP_SUBTRACT:
+            if (rk && rv == 0) replace(node, left);
+            break;
+        case OP_MULTIPLY: {
+            if (lk && !rk) {
+                // Literal on the right from here on
+                node->data.binary_expr.left = right;
+                node->data.binary_expr.right = left;
+                simplify_binary(folder, node, boolean);
+                break;
+            }
+            int exponent = power_of_two(rv);
+            if (rv == 1) {
+                replace(node, left);
+            } else if (rv == 0 && droppable(left)) {
+                make_integer(node, 0);
+            } else if (exponent > 0) {
+                node->data.binary_expr.op = OP_SHL;
+                make_integer(right, exponent);
+            }
+            break;
+        }
+        case OP_DIVIDE:
+        case OP_MODULO: {
+            if (!rk) break;
+            BinaryOp op = node->data.binary_expr.op;
+            int exponent = power_of_two(rv);
+            if (rv == 1) {
+                if (op == OP_DIVIDE) {
+                    replace(node, left);
+                } else if (droppable(left)) {
+                    make_integer(node, 0);
+                } else {
+                    // Still evaluates x, without the division helper
+                    node->data.binary_expr.op = OP_BITWISE_AND;
+                    make_integer(right, 0);
+                }
+            } else if (exponent > 0 && left->type == AST_IDENTIFIER) {
+                // The dividend is read more than once, so only a plain variable qualifies
+                reduce_division(folder, node, op, exponent);
+            }
+            break;
+        }
+        case OP_SHL:
+        case OP_SHR:
+            if (rk && rv == 0) replace(node, left);
+            break;
+        case OP_BITWISE_OR:
+        case OP_BITWISE_XOR:
+            if (rk && rv == 0) replace(node, left);
+            else if (lk && lv == 0) replace(node, right);
+            break;
+        case OP_BITWISE_AND:
+            if (rk && rv == -1) replace(node, left);
+            else if (lk && lv == -1) replace(node, right);
+            else if (rk && rv == 0 && droppable(left)) make_integer(node, 0);
+            else if (lk && lv == 0 && droppable(right)) make_integer(node, 0);
+            break;
+        case OP_LOGICAL_AND:
+            // The right operand of a decided && is never evaluated
+            if (lk && lv == 0) {
+                if (!mentions_variables(right)) make_integer(node, 0);
+            } else if (lk) {
+                make_truth_value(folder, node, right, boolean);
+            } else if (rv != 0) {
+                make_truth_value(folder, node, left, boolean);
+            } else if (droppable(left)) {
+                make_integer(node, 0);
+            }
+            break;
+        case OP_LOGICAL_OR:
+            if (lk && lv != 0) {
+                if (!mentions_variables(right)) make_integer(node, 1);
+            } else if (lk) {
+                make_truth_value(folder, node, right, boolean);
+            } else if (rv == 0) {
+                make_truth_value(folder, node, left, boolean);
+            } else if (droppable(left)) {
+                make_integer(node, 1);
+            }
+            break;
+        case OP_NEQ:
+            if (boolean && rk && rv == 0) replace(node, left);
+            break;
+        default:
+            break;
+    }
+}
+
+// Fold a binary expression whose operands are folded
+static void fold_binary(Folder *folder, ASTNode *node, int boolean) {
+    int32_t a;
+    int32_t b;
+    int32_t result;
+    if (literal_value(node->data.binary_expr.left, &a) && literal_value(node->data.binary_expr.right, &b) &&
+        evaluate_binary(node->data.binary_expr.op, a, b, &result)) {
+        make_integer(node, result);
+        return;
+    }
+    simplify_binary(folder, node, boolean);
+}
+
+// Fold a unary expression whose operand is folded
+static void fold_unary(ASTNode *node, int boolean) {
+    UnaryOp op = node->data.unary_expr.op;
+    ASTNode *operand = node->data.unary_expr.operand;
+
+    int32_t value;
+    if (op <= OP_BITWISE_NOT && literal_value(operand, &value)) {
+        if (op == OP_NEGATE) make_integer(node, (int32_t)(0U - (uint32_t)value));
+        else if (op == OP_BITWISE_NOT) make_integer(node, ~value);
+        else make_integer(node, !value);
+        return;
+    }
+
+    // !!x is x wherever only its truth matters
+    if (boolean && op == OP_NOT && operand && operand->type == AST_UNARY_EXPR &&
+        operand->data.unary_expr.op == OP_NOT && operand->data.unary_expr.operand) {
+        replace(node, operand->data.unary_expr.operand);
+    }
+}
+
+// Check whether only the truth value of a visited node is used
+static int in_boolean_context(const ASTVisit *visit) {
+    const ASTNode *parent = visit->parent;
+    if (!parent) return 0;
+    switch (parent->type) {
+        case AST_IF_STMT:
+        case AST_WHILE_STMT:
+            return visit->slot == AST_SLOT_CONDITION;
+        case AST_BINARY_EXPR:
+            return parent->data.binary_expr.op == OP_LOGICAL_AND || parent->data.binary_expr.op == OP_LOGICAL_OR;
+        case AST_UNARY_EXPR:
+            return parent->data.unary_expr.op == OP_NOT;
+        default:
+            return 0;
+    }
+}
+
+// Check whether a visited node is the target of an assignment
+static int is_assigned(const ASTVisit *visit) {
+    const ASTNode *parent = visit->parent;
+    if (!parent) return 0;
+    if (parent->type == AST_ASSIGN_EXPR) return visit->slot == AST_SLOT_LEFT;
+    return parent->type == AST_UNARY_EXPR && parent->data.unary_expr.op >= OP_PRE_INC;
+}
+
+// Fold a node once its children are folded
+static void fold_node(ASTVisit *visit, void *context) {
+    ASTNode *node = visit->node;
+    if (node->type != AST_BINARY_EXPR && node->type != AST_UNARY_EXPR) return;
+    // Simplifying a target could make it assignable, which hides the error
+    if (is_assigned(visit)) return;
+    if (node->type == AST_BINARY_EXPR) fold_binary((Folder*)context, node, in_boolean_context(visit));
+    else fold_unary(node, in_boolean_context(visit));
+}
+
+// Fold a program
+void fold_program(ASTNode *program, Arena *arena) {
+    Folder folder;
+    folder.arena = arena;
+    ast_walk(program, 0, NULL, fold_node, &folder);
+}
@@ -0,0 +1,19 @@
+/**
+ * Constant Folding Header
+ *
+ * Rewrites the AST of a translation unit before it is lowered: literal
+ * subexpressions are evaluated, identities such as x*1 or x+0 disappear,
+ * and multiplication, division and modulo by powers of two turn into
+ * shifts and masks so they need no division helper.
+ */
+
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "arena.h"
+#include "ast.h"
+
+// Fold a program in place; the few nodes it creates come from arena
+void fold_program(ASTNode *program, Arena *arena);
+
+#endif // FOLD_H
@@ -0,0 +1,132 @@
+/**
+ * String Interning Implementation
+ *
+ * Open-addressing hash table of canonical strings. The string bytes live
+ * in an arena so interning never pays one malloc per name. Lookups are
+ * serialised by a mutex so parser threads can share the table.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "intern.h"
+
+#define INITIAL_TABLE_CAPACITY 1024
+#define STRING_CHUNK_SIZE 65536
+
+// Hash table slot
+typedef struct {
+    const char *string;  // Canonical string, NULL for an empty slot
+    size_t length;
+    unsigned hash;
+} InternEntry;
+
+static InternEntry *table = NULL;
+static size_t table_capacity = 0;
+static size_t table_count = 0;
+static Arena *strings = NULL;  // Backing storage for the string bytes
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// FNV-1a hash of a text slice
+static unsigned hash_text(const char *text, size_t length) {
+    unsigned hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Copy a text slice into the string arena and terminate it
+static const char* store_text(const char *text, size_t length) {
+    if (!strings) {
+        strings = arena_create(STRING_CHUNK_SIZE);
+        if (!strings) return NULL;
+    }
+    return arena_strndup(strings, text, length);
+}
+
+// Double the hash table, reinserting every entry
+static int grow_table(void) {
+    size_t new_capacity = table_capacity ? table_capacity * 2 : INITIAL_TABLE_CAPACITY;
+    InternEntry *new_table = (InternEntry*)calloc(new_capacity, sizeof(InternEntry));
+    if (!new_table) return 0;
+    
+    for (size_t i = 0; i < table_capacity; i++) {
+        if (!table[i].string) continue;
+        size_t slot = table[i].hash & (new_capacity - 1);
+        while (new_table[slot].string) {
+            slot = (slot + 1) & (new_capacity - 1);
+        }
+        new_table[slot] = table[i];
+    }
+    
+    free(table);
+    table = new_table;
+    table_capacity = new_capacity;
+    return 1;
+}
+
+// Find or insert a text slice, with table_lock held
+static const char* intern_locked(const char *text, size_t length, unsigned hash) {
+    // Keep the load factor under 1/2
+    if ((table_count + 1) * 2 > table_capacity && !grow_table()) {
+        return NULL;
+    }
+    
+    size_t slot = hash & (table_capacity - 1);
+    while (table[slot].string) {
+        if (table[slot].hash == hash && table[slot].length == length &&
+            memcmp(table[slot].string, text, length) == 0) {
+            return table[slot].string;
+        }
+        slot = (slot + 1) & (table_capacity - 1);
+    }
+    
+    const char *copy = store_text(text, length);
+    if (!copy) return NULL;
+    
+    table[slot].string = copy;
+    table[slot].length = length;
+    table[slot].hash = hash;
+    table_count++;
+    return copy;
+}
+
+// Get the canonical copy of a text slice
+const char* intern_string(const char *text, size_t length) {
+    unsigned hash = hash_text(text, length);
+    
+    pthread_mutex_lock(&table_lock);
+    const char *copy = intern_locked(text, length, hash);
+    pthread_mutex_unlock(&table_lock);
+    return copy;
+}
+
+// Get the canonical copy of a '\0'-terminated string
+const char* intern_cstr(const char *text) {
+    return intern_string(text, strlen(text));
+}
+
+// Number of distinct strings currently interned
+size_t intern_count(void) {
+    return table_count;
+}
+
+// Bytes held by the table and the string storage
+size_t intern_memory_usage(void) {
+    size_t bytes = table_capacity * sizeof(InternEntry);
+    if (strings) bytes += strings->bytes_reserved;
+    return bytes;
+}
+
+// Release every interned string
+void free_interner(void) {
+    arena_destroy(strings);
+    strings = NULL;
+    free(table);
+    table = NULL;
+    table_capacity = 0;
+    table_count = 0;
+}
@@ -0,0 +1,29 @@
+/**
+ * String Interning Header
+ *
+ * Global table of canonical strings. Interning the same text twice
+ * returns the same pointer, so names can be compared with ==.
+ * Interning is thread-safe; freeing is not.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+// Get the canonical copy of a text slice (does not need to be '\0'-terminated)
+const char* intern_string(const char *text, size_t length);
+
+// Get the canonical copy of a '\0'-terminated string
+const char* intern_cstr(const char *text);
+
+// Number of distinct strings currently interned
+size_t intern_count(void);
+
+// Bytes held by the interner
+size_t intern_memory_usage(void);
+
+// Release every interned string, invalidating all returned pointers
+void free_interner(void);
+
+#endif // INTERN_H
@@ -0,0 +1,404 @@
+/**
+ * Intermediate Representation Implementation
+ *
+ * Construction helpers, the CFG and liveness shared by the passes, and a
+ * textual listing for debugging.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ir.h"
+#include "intern.h"
+
+// Grow an array by doubling, 0 on failure
+#define GROW(array, count, capacity) \
+    ((count) < (capacity) || grow_array((void**)&(array), &(capacity), sizeof(*(array))))
+
+// Double the capacity of an array
+static int grow_array(void **array, int *capacity, size_t element_size) {
+    int grown = *capacity ? *capacity * 2 : 16;
+    void *items = realloc(*array, (size_t)grown * element_size);
+    if (!items) return 0;
+    *array = items;
+    *capacity = grown;
+    return 1;
+}
+
+// Create an empty program
+IRProgram* ir_create_program(void) {
+    return (IRProgram*)calloc(1, sizeof(IRProgram));
+}
+
+// Free a program and its functions
+void ir_free_program(IRProgram *program) {
+    if (!program) return;
+    for (int i = 0; i < program->num_functions; i++) {
+        free(program->functions[i].insns);
+        free(program->functions[i].args);
+    }
+    free(program->functions);
+    free(program->globals);
+    free(program->strings);
+    free(program);
+}
+
+// Start a function; the pointer is valid until the next function is added
+IRFunction* ir_add_function(IRProgram *program, const char *name) {
+    if (!GROW(program->functions, program->num_functions, program->functions_capacity)) {
+        program->failed = 1;
+        return NULL;
+    }
+    IRFunction *function = &program->functions[program->num_functions++];
+    memset(function, 0, sizeof(IRFunction));
+    function->name = name;
+    return function;
+}
+
+// Add a zero-initialized word-sized global
+IRGlobal* ir_add_global(IRProgram *program, const char *name) {
+    if (!GROW(program->globals, program->num_globals, program->globals_capacity)) {
+        program->failed = 1;
+        return NULL;
+    }
+    IRGlobal *global = &program->globals[program->num_globals++];
+    memset(global, 0, sizeof(IRGlobal));
+    global->name = name;
+    global->size = 4;
+    global->align = 4;
+    return global;
+}
+
+// Add a string literal, returns its index or -1
+int ir_add_string(IRProgram *program, const char *literal) {
+    if (!GROW(program->strings, program->num_strings, program->strings_capacity)) {
+        program->failed = 1;
+        return -1;
+    }
+    program->strings[program->num_strings] = literal;
+    return program->num_strings++;
+}
+
+// Allocate a virtual register
+int ir_new_vreg(IRFunction *function) {
+    return function->num_vregs++;
+}
+
+// Allocate a label number
+int ir_new_label(IRFunction *function) {
+    return function->num_labels++;
+}
+
+// Append an instruction with no operands; once the buffer failed to grow,
+// a scratch instruction is returned and the function is marked failed
+IRInsn* ir_emit(IRFunction *function, IROp op) {
+    IRInsn *insn = &function->discard;
+    if (GROW(function->insns, function->num_insns, function->capacity)) {
+        insn = &function->insns[function->num_insns++];
+    } else {
+        function->failed = 1;
+    }
+    memset(insn, 0, sizeof(IRInsn));
+    insn->op = (uint8_t)op;
+    insn->dst = IR_NONE;
+    insn->a = IR_NONE;
+    insn->b = IR_NONE;
+    return insn;
+}
+
+// Record the argument registers of a call, returns the index of the first one
+int ir_add_call_args(IRFunction *function, const int32_t *args, int count) {
+    int first = function->num_args;
+    for (int i = 0; i < count; i++) {
+        if (!GROW(function->args, function->num_args, function->args_capacity)) {
+            function->failed = 1;
+            return first;
+        }
+        function->args[function->num_args++] = args[i];
+    }
+    return first;
+}
+
+// Operands read by an instruction
+int ir_reads(const IRInsn *insn) {
+    switch ((IROp)insn->op) {
+        case IR_COPY:
+        case IR_UNARY:
+        case IR_LOAD:
+            return IR_READS_A;
+        case IR_RETURN:
+            return insn->a != IR_NONE ? IR_READS_A : 0;
+        case IR_BINARY:
+        case IR_BRANCH:
+            return insn->flags & IR_IMM_B ? IR_READS_A : IR_READS_A | IR_READS_B;
+        case IR_STORE:
+            return IR_READS_A | IR_READS_B;
+        default:
+            return 0;
+    }
+}
+
+// Check whether instruction i ends its block
+static int ends_block(const IRFunction *function, int i) {
+    IROp op = (IROp)function->insns[i].op;
+    if (op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN) return 1;
+    return i + 1 == function->num_insns || function->insns[i + 1].op == IR_LABEL;
+}
+
+// Split a function into blocks and link them
+int ir_build_cfg(const IRFunction *function, IRCfg *cfg) {
+    memset(cfg, 0, sizeof(IRCfg));
+    int count = 0;
+    for (int i = 0; i < function->num_insns; i++) {
+        if (ends_block(function, i)) count++;
+    }
+
+    cfg->blocks = (IRBlock*)calloc(count ? count : 1, sizeof(IRBlock));
+    cfg->label_block = (int*)malloc((function->num_labels ? function->num_labels : 1) * sizeof(int));
+    cfg->edges = (int*)malloc((count ? 2 * count : 1) * sizeof(int));
+    if (!cfg->blocks || !cfg->label_block || !cfg->edges) {
+        ir_free_cfg(cfg);
+        return 0;
+    }
+    cfg->num_blocks = count;
+
+    int b = 0;
+    int first = 0;
+    for (int i = 0; i < function->num_insns; i++) {
+        if (function->insns[i].op == IR_LABEL) cfg->label_block[function->insns[i].imm] = b;
+        if (ends_block(function, i)) {
+            cfg->blocks[b].first = first;
+            cfg->blocks[b].last = i;
+            b++;
+            first = i + 1;
+        }
+    }
+
+    for (b = 0; b < count; b++) {
+        IRBlock *block = &cfg->blocks[b];
+        const IRInsn *last = &function->insns[block->last];
+        int next = b + 1 < count ? b + 1 : -1;
+        block->succ[0] = -1;
+        block->succ[1] = -1;
+        if (last->op == IR_JUMP) {
+            block->succ[0] = cfg->label_block[last->imm];
+        } else if (last->op == IR_BRANCH) {
+            block->succ[0] = cfg->label_block[last->imm];
+            // A branch to the next block is a single edge
+            if (next != block->succ[0]) block->succ[1] = next;
+        } else if (last->op != IR_RETURN) {
+            block->succ[0] = next;
+        }
+        for (int s = 0; s < 2; s++) {
+            if (block->succ[s] >= 0) cfg->blocks[block->succ[s]].num_preds++;
+        }
+    }
+
+    // Predecessor lists carved out of one array, filled in block order
+    int offset = 0;
+    for (b = 0; b < count; b++) {
+        cfg->blocks[b].preds = cfg->edges + offset;
+        offset += cfg->blocks[b].num_preds;
+        cfg->blocks[b].num_preds = 0;
+    }
+    for (b = 0; b < count; b++) {
+        for (int s = 0; s < 2; s++) {
+            int succ = cfg->blocks[b].succ[s];
+            if (succ >= 0) cfg->blocks[succ].preds[cfg->blocks[succ].num_preds++] = b;
+        }
+    }
+    return 1;
+}
+
+// Free the arrays of a CFG
+void ir_free_cfg(IRCfg *cfg) {
+    free(cfg->blocks);
+    free(cfg->label_block);
+    free(cfg->edges);
+    memset(cfg, 0, sizeof(IRCfg));
+}
+
+// Add a read to the upward-exposed uses unless the block defined it first
+static void note_use(uint32_t *use, const uint32_t *def, int vreg) {
+    if (!IR_LIVE(def, vreg)) use[vreg >> 5] |= 1u << (vreg & 31);
+}
+
+// Solve liveness backwards to a fixed point
+int ir_compute_liveness(const IRFunction *function, const IRCfg *cfg, IRLiveness *liveness) {
+    int words = (function->num_vregs + 31) / 32;
+    size_t set_count = (size_t)cfg->num_blocks * words;
+    memset(liveness, 0, sizeof(IRLiveness));
+    liveness->words = words;
+    liveness->live_in = (uint32_t*)calloc(set_count ? set_count : 1, sizeof(uint32_t));
+    liveness->live_out = (uint32_t*)calloc(set_count ? set_count : 1, sizeof(uint32_t));
+    uint32_t *use = (uint32_t*)calloc(set_count ? set_count : 1, sizeof(uint32_t));
+    uint32_t *def = (uint32_t*)calloc(set_count ? set_count : 1, sizeof(uint32_t));
+    if (!liveness->live_in || !liveness->live_out || !use || !def) {
+        free(use);
+        free(def);
+        ir_free_liveness(liveness);
+        return 0;
+    }
+
+    // Upward-exposed uses and definitions of each block
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        uint32_t *block_use = use + (size_t)b * words;
+        uint32_t *block_def = def + (size_t)b * words;
+        for (int i = cfg->blocks[b].first; i <= cfg->blocks[b].last; i++) {
+            const IRInsn *insn = &function->insns[i];
+            int reads = ir_reads(insn);
+            if (reads & IR_READS_A) note_use(block_use, block_def, insn->a);
+            if (reads & IR_READS_B) note_use(block_use, block_def, insn->b);
+            if (insn->op == IR_CALL) {
+                for (int j = 0; j < insn->imm; j++) note_use(block_use, block_def, function->args[insn->a + j]);
+            }
+            if (insn->dst != IR_NONE) block_def[insn->dst >> 5] |= 1u << (insn->dst & 31);
+        }
+    }
+
+    // Reverse block order converges fastest on forward-laid-out code
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = cfg->num_blocks - 1; b >= 0; b--) {
+            uint32_t *out = liveness->live_out + (size_t)b * words;
+            uint32_t *in = liveness->live_in + (size_t)b * words;
+            const uint32_t *block_use = use + (size_t)b * words;
+            const uint32_t *block_def = def + (size_t)b * words;
+            for (int w = 0; w < words; w++) {
+                uint32_t bits = 0;
+                for (int s = 0; s < 2; s++) {
+                    int succ = cfg->blocks[b].succ[s];
+                    if (succ >= 0) bits |= liveness->live_in[(size_t)succ * words + w];
+                }
+                out[w] = bits;
+                bits = block_use[w] | (bits & ~block_def[w]);
+                if (bits != in[w]) {
+                    in[w] = bits;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    free(use);
+    free(def);
+    return 1;
+}
+
+// Free the sets of a liveness
+void ir_free_liveness(IRLiveness *liveness) {
+    free(liveness->live_in);
+    free(liveness->live_out);
+    liveness->live_in = NULL;
+    liveness->live_out = NULL;
+}
+
+// Symbol of the string literal with the given index
+const char* ir_string_symbol(int index) {
+    char name[32];
+    snprintf(name, sizeof(name), ".LC%d", index);
+    return intern_cstr(name);
+}
+
+// Operator spellings, in BinaryOp order
+static const char *binary_names[] = {
+    "+", "-", "*", "/", "%", "==", "!=", "<", ">", "<=", ">=",
+    "&&", "||", "&", "|", "^", "<<", ">>"
+};
+
+// Print operand b, register or immediate
+static void print_b(FILE *out, const IRInsn *insn) {
+    if (insn->flags & IR_IMM_B) fprintf(out, "%d", insn->b);
+    else fprintf(out, "v%d", insn->b);
+}
+
+// Print a function listing, one instruction per line
+void ir_print_function(FILE *out, const IRFunction *function) {
+    fprintf(out, "function %s (%d params, %d vregs)\n", function->name,
+            function->num_params, function->num_vregs);
+    for (int i = 0; i < function->num_insns; i++) {
+        const IRInsn *insn = &function->insns[i];
+        const char *size = insn->flags & IR_BYTE ? "byte " : "";
+        switch ((IROp)insn->op) {
+            case IR_CONST:
+                fprintf(out, "    v%d = %d\n", insn->dst, insn->imm);
+                break;
+            case IR_ADDR:
+                fprintf(out, "    v%d = &%s\n", insn->dst, insn->symbol);
+                break;
+            case IR_FRAME_ADDR:
+                fprintf(out, "    v%d = &frame[%d]\n", insn->dst, insn->imm);
+                break;
+            case IR_COPY:
+                fprintf(out, "    v%d = v%d\n", insn->dst, insn->a);
+                break;
+            case IR_BINARY:
+                fprintf(out, "    v%d = v%d %s ", insn->dst, insn->a, binary_names[insn->subop]);
+                print_b(out, insn);
+                fputc('\n', out);
+                break;
+            case IR_UNARY:
+                fprintf(out, "    v%d = %cv%d\n", insn->dst,
+                        insn->subop == OP_NEGATE ? '-' : '~', insn->a);
+                break;
+            case IR_LOAD:
+                fprintf(out, "    v%d = %s[v%d + %d]\n", insn->dst, size, insn->a, insn->imm);
+                break;
+            case IR_STORE:
+                fprintf(out, "    %s[v%d + %d] = v%d\n", size, insn->a, insn->imm, insn->b);
+                break;
+            case IR_CALL:
+                fprintf(out, "    ");
+                if (insn->dst != IR_NONE) fprintf(out, "v%d = ", insn->dst);
+                fprintf(out, "call %s(", insn->symbol);
+                for (int j = 0; j < insn->imm; j++) {
+                    fprintf(out, "%sv%d", j ? ", " : "", function->args[insn->a + j]);
+                }
+                fprintf(out, ")%s\n", insn->flags & IR_RESULT1 ? " r1" : "");
+                break;
+            case IR_PARAM:
+                fprintf(out, "    v%d = param %d\n", insn->dst, insn->imm);
+                break;
+            case IR_LABEL:
+                fprintf(out, "L%d:\n", insn->imm);
+                break;
+            case IR_JUMP:
+                fprintf(out, "    goto L%d\n", insn->imm);
+                break;
+            case IR_BRANCH:
+                fprintf(out, "    if v%d %s ", insn->a, binary_names[insn->subop]);
+                print_b(out, insn);
+                fprintf(out, " goto L%d\n", insn->imm);
+                break;
+            case IR_RETURN:
+                if (insn->a != IR_NONE) fprintf(out, "    return v%d\n", insn->a);
+                else fprintf(out, "    return\n");
+                break;
+            case IR_PHI:
+                fprintf(out, "    v%d = phi(", insn->dst);
+                for (int j = 0; j < insn->imm; j++) {
+                    fprintf(out, "%sv%d", j ? ", " : "", function->args[insn->a + j]);
+                }
+                fprintf(out, ")\n");
+                break;
+            default:
+                fprintf(out, "    ?\n");
+                break;
+        }
+    }
+}
+
+// Print the listing of every function of a program
+void ir_print_program(FILE *out, const IRProgram *program) {
+    for (int i = 0; i < program->num_globals; i++) {
+        const IRGlobal *global = &program->globals[i];
+        fprintf(out, "global %s (%d bytes)", global->name, global->size);
+        if (global->has_value) fprintf(out, " = %d", global->value);
+        fputc('\n', out);
+    }
+    for (int i = 0; i < program->num_functions; i++) {
+        ir_print_function(out, &program->functions[i]);
+    }
+}
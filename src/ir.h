@@ -0,0 +1,166 @@
+/**
+ * Intermediate Representation Header
+ *
+ * Three-address code between the AST and the backend. A function is one
+ * flat array of fixed-size instructions over virtual registers; control
+ * flow uses numbered labels. Scalar locals and parameters are virtual
+ * registers (the language has no address-of operator), while globals and
+ * arrays are reached through loads and stores.
+ *
+ * Basic blocks are ranges of that array, described by an IRCfg built on
+ * demand, so passes that only rewrite instructions need no CFG upkeep.
+ */
+
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ast.h"
+
+// No virtual register
+#define IR_NONE (-1)
+
+// Operations (d = dst; a, b = operands, b an immediate with IR_IMM_B)
+typedef enum {
+    IR_CONST,        // d = imm
+    IR_ADDR,         // d = address of symbol
+    IR_FRAME_ADDR,   // d = address of byte imm of the function's array area
+    IR_COPY,         // d = a
+    IR_BINARY,       // d = a subop b, subop a BinaryOp (no logical, division or modulo)
+    IR_UNARY,        // d = subop a, subop OP_NEGATE or OP_BITWISE_NOT
+    IR_LOAD,         // d = [a + imm]
+    IR_STORE,        // [a + imm] = b
+    IR_CALL,         // d = symbol(args), args[a .. a + imm) of the function
+    IR_PARAM,        // d = incoming parameter imm
+    IR_LABEL,        // label imm
+    IR_JUMP,         // goto label imm
+    IR_BRANCH,       // if (a subop b) goto label imm, subop a comparison BinaryOp
+    IR_RETURN,       // return a (IR_NONE for none)
+    IR_PHI,          // d = args[a .. a + imm), one per predecessor in IRCfg order (SSA only)
+    IR_NUM_OPS
+} IROp;
+
+// Instruction flags
+#define IR_IMM_B   0x01  // Operand b is an immediate, held in b
+#define IR_BYTE    0x02  // Loads and stores access one byte, zero-extended
+#define IR_RESULT1 0x04  // Calls: the result comes back in r1 (__aeabi_idivmod)
+
+// Operands an instruction reads, see ir_reads
+#define IR_READS_A 0x01
+#define IR_READS_B 0x02
+
+// One instruction
+typedef struct {
+    uint8_t op;          // IROp
+    uint8_t subop;       // Operator or comparison
+    uint8_t flags;
+    uint8_t reserved;
+    int32_t dst;
+    int32_t a;
+    int32_t b;
+    int32_t imm;         // Constant, label, offset, argument count or parameter index
+    const char *symbol;  // Interned callee or symbol, else NULL
+} IRInsn;
+
+// One function
+typedef struct {
+    const char *name;    // Interned
+    IRInsn *insns;
+    int num_insns;
+    int capacity;
+    int32_t *args;       // Argument registers of every call and phi, in order
+    int num_args;
+    int args_capacity;
+    int num_vregs;
+    int num_labels;
+    int num_params;
+    int array_bytes;     // Size of the array area of the frame
+    int in_ssa;          // Set while the function is in SSA form (ssa.h)
+    int failed;          // Set once an allocation failed
+    IRInsn discard;      // Written instead once failed
+} IRFunction;
+
+// Basic block: a run of instructions entered only at the first one and
+// left only after the last one
+typedef struct {
+    int first;           // Index of the first instruction
+    int last;            // Index of the last instruction
+    int succ[2];         // Successors, -1 for none; the taken branch first
+    int *preds;          // Predecessors, in block order
+    int num_preds;
+} IRBlock;
+
+// Control-flow graph of a function, blocks in instruction order
+typedef struct {
+    IRBlock *blocks;
+    int num_blocks;
+    int *label_block;    // Block of each label
+    int *edges;          // Storage of the predecessor lists
+} IRCfg;
+
+// Live virtual registers at the borders of the blocks, as bitsets
+typedef struct {
+    int words;           // 32-bit words per set
+    uint32_t *live_in;   // num_blocks sets
+    uint32_t *live_out;
+} IRLiveness;
+
+// Test a virtual register in a set of a liveness
+#define IR_LIVE(set, vreg) (((set)[(vreg) >> 5] >> ((vreg) & 31)) & 1u)
+
+// Global variable of the unit
+typedef struct {
+    const char *name;    // Interned
+    int size;            // Bytes
+    int align;
+    int has_value;
+    int32_t value;
+} IRGlobal;
+
+// Whole translation unit
+typedef struct {
+    IRFunction *functions;
+    int num_functions;
+    int functions_capacity;
+    IRGlobal *globals;
+    int num_globals;
+    int globals_capacity;
+    const char **strings;  // Literals as written between the quotes
+    int num_strings;
+    int strings_capacity;
+    int failed;
+} IRProgram;
+
+// Program construction
+IRProgram* ir_create_program(void);
+void ir_free_program(IRProgram *program);
+IRFunction* ir_add_function(IRProgram *program, const char *name);
+IRGlobal* ir_add_global(IRProgram *program, const char *name);
+int ir_add_string(IRProgram *program, const char *literal);
+
+// Function construction
+int ir_new_vreg(IRFunction *function);
+int ir_new_label(IRFunction *function);
+IRInsn* ir_emit(IRFunction *function, IROp op);
+int ir_add_call_args(IRFunction *function, const int32_t *args, int count);
+
+// Operands read by an instruction, IR_READS_A and IR_READS_B; the
+// arguments of calls and phis come on top
+int ir_reads(const IRInsn *insn);
+
+// Blocks and liveness; phis are not handled by the liveness (build it
+// on code outside SSA form). Both return 0 on allocation failure.
+int ir_build_cfg(const IRFunction *function, IRCfg *cfg);
+void ir_free_cfg(IRCfg *cfg);
+int ir_compute_liveness(const IRFunction *function, const IRCfg *cfg, IRLiveness *liveness);
+void ir_free_liveness(IRLiveness *liveness);
+
+// Symbol of the string literal with the given index (.LC<index>)
+const char* ir_string_symbol(int index);
+
+// Human-readable listing
+void ir_print_function(FILE *out, const IRFunction *function);
+void ir_print_program(FILE *out, const IRProgram *program);
+
+#endif // IR_H
@@ -4,54 +4,95 @@
  * Handles the lexical analysis phase of compilation,
  * converting source text into a stream of tokens.
 */
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <assert.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "lexeme.h"
 #include "error.h"
+#include "intern.h"
+#include "scan.h"
  
-#define BUFFER_SIZE 4096
+// Initial capacity used when the input size cannot be queried up front
+#define READ_CHUNK_SIZE 65536
+
+// Zero bytes appended after the source text; the first acts as the EOF sentinel
+// and the rest let the block scanners read past it
+#define BUFFER_PADDING SCAN_PADDING
+
+// Read the whole input into one contiguous, sentinel-terminated buffer
+static char* read_whole_file(FILE *file, int *out_size, unsigned long *num_reads) {
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t size = 0;
+    
+    // Use the file size as a hint when the stream is seekable
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long end = ftell(file);
+        if (end > 0) capacity = (size_t)end + 1;  // One spare byte lets the first read hit EOF
+        fseek(file, 0, SEEK_SET);
+    }
+    
+    char *buffer = (char*)malloc(capacity + BUFFER_PADDING);
+    if (!buffer) return NULL;
+    
+    for (;;) {
+        size_t bytes_read = fread(buffer + size, 1, capacity - size, file);
+        (*num_reads)++;
+        size += bytes_read;
+        if (size < capacity) break;
+        
+        // Buffer is full: grow it and keep reading until EOF
+        char *new_buffer = (char*)realloc(buffer, capacity * 2 + BUFFER_PADDING);
+        if (!new_buffer) {
+            free(buffer);
+            return NULL;
+        }
+        buffer = new_buffer;
+        capacity *= 2;
+    }
+    
+    memset(buffer + size, '\0', BUFFER_PADDING);
+    *out_size = (int)size;
+    return buffer;
+}
  
-// Initialize lexer with input file
-Lexer* init_lexer(FILE *file, char *filename) {
+// Initialize lexer with input file, errors are reported to diag
+Lexer* init_lexer(FILE *file, char *filename, DiagEngine *diag) {
+    if (!file) return NULL;
+    
     Lexer *lexer = (Lexer*)malloc(sizeof(Lexer));
     if (!lexer) return NULL;
      
     lexer->file = file;
     lexer->filename = strdup(filename);
-    lexer->buffer_size = BUFFER_SIZE;
-    lexer->buffer = (char*)malloc(lexer->buffer_size);
-    if (!lexer->buffer) {
-        free(lexer->filename);
-        free(lexer);
-        return NULL;
-    }
+    lexer->num_tokens = 0;
+    lexer->num_reads = 0;
+    lexer->stats = NULL;
+    lexer->diag = diag;
     
-    // Validate file and buffer
-    if (!file || !lexer->buffer) {
+    // Load the whole file at once, no refill is ever needed afterwards
+    lexer->buffer = read_whole_file(file, &lexer->buffer_size, &lexer->num_reads);
+    if (!lexer->buffer) {
         free(lexer->filename);
-        free(lexer->buffer);
         free(lexer);
         return NULL;
     }
-
-    // Read initial buffer
-    size_t bytes_read = fread(lexer->buffer, 1, lexer->buffer_size, file);
-    assert(lexer->buffer_size >= 0); // Ensure non-negative first
-    if (bytes_read < (size_t)lexer->buffer_size){lexer->buffer[bytes_read] = '\0';} // Ensure null termination
      
     lexer->position = 0;
-    lexer->line = 1;
-    lexer->column = 1;
-     
-    // Initialize with first token
-    lexer->current.type = TOKEN_ERROR;
-    lexer->current.value = NULL;
-    advance_token(lexer);
+    lexer->line_starts = NULL;  // Built on the first location query
+    lexer->num_lines = 0;
+    lexer->ring_head = 0;       // The first batch is lexed on the first peek
+    lexer->ring_count = 0;
+    lexer->tokens = NULL;       // Only set by lexer_lex_all
+    lexer->num_tokens_total = 0;
+    lexer->next_token = 0;
+    lexer->sources = NULL;      // Only the main buffer until lexer_add_source
+    lexer->num_sources = 0;
+    lexer->sources_capacity = 0;
      
     return lexer;
 }
@@ -61,54 +102,27 @@ void free_lexer(Lexer *lexer) {
      if (lexer) {
          free(lexer->filename);
          free(lexer->buffer);
-         if (lexer->current.value) {
-             free(lexer->current.value);
-         }
+         free(lexer->line_starts);
+         free(lexer->tokens);
+         free(lexer->sources);
          free(lexer);
      }
  }
  
-// Reload buffer with more file data
-static int reload_buffer(Lexer *lexer) {
-    // If we're at the end of the file, nothing to reload
-    if (feof(lexer->file)) return 0;
-     
-    size_t bytes_read = fread(lexer->buffer, 1, lexer->buffer_size, lexer->file);
-    if (bytes_read == 0) return 0;
-     
-    lexer->position = 0;
-    assert(lexer->buffer_size >= 0);
-    if (bytes_read < (size_t)lexer->buffer_size){lexer->buffer[bytes_read] = '\0';} 
-    return 1;
-}
- 
-// Get current character
-static char current_char(Lexer *lexer) {
-     if (lexer->position >= lexer->buffer_size) {
-         if (!reload_buffer(lexer)) {
-             return '\0';  // EOF
-         }
-     }
-     
+// Get current character (the buffer always ends with a '\0' sentinel)
+static inline char current_char(Lexer *lexer) {
      return lexer->buffer[lexer->position];
  }
  
-// Advance to next character
-static void advance_char(Lexer *lexer) {
-     if (current_char(lexer) == '\n') {
-         lexer->line++;
-         lexer->column = 1;
-     } else {
-         lexer->column++;
-     }
-     
+// Advance to next character (lines and columns are recovered from offsets on demand)
+static inline void advance_char(Lexer *lexer) {
      lexer->position++;
  }
  
 // Peek at next character without advancing
-static char peek_char(Lexer *lexer) {
-     if (lexer->position + 1 >= lexer->buffer_size) {
-         return '\0';  // Can't peek beyond buffer
+static inline char peek_char(Lexer *lexer) {
+     if (current_char(lexer) == '\0') {
+         return '\0';  // Never look past the sentinel
      }
      
      return lexer->buffer[lexer->position + 1];
@@ -116,9 +130,7 @@ static char peek_char(Lexer *lexer) {
  
 // Skip whitespace
 static void skip_whitespace(Lexer *lexer) {
-     while (isspace(current_char(lexer))) {
-         advance_char(lexer);
-     }
+     lexer->position += (int)scan_whitespace(lexer->buffer + lexer->position);
  }
  
 // Skip comments
@@ -126,12 +138,7 @@ static void skip_comments(Lexer *lexer) {
      // Single-line comment
      if (current_char(lexer) == '/' && peek_char(lexer) == '/') {
          // Skip until end of line
-         advance_char(lexer);  // Skip first '/'
-         advance_char(lexer);  // Skip second '/'
-         
-         while (current_char(lexer) != '\n' && current_char(lexer) != '\0') {
-             advance_char(lexer);
-         }
+         lexer->position += (int)scan_line_end(lexer->buffer + lexer->position);
          if (current_char(lexer) == '\n') {
              advance_char(lexer);  // Skip newline
          }
@@ -141,153 +148,139 @@ static void skip_comments(Lexer *lexer) {
          advance_char(lexer);  // Skip '/'
          advance_char(lexer);  // Skip '*'
          
-         while (!(current_char(lexer) == '*' && peek_char(lexer) == '/') && 
-                current_char(lexer) != '\0') {
-             advance_char(lexer);
-         }
+         lexer->position += (int)scan_block_comment(lexer->buffer + lexer->position);
          
          if (current_char(lexer) != '\0') {
              advance_char(lexer);  // Skip '*'
              advance_char(lexer);  // Skip '/'
          } else {
-             lexer_error(lexer, "Unterminated multi-line comment");
+             lexer_error(lexer, DIAG_UNTERMINATED_COMMENT);
          }
      }
  }
  
+// Keyword table, indexed by a perfect hash over length, first and last character.
+// The multiplier keeps every C89 keyword in its own slot, so new keywords only
+// need a table entry; a collision shows up as an "initialized field overwritten"
+// warning (-Woverride-init, part of -Wextra) and therefore fails the build.
+#define KEYWORD_TABLE_SIZE 64
+#define KEYWORD_MAX_LENGTH 8
+#define KEYWORD_HASH(length, first, last) \
+     (((length) + (unsigned char)(first) * 54 + (unsigned char)(last)) & (KEYWORD_TABLE_SIZE - 1))
+
+typedef struct {
+     const char *text;
+     int length;
+     TokenType type;
+} Keyword;
+
+static const Keyword keyword_table[KEYWORD_TABLE_SIZE] = {
+     [KEYWORD_HASH(3, 'i', 't')] = { "int",    3, TOKEN_INT },
+     [KEYWORD_HASH(4, 'c', 'r')] = { "char",   4, TOKEN_CHAR },
+     [KEYWORD_HASH(4, 'v', 'd')] = { "void",   4, TOKEN_VOID },
+     [KEYWORD_HASH(2, 'i', 'f')] = { "if",     2, TOKEN_IF },
+     [KEYWORD_HASH(4, 'e', 'e')] = { "else",   4, TOKEN_ELSE },
+     [KEYWORD_HASH(5, 'w', 'e')] = { "while",  5, TOKEN_WHILE },
+     [KEYWORD_HASH(3, 'f', 'r')] = { "for",    3, TOKEN_FOR },
+     [KEYWORD_HASH(6, 'r', 'n')] = { "return", 6, TOKEN_RETURN },
+};
+
+// Classify an identifier slice of the source buffer as a keyword or identifier
+static TokenType lookup_keyword(const char *text, int length) {
+     if (length < 2 || length > KEYWORD_MAX_LENGTH) return TOKEN_IDENTIFIER;
+     
+     const Keyword *keyword = &keyword_table[KEYWORD_HASH(length, text[0], text[length - 1])];
+     if (keyword->length == length && memcmp(keyword->text, text, length) == 0) {
+         return keyword->type;
+     }
+     return TOKEN_IDENTIFIER;
+ }
+ 
+// Build a token spanning the source text from start_pos to the current position
+static inline Token make_token(Lexer *lexer, TokenType type, int start_pos) {
+     Token token;
+     token.type = type;
+     token.offset = (unsigned)start_pos;
+     token.length = (unsigned)(lexer->position - start_pos);
+     return token;
+ }
+ 
+// Decode the character following a backslash, returns 0 for unknown escapes
+static int decode_escape(char escape, char *out) {
+     switch (escape) {
+         case 'n': *out = '\n'; return 1;
+         case 't': *out = '\t'; return 1;
+         case 'r': *out = '\r'; return 1;
+         case '0': *out = '\0'; return 1;
+         case '\\': *out = '\\'; return 1;
+         case '\'': *out = '\''; return 1;
+         case '\"': *out = '\"'; return 1;
+         default: return 0;
+     }
+ }
+ 
 // Scan identifier or keyword
 static Token scan_identifier(Lexer *lexer) {
-     Token token;
      int start_pos = lexer->position;
-     int start_line = lexer->line;
-     int start_col = lexer->column;
      
-     while (isalnum(current_char(lexer)) || current_char(lexer) == '_') {
-         advance_char(lexer);
-     }
+     int length = (int)scan_identifier_length(lexer->buffer + start_pos);
+     lexer->position += length;
      
-     // Extract identifier text
-     int length = lexer->position - start_pos;
-     char *value = (char*)malloc(length + 1);
-     strncpy(value, lexer->buffer + start_pos, length);
-     value[length] = '\0';
-     
-     // Check if this is a keyword
-     token.type = TOKEN_IDENTIFIER;
-     if (strcmp(value, "int") == 0) token.type = TOKEN_INT;
-     else if (strcmp(value, "char") == 0) token.type = TOKEN_CHAR;
-     else if (strcmp(value, "void") == 0) token.type = TOKEN_VOID;
-     else if (strcmp(value, "if") == 0) token.type = TOKEN_IF;
-     else if (strcmp(value, "else") == 0) token.type = TOKEN_ELSE;
-     else if (strcmp(value, "while") == 0) token.type = TOKEN_WHILE;
-     else if (strcmp(value, "for") == 0) token.type = TOKEN_FOR;
-     else if (strcmp(value, "return") == 0) token.type = TOKEN_RETURN;
-     
-     token.value = value;
-     token.line = start_line;
-     token.column = start_col;
-     token.filename = lexer->filename;
+     // Check if this is a keyword, directly on the buffer slice
+     TokenType type = lookup_keyword(lexer->buffer + start_pos, length);
      
-     return token;
+     return make_token(lexer, type, start_pos);
  }
  
 // Scan numeric literal
 static Token scan_number(Lexer *lexer) {
-     Token token;
      int start_pos = lexer->position;
-     int start_line = lexer->line;
-     int start_col = lexer->column;
      
      while (isdigit(current_char(lexer))) {
          advance_char(lexer);
      }
      
-     // Extract number text
-     int length = lexer->position - start_pos;
-     char *value = (char*)malloc(length + 1);
-     strncpy(value, lexer->buffer + start_pos, length);
-     value[length] = '\0';
-     
-     token.type = TOKEN_INTEGER;
-     token.value = value;
-     token.line = start_line;
-     token.column = start_col;
-     token.filename = lexer->filename;
-     
-     return token;
+     return make_token(lexer, TOKEN_INTEGER, start_pos);
  }
  
 // Scan character literal
 static Token scan_character(Lexer *lexer) {
-     Token token;
-     int start_line = lexer->line;
-     int start_col = lexer->column;
+     int start_pos = lexer->position;
      
      advance_char(lexer);  // Skip opening quote
      
      char c;
      if (current_char(lexer) == '\\') {
          advance_char(lexer);  // Skip backslash
-         switch (current_char(lexer)) {
-             case 'n': c = '\n'; break;
-             case 't': c = '\t'; break;
-             case 'r': c = '\r'; break;
-             case '0': c = '\0'; break;
-             case '\\': c = '\\'; break;
-             case '\'': c = '\''; break;
-             case '\"': c = '\"'; break;
-             default:
-                 lexer_error(lexer, "Invalid escape sequence");
-                 token.type = TOKEN_ERROR;
-                 token.value = strdup("Invalid escape sequence");
-                 token.line = start_line;
-                 token.column = start_col;
-                 token.filename = lexer->filename;
-                 return token;
+         if (!decode_escape(current_char(lexer), &c)) {
+             lexer_error(lexer, DIAG_INVALID_ESCAPE);
+             return make_token(lexer, TOKEN_ERROR, start_pos);
          }
          advance_char(lexer);
      } else {
-         c = current_char(lexer);
+         if (current_char(lexer) == '\0') {
+             lexer_error(lexer, DIAG_UNTERMINATED_CHARACTER);
+             return make_token(lexer, TOKEN_ERROR, start_pos);
+         }
          advance_char(lexer);
      }
      
      if (current_char(lexer) != '\'') {
-         lexer_error(lexer, "Unterminated character literal");
-         token.type = TOKEN_ERROR;
-         token.value = strdup("Unterminated character literal");
-         token.line = start_line;
-         token.column = start_col;
-         token.filename = lexer->filename;
-         return token;
+         lexer_error(lexer, DIAG_UNTERMINATED_CHARACTER);
+         return make_token(lexer, TOKEN_ERROR, start_pos);
      }
      
      advance_char(lexer);  // Skip closing quote
      
-     // Create token
-     char *value = (char*)malloc(2);
-     value[0] = c;
-     value[1] = '\0';
-     
-     token.type = TOKEN_CHARACTER;
-     token.value = value;
-     token.line = start_line;
-     token.column = start_col;
-     token.filename = lexer->filename;
-     
-     return token;
+     return make_token(lexer, TOKEN_CHARACTER, start_pos);
  }
  
 // Scan string literal
 static Token scan_string(Lexer *lexer) {
-     Token token;
-     int start_line = lexer->line;
-     int start_col = lexer->column;
+     int start_pos = lexer->position;
      
      advance_char(lexer);  // Skip opening quote
      
-     int start_pos = lexer->position;
-     int length = 0;
-     
      while (current_char(lexer) != '\"' && current_char(lexer) != '\0') {
          if (current_char(lexer) == '\\') {
              advance_char(lexer);  // Skip backslash
@@ -296,39 +289,20 @@ static Token scan_string(Lexer *lexer) {
              }
          }
          advance_char(lexer);
-         length++;
      }
      
      if (current_char(lexer) == '\0') {
-         lexer_error(lexer, "Unterminated string literal");
-         token.type = TOKEN_ERROR;
-         token.value = strdup("Unterminated string literal");
-         token.line = start_line;
-         token.column = start_col;
-         token.filename = lexer->filename;
-         return token;
+         lexer_error(lexer, DIAG_UNTERMINATED_STRING);
+         return make_token(lexer, TOKEN_ERROR, start_pos);
      }
      
-     // Extract string value
-     char *value = (char*)malloc(length + 1);
-     strncpy(value, lexer->buffer + start_pos, length);
-     value[length] = '\0';
-     
      advance_char(lexer);  // Skip closing quote
      
-     token.type = TOKEN_STRING;
-     token.value = value;
-     token.line = start_line;
-     token.column = start_col;
-     token.filename = lexer->filename;
-     
-     return token;
+     return make_token(lexer, TOKEN_STRING, start_pos);
  }
  
-// Get the next token from input
-Token get_token(Lexer *lexer) {
-     Token token;
-     
+// Skip the whitespace and comments in front of a token
+static void skip_trivia(Lexer *lexer) {
      skip_whitespace(lexer);
      
      // Handle comments
@@ -337,18 +311,15 @@ Token get_token(Lexer *lexer) {
          skip_comments(lexer);
          skip_whitespace(lexer);
      }
-     
-     int start_line = lexer->line;
-     int start_col = lexer->column;
+ }
+ 
+// Scan the token starting at the current position
+static Token scan_token(Lexer *lexer) {
+     int start_pos = lexer->position;
      
      // EOF
      if (current_char(lexer) == '\0') {
-         token.type = TOKEN_EOF;
-         token.value = strdup("EOF");
-         token.line = start_line;
-         token.column = start_col;
-         token.filename = lexer->filename;
-         return token;
+         return make_token(lexer, TOKEN_EOF, start_pos);
      }
      
      // Identifiers and keywords
@@ -372,220 +343,484 @@ Token get_token(Lexer *lexer) {
      }
      
      // Operators and punctuation
-     token.type = TOKEN_ERROR;
-     token.line = start_line;
-     token.column = start_col;
-     token.filename = lexer->filename;
+     TokenType type = TOKEN_ERROR;
+     char c = current_char(lexer);
+     advance_char(lexer);
      
-     switch (current_char(lexer)) {
+     switch (c) {
          case '+':
-             advance_char(lexer);
              if (current_char(lexer) == '+') {
                  advance_char(lexer);
-                 token.type = TOKEN_INC;
-                 token.value = strdup("++");
+                 type = TOKEN_INC;
              } else {
-                 token.type = TOKEN_PLUS;
-                 token.value = strdup("+");
+                 type = TOKEN_PLUS;
              }
              break;
          case '-':
-             advance_char(lexer);
              if (current_char(lexer) == '-') {
                  advance_char(lexer);
-                 token.type = TOKEN_DEC;
-                 token.value = strdup("--");
+                 type = TOKEN_DEC;
              } else {
-                 token.type = TOKEN_MINUS;
-                 token.value = strdup("-");
+                 type = TOKEN_MINUS;
              }
              break;
-         case '*':
-             advance_char(lexer);
-             token.type = TOKEN_STAR;
-             token.value = strdup("*");
-             break;
-         case '/':
-             advance_char(lexer);
-             token.type = TOKEN_SLASH;
-             token.value = strdup("/");
-             break;
-         case '%':
-             advance_char(lexer);
-             token.type = TOKEN_PERCENT;
-             token.value = strdup("%");
-             break;
+         case '*': type = TOKEN_STAR; break;
+         case '/': type = TOKEN_SLASH; break;
+         case '%': type = TOKEN_PERCENT; break;
          case '=':
-             advance_char(lexer);
              if (current_char(lexer) == '=') {
                  advance_char(lexer);
-                 token.type = TOKEN_EQ;
-                 token.value = strdup("==");
+                 type = TOKEN_EQ;
              } else {
-                 token.type = TOKEN_ASSIGN;
-                 token.value = strdup("=");
+                 type = TOKEN_ASSIGN;
              }
              break;
          case '!':
-             advance_char(lexer);
              if (current_char(lexer) == '=') {
                  advance_char(lexer);
-                 token.type = TOKEN_NEQ;
-                 token.value = strdup("!=");
+                 type = TOKEN_NEQ;
              } else {
-                 token.type = TOKEN_NOT;
-                 token.value = strdup("!");
+                 type = TOKEN_NOT;
              }
              break;
          case '<':
-             advance_char(lexer);
              if (current_char(lexer) == '=') {
                  advance_char(lexer);
-                 token.type = TOKEN_LTE;
-                 token.value = strdup("<=");
+                 type = TOKEN_LTE;
              } else if (current_char(lexer) == '<') {
                  advance_char(lexer);
-                 token.type = TOKEN_SHL;
-                 token.value = strdup("<<");
+                 type = TOKEN_SHL;
              } else {
-                 token.type = TOKEN_LT;
-                 token.value = strdup("<");
+                 type = TOKEN_LT;
              }
              break;
          case '>':
-             advance_char(lexer);
              if (current_char(lexer) == '=') {
                  advance_char(lexer);
-                 token.type = TOKEN_GTE;
-                 token.value = strdup(">=");
+                 type = TOKEN_GTE;
              } else if (current_char(lexer) == '>') {
                  advance_char(lexer);
-                 token.type = TOKEN_SHR;
-                 token.value = strdup(">>");
+                 type = TOKEN_SHR;
              } else {
-                 token.type = TOKEN_GT;
-                 token.value = strdup(">");
+                 type = TOKEN_GT;
              }
              break;
          case '&':
-             advance_char(lexer);
              if (current_char(lexer) == '&') {
                  advance_char(lexer);
-                 token.type = TOKEN_AND;
-                 token.value = strdup("&&");
+                 type = TOKEN_AND;
              } else {
-                 token.type = TOKEN_BITAND;
-                 token.value = strdup("&");
+                 type = TOKEN_BITAND;
              }
              break;
          case '|':
-             advance_char(lexer);
              if (current_char(lexer) == '|') {
                  advance_char(lexer);
-                 token.type = TOKEN_OR;
-                 token.value = strdup("||");
+                 type = TOKEN_OR;
              } else {
-                 token.type = TOKEN_BITOR;
-                 token.value = strdup("|");
+                 type = TOKEN_BITOR;
              }
              break;
-         case '^':
-             advance_char(lexer);
-             token.type = TOKEN_BITXOR;
-             token.value = strdup("^");
-             break;
-         case '~':
-             advance_char(lexer);
-             token.type = TOKEN_BITNOT;
-             token.value = strdup("~");
-             break;
-         case ';':
-             advance_char(lexer);
-             token.type = TOKEN_SEMICOLON;
-             token.value = strdup(";");
-             break;
-         case ':':
-             advance_char(lexer);
-             token.type = TOKEN_COLON;
-             token.value = strdup(":");
-             break;
-         case ',':
-             advance_char(lexer);
-             token.type = TOKEN_COMMA;
-             token.value = strdup(",");
-             break;
-         case '.':
-             advance_char(lexer);
-             token.type = TOKEN_DOT;
-             token.value = strdup(".");
-             break;
-         case '(':
-             advance_char(lexer);
-             token.type = TOKEN_LPAREN;
-             token.value = strdup("(");
-             break;
-         case ')':
-             advance_char(lexer);
-             token.type = TOKEN_RPAREN;
-             token.value = strdup(")");
-             break;
-         case '{':
-             advance_char(lexer);
-             token.type = TOKEN_LBRACE;
-             token.value = strdup("{");
-             break;
-         case '}':
-             advance_char(lexer);
-             token.type = TOKEN_RBRACE;
-             token.value = strdup("}");
-             break;
-         case '[':
-             advance_char(lexer);
-             token.type = TOKEN_LBRACKET;
-             token.value = strdup("[");
-             break;
-         case ']':
-             advance_char(lexer);
-             token.type = TOKEN_RBRACKET;
-             token.value = strdup("]");
+         case '^': type = TOKEN_BITXOR; break;
+         case '~': type = TOKEN_BITNOT; break;
+         case ';': type = TOKEN_SEMICOLON; break;
+         case ':': type = TOKEN_COLON; break;
+         case ',': type = TOKEN_COMMA; break;
+         case '.': type = TOKEN_DOT; break;
+         case '(': type = TOKEN_LPAREN; break;
+         case ')': type = TOKEN_RPAREN; break;
+         case '{': type = TOKEN_LBRACE; break;
+         case '}': type = TOKEN_RBRACE; break;
+         case '[': type = TOKEN_LBRACKET; break;
+         case ']': type = TOKEN_RBRACKET; break;
+         case '#': type = TOKEN_POUND; break;
+         default:
+             lexer_error_at(lexer, (unsigned)start_pos, DIAG_UNEXPECTED_CHARACTER, c);
              break;
-         case '#':
-             advance_char(lexer);
-             token.type = TOKEN_POUND;
-             token.value = strdup("#");
+     }
+     
+     return make_token(lexer, type, start_pos);
+ }
+ 
+// Get the next token from input
+Token get_token(Lexer *lexer) {
+     skip_trivia(lexer);
+     return scan_token(lexer);
+ }
+ 
+// Smallest chunk worth a thread of its own
+#define LEX_MIN_CHUNK (1 << 20)
+
+// Work of one lexing thread: the tokens starting in [start, end)
+typedef struct {
+     Lexer lexer;         // Private copy of the lexer state, positioned at start
+     int end;             // First offset of the next chunk
+     Token *tokens;       // Tokens of the chunk
+     size_t num_tokens;
+     size_t capacity;
+     int failed;          // Set when the token array could not grow
+} LexChunk;
+
+// Find up to max_chunks - 1 split points, each at the start of a line outside
+// comments, string and character literals. The walk mirrors the lexer: those
+// constructs can only begin where a token begins, so testing every byte is exact.
+static int find_split_points(Lexer *lexer, int *splits, int max_chunks) {
+     Lexer walker = *lexer;
+     DiagEngine *quiet = diag_create(NULL);  // Errors are reported by the workers
+     if (!quiet) return 0;
+     walker.diag = quiet;
+     walker.line_starts = NULL;
+     walker.position = 0;
+     
+     int count = 0;
+     int target = lexer->buffer_size / max_chunks;
+     
+     while (count < max_chunks - 1 && current_char(&walker) != '\0') {
+         char c = current_char(&walker);
+         if (c == '/' && (peek_char(&walker) == '/' || peek_char(&walker) == '*')) {
+             skip_comments(&walker);
+         } else if (c == '\"') {
+             scan_string(&walker);
+         } else if (c == '\'') {
+             scan_character(&walker);
+         } else {
+             advance_char(&walker);
+             // A line start past the next target becomes a split point
+             if (c == '\n' && walker.position >= target * (count + 1)) {
+                 splits[count++] = walker.position;
+             }
+         }
+     }
+     
+     free(walker.line_starts);
+     diag_destroy(quiet);
+     return count;
+ }
+ 
+// Append a token to a chunk, growing its array geometrically
+static void chunk_push(LexChunk *chunk, Token token) {
+     if (chunk->num_tokens == chunk->capacity) {
+         size_t capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+         Token *tokens = (Token*)realloc(chunk->tokens, capacity * sizeof(Token));
+         if (!tokens) {
+             chunk->failed = 1;
+             return;
+         }
+         chunk->tokens = tokens;
+         chunk->capacity = capacity;
+     }
+     chunk->tokens[chunk->num_tokens++] = token;
+ }
+ 
+// Thread body: lex every token that starts inside the chunk
+static void* lex_chunk(void *arg) {
+     LexChunk *chunk = (LexChunk*)arg;
+     Lexer *lexer = &chunk->lexer;
+     
+     for (;;) {
+         skip_trivia(lexer);
+         if (lexer->position >= chunk->end || current_char(lexer) == '\0') break;
+         chunk_push(chunk, scan_token(lexer));
+         if (chunk->failed) break;
+     }
+     return NULL;
+ }
+ 
+// Lex the whole input up front, on up to num_threads threads for large inputs.
+// Tokens are kept in lexer->tokens and handed out by the ring in order; returns
+// 0 on failure, in which case the lexer keeps lexing on demand.
+int lexer_lex_all(Lexer *lexer, int num_threads) {
+     if (lexer->tokens) return 1;
+     if (lexer->position != 0 || lexer->ring_count != 0) return 0;
+     
+     // Small inputs are not worth the threads and run on the caller's
+     int max_chunks = num_threads;
+     if (lexer->buffer_size / LEX_MIN_CHUNK < max_chunks) {
+         max_chunks = lexer->buffer_size / LEX_MIN_CHUNK;
+     }
+     if (max_chunks < 1) max_chunks = 1;
+     
+     double start = lexer->stats ? stats_wall_clock() : 0.0;
+     
+     int *splits = (int*)malloc(max_chunks * sizeof(int));
+     LexChunk *chunks = (LexChunk*)calloc(max_chunks, sizeof(LexChunk));
+     pthread_t *threads = (pthread_t*)malloc(max_chunks * sizeof(pthread_t));
+     int ok = splits && chunks && threads;
+     
+     int num_chunks = 0;
+     if (ok) num_chunks = max_chunks > 1 ? find_split_points(lexer, splits, max_chunks) + 1 : 1;
+     int started = 0;
+     
+     for (int i = 0; ok && i < num_chunks; i++) {
+         LexChunk *chunk = &chunks[i];
+         chunk->lexer = *lexer;
+         chunk->lexer.position = i == 0 ? 0 : splits[i - 1];
+         chunk->lexer.line_starts = NULL;
+         chunk->lexer.stats = NULL;
+         chunk->lexer.diag = diag_create(NULL);
+         if (chunk->lexer.diag) diag_set_max_errors(chunk->lexer.diag, lexer->diag->max_errors);
+         chunk->end = i == num_chunks - 1 ? lexer->buffer_size : splits[i];
+         if (!chunk->lexer.diag) {
+             ok = 0;
              break;
-         default:
-             char error_msg[128];
-             snprintf(error_msg, sizeof(error_msg), "Unexpected character: '%c'", current_char(lexer));
-             lexer_error(lexer, error_msg);
-             token.type = TOKEN_ERROR;
-             token.value = strdup(error_msg);
-             advance_char(lexer);
+         }
+         if (num_chunks == 1) {
+             lex_chunk(chunk);
+         } else if (pthread_create(&threads[i], NULL, lex_chunk, chunk) != 0) {
+             ok = 0;
              break;
+         } else {
+             started++;
+         }
      }
      
-     return token;
+     for (int i = 0; i < started; i++) {
+         pthread_join(threads[i], NULL);
+     }
+     
+     size_t total = 0;
+     for (int i = 0; ok && i < num_chunks; i++) {
+         if (chunks[i].failed) ok = 0;
+         total += chunks[i].num_tokens;
+     }
+     
+     // Concatenate the chunks in order and terminate the stream with EOF
+     if (ok) {
+         lexer->tokens = (Token*)malloc((total + 1) * sizeof(Token));
+         ok = lexer->tokens != NULL;
+     }
+     if (ok) {
+         size_t count = 0;
+         for (int i = 0; i < num_chunks; i++) {
+             memcpy(lexer->tokens + count, chunks[i].tokens, chunks[i].num_tokens * sizeof(Token));
+             count += chunks[i].num_tokens;
+             diag_merge(lexer->diag, chunks[i].lexer.diag);
+         }
+         
+         // EOF sits after the trivia ending the last chunk, as get_token would put it
+         lexer->position = chunks[num_chunks - 1].lexer.position;
+         lexer->tokens[count] = make_token(lexer, TOKEN_EOF, lexer->position);
+         lexer->num_tokens_total = count + 1;
+         lexer->next_token = 0;
+         lexer->num_tokens += count + 1;
+     }
+     
+     for (int i = 0; chunks && i < max_chunks; i++) {
+         free(chunks[i].tokens);
+         free(chunks[i].lexer.line_starts);
+         diag_destroy(chunks[i].lexer.diag);
+     }
+     free(chunks);
+     free(threads);
+     free(splits);
+     
+     if (lexer->stats) {
+         stats_add_wall(lexer->stats, PHASE_LEX, stats_wall_clock() - start);
+     }
+     return ok;
  }
  
-// Advance to the next token
-void advance_token(Lexer *lexer) {
-     if (lexer->current.value) {
-         free(lexer->current.value);
+// Lex ahead until the ring is full or the end of input is reached
+static void refill_tokens(Lexer *lexer) {
+     double start = lexer->stats ? stats_wall_clock() : 0.0;
+     
+     while (lexer->ring_count < TOKEN_RING_SIZE) {
+         Token token;
+         if (lexer->tokens) {
+             // Tokens lexed up front are copied out; the ring never refills
+             // once it holds EOF, so this stays inside the array
+             token = lexer->tokens[lexer->next_token++];
+         } else {
+             token = get_token(lexer);
+             lexer->num_tokens++;
+         }
+         lexer->ring[(lexer->ring_head + lexer->ring_count) & (TOKEN_RING_SIZE - 1)] = token;
+         lexer->ring_count++;
+         if (token.type == TOKEN_EOF) break;
+     }
+     
+     if (lexer->stats) {
+         stats_add_wall(lexer->stats, PHASE_LEX, stats_wall_clock() - start);
+     }
+ }
+ 
+// Look k tokens past the current one (k = 0 is the current token).
+// Lookahead is capped at TOKEN_RING_SIZE - 1; past the end of input EOF is returned.
+Token peek_token_n(Lexer *lexer, unsigned k) {
+     if (k >= TOKEN_RING_SIZE) {
+         k = TOKEN_RING_SIZE - 1;
+     }
+     
+     while (lexer->ring_count <= k) {
+         if (lexer->ring_count > 0) {
+             Token last = lexer->ring[(lexer->ring_head + lexer->ring_count - 1) & (TOKEN_RING_SIZE - 1)];
+             if (last.type == TOKEN_EOF) return last;
+         }
+         refill_tokens(lexer);
      }
-     lexer->current = get_token(lexer);
+     
+     return lexer->ring[(lexer->ring_head + k) & (TOKEN_RING_SIZE - 1)];
+ }
+ 
+// Index of the current token in lexer->tokens (only meaningful after lexer_lex_all)
+size_t lexer_token_index(Lexer *lexer) {
+     return lexer->next_token - lexer->ring_count;
+ }
+ 
+// Make the token at index of lexer->tokens the current one (after lexer_lex_all)
+void lexer_seek_token(Lexer *lexer, size_t index) {
+     if (index >= lexer->num_tokens_total) index = lexer->num_tokens_total - 1;
+     lexer->ring_head = 0;
+     lexer->ring_count = 0;
+     lexer->next_token = index;
+ }
+ 
+// Advance to the next token, the end of input is never consumed
+void advance_token(Lexer *lexer) {
+     if (peek_token_n(lexer, 0).type == TOKEN_EOF) return;
+     
+     lexer->ring_head = (lexer->ring_head + 1) & (TOKEN_RING_SIZE - 1);
+     lexer->ring_count--;
  }
  
 // Peek at current token without consuming it
 Token peek_token(Lexer *lexer) {
-    if (lexer == NULL){
-        
-    }
-    return lexer->current;
+     return peek_token_n(lexer, 0);
  }
  
-// Report lexer error
-void lexer_error(Lexer *lexer, const char *message) {
-     error_report_location(lexer->filename, lexer->line, lexer->column, message);
+// Build the table of line start offsets, one entry per line. Done on the
+// first location query, or up front before the lexer is shared with threads.
+int lexer_index_lines(Lexer *lexer) {
+     if (lexer->line_starts) return 1;
+     
+     size_t size = (size_t)lexer->buffer_size;
+     size_t capacity = scan_count_newlines(lexer->buffer, size) + 1;
+     
+     lexer->line_starts = (unsigned*)malloc(capacity * sizeof(unsigned));
+     if (!lexer->line_starts) {
+         return 0;
+     }
+     
+     lexer->line_starts[0] = 0;
+     lexer->num_lines = 1;
+     
+     // scan_line_end also stops at '\0' bytes embedded in the text
+     size_t position = 0;
+     while (position < size) {
+         position += scan_line_end(lexer->buffer + position);
+         if (position >= size) break;
+         if (lexer->buffer[position] == '\n') {
+             lexer->line_starts[lexer->num_lines++] = (unsigned)(position + 1);
+         }
+         position++;
+     }
+     return 1;
+ }
+ 
+// Find the 1-based line and column of a byte offset in a line table
+static void locate_in_lines(const unsigned *line_starts, size_t num_lines, unsigned offset,
+                            int *line, int *column) {
+     // Last line starting at or before offset
+     size_t low = 0;
+     size_t high = num_lines;
+     while (high - low > 1) {
+         size_t mid = low + (high - low) / 2;
+         if (line_starts[mid] <= offset) {
+             low = mid;
+         } else {
+             high = mid;
+         }
+     }
+     
+     *line = (int)low + 1;
+     *column = (int)(offset - line_starts[low]) + 1;
+ }
+ 
+// Convert a token offset into a 1-based line and column in its source, both 0 if unavailable
+void lexer_location(Lexer *lexer, unsigned offset, int *line, int *column) {
+     if (offset > (unsigned)lexer->buffer_size) {
+         const SourceFile *source = lexer_find_source(lexer, offset);
+         if (source && source->line_starts) {
+             locate_in_lines(source->line_starts, source->num_lines, offset - source->base, line, column);
+             return;
+         }
+     } else if (lexer_index_lines(lexer)) {
+         locate_in_lines(lexer->line_starts, lexer->num_lines, offset, line, column);
+         return;
+     }
+     
+     *line = 0;
+     *column = 0;
+ }
+ 
+// Name of the source file a token offset belongs to
+const char* lexer_source_name(const Lexer *lexer, unsigned offset) {
+     if (offset <= (unsigned)lexer->buffer_size) return lexer->filename;
+     const SourceFile *source = lexer_find_source(lexer, offset);
+     return source ? source->filename : lexer->filename;
+ }
+ 
+// Map an extra source after the last one (its '\0' included), returns its base or 0 on failure
+unsigned lexer_add_source(Lexer *lexer, const SourceFile *source) {
+     if (lexer->num_sources == lexer->sources_capacity) {
+         int capacity = lexer->sources_capacity ? lexer->sources_capacity * 2 : 8;
+         SourceFile *sources = (SourceFile*)realloc(lexer->sources, capacity * sizeof(SourceFile));
+         if (!sources) return 0;
+         lexer->sources = sources;
+         lexer->sources_capacity = capacity;
+     }
+     
+     unsigned base = (unsigned)lexer->buffer_size + 1;
+     if (lexer->num_sources > 0) {
+         const SourceFile *last = &lexer->sources[lexer->num_sources - 1];
+         base = last->base + last->size + 1;
+     }
+     
+     SourceFile *added = &lexer->sources[lexer->num_sources++];
+     *added = *source;
+     added->base = base;
+     return base;
+ }
+ 
+// Source holding a token offset past the main buffer, NULL for the main buffer
+const SourceFile* lexer_find_source(const Lexer *lexer, unsigned offset) {
+     if (offset <= (unsigned)lexer->buffer_size || lexer->num_sources == 0) return NULL;
+     
+     // Last source whose base is at or before offset
+     int low = 0;
+     int high = lexer->num_sources;
+     while (high - low > 1) {
+         int mid = low + (high - low) / 2;
+         if (lexer->sources[mid].base <= offset) {
+             low = mid;
+         } else {
+             high = mid;
+         }
+     }
+     return &lexer->sources[low];
+ }
+ 
+// Report a lexer error at a byte offset
+static void lexer_verror_at(Lexer *lexer, unsigned offset, DiagId id, va_list args) {
+     int line, column;
+     lexer_location(lexer, offset, &line, &column);
+     diag_vreport(lexer->diag, DIAG_ERROR, id, lexer_source_name(lexer, offset), line, column, args);
+ }
+ 
+// Report lexer error at the current position
+void lexer_error(Lexer *lexer, DiagId id, ...) {
+     va_list args;
+     va_start(args, id);
+     lexer_verror_at(lexer, (unsigned)lexer->position, id, args);
+     va_end(args);
+ }
+ 
+// Report lexer error at a byte offset
+void lexer_error_at(Lexer *lexer, unsigned offset, DiagId id, ...) {
+     va_list args;
+     va_start(args, id);
+     lexer_verror_at(lexer, offset, id, args);
+     va_end(args);
  }
  
 // Get string representation of token type
@@ -643,12 +878,68 @@ const char* token_type_str(TokenType type) {
      }
  }
  
+// Get a pointer to the token text inside the source buffer (not '\0'-terminated)
+const char* token_text(const Lexer *lexer, Token token) {
+     if (token.offset <= (unsigned)lexer->buffer_size) {
+         return lexer->buffer + token.offset;
+     }
+     
+     // Token of an included source
+     const SourceFile *source = lexer_find_source(lexer, token.offset);
+     return source->text + (token.offset - source->base);
+ }
+ 
+// Get a heap-allocated copy of the token text
+char* token_strdup(const Lexer *lexer, Token token) {
+     char *value = (char*)malloc(token.length + 1);
+     if (!value) return NULL;
+     memcpy(value, token_text(lexer, token), token.length);
+     value[token.length] = '\0';
+     return value;
+ }
+ 
+// Get the value of an integer literal token
+int token_int_value(const Lexer *lexer, Token token) {
+     // The digit run is always followed by a non-digit or the sentinel
+     return atoi(token_text(lexer, token));
+ }
+ 
+// Get the value of a character literal token, escapes decoded
+char token_char_value(const Lexer *lexer, Token token) {
+     const char *text = token_text(lexer, token);
+     char c = text[1];
+     if (c == '\\') {
+         decode_escape(text[2], &c);
+     }
+     return c;
+ }
+ 
+// Get a heap-allocated copy of a string literal token without its quotes
+char* token_string_value(const Lexer *lexer, Token token) {
+     Token contents = token;
+     contents.offset = token.offset + 1;
+     contents.length = token.length >= 2 ? token.length - 2 : 0;
+     return token_strdup(lexer, contents);
+ }
+ 
+// Get the canonical interned copy of an identifier or string literal token,
+// read straight from the source buffer (string quotes are stripped)
+const char* token_intern(const Lexer *lexer, Token token) {
+     const char *text = token_text(lexer, token);
+     if (token.type == TOKEN_STRING && token.length >= 2) {
+         return intern_string(text + 1, token.length - 2);
+     }
+     return intern_string(text, token.length);
+ }
+ 
 // Print token for debugging
-void print_token(Token token) {
-     printf("Token{ type = %s, value = \"%s\", line = %d, column = %d }\n",
+void print_token(Lexer *lexer, Token token) {
+     int line, column;
+     lexer_location(lexer, token.offset, &line, &column);
+     printf("Token{ type = %s, value = \"%.*s\", line = %d, column = %d }\n",
             token_type_str(token.type),
-            token.value,
-            token.line,
-            token.column);
+            (int)token.length,
+            token_text(lexer, token),
+            line,
+            column);
  }
- 
\ No newline at end of file
@@ -2,6 +2,8 @@
  #define LEXEME_H
  
  #include <stdio.h>
+ #include "stats.h"
+ #include "error.h"
  
  // Token types
  typedef enum {
@@ -67,38 +69,83 @@
      TOKEN_ERROR
  } TokenType;
  
- // Token structure
+ // Token structure (12 bytes), the lexeme text stays in the lexer buffer.
+ // Line and column are not stored: lexer_location derives them from the offset.
  typedef struct {
      TokenType type;
-     char *value;      // Lexeme value
-     int line;         // Line number
-     int column;       // Column number
-     char *filename;   // Source filename
+     unsigned offset;  // Byte offset of the lexeme in the source buffer
+     unsigned length;  // Length of the lexeme in bytes
  } Token;
  
+ // Extra source text (an included header) mapped after the main buffer: token
+ // offsets past the main buffer select a source by its base offset.
+ typedef struct {
+     const char *text;              // '\0'-terminated text, owned by the caller
+     const char *filename;          // Name used in diagnostics
+     unsigned base;                 // Offset of text[0] in the token offset space
+     unsigned size;                 // Length of text in bytes
+     const unsigned *line_starts;   // Line table of text
+     size_t num_lines;
+ } SourceFile;
+ 
+ // Tokens lexed ahead of the parser in one batch (a power of two)
+ #define TOKEN_RING_SIZE 64
+ 
  // Lexer structure
  typedef struct {
      FILE *file;       // Source file
      char *filename;   // Source filename
-     char *buffer;     // Buffer for reading file
-     int buffer_size;  // Size of buffer
+     char *buffer;     // Whole source text, '\0'-terminated
+     int buffer_size;  // Length of the source text in bytes
      int position;     // Current position in buffer
-     int line;         // Current line number
-     int column;       // Current column number
-     Token current;    // Current token
+     Token ring[TOKEN_RING_SIZE];  // Lookahead tokens, the current one at ring_head
+     unsigned ring_head;           // Slot of the current token
+     unsigned ring_count;          // Tokens lexed but not yet consumed
+     unsigned long num_tokens;  // Tokens produced so far
+     unsigned long num_reads;   // read calls used to load the source
+     CompileStats *stats;       // Time lexing into stats when not NULL
+     DiagEngine *diag;          // Destination of lexical errors
+     unsigned *line_starts;     // Offset of each line start, built on first use
+     size_t num_lines;          // Entries in line_starts
+     Token *tokens;             // Whole token stream when lexed in parallel, else NULL
+     size_t num_tokens_total;   // Entries in tokens, the last one is EOF
+     size_t next_token;         // Next entry of tokens to move into the ring
+     SourceFile *sources;       // Extra sources in base order (see lexer_add_source)
+     int num_sources;
+     int sources_capacity;
  } Lexer;
  
  // Lexer functions
- Lexer* init_lexer(FILE *file, char *filename);
+ Lexer* init_lexer(FILE *file, char *filename, DiagEngine *diag);
  void free_lexer(Lexer *lexer);
  Token get_token(Lexer *lexer);
  void advance_token(Lexer *lexer);
  Token peek_token(Lexer *lexer);
- void lexer_error(Lexer *lexer, const char *message);
+ Token peek_token_n(Lexer *lexer, unsigned k);
+ int lexer_lex_all(Lexer *lexer, int num_threads);
+ size_t lexer_token_index(Lexer *lexer);
+ void lexer_seek_token(Lexer *lexer, size_t index);
+ void lexer_error(Lexer *lexer, DiagId id, ...);
+ void lexer_error_at(Lexer *lexer, unsigned offset, DiagId id, ...);
+ int lexer_index_lines(Lexer *lexer);
+ void lexer_location(Lexer *lexer, unsigned offset, int *line, int *column);
+ const char* lexer_source_name(const Lexer *lexer, unsigned offset);
+ 
+ // Extra sources for token offsets past the main buffer
+ unsigned lexer_add_source(Lexer *lexer, const SourceFile *source);
+ const SourceFile* lexer_find_source(const Lexer *lexer, unsigned offset);
  
  // Token utilities
  const char* token_type_str(TokenType type);
- void print_token(Token token);
+ void print_token(Lexer *lexer, Token token);
+ 
+ // Lexeme accessors, resolved against the lexer source buffer
+ const char* token_text(const Lexer *lexer, Token token);
+ char* token_strdup(const Lexer *lexer, Token token);
+ int token_int_value(const Lexer *lexer, Token token);
+ char token_char_value(const Lexer *lexer, Token token);
+ char* token_string_value(const Lexer *lexer, Token token);
+ const char* token_intern(const Lexer *lexer, Token token);
  
  #endif // LEXER_H
  
\ No newline at end of file
@@ -0,0 +1,1002 @@
+/**
+ * AST Lowering Implementation
+ *
+ * Every expression yields a virtual register. Conditions of if/while and
+ * the operands of && and || are lowered straight to branches, so a
+ * comparison only becomes a 0/1 value where its result is stored.
+ * Division and modulo become calls of the EABI helpers, which keeps the
+ * code runnable on cores without a hardware divider. Statements and
+ * expressions are lowered by steps on a heap stack rather than by
+ * recursion, so deep nesting is bounded by memory, not by the C stack;
+ * a step lowers what it can at once and queues the rest, in the order
+ * the code is emitted.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lower.h"
+#include "intern.h"
+#include "symtab.h"
+
+// Largest constant offset of a load or store, the imm12 reach of the target
+#define MAX_OFFSET 4095
+
+// Initial capacity of the step and value stacks
+#define INITIAL_STEPS 64
+
+// Lvalue of an assignment or increment
+typedef struct {
+    Symbol *symbol;      // Scalar variable, or NULL for an array element
+    int address;         // Address register of a global or an element
+    int32_t offset;
+    int is_byte;
+} LValue;
+
+// Kind of a pending step
+typedef enum {
+    STEP_STATEMENT,      // Lower node as a statement
+    STEP_VALUE,          // Push the value of node
+    STEP_BRANCH,         // Jump to label when the truth of node is a, else fall through
+    STEP_LABEL,          // Place label
+    STEP_CLOSE_SCOPE,    // Close the scopes opened since mark a, back to the scope at mark imm
+    STEP_ELSE,           // After the then branch of node: its else branch, label being the else label
+    STEP_DECLARE,        // Declare the local of node, popping its initializer if it has one
+    STEP_RETURN,         // Return from the function, popping the value if node has one
+    STEP_DISCARD,        // Pop the value of an expression statement
+    STEP_TEST,           // Pop a value, jump to label when its truth is a
+    STEP_COMPARE,        // Pop the operands, jump to label when comparison a holds
+    STEP_TRUTH,          // Finish the 0/1 value in register a, label ending its false path
+    STEP_BINARY,         // Pop the operands of node, push the result
+    STEP_UNARY,          // Pop the operand of node, push the result
+    STEP_CALL,           // Pop the a arguments of node, push the result of the call
+    STEP_ELEMENT,        // Pop an index into the array at register a, push the element
+    STEP_LOAD,           // Pop an element, push its value
+    STEP_ASSIGN,         // Pop the value, store it into lvalue (an element popped unless a), push it
+    STEP_INCREMENT       // Pop an element, apply the ++ or -- of node, push the result
+} StepKind;
+
+// Pending work of the lowering
+typedef struct {
+    StepKind kind;
+    ASTNode *node;
+    int label;
+    int a;               // Per kind, see StepKind
+    int has_imm;         // imm replaces the last operand
+    int32_t imm;         // Immediate operand, or the element size of STEP_ELEMENT
+    LValue lvalue;       // Scalar target of STEP_ASSIGN
+} Step;
+
+// State of one translation unit
+typedef struct {
+    IRProgram *program;
+    IRFunction *function;    // Function being lowered
+    DataType return_type;    // Of the function being lowered
+    Lexer *lexer;            // Resolves node offsets in diagnostics
+    SymbolTable symbols;     // Globals, then the locals of the open scopes
+    int scope;               // Mark of the innermost scope, its symbols follow it
+    Step *steps;             // Pending steps, the next one on top
+    int num_steps;
+    int steps_capacity;
+    int32_t *values;         // Registers the steps hand to the ones below them
+    int num_values;
+    int values_capacity;
+    int exhausted;           // A stack could not grow, lowering stopped
+    int errors;
+} Lowering;
+
+// Report a construct the backend cannot compile
+static void unsupported(Lowering *lw, ASTNode *node, const char *what) {
+    lexer_error_at(lw->lexer, node ? node->span.start : 0, DIAG_UNSUPPORTED_CONSTRUCT, what);
+    lw->errors++;
+}
+
+// Report an expression that cannot be assigned to
+static void not_assignable(Lowering *lw, ASTNode *node) {
+    lexer_error_at(lw->lexer, node->span.start, DIAG_NOT_ASSIGNABLE);
+    lw->errors++;
+}
+
+// Declare a name in the innermost scope
+static Symbol* add_symbol(Lowering *lw, ASTNode *node, const char *name, SymbolKind kind) {
+    // Only an outer binding may be hidden, one of the innermost scope is a clash
+    Symbol *existing = symtab_lookup(&lw->symbols, name);
+    if (existing && existing - lw->symbols.symbols >= lw->scope) {
+        lexer_error_at(lw->lexer, node->span.start, DIAG_REDECLARED, name);
+        lw->errors++;
+        return NULL;
+    }
+    Symbol *symbol = symtab_declare(&lw->symbols, name, kind);
+    if (!symbol) lw->errors++;
+    return symbol;
+}
+
+// Resolve an identifier node, reporting it when undeclared
+static Symbol* resolve(Lowering *lw, ASTNode *node) {
+    Symbol *symbol = symtab_lookup(&lw->symbols, node->data.identifier.name);
+    if (!symbol) {
+        lexer_error_at(lw->lexer, node->span.start, DIAG_UNDECLARED_IDENTIFIER, node->data.identifier.name);
+        lw->errors++;
+    }
+    return symbol;
+}
+
+// d = imm
+static int emit_const(Lowering *lw, int32_t value) {
+    IRInsn *insn = ir_emit(lw->function, IR_CONST);
+    insn->dst = ir_new_vreg(lw->function);
+    insn->imm = value;
+    return insn->dst;
+}
+
+// d = a op b
+static int emit_binary(Lowering *lw, BinaryOp op, int a, int b) {
+    IRInsn *insn = ir_emit(lw->function, IR_BINARY);
+    insn->subop = (uint8_t)op;
+    insn->dst = ir_new_vreg(lw->function);
+    insn->a = a;
+    insn->b = b;
+    return insn->dst;
+}
+
+// d = a op imm
+static int emit_binary_imm(Lowering *lw, BinaryOp op, int a, int32_t imm) {
+    IRInsn *insn = ir_emit(lw->function, IR_BINARY);
+    insn->subop = (uint8_t)op;
+    insn->flags = IR_IMM_B;
+    insn->dst = ir_new_vreg(lw->function);
+    insn->a = a;
+    insn->b = imm;
+    return insn->dst;
+}
+
+// dst = a, into an existing register
+static void emit_copy(Lowering *lw, int dst, int a) {
+    IRInsn *insn = ir_emit(lw->function, IR_COPY);
+    insn->dst = dst;
+    insn->a = a;
+}
+
+// d = address of a symbol
+static int emit_address(Lowering *lw, const char *symbol) {
+    IRInsn *insn = ir_emit(lw->function, IR_ADDR);
+    insn->dst = ir_new_vreg(lw->function);
+    insn->symbol = symbol;
+    return insn->dst;
+}
+
+// d = [address + offset]
+static int emit_load(Lowering *lw, int address, int32_t offset, int is_byte) {
+    IRInsn *insn = ir_emit(lw->function, IR_LOAD);
+    insn->flags = is_byte ? IR_BYTE : 0;
+    insn->dst = ir_new_vreg(lw->function);
+    insn->a = address;
+    insn->imm = offset;
+    return insn->dst;
+}
+
+// [address + offset] = value
+static void emit_store(Lowering *lw, int address, int32_t offset, int value, int is_byte) {
+    IRInsn *insn = ir_emit(lw->function, IR_STORE);
+    insn->flags = is_byte ? IR_BYTE : 0;
+    insn->a = address;
+    insn->imm = offset;
+    insn->b = value;
+}
+
+// Place a label
+static void emit_label(Lowering *lw, int label) {
+    ir_emit(lw->function, IR_LABEL)->imm = label;
+}
+
+// Unconditional jump
+static void emit_jump(Lowering *lw, int label) {
+    ir_emit(lw->function, IR_JUMP)->imm = label;
+}
+
+// if (a op b) goto label, b an immediate when is_imm
+static void emit_branch(Lowering *lw, BinaryOp op, int a, int32_t b, int is_imm, int label) {
+    IRInsn *insn = ir_emit(lw->function, IR_BRANCH);
+    insn->subop = (uint8_t)op;
+    insn->flags = is_imm ? IR_IMM_B : 0;
+    insn->a = a;
+    insn->b = b;
+    insn->imm = label;
+}
+
+// d = callee(args)
+static int emit_call(Lowering *lw, const char *callee, const int32_t *args, int count, int flags) {
+    int first = ir_add_call_args(lw->function, args, count);
+    IRInsn *insn = ir_emit(lw->function, IR_CALL);
+    insn->flags = (uint8_t)flags;
+    insn->dst = ir_new_vreg(lw->function);
+    insn->a = first;
+    insn->imm = count;
+    insn->symbol = callee;
+    return insn->dst;
+}
+
+// Check that a comparison operator is one
+static int is_comparison(BinaryOp op) {
+    return op >= OP_EQ && op <= OP_GTE;
+}
+
+// Comparison holding exactly when op does not
+static BinaryOp negate_comparison(BinaryOp op) {
+    switch (op) {
+        case OP_EQ: return OP_NEQ;
+        case OP_NEQ: return OP_EQ;
+        case OP_LT: return OP_GTE;
+        case OP_GT: return OP_LTE;
+        case OP_LTE: return OP_GT;
+        default: return OP_LT;
+    }
+}
+
+// Integer literal value of a node, 0 if it is not one
+static int literal_value(const ASTNode *node, int32_t *value) {
+    if (!node) return 0;
+    if (node->type == AST_INTEGER) {
+        *value = node->data.integer.value;
+        return 1;
+    }
+    if (node->type == AST_CHARACTER) {
+        *value = (unsigned char)node->data.character.value;
+        return 1;
+    }
+    return 0;
+}
+
+// Register holding the address of an array object, or the value of an array parameter
+static int lower_array_base(Lowering *lw, ASTNode *node, int *element_size) {
+    *element_size = 4;
+    if (node && node->type == AST_STRING) {
+        *element_size = 1;
+        return emit_address(lw, ir_string_symbol(ir_add_string(lw->program, node->data.string.value)));
+    }
+    if (!node || node->type != AST_IDENTIFIER) {
+        unsupported(lw, node, "subscripts of this expression");
+        return emit_const(lw, 0);
+    }
+
+    Symbol *symbol = resolve(lw, node);
+    if (!symbol) return emit_const(lw, 0);
+    if (!symbol->is_array && !symbol->is_pointer) {
+        unsupported(lw, node, "subscripts of a scalar");
+        return emit_const(lw, 0);
+    }
+    *element_size = symbol->type == TYPE_CHAR ? 1 : 4;
+    if (symbol->is_pointer) return symbol->vreg;
+    if (symbol->kind == SYM_GLOBAL) return emit_address(lw, symbol->name);
+
+    IRInsn *insn = ir_emit(lw->function, IR_FRAME_ADDR);
+    insn->dst = ir_new_vreg(lw->function);
+    insn->imm = symbol->offset;
+    return insn->dst;
+}
+
+// Value of an identifier
+static int lower_identifier(Lowering *lw, ASTNode *node) {
+    Symbol *symbol = resolve(lw, node);
+    if (!symbol) return emit_const(lw, 0);
+    if (symbol->kind == SYM_FUNCTION) {
+        unsupported(lw, node, "functions used as values");
+        return emit_const(lw, 0);
+    }
+    if (symbol->is_array) {
+        int element_size;
+        return lower_array_base(lw, node, &element_size);
+    }
+    if (symbol->kind == SYM_LOCAL) return symbol->vreg;
+    return emit_load(lw, emit_address(lw, symbol->name), 0, symbol->type == TYPE_CHAR);
+}
+
+// C conversion of a value stored into a variable of type
+static int convert_for_store(Lowering *lw, DataType type, int value) {
+    return type == TYPE_CHAR ? emit_binary_imm(lw, OP_BITWISE_AND, value, 0xff) : value;
+}
+
+// Resolve a target that is not an array element, 0 (reported) if it is not assignable
+static int lower_lvalue(Lowering *lw, ASTNode *node, ASTNode *target, LValue *lvalue) {
+    memset(lvalue, 0, sizeof(LValue));
+    if (!target || target->type != AST_IDENTIFIER) {
+        not_assignable(lw, target ? target : node);
+        return 0;
+    }
+
+    Symbol *symbol = resolve(lw, target);
+    if (!symbol) return 0;
+    if (symbol->kind == SYM_FUNCTION || symbol->is_array) {
+        not_assignable(lw, target);
+        return 0;
+    }
+    lvalue->symbol = symbol;
+    lvalue->is_byte = symbol->type == TYPE_CHAR && !symbol->is_pointer;
+    if (symbol->kind == SYM_GLOBAL) lvalue->address = emit_address(lw, symbol->name);
+    return 1;
+}
+
+// Current value of an lvalue
+static int load_lvalue(Lowering *lw, const LValue *lvalue) {
+    if (lvalue->symbol && lvalue->symbol->kind == SYM_LOCAL) return lvalue->symbol->vreg;
+    return emit_load(lw, lvalue->address, lvalue->offset, lvalue->is_byte);
+}
+
+// Store into an lvalue, returns the register holding the stored value
+static int store_lvalue(Lowering *lw, const LValue *lvalue, int value) {
+    if (lvalue->symbol && lvalue->symbol->kind == SYM_LOCAL) {
+        value = convert_for_store(lw, lvalue->symbol->is_pointer ? TYPE_INT : lvalue->symbol->type, value);
+        emit_copy(lw, lvalue->symbol->vreg, value);
+        return value;
+    }
+    emit_store(lw, lvalue->address, lvalue->offset, value, lvalue->is_byte);
+    return lvalue->is_byte ? emit_binary_imm(lw, OP_BITWISE_AND, value, 0xff) : value;
+}
+
+// Apply ++ or -- to a resolved lvalue, returns the value of the expression
+static int lower_increment(Lowering *lw, ASTNode *node, const LValue *lvalue) {
+    UnaryOp op = node->data.unary_expr.op;
+    int is_post = op == OP_POST_INC || op == OP_POST_DEC;
+    BinaryOp step = op == OP_PRE_INC || op == OP_POST_INC ? OP_ADD : OP_SUBTRACT;
+
+    int old_value = load_lvalue(lw, lvalue);
+    if (is_post && lvalue->symbol && lvalue->symbol->kind == SYM_LOCAL) {
+        // The variable's register is about to change
+        int saved = ir_new_vreg(lw->function);
+        emit_copy(lw, saved, old_value);
+        old_value = saved;
+    }
+    int new_value = store_lvalue(lw, lvalue, emit_binary_imm(lw, step, old_value, 1));
+    return is_post ? old_value : new_value;
+}
+
+// Bytes of an array declaration, rounded to whole words
+static int array_size(const VariableDeclData *decl) {
+    long bytes = (long)decl->array_size * (decl->type == TYPE_CHAR ? 1 : 4);
+    return (int)((bytes + 3) & ~3L);
+}
+
+// Check that a declaration can be compiled, reporting it otherwise
+static int check_declaration(Lowering *lw, ASTNode *node) {
+    VariableDeclData *decl = &node->data.variable_decl;
+    if (decl->type == TYPE_VOID) {
+        unsupported(lw, node, "void variables");
+        return 0;
+    }
+    if (decl->is_array && (decl->array_size <= 0 || decl->array_size > (1 << 22) || decl->initializer)) {
+        unsupported(lw, node, decl->initializer ? "array initializers" : "arrays of this size");
+        return 0;
+    }
+    return 1;
+}
+
+// Declare a checked local, value holding its initializer or IR_NONE
+static void lower_declaration(Lowering *lw, ASTNode *node, int value) {
+    VariableDeclData *decl = &node->data.variable_decl;
+    Symbol *symbol = add_symbol(lw, node, decl->name, SYM_LOCAL);
+    if (!symbol) return;
+    symbol->type = decl->type;
+    symbol->is_array = decl->is_array;
+    if (decl->is_array) {
+        symbol->offset = lw->function->array_bytes;
+        lw->function->array_bytes += array_size(decl);
+        return;
+    }
+
+    // Uninitialized locals read as 0 rather than as whatever a register held
+    symbol->vreg = ir_new_vreg(lw->function);
+    if (value == IR_NONE) value = emit_const(lw, 0);
+    emit_copy(lw, symbol->vreg, convert_for_store(lw, decl->type, value));
+}
+
+// -- Steps --
+
+// Queue a step, NULL (counted as an error) when the stack cannot grow;
+// the pointer stays valid until the next push
+static Step* push_step(Lowering *lw, StepKind kind, ASTNode *node) {
+    if (lw->num_steps == lw->steps_capacity) {
+        int capacity = lw->steps_capacity ? lw->steps_capacity * 2 : INITIAL_STEPS;
+        Step *steps = (Step*)realloc(lw->steps, capacity * sizeof(Step));
+        if (!steps) {
+            if (!lw->exhausted) lw->errors++;
+            lw->exhausted = 1;
+            return NULL;
+        }
+        lw->steps = steps;
+        lw->steps_capacity = capacity;
+    }
+    Step *step = &lw->steps[lw->num_steps++];
+    memset(step, 0, sizeof(Step));
+    step->kind = kind;
+    step->node = node;
+    return step;
+}
+
+// Queue the lowering of a condition
+static void push_branch(Lowering *lw, ASTNode *node, int label, int jump_if) {
+    Step *step = push_step(lw, STEP_BRANCH, node);
+    if (!step) return;
+    step->label = label;
+    step->a = jump_if;
+}
+
+// Queue a label
+static void push_label(Lowering *lw, int label) {
+    Step *step = push_step(lw, STEP_LABEL, NULL);
+    if (step) step->label = label;
+}
+
+// Hand a register to the steps below
+static void push_value(Lowering *lw, int32_t value) {
+    if (lw->num_values == lw->values_capacity) {
+        int capacity = lw->values_capacity ? lw->values_capacity * 2 : INITIAL_STEPS;
+        int32_t *values = (int32_t*)realloc(lw->values, capacity * sizeof(int32_t));
+        if (!values) {
+            if (!lw->exhausted) lw->errors++;
+            lw->exhausted = 1;
+            return;
+        }
+        lw->values = values;
+        lw->values_capacity = capacity;
+    }
+    lw->values[lw->num_values++] = value;
+}
+
+// Take the register a step left
+static int pop_value(Lowering *lw) {
+    return lw->num_values > 0 ? lw->values[--lw->num_values] : IR_NONE;
+}
+
+// Hand an array element over as its address, offset and element size
+static void push_element(Lowering *lw, int address, int32_t offset, int element_size) {
+    push_value(lw, address);
+    push_value(lw, offset);
+    push_value(lw, element_size);
+}
+
+// Take an array element as an lvalue
+static void pop_element(Lowering *lw, LValue *lvalue) {
+    memset(lvalue, 0, sizeof(LValue));
+    lvalue->is_byte = pop_value(lw) == 1;
+    lvalue->offset = pop_value(lw);
+    lvalue->address = pop_value(lw);
+}
+
+// Lower the array base of an element, and queue its index unless it folds into the offset
+static void expand_element(Lowering *lw, ASTNode *node) {
+    ASTNode *index = node->data.subscript_expr.index;
+    int element_size;
+    int base = lower_array_base(lw, node->data.subscript_expr.array, &element_size);
+
+    // Constant indexes fold into the offset of the access, within imm12 reach
+    int32_t value;
+    if (literal_value(index, &value) && value >= 0 && value <= MAX_OFFSET / element_size) {
+        push_element(lw, base, value * element_size, element_size);
+        return;
+    }
+    Step *step = push_step(lw, STEP_ELEMENT, node);
+    if (!step) return;
+    step->a = base;
+    step->imm = element_size;
+    push_step(lw, STEP_VALUE, index);
+}
+
+// Start a 0/1 value; the condition branches to the end when it is false
+static void expand_truth_value(Lowering *lw, ASTNode *node) {
+    int result = emit_const(lw, 0);
+    int done = ir_new_label(lw->function);
+    Step *step = push_step(lw, STEP_TRUTH, node);
+    if (!step) return;
+    step->a = result;
+    step->label = done;
+    push_branch(lw, node, done, 0);
+}
+
+// Queue the operands of a binary expression, then the operation
+static void expand_binary(Lowering *lw, ASTNode *node) {
+    BinaryOp op = node->data.binary_expr.op;
+    if (op == OP_LOGICAL_AND || op == OP_LOGICAL_OR || is_comparison(op)) {
+        expand_truth_value(lw, node);
+        return;
+    }
+
+    ASTNode *right = node->data.binary_expr.right;
+    Step *step = push_step(lw, STEP_BINARY, node);
+    if (!step) return;
+    int32_t value;
+    if (op != OP_DIVIDE && op != OP_MODULO && literal_value(right, &value)) {
+        step->has_imm = 1;
+        step->imm = value;
+    } else {
+        push_step(lw, STEP_VALUE, right);
+    }
+    push_step(lw, STEP_VALUE, node->data.binary_expr.left);
+}
+
+// Resolve the target of an assignment, then queue the value and the store
+static void expand_assign(Lowering *lw, ASTNode *node) {
+    ASTNode *target = node->data.binary_expr.left;
+    if (target && target->type == AST_SUBSCRIPT_EXPR) {
+        // The element is computed before the value, the store takes both
+        if (!push_step(lw, STEP_ASSIGN, node)) return;
+        push_step(lw, STEP_VALUE, node->data.binary_expr.right);
+        expand_element(lw, target);
+        return;
+    }
+
+    LValue lvalue;
+    if (!lower_lvalue(lw, node, target, &lvalue)) {
+        push_value(lw, emit_const(lw, 0));
+        return;
+    }
+    Step *step = push_step(lw, STEP_ASSIGN, node);
+    if (!step) return;
+    step->lvalue = lvalue;
+    step->a = 1;
+    push_step(lw, STEP_VALUE, node->data.binary_expr.right);
+}
+
+// Queue the operand of a unary expression, or apply ++ and --
+static void expand_unary(Lowering *lw, ASTNode *node) {
+    ASTNode *operand = node->data.unary_expr.operand;
+    switch (node->data.unary_expr.op) {
+        case OP_NEGATE:
+        case OP_BITWISE_NOT:
+            if (!push_step(lw, STEP_UNARY, node)) return;
+            push_step(lw, STEP_VALUE, operand);
+            return;
+        case OP_NOT:
+            expand_truth_value(lw, node);
+            return;
+        default: {
+            if (operand && operand->type == AST_SUBSCRIPT_EXPR) {
+                if (!push_step(lw, STEP_INCREMENT, node)) return;
+                expand_element(lw, operand);
+                return;
+            }
+            LValue lvalue;
+            if (!lower_lvalue(lw, node, operand, &lvalue)) {
+                push_value(lw, emit_const(lw, 0));
+                return;
+            }
+            push_value(lw, lower_increment(lw, node, &lvalue));
+            return;
+        }
+    }
+}
+
+// Queue the arguments of a call, evaluated left to right, then the call
+static void expand_call(Lowering *lw, ASTNode *node) {
+    ASTNode *callee = node->data.call_expr.function;
+    ASTNode *arguments = node->data.call_expr.arguments;
+    if (!callee || callee->type != AST_IDENTIFIER) {
+        unsupported(lw, node, "calls through an expression");
+        push_value(lw, emit_const(lw, 0));
+        return;
+    }
+
+    int count = arguments ? arguments->num_children : 0;
+    Step *step = push_step(lw, STEP_CALL, node);
+    if (!step) return;
+    step->a = count;
+    for (int i = count - 1; i >= 0; i--) push_step(lw, STEP_VALUE, arguments->children[i]);
+}
+
+// Lower what an expression can give at once, and queue the rest
+static void expand_value(Lowering *lw, ASTNode *node) {
+    if (!node) {
+        unsupported(lw, node, "incomplete expressions");
+        push_value(lw, emit_const(lw, 0));
+        return;
+    }
+
+    switch (node->type) {
+        case AST_INTEGER:
+        case AST_CHARACTER: {
+            int32_t value = 0;
+            literal_value(node, &value);
+            push_value(lw, emit_const(lw, value));
+            break;
+        }
+        case AST_STRING:
+            push_value(lw, emit_address(lw, ir_string_symbol(ir_add_string(lw->program, node->data.string.value))));
+            break;
+        case AST_IDENTIFIER:
+            push_value(lw, lower_identifier(lw, node));
+            break;
+        case AST_BINARY_EXPR:
+            expand_binary(lw, node);
+            break;
+        case AST_ASSIGN_EXPR:
+            expand_assign(lw, node);
+            break;
+        case AST_UNARY_EXPR:
+            expand_unary(lw, node);
+            break;
+        case AST_CALL_EXPR:
+            expand_call(lw, node);
+            break;
+        case AST_SUBSCRIPT_EXPR:
+            if (!push_step(lw, STEP_LOAD, node)) return;
+            expand_element(lw, node);
+            break;
+        default:
+            unsupported(lw, node, "this expression");
+            push_value(lw, emit_const(lw, 0));
+            break;
+    }
+}
+
+// Queue the lowering of a condition: jump to label when its truth is jump_if, else fall through
+static void expand_branch(Lowering *lw, ASTNode *node, int label, int jump_if) {
+    if (node && node->type == AST_BINARY_EXPR) {
+        BinaryOp op = node->data.binary_expr.op;
+        ASTNode *left = node->data.binary_expr.left;
+        ASTNode *right = node->data.binary_expr.right;
+
+        if (op == OP_LOGICAL_AND || op == OP_LOGICAL_OR) {
+            // The left operand alone decides when it is false for && or true for ||
+            int decides = op == OP_LOGICAL_OR;
+            if (jump_if == decides) {
+                push_branch(lw, right, label, jump_if);
+                push_branch(lw, left, label, jump_if);
+            } else {
+                int skip = ir_new_label(lw->function);
+                push_label(lw, skip);
+                push_branch(lw, right, label, jump_if);
+                push_branch(lw, left, skip, decides);
+            }
+            return;
+        }
+        if (is_comparison(op)) {
+            Step *step = push_step(lw, STEP_COMPARE, node);
+            if (!step) return;
+            step->a = jump_if ? op : negate_comparison(op);
+            step->label = label;
+            int32_t value;
+            if (literal_value(right, &value)) {
+                step->has_imm = 1;
+                step->imm = value;
+            } else {
+                push_step(lw, STEP_VALUE, right);
+            }
+            push_step(lw, STEP_VALUE, left);
+            return;
+        }
+    }
+    if (node && node->type == AST_UNARY_EXPR && node->data.unary_expr.op == OP_NOT) {
+        push_branch(lw, node->data.unary_expr.operand, label, !jump_if);
+        return;
+    }
+
+    Step *step = push_step(lw, STEP_TEST, node);
+    if (!step) return;
+    step->a = jump_if;
+    step->label = label;
+    push_step(lw, STEP_VALUE, node);
+}
+
+// Lower what a statement can give at once, and queue its parts
+static void expand_statement(Lowering *lw, ASTNode *node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case AST_COMPOUND_STMT: {
+            Step *step = push_step(lw, STEP_CLOSE_SCOPE, node);
+            if (!step) return;
+            step->a = symtab_open_scope(&lw->symbols);
+            step->imm = lw->scope;
+            lw->scope = step->a;
+            for (int i = node->num_children - 1; i >= 0; i--) push_step(lw, STEP_STATEMENT, node->children[i]);
+            break;
+        }
+        case AST_VARIABLE_DECL:
+            if (!check_declaration(lw, node)) return;
+            // The initializer cannot see the variable it initializes yet
+            if (!push_step(lw, STEP_DECLARE, node)) return;
+            if (node->data.variable_decl.initializer) {
+                push_step(lw, STEP_VALUE, node->data.variable_decl.initializer);
+            }
+            break;
+        case AST_EXPR_STMT:
+            if (node->num_children == 0 || !push_step(lw, STEP_DISCARD, node)) return;
+            push_step(lw, STEP_VALUE, node->children[0]);
+            break;
+        case AST_IF_STMT: {
+            int else_label = ir_new_label(lw->function);
+            Step *step = push_step(lw, STEP_ELSE, node);
+            if (!step) return;
+            step->label = else_label;
+            push_step(lw, STEP_STATEMENT, node->data.if_stmt.if_branch);
+            push_branch(lw, node->data.if_stmt.condition, else_label, 0);
+            break;
+        }
+        case AST_WHILE_STMT: {
+            // Condition at the bottom: one branch per iteration
+            int body = ir_new_label(lw->function);
+            int test = ir_new_label(lw->function);
+            emit_jump(lw, test);
+            emit_label(lw, body);
+            push_branch(lw, node->data.while_stmt.condition, body, 1);
+            push_label(lw, test);
+            push_step(lw, STEP_STATEMENT, node->data.while_stmt.body);
+            break;
+        }
+        case AST_RETURN_STMT:
+            if (!push_step(lw, STEP_RETURN, node)) return;
+            if (node->data.return_stmt.value) push_step(lw, STEP_VALUE, node->data.return_stmt.value);
+            break;
+        default:
+            unsupported(lw, node, "this statement");
+            break;
+    }
+}
+
+// Run one step, its operands on top of the value stack
+static void run_step(Lowering *lw, const Step *step) {
+    ASTNode *node = step->node;
+    switch (step->kind) {
+        case STEP_STATEMENT:
+            expand_statement(lw, node);
+            break;
+        case STEP_VALUE:
+            expand_value(lw, node);
+            break;
+        case STEP_BRANCH:
+            expand_branch(lw, node, step->label, step->a);
+            break;
+        case STEP_LABEL:
+            emit_label(lw, step->label);
+            break;
+        case STEP_CLOSE_SCOPE:
+            symtab_close_scope(&lw->symbols, step->a);
+            lw->scope = step->imm;
+            break;
+        case STEP_ELSE:
+            if (node->data.if_stmt.else_branch) {
+                int done = ir_new_label(lw->function);
+                emit_jump(lw, done);
+                emit_label(lw, step->label);
+                push_label(lw, done);
+                push_step(lw, STEP_STATEMENT, node->data.if_stmt.else_branch);
+            } else {
+                emit_label(lw, step->label);
+            }
+            break;
+        case STEP_DECLARE:
+            lower_declaration(lw, node, node->data.variable_decl.initializer ? pop_value(lw) : IR_NONE);
+            break;
+        case STEP_RETURN: {
+            int value = IR_NONE;
+            if (node->data.return_stmt.value) value = convert_for_store(lw, lw->return_type, pop_value(lw));
+            ir_emit(lw->function, IR_RETURN)->a = value;
+            break;
+        }
+        case STEP_DISCARD:
+            pop_value(lw);
+            break;
+        case STEP_TEST:
+            emit_branch(lw, step->a ? OP_NEQ : OP_EQ, pop_value(lw), 0, 1, step->label);
+            break;
+        case STEP_COMPARE: {
+            int32_t b = step->has_imm ? step->imm : pop_value(lw);
+            int a = pop_value(lw);
+            emit_branch(lw, (BinaryOp)step->a, a, b, step->has_imm, step->label);
+            break;
+        }
+        case STEP_TRUTH:
+            emit_copy(lw, step->a, emit_const(lw, 1));
+            emit_label(lw, step->label);
+            push_value(lw, step->a);
+            break;
+        case STEP_BINARY: {
+            BinaryOp op = node->data.binary_expr.op;
+            int right = step->has_imm ? IR_NONE : pop_value(lw);
+            int left = pop_value(lw);
+            if (step->has_imm) {
+                push_value(lw, emit_binary_imm(lw, op, left, step->imm));
+            } else if (op == OP_DIVIDE || op == OP_MODULO) {
+                // __aeabi_idivmod returns the quotient in r0 and the remainder in r1
+                int32_t args[2] = { left, right };
+                push_value(lw, op == OP_DIVIDE ? emit_call(lw, intern_cstr("__aeabi_idiv"), args, 2, 0)
+                                               : emit_call(lw, intern_cstr("__aeabi_idivmod"), args, 2, IR_RESULT1));
+            } else {
+                push_value(lw, emit_binary(lw, op, left, right));
+            }
+            break;
+        }
+        case STEP_UNARY: {
+            int operand = pop_value(lw);
+            IRInsn *insn = ir_emit(lw->function, IR_UNARY);
+            insn->subop = node->data.unary_expr.op;
+            insn->dst = ir_new_vreg(lw->function);
+            insn->a = operand;
+            push_value(lw, insn->dst);
+            break;
+        }
+        case STEP_CALL: {
+            // The arguments are the top values, first one deepest
+            int count = step->a;
+            lw->num_values -= count;
+            int result = emit_call(lw, node->data.call_expr.function->data.identifier.name,
+                                   lw->values + lw->num_values, count, 0);
+            push_value(lw, result);
+            break;
+        }
+        case STEP_ELEMENT: {
+            int scaled = pop_value(lw);
+            if (step->imm == 4) scaled = emit_binary_imm(lw, OP_SHL, scaled, 2);
+            push_element(lw, emit_binary(lw, OP_ADD, step->a, scaled), 0, step->imm);
+            break;
+        }
+        case STEP_LOAD: {
+            LValue element;
+            pop_element(lw, &element);
+            push_value(lw, emit_load(lw, element.address, element.offset, element.is_byte));
+            break;
+        }
+        case STEP_ASSIGN: {
+            int value = pop_value(lw);
+            LValue lvalue = step->lvalue;
+            if (!step->a) pop_element(lw, &lvalue);
+            push_value(lw, store_lvalue(lw, &lvalue, value));
+            break;
+        }
+        case STEP_INCREMENT: {
+            LValue element;
+            pop_element(lw, &element);
+            push_value(lw, lower_increment(lw, node, &element));
+            break;
+        }
+    }
+}
+
+// Lower a statement, running its steps until none is left
+static void lower_statement(Lowering *lw, ASTNode *node) {
+    int base = lw->num_steps;
+    push_step(lw, STEP_STATEMENT, node);
+    while (lw->num_steps > base && !lw->exhausted) {
+        // Copied out, running it may push over it
+        Step step = lw->steps[--lw->num_steps];
+        run_step(lw, &step);
+    }
+    lw->num_steps = base;
+}
+
+// Lower a function definition
+static void lower_function(Lowering *lw, ASTNode *node) {
+    FunctionData *data = &node->data.function;
+    ASTNode *parameters = data->parameters;
+    int count = parameters ? parameters->num_children : 0;
+
+    lw->function = ir_add_function(lw->program, data->name);
+    if (!lw->function) {
+        lw->errors++;
+        return;
+    }
+    lw->function->num_params = count;
+    lw->return_type = data->return_type;
+
+    int mark = symtab_open_scope(&lw->symbols);
+    lw->scope = mark;
+    for (int i = 0; i < count; i++) {
+        ASTNode *parameter = parameters->children[i];
+        Symbol *symbol = add_symbol(lw, parameter, parameter->data.parameter.name, SYM_LOCAL);
+        if (!symbol) continue;
+        symbol->type = parameter->data.parameter.type;
+        symbol->is_pointer = parameter->data.parameter.is_array;
+        symbol->vreg = ir_new_vreg(lw->function);
+
+        IRInsn *insn = ir_emit(lw->function, IR_PARAM);
+        insn->dst = symbol->vreg;
+        insn->imm = i;
+    }
+    for (int i = mark; i < lw->symbols.num_symbols; i++) {
+        // Callers pass char arguments as full words
+        Symbol *symbol = &lw->symbols.symbols[i];
+        if (symbol->type == TYPE_CHAR && !symbol->is_pointer) {
+            emit_copy(lw, symbol->vreg, convert_for_store(lw, TYPE_CHAR, symbol->vreg));
+        }
+    }
+
+    // The parameters belong to the outermost block of the body
+    if (data->body->type == AST_COMPOUND_STMT) {
+        for (int i = 0; i < data->body->num_children; i++) lower_statement(lw, data->body->children[i]);
+    } else {
+        lower_statement(lw, data->body);
+    }
+    symtab_close_scope(&lw->symbols, mark);
+    lw->scope = 0;
+
+    // Falling off the end returns 0, which main relies on
+    int zero = emit_const(lw, 0);
+    ir_emit(lw->function, IR_RETURN)->a = zero;
+    if (lw->function->failed) lw->errors++;
+}
+
+// Value of a constant global initializer, 0 if it is not constant
+static int constant_value(const ASTNode *node, int32_t *value) {
+    if (literal_value(node, value)) return 1;
+    if (!node || node->type != AST_UNARY_EXPR) return 0;
+    if (!constant_value(node->data.unary_expr.operand, value)) return 0;
+    switch (node->data.unary_expr.op) {
+        case OP_NEGATE: *value = (int32_t)(0U - (uint32_t)*value); return 1;
+        case OP_BITWISE_NOT: *value = ~*value; return 1;
+        case OP_NOT: *value = !*value; return 1;
+        default: return 0;
+    }
+}
+
+// Define a global variable
+static void lower_global(Lowering *lw, ASTNode *node) {
+    VariableDeclData *decl = &node->data.variable_decl;
+    if (!check_declaration(lw, node)) return;
+    Symbol *symbol = add_symbol(lw, node, decl->name, SYM_GLOBAL);
+    if (!symbol) return;
+    symbol->type = decl->type;
+    symbol->is_array = decl->is_array;
+
+    IRGlobal *global = ir_add_global(lw->program, decl->name);
+    if (!global) {
+        lw->errors++;
+        return;
+    }
+    int element_size = decl->type == TYPE_CHAR ? 1 : 4;
+    global->size = decl->is_array ? element_size * decl->array_size : element_size;
+    global->align = element_size;
+    if (decl->initializer) {
+        if (!constant_value(decl->initializer, &global->value)) {
+            unsupported(lw, decl->initializer, "non-constant global initializers");
+        }
+        global->has_value = 1;
+    }
+}
+
+// Declare a function; prototypes may repeat, the body may come once
+static void declare_function(Lowering *lw, ASTNode *node) {
+    FunctionData *data = &node->data.function;
+    Symbol *existing = symtab_lookup(&lw->symbols, data->name);
+    if (existing && existing->kind == SYM_FUNCTION && !(existing->is_defined && data->body)) {
+        if (data->body) existing->is_defined = 1;
+        return;
+    }
+
+    Symbol *symbol = add_symbol(lw, node, data->name, SYM_FUNCTION);
+    if (!symbol) return;
+    symbol->type = data->return_type;
+    symbol->is_defined = data->body != NULL;
+}
+
+// Lower a program
+IRProgram* lower_program(ASTNode *program, Lexer *lexer) {
+    if (!program) return NULL;
+
+    Lowering lw;
+    memset(&lw, 0, sizeof(lw));
+    symtab_init(&lw.symbols);
+    lw.lexer = lexer;
+    lw.program = ir_create_program();
+    if (!lw.program) return NULL;
+
+    // Top-level names become visible in source order, as C requires
+    for (int i = 0; i < program->num_children; i++) {
+        ASTNode *node = program->children[i];
+        if (node->type == AST_FUNCTION) {
+            declare_function(&lw, node);
+            if (node->data.function.body) lower_function(&lw, node);
+        } else if (node->type == AST_VARIABLE_DECL) {
+            lower_global(&lw, node);
+        } else {
+            unsupported(&lw, node, "this declaration");
+        }
+    }
+
+    symtab_free(&lw.symbols);
+    free(lw.steps);
+    free(lw.values);
+    if (lw.errors > 0 || lw.program->failed) {
+        ir_free_program(lw.program);
+        return NULL;
+    }
+    return lw.program;
+}
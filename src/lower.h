@@ -0,0 +1,19 @@
+/**
+ * AST Lowering Header
+ *
+ * Translates the AST of an error-free translation unit into IR (ir.h),
+ * resolving names and checking what the backend can compile.
+ */
+
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "ast.h"
+#include "ir.h"
+#include "lexeme.h"
+
+// Lower a program; constructs that cannot be compiled are reported on the
+// lexer's diagnostics engine, and NULL is returned then
+IRProgram* lower_program(ASTNode *program, Lexer *lexer);
+
+#endif // LOWER_H
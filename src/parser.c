@@ -5,6 +5,7 @@
  * Translates a token stream into an abstract syntax tree (AST).
  */
 
+ #include <stdarg.h>
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
@@ -12,39 +13,71 @@
  #include "parser.h"
  #include "ast.h"
  #include "error.h"
+ #include "pool.h"
  
- // Initialize parser with a lexer
- Parser* init_parser(Lexer *lexer) {
+ // Initialize parser with a lexer, AST nodes are allocated from the arena
+ Parser* init_parser(Lexer *lexer, Arena *arena) {
      Parser *parser = (Parser*)malloc(sizeof(Parser));
      if (!parser) return NULL;
      
      parser->lexer = lexer;
+     parser->arena = arena;
      parser->current_token = peek_token(lexer);
+     parser->bodies = NULL;
+     parser->num_bodies = 0;
+     parser->next_body = 0;
+     parser->body_arenas = NULL;
+     parser->num_body_arenas = 0;
+     parser->last_end = parser->current_token.offset;
      
      return parser;
  }
  
+ // Function body parsed ahead of time, spanning tokens [lbrace, rbrace]
+ struct ParsedBody {
+     size_t lbrace;            // Token index of the opening brace
+     size_t rbrace;            // Token index of the matching closing brace
+     ASTNode *node;            // Parsed body, NULL if it must be parsed in sequence
+     DiagEngine *diag;         // Diagnostics of the body, merged when it is attached
+ };
+ 
  // Free parser resources
  void free_parser(Parser *parser) {
      if (parser) {
+         for (size_t i = 0; i < parser->num_bodies; i++) {
+             diag_destroy(parser->bodies[i].diag);
+         }
+         free(parser->bodies);
+         for (int i = 0; i < parser->num_body_arenas; i++) {
+             arena_destroy(parser->body_arenas[i]);
+         }
+         free(parser->body_arenas);
          free(parser);
      }
  }
  
+ // Move to the next token
+ void parser_advance(Parser *parser) {
+     parser->last_end = parser->current_token.offset + parser->current_token.length;
+     advance_token(parser->lexer);
+     parser->current_token = peek_token(parser->lexer);
+ }
+ 
+ // Look k tokens past the current one without consuming anything
+ Token parser_peek(Parser *parser, unsigned k) {
+     return peek_token_n(parser->lexer, k);
+ }
+ 
  // Consume current token and advance to next if it matches expected type
  int expect_token(Parser *parser, TokenType type) {
      if (parser->current_token.type == type) {
-         advance_token(parser->lexer);
-         parser->current_token = peek_token(parser->lexer);
+         parser_advance(parser);
          return 1;
      }
      
-     char error_msg[128];
-     snprintf(error_msg, sizeof(error_msg), 
-              "Expected token %s, got %s", 
-              token_type_str(type), 
-              token_type_str(parser->current_token.type));
-     parser_error(parser, error_msg);
+     parser_error(parser, DIAG_EXPECTED_TOKEN,
+                  token_type_str(type),
+                  token_type_str(parser->current_token.type));
      return 0;
  }
  
@@ -53,79 +86,221 @@
      return parser->current_token.type == type;
  }
  
- // Report parser error
- void parser_error(Parser *parser, const char *message) {
-     error_report_location(
-         parser->current_token.filename,
-         parser->current_token.line,
-         parser->current_token.column,
-         message
-     );
+ // Report parser error at the current token
+ void parser_error(Parser *parser, DiagId id, ...) {
+     int line, column;
+     lexer_location(parser->lexer, parser->current_token.offset, &line, &column);
+     
+     va_list args;
+     va_start(args, id);
+     diag_vreport(parser->lexer->diag, DIAG_ERROR, id,
+                  lexer_source_name(parser->lexer, parser->current_token.offset), line, column, args);
+     va_end(args);
+ }
+ 
+ // Create a node whose span starts at the current token
+ static ASTNode* new_node(Parser *parser, ASTNodeType type) {
+     ASTNode *node = create_ast_node(parser->arena, type);
+     if (node) {
+         node->span.start = parser->current_token.offset;
+         node->span.end = parser->current_token.offset;
+     }
+     return node;
+ }
+ 
+ // Close the span of a node after the last token consumed
+ static ASTNode* end_node(Parser *parser, ASTNode *node) {
+     if (node) node->span.end = parser->last_end;
+     return node;
+ }
+ 
+ // Create a node whose span starts with an operand parsed before it
+ static ASTNode* new_node_from(Parser *parser, ASTNodeType type, const ASTNode *first) {
+     ASTNode *node = new_node(parser, type);
+     if (node && first) node->span.start = first->span.start;
+     return node;
+ }
+ 
+ // Whether parsing should give up because the error cap was reached
+ static int parser_should_stop(Parser *parser) {
+     return diag_limit_reached(parser->lexer->diag);
+ }
+ 
+ // Attach the pre-parsed body starting at the current '{', if there is one
+ static ASTNode* take_parsed_body(Parser *parser) {
+     if (!parser->bodies) return NULL;
+     
+     // Bodies before the current token were not reached as function bodies
+     size_t index = lexer_token_index(parser->lexer);
+     while (parser->next_body < parser->num_bodies && parser->bodies[parser->next_body].lbrace < index) {
+         parser->next_body++;
+     }
+     if (parser->next_body == parser->num_bodies) return NULL;
+     
+     ParsedBody *body = &parser->bodies[parser->next_body];
+     if (body->lbrace != index || !body->node) return NULL;
+     parser->next_body++;
+     
+     diag_merge(parser->lexer->diag, body->diag);
+     const Token *rbrace = &parser->lexer->tokens[body->rbrace];
+     parser->last_end = rbrace->offset + rbrace->length;
+     lexer_seek_token(parser->lexer, body->rbrace + 1);
+     parser->current_token = peek_token(parser->lexer);
+     return body->node;
+ }
+ 
+ // Index of the token closing the bracket opened at tokens[open], or count if unmatched
+ static size_t matching_token(const Token *tokens, size_t count, size_t open,
+                              TokenType open_type, TokenType close_type) {
+     int depth = 0;
+     for (size_t i = open; i < count; i++) {
+         if (tokens[i].type == open_type) {
+             depth++;
+         } else if (tokens[i].type == close_type && --depth == 0) {
+             return i;
+         }
+     }
+     return count;
+ }
+ 
+ // Skim the token stream for top-level "type name ( ... ) { ... }" definitions
+ static int skim_function_bodies(Parser *parser) {
+     const Token *tokens = parser->lexer->tokens;
+     size_t count = parser->lexer->num_tokens_total;
+     size_t capacity = 0;
+     int depth = 0;
+     
+     for (size_t i = 0; i + 2 < count; i++) {
+         TokenType type = tokens[i].type;
+         if (type == TOKEN_LBRACE) depth++;
+         if (type == TOKEN_RBRACE && depth > 0) depth--;
+         if (depth > 0 || (type != TOKEN_INT && type != TOKEN_CHAR && type != TOKEN_VOID) ||
+             tokens[i + 1].type != TOKEN_IDENTIFIER || tokens[i + 2].type != TOKEN_LPAREN) {
+             continue;
+         }
+         
+         size_t rparen = matching_token(tokens, count, i + 2, TOKEN_LPAREN, TOKEN_RPAREN);
+         if (rparen + 1 >= count || tokens[rparen + 1].type != TOKEN_LBRACE) continue;
+         size_t rbrace = matching_token(tokens, count, rparen + 1, TOKEN_LBRACE, TOKEN_RBRACE);
+         if (rbrace == count) break;  // Unbalanced from here on, leave the rest in sequence
+         
+         if (parser->num_bodies == capacity) {
+             capacity = capacity ? capacity * 2 : 64;
+             ParsedBody *bodies = (ParsedBody*)realloc(parser->bodies, capacity * sizeof(ParsedBody));
+             if (!bodies) return 0;
+             parser->bodies = bodies;
+         }
+         ParsedBody *body = &parser->bodies[parser->num_bodies++];
+         body->lbrace = rparen + 1;
+         body->rbrace = rbrace;
+         body->node = NULL;
+         body->diag = NULL;
+         i = rbrace;
+     }
+     return 1;
+ }
+ 
+ // Pool job: parse one function body with a private lexer view and the thread's arena
+ static void parse_body_job(void *context, size_t job, int worker) {
+     Parser *parser = (Parser*)context;
+     ParsedBody *body = &parser->bodies[job];
+     
+     body->diag = diag_create(NULL);
+     if (!body->diag) return;
+     diag_set_max_errors(body->diag, parser->lexer->diag->max_errors);
+     
+     // The token array and line table are shared read-only
+     Lexer lexer = *parser->lexer;
+     lexer.diag = body->diag;
+     lexer.stats = NULL;
+     lexer_seek_token(&lexer, body->lbrace);
+     
+     Parser body_parser = *parser;
+     body_parser.lexer = &lexer;
+     body_parser.arena = parser->body_arenas[worker];
+     body_parser.bodies = NULL;
+     body_parser.num_bodies = 0;
+     body_parser.current_token = peek_token(&lexer);
+     
+     body->node = parse_compound_statement(&body_parser);
+     
+     // A body that did not end on its closing brace is parsed again in sequence
+     if (lexer_token_index(&lexer) != body->rbrace + 1) {
+         body->node = NULL;
+     }
+ }
+ 
+ // Parse the program, with every function body parsed ahead of time on a
+ // thread pool. Needs the whole token stream (lexer_lex_all) before the
+ // parser is created, otherwise this is plain parse_program.
+ ASTNode* parse_program_parallel(Parser *parser, int num_threads) {
+     Lexer *lexer = parser->lexer;
+     if (num_threads > 1 && lexer->tokens && lexer_token_index(lexer) == 0 &&
+         !parser->bodies && lexer_index_lines(lexer) && skim_function_bodies(parser) &&
+         parser->num_bodies > 0) {
+         parser->body_arenas = (Arena**)calloc(num_threads, sizeof(Arena*));
+         int ok = parser->body_arenas != NULL;
+         for (int i = 0; ok && i < num_threads; i++) {
+             parser->body_arenas[i] = arena_create(0);
+             if (parser->body_arenas[i]) parser->num_body_arenas++;
+             else ok = 0;
+         }
+         
+         if (ok) {
+             pool_run(num_threads, parser->num_bodies, parse_body_job, parser);
+         } else {
+             parser->num_bodies = 0;
+         }
+     }
+     
+     return parse_program(parser);
  }
  
  // Parse entire program
  ASTNode* parse_program(Parser *parser) {
-     ASTNode *program = create_ast_node(AST_PROGRAM);
+     ASTNode *program = new_node(parser, AST_PROGRAM);
      if (!program) return NULL;
+     // The unit spans its main buffer from the start, even when the first
+     // token comes from an included header and has an offset past it
+     program->span.start = 0;
      
      // Parse a sequence of function definitions and global declarations
-     while (!match_token(parser, TOKEN_EOF)) {
-         // Check for preprocessor directives
-         if (match_token(parser, TOKEN_POUND)) {
-             // Simple handling of #include and #define
-             expect_token(parser, TOKEN_POUND);
-             
-             if (match_token(parser, TOKEN_IDENTIFIER)) {
-                 char *directive = strdup(parser->current_token.value);
-                 expect_token(parser, TOKEN_IDENTIFIER);
-                 
-                 // Skip the rest of the line for now (simplistic approach)
-                 while (!match_token(parser, TOKEN_EOF) && 
-                        !match_token(parser, TOKEN_SEMICOLON)) {
-                     advance_token(parser->lexer);
-                     parser->current_token = peek_token(parser->lexer);
-                 }
-                 
-                 if (match_token(parser, TOKEN_SEMICOLON)) {
-                     expect_token(parser, TOKEN_SEMICOLON);
-                 }
-                 
-                 free(directive);
-             }
-             continue;
-         }
-         
+     while (!match_token(parser, TOKEN_EOF) && !parser_should_stop(parser)) {
          // Type specifier for function or variable
          if (match_token(parser, TOKEN_INT) || 
              match_token(parser, TOKEN_CHAR) || 
              match_token(parser, TOKEN_VOID)) {
+             unsigned start = parser->current_token.offset;
              
+             // Lookahead over "type name (" tells a function from a global variable
              TokenType type_token = parser->current_token.type;
+             Token name_token = parser_peek(parser, 1);
+             int is_function = parser_peek(parser, 2).type == TOKEN_LPAREN;
              expect_token(parser, type_token);
              
              // Variable or function name
-             if (match_token(parser, TOKEN_IDENTIFIER)) {
-                 char *identifier = strdup(parser->current_token.value);
+             if (name_token.type == TOKEN_IDENTIFIER) {
+                 const char *identifier = token_intern(parser->lexer, name_token);
                  expect_token(parser, TOKEN_IDENTIFIER);
                  
                  // Function definition
-                 if (match_token(parser, TOKEN_LPAREN)) {
+                 if (is_function) {
                      ASTNode *function = parse_function(parser);
                      if (function) {
+                         function->span.start = start;
                          // Set function return type
                          function->data.function.return_type = type_token == TOKEN_INT ? TYPE_INT : 
                                                               type_token == TOKEN_CHAR ? TYPE_CHAR : 
                                                               TYPE_VOID;
                          function->data.function.name = identifier;
-                         add_child(program, function);
-                     } else {
-                         free(identifier);
+                         add_child(parser->arena, program, function);
                      }
                  }
                  // Global variable declaration
                  else {
-                     ASTNode *variable = create_ast_node(AST_VARIABLE_DECL);
+                     ASTNode *variable = new_node(parser, AST_VARIABLE_DECL);
                      if (variable) {
+                         variable->span.start = start;
                          variable->data.variable_decl.type = type_token == TOKEN_INT ? TYPE_INT : 
                                                             type_token == TOKEN_CHAR ? TYPE_CHAR : 
                                                             TYPE_VOID;
@@ -137,7 +312,7 @@
                              
                              if (match_token(parser, TOKEN_INTEGER)) {
                                  variable->data.variable_decl.is_array = 1;
-                                 variable->data.variable_decl.array_size = atoi(parser->current_token.value);
+                                 variable->data.variable_decl.array_size = token_int_value(parser->lexer, parser->current_token);
                                  expect_token(parser, TOKEN_INTEGER);
                              }
                              
@@ -155,30 +330,26 @@
                          }
                          
                          expect_token(parser, TOKEN_SEMICOLON);
-                         add_child(program, variable);
-                     } else {
-                         free(identifier);
+                         add_child(parser->arena, program, end_node(parser, variable));
                      }
                  }
              } else {
-                 parser_error(parser, "Expected identifier after type specifier");
+                 parser_error(parser, DIAG_EXPECTED_IDENTIFIER_AFTER_TYPE);
                  // Try to recover by skipping to next semicolon
                  while (!match_token(parser, TOKEN_EOF) && 
                         !match_token(parser, TOKEN_SEMICOLON)) {
-                     advance_token(parser->lexer);
-                     parser->current_token = peek_token(parser->lexer);
+                     parser_advance(parser);
                  }
                  if (match_token(parser, TOKEN_SEMICOLON)) {
                      expect_token(parser, TOKEN_SEMICOLON);
                  }
              }
          } else {
-             parser_error(parser, "Expected type specifier");
+             parser_error(parser, DIAG_EXPECTED_TYPE);
              // Try to recover by skipping to next semicolon
              while (!match_token(parser, TOKEN_EOF) && 
                    !match_token(parser, TOKEN_SEMICOLON)) {
-                 advance_token(parser->lexer);
-                 parser->current_token = peek_token(parser->lexer);
+                 parser_advance(parser);
              }
              if (match_token(parser, TOKEN_SEMICOLON)) {
                  expect_token(parser, TOKEN_SEMICOLON);
@@ -186,12 +357,12 @@
          }
      }
      
-     return program;
+     return end_node(parser, program);
  }
  
  // Parse function definition
  ASTNode* parse_function(Parser *parser) {
-     ASTNode *function = create_ast_node(AST_FUNCTION);
+     ASTNode *function = new_node(parser, AST_FUNCTION);
      if (!function) return NULL;
      
      // Parameter list
@@ -206,9 +377,10 @@
      
      expect_token(parser, TOKEN_RPAREN);
      
-     // Function body
+     // Function body, possibly parsed ahead of time
      if (match_token(parser, TOKEN_LBRACE)) {
-         ASTNode *body = parse_compound_statement(parser);
+         ASTNode *body = take_parsed_body(parser);
+         if (!body) body = parse_compound_statement(parser);
          if (body) {
              function->data.function.body = body;
          }
@@ -217,12 +389,12 @@
          expect_token(parser, TOKEN_SEMICOLON);
      }
      
-     return function;
+     return end_node(parser, function);
  }
  
  // Parse function parameter list
  ASTNode* parse_parameter_list(Parser *parser) {
-     ASTNode *param_list = create_ast_node(AST_PARAM_LIST);
+     ASTNode *param_list = new_node(parser, AST_PARAM_LIST);
      if (!param_list) return NULL;
      
      // Parse first parameter
@@ -231,24 +403,23 @@
          match_token(parser, TOKEN_VOID)) {
          
          TokenType type_token = parser->current_token.type;
+         unsigned start = parser->current_token.offset;
          expect_token(parser, type_token);
          
          // Special case for void parameter (no other parameters)
          if (type_token == TOKEN_VOID && !match_token(parser, TOKEN_IDENTIFIER)) {
-             return param_list;  // Empty parameter list
+             return end_node(parser, param_list);  // Empty parameter list
          }
          
          if (match_token(parser, TOKEN_IDENTIFIER)) {
-             ASTNode *param = create_ast_node(AST_PARAMETER);
-             if (!param) {
-                 free_ast(param_list);
-                 return NULL;
-             }
+             ASTNode *param = new_node(parser, AST_PARAMETER);
+             if (!param) return NULL;
+             param->span.start = start;
              
              param->data.parameter.type = type_token == TOKEN_INT ? TYPE_INT : 
                                           type_token == TOKEN_CHAR ? TYPE_CHAR : 
                                           TYPE_VOID;
-             param->data.parameter.name = strdup(parser->current_token.value);
+             param->data.parameter.name = token_intern(parser->lexer, parser->current_token);
              expect_token(parser, TOKEN_IDENTIFIER);
              
              // Check for array parameter
@@ -258,7 +429,7 @@
                  param->data.parameter.is_array = 1;
              }
              
-             add_child(param_list, param);
+             add_child(parser->arena, param_list, end_node(parser, param));
          }
      }
      
@@ -271,19 +442,18 @@
              match_token(parser, TOKEN_VOID)) {
              
              TokenType type_token = parser->current_token.type;
+             unsigned start = parser->current_token.offset;
              expect_token(parser, type_token);
              
              if (match_token(parser, TOKEN_IDENTIFIER)) {
-                 ASTNode *param = create_ast_node(AST_PARAMETER);
-                 if (!param) {
-                     free_ast(param_list);
-                     return NULL;
-                 }
+                 ASTNode *param = new_node(parser, AST_PARAMETER);
+                 if (!param) return NULL;
+                 param->span.start = start;
                  
                  param->data.parameter.type = type_token == TOKEN_INT ? TYPE_INT : 
                                               type_token == TOKEN_CHAR ? TYPE_CHAR : 
                                               TYPE_VOID;
-                 param->data.parameter.name = strdup(parser->current_token.value);
+                 param->data.parameter.name = token_intern(parser->lexer, parser->current_token);
                  expect_token(parser, TOKEN_IDENTIFIER);
                  
                  // Check for array parameter
@@ -293,33 +463,40 @@
                      param->data.parameter.is_array = 1;
                  }
                  
-                 add_child(param_list, param);
+                 add_child(parser->arena, param_list, end_node(parser, param));
              }
          }
      }
      
-     return param_list;
+     return end_node(parser, param_list);
  }
  
  // Parse compound statement (block)
  ASTNode* parse_compound_statement(Parser *parser) {
-     ASTNode *block = create_ast_node(AST_COMPOUND_STMT);
+     ASTNode *block = new_node(parser, AST_COMPOUND_STMT);
      if (!block) return NULL;
      
      expect_token(parser, TOKEN_LBRACE);
      
      // Parse statements until closing brace
-     while (!match_token(parser, TOKEN_RBRACE) && !match_token(parser, TOKEN_EOF)) {
+     while (!match_token(parser, TOKEN_RBRACE) && !match_token(parser, TOKEN_EOF) &&
+            !parser_should_stop(parser)) {
+         unsigned start_offset = parser->current_token.offset;
          ASTNode *statement = parse_statement(parser);
          if (statement) {
-             add_child(block, statement);
+             add_child(parser->arena, block, statement);
+             
+             // A statement that failed without consuming anything would be
+             // parsed again forever, skip the offending token instead
+             if (parser->current_token.offset == start_offset && !match_token(parser, TOKEN_EOF)) {
+                 parser_advance(parser);
+             }
          } else {
              // Error recovery - skip to semicolon or next statement
              while (!match_token(parser, TOKEN_SEMICOLON) && 
                    !match_token(parser, TOKEN_RBRACE) && 
                    !match_token(parser, TOKEN_EOF)) {
-                 advance_token(parser->lexer);
-                 parser->current_token = peek_token(parser->lexer);
+                 parser_advance(parser);
              }
              if (match_token(parser, TOKEN_SEMICOLON)) {
                  expect_token(parser, TOKEN_SEMICOLON);
@@ -329,7 +506,7 @@
      
      expect_token(parser, TOKEN_RBRACE);
      
-     return block;
+     return end_node(parser, block);
  }
  
  // Parse a statement
@@ -366,25 +543,28 @@
  // Parse variable declaration
  ASTNode* parse_declaration(Parser *parser) {
      TokenType type_token = parser->current_token.type;
+     unsigned start = parser->current_token.offset;
      expect_token(parser, type_token);
      
-     return parse_variable_declaration(parser, type_token);
+     ASTNode *var_decl = parse_variable_declaration(parser, type_token);
+     if (var_decl) var_decl->span.start = start;
+     return var_decl;
  }
  
  // Parse variable declaration with known type
  ASTNode* parse_variable_declaration(Parser *parser, TokenType type_token) {
      if (!match_token(parser, TOKEN_IDENTIFIER)) {
-         parser_error(parser, "Expected identifier in variable declaration");
+         parser_error(parser, DIAG_EXPECTED_IDENTIFIER_IN_DECL);
          return NULL;
      }
      
-     ASTNode *var_decl = create_ast_node(AST_VARIABLE_DECL);
+     ASTNode *var_decl = new_node(parser, AST_VARIABLE_DECL);
      if (!var_decl) return NULL;
      
      var_decl->data.variable_decl.type = type_token == TOKEN_INT ? TYPE_INT : 
                                          type_token == TOKEN_CHAR ? TYPE_CHAR : 
                                          TYPE_VOID;
-     var_decl->data.variable_decl.name = strdup(parser->current_token.value);
+     var_decl->data.variable_decl.name = token_intern(parser->lexer, parser->current_token);
      expect_token(parser, TOKEN_IDENTIFIER);
      
      // Check for array declaration
@@ -393,7 +573,7 @@
          
          if (match_token(parser, TOKEN_INTEGER)) {
              var_decl->data.variable_decl.is_array = 1;
-             var_decl->data.variable_decl.array_size = atoi(parser->current_token.value);
+             var_decl->data.variable_decl.array_size = token_int_value(parser->lexer, parser->current_token);
              expect_token(parser, TOKEN_INTEGER);
          }
          
@@ -412,34 +592,34 @@
      
      expect_token(parser, TOKEN_SEMICOLON);
      
-     return var_decl;
+     return end_node(parser, var_decl);
  }
  
  // Parse expression statement (expression followed by semicolon)
  ASTNode* parse_expression_statement(Parser *parser) {
-     ASTNode *expr_stmt = create_ast_node(AST_EXPR_STMT);
+     ASTNode *expr_stmt = new_node(parser, AST_EXPR_STMT);
      if (!expr_stmt) return NULL;
      
      // Empty statement
      if (match_token(parser, TOKEN_SEMICOLON)) {
          expect_token(parser, TOKEN_SEMICOLON);
-         return expr_stmt;
+         return end_node(parser, expr_stmt);
      }
      
      // Expression
      ASTNode *expr = parse_expression(parser);
      if (expr) {
-         add_child(expr_stmt, expr);
+         add_child(parser->arena, expr_stmt, expr);
      }
      
      expect_token(parser, TOKEN_SEMICOLON);
      
-     return expr_stmt;
+     return end_node(parser, expr_stmt);
  }
  
  // Parse if statement
  ASTNode* parse_if_statement(Parser *parser) {
-     ASTNode *if_stmt = create_ast_node(AST_IF_STMT);
+     ASTNode *if_stmt = new_node(parser, AST_IF_STMT);
      if (!if_stmt) return NULL;
      
      expect_token(parser, TOKEN_IF);
@@ -469,12 +649,12 @@
          }
      }
      
-     return if_stmt;
+     return end_node(parser, if_stmt);
  }
  
  // Parse while statement
  ASTNode* parse_while_statement(Parser *parser) {
-     ASTNode *while_stmt = create_ast_node(AST_WHILE_STMT);
+     ASTNode *while_stmt = new_node(parser, AST_WHILE_STMT);
      if (!while_stmt) return NULL;
      
      expect_token(parser, TOKEN_WHILE);
@@ -494,12 +674,12 @@
          while_stmt->data.while_stmt.body = body;
      }
      
-     return while_stmt;
+     return end_node(parser, while_stmt);
  }
  
  // Parse return statement
  ASTNode* parse_return_statement(Parser *parser) {
-     ASTNode *return_stmt = create_ast_node(AST_RETURN_STMT);
+     ASTNode *return_stmt = new_node(parser, AST_RETURN_STMT);
      if (!return_stmt) return NULL;
      
      expect_token(parser, TOKEN_RETURN);
@@ -514,7 +694,7 @@
      
      expect_token(parser, TOKEN_SEMICOLON);
      
-     return return_stmt;
+     return end_node(parser, return_stmt);
  }
  
  // Parse expression
@@ -524,14 +704,11 @@
  
  // Parse assignment expression
  ASTNode* parse_assignment_expression(Parser *parser) {
-     ASTNode *expr = parse_logical_or_expression(parser);
+     ASTNode *expr = parse_binary_expression(parser, 1);
      
      if (match_token(parser, TOKEN_ASSIGN)) {
-         ASTNode *assign = create_ast_node(AST_ASSIGN_EXPR);
-         if (!assign) {
-             free_ast(expr);
-             return NULL;
-         }
+         ASTNode *assign = new_node_from(parser, AST_ASSIGN_EXPR, expr);
+         if (!assign) return NULL;
          
          assign->data.binary_expr.left = expr;
          
@@ -542,201 +719,66 @@
              assign->data.binary_expr.right = right;
          }
          
-         return assign;
+         return end_node(parser, assign);
      }
      
      return expr;
  }
  
- // Parse logical OR expression
- ASTNode* parse_logical_or_expression(Parser *parser) {
-     ASTNode *left = parse_logical_and_expression(parser);
-     
-     while (match_token(parser, TOKEN_OR)) {
-         ASTNode *or_expr = create_ast_node(AST_BINARY_EXPR);
-         if (!or_expr) {
-             free_ast(left);
-             return NULL;
-         }
-         
-         or_expr->data.binary_expr.op = OP_LOGICAL_OR;
-         or_expr->data.binary_expr.left = left;
-         
-         expect_token(parser, TOKEN_OR);
-         
-         ASTNode *right = parse_logical_and_expression(parser);
-         if (right) {
-             or_expr->data.binary_expr.right = right;
-         }
-         
-         left = or_expr;
-     }
-     
-     return left;
- }
+ // Binary operator table indexed by token type, precedence 0 means "not a
+ // binary operator". Higher binds tighter, every level is left-associative.
+ typedef struct {
+     int precedence;
+     BinaryOp op;
+ } BinaryOperator;
  
- // Parse logical AND expression
- ASTNode* parse_logical_and_expression(Parser *parser) {
-     ASTNode *left = parse_equality_expression(parser);
-     
-     while (match_token(parser, TOKEN_AND)) {
-         ASTNode *and_expr = create_ast_node(AST_BINARY_EXPR);
-         if (!and_expr) {
-             free_ast(left);
-             return NULL;
-         }
-         
-         and_expr->data.binary_expr.op = OP_LOGICAL_AND;
-         and_expr->data.binary_expr.left = left;
-         
-         expect_token(parser, TOKEN_AND);
-         
-         ASTNode *right = parse_equality_expression(parser);
-         if (right) {
-             and_expr->data.binary_expr.right = right;
-         }
-         
-         left = and_expr;
-     }
-     
-     return left;
- }
+ static const BinaryOperator binary_operators[TOKEN_ERROR + 1] = {
+     [TOKEN_OR]      = { 1, OP_LOGICAL_OR },
+     [TOKEN_AND]     = { 2, OP_LOGICAL_AND },
+     [TOKEN_BITOR]   = { 3, OP_BITWISE_OR },
+     [TOKEN_BITXOR]  = { 4, OP_BITWISE_XOR },
+     [TOKEN_BITAND]  = { 5, OP_BITWISE_AND },
+     [TOKEN_EQ]      = { 6, OP_EQ },
+     [TOKEN_NEQ]     = { 6, OP_NEQ },
+     [TOKEN_LT]      = { 7, OP_LT },
+     [TOKEN_GT]      = { 7, OP_GT },
+     [TOKEN_LTE]     = { 7, OP_LTE },
+     [TOKEN_GTE]     = { 7, OP_GTE },
+     [TOKEN_SHL]     = { 8, OP_SHL },
+     [TOKEN_SHR]     = { 8, OP_SHR },
+     [TOKEN_PLUS]    = { 9, OP_ADD },
+     [TOKEN_MINUS]   = { 9, OP_SUBTRACT },
+     [TOKEN_STAR]    = { 10, OP_MULTIPLY },
+     [TOKEN_SLASH]   = { 10, OP_DIVIDE },
+     [TOKEN_PERCENT] = { 10, OP_MODULO },
+ };
  
- // Parse equality expression
- ASTNode* parse_equality_expression(Parser *parser) {
-     ASTNode *left = parse_relational_expression(parser);
-     
-     while (match_token(parser, TOKEN_EQ) || match_token(parser, TOKEN_NEQ)) {
-         ASTNode *eq_expr = create_ast_node(AST_BINARY_EXPR);
-         if (!eq_expr) {
-             free_ast(left);
-             return NULL;
-         }
-         
-         if (match_token(parser, TOKEN_EQ)) {
-             eq_expr->data.binary_expr.op = OP_EQ;
-             expect_token(parser, TOKEN_EQ);
-         } else {
-             eq_expr->data.binary_expr.op = OP_NEQ;
-             expect_token(parser, TOKEN_NEQ);
-         }
-         
-         eq_expr->data.binary_expr.left = left;
-         
-         ASTNode *right = parse_relational_expression(parser);
-         if (right) {
-             eq_expr->data.binary_expr.right = right;
-         }
-         
-         left = eq_expr;
-     }
-     
-     return left;
- }
- 
- // Parse relational expression
- ASTNode* parse_relational_expression(Parser *parser) {
-     ASTNode *left = parse_additive_expression(parser);
-     
-     while (match_token(parser, TOKEN_LT) || match_token(parser, TOKEN_GT) ||
-            match_token(parser, TOKEN_LTE) || match_token(parser, TOKEN_GTE)) {
-         ASTNode *rel_expr = create_ast_node(AST_BINARY_EXPR);
-         if (!rel_expr) {
-             free_ast(left);
-             return NULL;
-         }
-         
-         if (match_token(parser, TOKEN_LT)) {
-             rel_expr->data.binary_expr.op = OP_LT;
-             expect_token(parser, TOKEN_LT);
-         } else if (match_token(parser, TOKEN_GT)) {
-             rel_expr->data.binary_expr.op = OP_GT;
-             expect_token(parser, TOKEN_GT);
-         } else if (match_token(parser, TOKEN_LTE)) {
-             rel_expr->data.binary_expr.op = OP_LTE;
-             expect_token(parser, TOKEN_LTE);
-         } else {
-             rel_expr->data.binary_expr.op = OP_GTE;
-             expect_token(parser, TOKEN_GTE);
-         }
-         
-         rel_expr->data.binary_expr.left = left;
-         
-         ASTNode *right = parse_additive_expression(parser);
-         if (right) {
-             rel_expr->data.binary_expr.right = right;
-         }
-         
-         left = rel_expr;
-     }
-     
-     return left;
- }
- 
- // Parse additive expression
- ASTNode* parse_additive_expression(Parser *parser) {
-     ASTNode *left = parse_multiplicative_expression(parser);
-     
-     while (match_token(parser, TOKEN_PLUS) || match_token(parser, TOKEN_MINUS)) {
-         ASTNode *add_expr = create_ast_node(AST_BINARY_EXPR);
-         if (!add_expr) {
-             free_ast(left);
-             return NULL;
-         }
-         
-         if (match_token(parser, TOKEN_PLUS)) {
-             add_expr->data.binary_expr.op = OP_ADD;
-             expect_token(parser, TOKEN_PLUS);
-         } else {
-             add_expr->data.binary_expr.op = OP_SUBTRACT;
-             expect_token(parser, TOKEN_MINUS);
-         }
-         
-         add_expr->data.binary_expr.left = left;
-         
-         ASTNode *right = parse_multiplicative_expression(parser);
-         if (right) {
-             add_expr->data.binary_expr.right = right;
-         }
-         
-         left = add_expr;
-     }
-     
-     return left;
- }
- 
- // Parse multiplicative expression
- ASTNode* parse_multiplicative_expression(Parser *parser) {
+ // Parse binary expression by precedence climbing: operands bind to
+ // operators of at least min_precedence
+ ASTNode* parse_binary_expression(Parser *parser, int min_precedence) {
      ASTNode *left = parse_unary_expression(parser);
      
-     while (match_token(parser, TOKEN_STAR) || 
-            match_token(parser, TOKEN_SLASH) || 
-            match_token(parser, TOKEN_PERCENT)) {
-         ASTNode *mul_expr = create_ast_node(AST_BINARY_EXPR);
-         if (!mul_expr) {
-             free_ast(left);
-             return NULL;
+     for (;;) {
+         TokenType type = parser->current_token.type;
+         const BinaryOperator *op = &binary_operators[type];
+         if (op->precedence == 0 || op->precedence < min_precedence) {
+             break;
          }
          
-         if (match_token(parser, TOKEN_STAR)) {
-             mul_expr->data.binary_expr.op = OP_MULTIPLY;
-             expect_token(parser, TOKEN_STAR);
-         } else if (match_token(parser, TOKEN_SLASH)) {
-             mul_expr->data.binary_expr.op = OP_DIVIDE;
-             expect_token(parser, TOKEN_SLASH);
-         } else {
-             mul_expr->data.binary_expr.op = OP_MODULO;
-             expect_token(parser, TOKEN_PERCENT);
-         }
+         ASTNode *binary = new_node_from(parser, AST_BINARY_EXPR, left);
+         if (!binary) return NULL;
+         
+         binary->data.binary_expr.op = op->op;
+         binary->data.binary_expr.left = left;
          
-         mul_expr->data.binary_expr.left = left;
+         expect_token(parser, type);
          
-         ASTNode *right = parse_unary_expression(parser);
+         ASTNode *right = parse_binary_expression(parser, op->precedence + 1);
          if (right) {
-             mul_expr->data.binary_expr.right = right;
+             binary->data.binary_expr.right = right;
          }
          
-         left = mul_expr;
+         left = end_node(parser, binary);
      }
      
      return left;
@@ -747,7 +789,7 @@
      if (match_token(parser, TOKEN_MINUS) || 
          match_token(parser, TOKEN_NOT) ||
          match_token(parser, TOKEN_BITNOT)) {
-         ASTNode *unary = create_ast_node(AST_UNARY_EXPR);
+         ASTNode *unary = new_node(parser, AST_UNARY_EXPR);
          if (!unary) return NULL;
          
          if (match_token(parser, TOKEN_MINUS)) {
@@ -766,7 +808,7 @@
              unary->data.unary_expr.operand = operand;
          }
          
-         return unary;
+         return end_node(parser, unary);
      }
      
      return parse_postfix_expression(parser);
@@ -779,11 +821,8 @@
      for (;;) {
          // Array subscript
          if (match_token(parser, TOKEN_LBRACKET)) {
-             ASTNode *subscript = create_ast_node(AST_SUBSCRIPT_EXPR);
-             if (!subscript) {
-                 free_ast(expr);
-                 return NULL;
-             }
+             ASTNode *subscript = new_node_from(parser, AST_SUBSCRIPT_EXPR, expr);
+             if (!subscript) return NULL;
              
              subscript->data.subscript_expr.array = expr;
              
@@ -796,15 +835,12 @@
              
              expect_token(parser, TOKEN_RBRACKET);
              
-             expr = subscript;
+             expr = end_node(parser, subscript);
          }
          // Function call
          else if (match_token(parser, TOKEN_LPAREN)) {
-             ASTNode *call = create_ast_node(AST_CALL_EXPR);
-             if (!call) {
-                 free_ast(expr);
-                 return NULL;
-             }
+             ASTNode *call = new_node_from(parser, AST_CALL_EXPR, expr);
+             if (!call) return NULL;
              
              call->data.call_expr.function = expr;
              
@@ -812,16 +848,13 @@
              
              // Parse arguments if present
              if (!match_token(parser, TOKEN_RPAREN)) {
-                 ASTNode *args = create_ast_node(AST_ARG_LIST);
-                 if (!args) {
-                     free_ast(call);
-                     return NULL;
-                 }
+                 ASTNode *args = new_node(parser, AST_ARG_LIST);
+                 if (!args) return NULL;
                  
                  // First argument
                  ASTNode *arg = parse_expression(parser);
                  if (arg) {
-                     add_child(args, arg);
+                     add_child(parser->arena, args, arg);
                  }
                  
                  // Additional arguments
@@ -830,24 +863,21 @@
                      
                      arg = parse_expression(parser);
                      if (arg) {
-                         add_child(args, arg);
+                         add_child(parser->arena, args, arg);
                      }
                  }
                  
-                 call->data.call_expr.arguments = args;
+                 call->data.call_expr.arguments = end_node(parser, args);
              }
              
              expect_token(parser, TOKEN_RPAREN);
              
-             expr = call;
+             expr = end_node(parser, call);
          }
          // Postfix increment/decrement
          else if (match_token(parser, TOKEN_INC) || match_token(parser, TOKEN_DEC)) {
-             ASTNode *postfix = create_ast_node(AST_UNARY_EXPR);
-             if (!postfix) {
-                 free_ast(expr);
-                 return NULL;
-             }
+             ASTNode *postfix = new_node_from(parser, AST_UNARY_EXPR, expr);
+             if (!postfix) return NULL;
              
              if (match_token(parser, TOKEN_INC)) {
                  postfix->data.unary_expr.op = OP_POST_INC;
@@ -859,7 +889,7 @@
              
              postfix->data.unary_expr.operand = expr;
              
-             expr = postfix;
+             expr = end_node(parser, postfix);
          }
          else {
              break;
@@ -873,46 +903,46 @@
  ASTNode* parse_primary_expression(Parser *parser) {
      // Identifier
      if (match_token(parser, TOKEN_IDENTIFIER)) {
-         ASTNode *identifier = create_ast_node(AST_IDENTIFIER);
+         ASTNode *identifier = new_node(parser, AST_IDENTIFIER);
          if (!identifier) return NULL;
          
-         identifier->data.identifier.name = strdup(parser->current_token.value);
+         identifier->data.identifier.name = token_intern(parser->lexer, parser->current_token);
          expect_token(parser, TOKEN_IDENTIFIER);
          
-         return identifier;
+         return end_node(parser, identifier);
      }
      
      // Integer literal
      if (match_token(parser, TOKEN_INTEGER)) {
-         ASTNode *integer = create_ast_node(AST_INTEGER);
+         ASTNode *integer = new_node(parser, AST_INTEGER);
          if (!integer) return NULL;
          
-         integer->data.integer.value = atoi(parser->current_token.value);
+         integer->data.integer.value = token_int_value(parser->lexer, parser->current_token);
          expect_token(parser, TOKEN_INTEGER);
          
-         return integer;
+         return end_node(parser, integer);
      }
      
      // Character literal
      if (match_token(parser, TOKEN_CHARACTER)) {
-         ASTNode *character = create_ast_node(AST_CHARACTER);
+         ASTNode *character = new_node(parser, AST_CHARACTER);
          if (!character) return NULL;
          
-         character->data.character.value = parser->current_token.value[0];
+         character->data.character.value = token_char_value(parser->lexer, parser->current_token);
          expect_token(parser, TOKEN_CHARACTER);
          
-         return character;
+         return end_node(parser, character);
      }
      
      // String literal
      if (match_token(parser, TOKEN_STRING)) {
-         ASTNode *string = create_ast_node(AST_STRING);
+         ASTNode *string = new_node(parser, AST_STRING);
          if (!string) return NULL;
          
-         string->data.string.value = strdup(parser->current_token.value);
+         string->data.string.value = token_intern(parser->lexer, parser->current_token);
          expect_token(parser, TOKEN_STRING);
          
-         return string;
+         return end_node(parser, string);
      }
      
      // Parenthesized expression
@@ -926,7 +956,7 @@
          return expr;
      }
      
-     parser_error(parser, "Expected expression");
+     parser_error(parser, DIAG_EXPECTED_EXPRESSION);
      return NULL;
  }
  
\ No newline at end of file
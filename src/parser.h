@@ -8,18 +8,29 @@
  #include "lexeme.h"
  #include "ast.h"
  
+ // Function body parsed ahead of time by parse_program_parallel
+ typedef struct ParsedBody ParsedBody;
+ 
  // Parser structure
  typedef struct {
      Lexer *lexer;             // Lexer providing tokens
      Token current_token;      // Current token being processed
+     Arena *arena;             // Arena owning the AST being built
+     unsigned last_end;        // End offset of the last token consumed, closes node spans
+     ParsedBody *bodies;       // Pre-parsed function bodies in source order, or NULL
+     size_t num_bodies;
+     size_t next_body;         // First body not yet attached or skipped
+     Arena **body_arenas;      // Per-thread arenas owning the pre-parsed bodies
+     int num_body_arenas;
  } Parser;
  
  // Parser functions
- Parser* init_parser(Lexer *lexer);
+ Parser* init_parser(Lexer *lexer, Arena *arena);
  void free_parser(Parser *parser);
  
  // Parsing functions for different grammar constructs
  ASTNode* parse_program(Parser *parser);
+ ASTNode* parse_program_parallel(Parser *parser, int num_threads);
  ASTNode* parse_function(Parser *parser);
  ASTNode* parse_parameter_list(Parser *parser);
  ASTNode* parse_compound_statement(Parser *parser);
@@ -32,20 +43,17 @@
  ASTNode* parse_return_statement(Parser *parser);
  ASTNode* parse_expression(Parser *parser);
  ASTNode* parse_assignment_expression(Parser *parser);
- ASTNode* parse_logical_or_expression(Parser *parser);
- ASTNode* parse_logical_and_expression(Parser *parser);
- ASTNode* parse_equality_expression(Parser *parser);
- ASTNode* parse_relational_expression(Parser *parser);
- ASTNode* parse_additive_expression(Parser *parser);
- ASTNode* parse_multiplicative_expression(Parser *parser);
+ ASTNode* parse_binary_expression(Parser *parser, int min_precedence);
  ASTNode* parse_unary_expression(Parser *parser);
  ASTNode* parse_postfix_expression(Parser *parser);
  ASTNode* parse_primary_expression(Parser *parser);
  
  // Utility functions
+ void parser_advance(Parser *parser);
+ Token parser_peek(Parser *parser, unsigned k);
  int expect_token(Parser *parser, TokenType type);
  int match_token(Parser *parser, TokenType type);
- void parser_error(Parser *parser, const char *message);
+ void parser_error(Parser *parser, DiagId id, ...);
  
  #endif // PARSER_H
  
\ No newline at end of file
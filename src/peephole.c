@@ -0,0 +1,517 @@
+/**
+ * Peephole Optimizer Implementation
+ *
+ * Each sweep walks the buffer once, marks the instructions it removes and
+ * compacts the buffer at the end; sweeps repeat until nothing changes.
+ * Whether a register is still needed is answered by a short forward scan
+ * along the branches, so rewrites never need a full liveness analysis.
+ * Conditional branches become IT blocks first; cbz/cbnz only take the
+ * ones left, since their reach has to be estimated from the instruction
+ * count (at most 4 bytes each).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "peephole.h"
+
+// Marks an instruction removed by the current sweep
+#define DELETED ARM_NUM_OPS
+
+// Register mask bit
+#define BIT(reg) (1u << (reg))
+
+// Argument registers, read by every call
+#define ARG_REGS 0x000fu
+
+// Registers a call may overwrite
+#define CALL_CLOBBERS (ARG_REGS | BIT(ARM_IP) | BIT(ARM_LR))
+
+// Longest IT block, and longest run of instructions a then-only block takes
+#define MAX_IT_SLOTS 4
+#define MAX_THEN_SLOTS 3
+
+// Instructions a cbz/cbnz may skip: 4 bytes each stay within its 126 bytes
+#define MAX_CBZ_SKIP 30
+
+// Instructions looked at before a register or the flags are assumed live
+#define SCAN_STEPS 64
+
+// State of the optimization of one function
+typedef struct {
+    ArmFunction *function;
+    int *label_at;       // Index of each label, -1 if not in the buffer
+    int *references;     // Branches targeting each label
+    int *visited;        // Scan stamp of each instruction
+    int stamp;
+} Peephole;
+
+// Registers an instruction reads
+static unsigned insn_reads(const ArmInsn *insn);
+
+// Registers an instruction writes when it executes
+static unsigned insn_writes(const ArmInsn *insn) {
+    switch (insn->op) {
+        case ARM_LABEL:
+        case ARM_CMP:
+        case ARM_STR:
+        case ARM_STRB:
+        case ARM_PUSH:
+        case ARM_B:
+        case ARM_IT:
+        case ARM_CBZ:
+        case ARM_CBNZ:
+        case DELETED:
+            return 0;
+        case ARM_POP:
+            return (unsigned)insn->imm & ~BIT(ARM_PC);
+        case ARM_BL:
+            return CALL_CLOBBERS;
+        default:
+            return BIT(insn->rd);
+    }
+}
+
+static unsigned insn_reads(const ArmInsn *insn) {
+    unsigned rm = insn->form == ARM_OPERAND_REG ? BIT(insn->rm) : 0;
+    unsigned bits;
+    switch (insn->op) {
+        case ARM_LABEL:
+        case ARM_B:
+        case ARM_IT:
+        case ARM_MOVW:
+        case ARM_POP:
+        case DELETED:
+            bits = 0;
+            break;
+        case ARM_MOV:
+        case ARM_MVN:
+        case ARM_CLZ:
+            bits = rm;
+            break;
+        case ARM_MOVT:
+            bits = BIT(insn->rd);
+            break;
+        case ARM_STR:
+        case ARM_STRB:
+            bits = BIT(insn->rd) | BIT(insn->rn) | rm;
+            break;
+        case ARM_PUSH:
+            bits = (unsigned)insn->imm;
+            break;
+        case ARM_BL:
+            bits = ARG_REGS;
+            break;
+        case ARM_CBZ:
+        case ARM_CBNZ:
+            bits = BIT(insn->rn);
+            break;
+        default:
+            // Data processing, compares and loads
+            bits = BIT(insn->rn) | rm;
+            break;
+    }
+    // A conditional write may keep the old value
+    if (insn->cond != ARM_AL) bits |= insn_writes(insn);
+    return bits;
+}
+
+// Registers an instruction certainly overwrites
+static unsigned insn_kills(const ArmInsn *insn) {
+    return insn->cond == ARM_AL ? insn_writes(insn) : 0;
+}
+
+// Check whether an instruction depends on the condition flags
+static int reads_flags(const ArmInsn *insn) {
+    return insn->op == ARM_IT || (insn->op != DELETED && insn->op != ARM_LABEL && insn->cond != ARM_AL);
+}
+
+// Check whether an instruction is a branch to a label
+static int is_branch(const ArmInsn *insn) {
+    return insn->op == ARM_B || insn->op == ARM_CBZ || insn->op == ARM_CBNZ;
+}
+
+// Check whether an instruction ends the function
+static int is_return(const ArmInsn *insn) {
+    return insn->op == ARM_POP && (insn->imm & BIT(ARM_PC));
+}
+
+// Check whether an instruction can take a slot of an IT block
+static int is_conditionalizable(const ArmInsn *insn) {
+    if (insn->cond != ARM_AL) return 0;
+    switch (insn->op) {
+        case ARM_ADD: case ARM_SUB: case ARM_RSB: case ARM_MUL:
+        case ARM_AND: case ARM_ORR: case ARM_EOR:
+        case ARM_LSL: case ARM_LSR: case ARM_ASR:
+        case ARM_MOV: case ARM_MVN: case ARM_CLZ: case ARM_MOVW: case ARM_MOVT:
+        case ARM_LDR: case ARM_LDRB: case ARM_STR: case ARM_STRB:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Check whether an instruction computes its destination from its operands only
+static int is_retargetable(const ArmInsn *insn) {
+    if (insn->cond != ARM_AL || insn->op == ARM_MOVW || insn->op == ARM_MOVT) return 0;
+    return is_conditionalizable(insn) && insn->op != ARM_STR && insn->op != ARM_STRB &&
+           insn->rd != ARM_SP && insn->rd != ARM_PC;
+}
+
+// Next instruction still in the buffer, labels included
+static int next_insn(const Peephole *pp, int index) {
+    const ArmFunction *f = pp->function;
+    do index++; while (index < f->num_insns && f->insns[index].op == DELETED);
+    return index;
+}
+
+// Check whether the labels right at index include label
+static int label_run_has(const Peephole *pp, int index, int label) {
+    const ArmFunction *f = pp->function;
+    for (; index < f->num_insns; index = next_insn(pp, index)) {
+        if (f->insns[index].op != ARM_LABEL) return 0;
+        if (f->insns[index].imm == label) return 1;
+    }
+    return 0;
+}
+
+// Remove an instruction, releasing the label it branches to
+static void delete_insn(Peephole *pp, int index) {
+    ArmInsn *insn = &pp->function->insns[index];
+    if (is_branch(insn)) pp->references[insn->imm]--;
+    insn->op = DELETED;
+}
+
+// Check whether reg is overwritten before being read on every path from index
+static int is_dead_from(Peephole *pp, int index, int reg) {
+    const ArmFunction *f = pp->function;
+    int worklist[SCAN_STEPS];
+    int pending = 0;
+    int steps = 0;
+    unsigned bit = BIT(reg);
+
+    pp->stamp++;
+    worklist[pending++] = index;
+    while (pending > 0) {
+        int p = worklist[--pending];
+        for (;;) {
+            if (p < 0 || p >= f->num_insns || ++steps > SCAN_STEPS) return 0;
+            if (pp->visited[p] == pp->stamp) break;  // Already followed from there
+            pp->visited[p] = pp->stamp;
+
+            const ArmInsn *insn = &f->insns[p];
+            if (insn_reads(insn) & bit) return 0;
+            if (is_return(insn)) {
+                if (reg == 0) return 0;  // The return value
+                break;
+            }
+            if (insn_kills(insn) & bit) break;
+            if (is_branch(insn)) {
+                int target = pp->label_at[insn->imm];
+                if (insn->op == ARM_B && insn->cond == ARM_AL) {
+                    p = target;
+                    continue;
+                }
+                if (pending == SCAN_STEPS) return 0;
+                worklist[pending++] = target;
+            }
+            p++;
+        }
+    }
+    return 1;
+}
+
+// Check whether nothing reads the flags before they are set again, from index on
+static int flags_dead_from(const Peephole *pp, int index) {
+    const ArmFunction *f = pp->function;
+    for (int steps = 0; index >= 0 && index < f->num_insns && steps < SCAN_STEPS; steps++) {
+        const ArmInsn *insn = &f->insns[index];
+        if (reads_flags(insn)) return 0;
+        // Calls do not preserve the flags, so nothing after one expects them
+        if (insn->op == ARM_CMP || insn->op == ARM_BL || is_return(insn)) return 1;
+        if (insn->op == ARM_CBZ || insn->op == ARM_CBNZ) return 0;
+        index = insn->op == ARM_B ? pp->label_at[insn->imm] : index + 1;
+    }
+    return 0;
+}
+
+// mov rX, rX
+static int remove_self_move(Peephole *pp, int i) {
+    const ArmInsn *insn = &pp->function->insns[i];
+    if (insn->op != ARM_MOV || insn->form != ARM_OPERAND_REG || insn->cond != ARM_AL || insn->rd != insn->rm) {
+        return 0;
+    }
+    delete_insn(pp, i);
+    return 1;
+}
+
+// str rA, [rB, #o] then ldr rC, [rB, #o], and the other way around
+static int remove_reload(Peephole *pp, int i) {
+    ArmFunction *f = pp->function;
+    int j = next_insn(pp, i);
+    if (j >= f->num_insns) return 0;
+    ArmInsn *first = &f->insns[i];
+    ArmInsn *second = &f->insns[j];
+    if (first->cond != ARM_AL || second->cond != ARM_AL || first->form != ARM_OPERAND_IMM ||
+        second->form != ARM_OPERAND_IMM || first->rn != second->rn || first->imm != second->imm) {
+        return 0;
+    }
+
+    if (first->op == ARM_STR && second->op == ARM_LDR) {
+        // The value is still in the register it was stored from
+        if (second->rd == first->rd) {
+            delete_insn(pp, j);
+        } else {
+            int rd = second->rd;
+            memset(second, 0, sizeof(ArmInsn));
+            second->op = ARM_MOV;
+            second->cond = ARM_AL;
+            second->form = ARM_OPERAND_REG;
+            second->rd = (uint8_t)rd;
+            second->rm = first->rd;
+        }
+        return 1;
+    }
+    if ((first->op == ARM_LDR && second->op == ARM_STR) || (first->op == ARM_LDRB && second->op == ARM_STRB)) {
+        // Storing back what was just loaded, unless the load moved the base
+        if (first->rd != second->rd || first->rd == first->rn) return 0;
+        delete_insn(pp, j);
+        return 1;
+    }
+    if (first->op == second->op && (first->op == ARM_STR || first->op == ARM_STRB) && first->rn != ARM_SP) {
+        // The second store overwrites the first
+        delete_insn(pp, i);
+        return 1;
+    }
+    return 0;
+}
+
+// op rT, ... then mov rD, rT with rT dead: op rD, ...
+static int fold_copy(Peephole *pp, int i) {
+    ArmFunction *f = pp->function;
+    int j = next_insn(pp, i);
+    if (j >= f->num_insns) return 0;
+    ArmInsn *def = &f->insns[i];
+    const ArmInsn *copy = &f->insns[j];
+    if (!is_retargetable(def) || copy->op != ARM_MOV || copy->form != ARM_OPERAND_REG ||
+        copy->cond != ARM_AL || copy->rm != def->rd || copy->rd == def->rd ||
+        copy->rd == ARM_SP || copy->rd == ARM_PC) {
+        return 0;
+    }
+    if (!is_dead_from(pp, j + 1, def->rd)) return 0;
+    def->rd = copy->rd;
+    delete_insn(pp, j);
+    return 1;
+}
+
+// Code after an unconditional branch or a return, up to the next label
+static int remove_unreachable(Peephole *pp, int i) {
+    ArmFunction *f = pp->function;
+    const ArmInsn *insn = &f->insns[i];
+    if (!((insn->op == ARM_B && insn->cond == ARM_AL) || is_return(insn))) return 0;
+
+    int changed = 0;
+    for (int j = next_insn(pp, i); j < f->num_insns && f->insns[j].op != ARM_LABEL; j = next_insn(pp, j)) {
+        delete_insn(pp, j);
+        changed = 1;
+    }
+    return changed;
+}
+
+// Branch to the instruction that follows anyway
+static int remove_branch_to_next(Peephole *pp, int i) {
+    const ArmInsn *insn = &pp->function->insns[i];
+    if (!is_branch(insn) || !label_run_has(pp, next_insn(pp, i), insn->imm)) return 0;
+    delete_insn(pp, i);
+    return 1;
+}
+
+// Length of the run of IT-able instructions from index, up to limit
+static int conditional_run(const Peephole *pp, int index, int limit, int *end) {
+    const ArmFunction *f = pp->function;
+    int count = 0;
+    while (index < f->num_insns && count <= limit && is_conditionalizable(&f->insns[index])) {
+        count++;
+        index = next_insn(pp, index);
+    }
+    *end = index;
+    return count;
+}
+
+// Give the slots of an IT block their condition
+static void set_conditions(Peephole *pp, int index, int count, ArmCond cond) {
+    ArmInsn *insns = pp->function->insns;
+    for (int k = 0; k < count; k++, index = next_insn(pp, index)) insns[index].cond = (uint8_t)cond;
+}
+
+// bCC L1; X; [b L2; L1: Y;] L: as an IT block of X (and Y)
+static int form_it_block(Peephole *pp, int i) {
+    ArmFunction *f = pp->function;
+    ArmInsn *branch = &f->insns[i];
+    if (branch->op != ARM_B || branch->cond == ARM_AL) return 0;
+    int skip = branch->imm;
+    ArmCond taken = (ArmCond)branch->cond;
+    ArmCond fallthrough = (ArmCond)(taken ^ 1);  // Conditions come in inverse pairs
+
+    int first = next_insn(pp, i);
+    int end;
+    int then_count = conditional_run(pp, first, MAX_IT_SLOTS, &end);
+    if (then_count == 0) return 0;
+
+    if (then_count <= MAX_THEN_SLOTS && label_run_has(pp, end, skip)) {
+        // if (...) X;
+        branch->op = ARM_IT;
+        branch->cond = (uint8_t)fallthrough;
+        branch->rn = (uint8_t)then_count;
+        branch->imm = 0;
+        pp->references[skip]--;
+        set_conditions(pp, first, then_count, fallthrough);
+        return 1;
+    }
+
+    // if (...) X; else Y; where nothing else jumps to the else part
+    if (then_count >= MAX_IT_SLOTS || end >= f->num_insns) return 0;
+    ArmInsn *jump = &f->insns[end];
+    if (jump->op != ARM_B || jump->cond != ARM_AL) return 0;
+    int join = jump->imm;
+    int else_label = next_insn(pp, end);
+    if (else_label >= f->num_insns || f->insns[else_label].op != ARM_LABEL ||
+        f->insns[else_label].imm != skip || pp->references[skip] != 1) {
+        return 0;
+    }
+    int else_first = next_insn(pp, else_label);
+    int else_end;
+    int else_count = conditional_run(pp, else_first, MAX_IT_SLOTS - then_count, &else_end);
+    if (else_count == 0 || then_count + else_count > MAX_IT_SLOTS || !label_run_has(pp, else_end, join)) {
+        return 0;
+    }
+
+    branch->op = ARM_IT;
+    branch->cond = (uint8_t)fallthrough;
+    branch->rn = (uint8_t)(then_count + else_count);
+    branch->imm = 0;
+    for (int k = then_count; k < then_count + else_count; k++) branch->imm |= 1 << k;
+    pp->references[skip]--;
+    set_conditions(pp, first, then_count, fallthrough);
+    set_conditions(pp, else_first, else_count, taken);
+    delete_insn(pp, end);
+    f->insns[else_label].op = DELETED;
+    return 1;
+}
+
+// cmp rN, #0; beq/bne L: cbz/cbnz rN, L for a near forward L
+static int form_cbz(Peephole *pp, int i) {
+    ArmFunction *f = pp->function;
+    ArmInsn *compare = &f->insns[i];
+    if (compare->op != ARM_CMP || compare->form != ARM_OPERAND_IMM || compare->imm != 0 ||
+        compare->cond != ARM_AL || compare->rn > 7) {
+        return 0;
+    }
+    int j = next_insn(pp, i);
+    if (j >= f->num_insns) return 0;
+    const ArmInsn *branch = &f->insns[j];
+    if (branch->op != ARM_B || (branch->cond != ARM_EQ && branch->cond != ARM_NE)) return 0;
+
+    int target = pp->label_at[branch->imm];
+    if (target <= j) return 0;  // cbz only branches forward
+    int skipped = 0;
+    for (int k = next_insn(pp, j); k < target; k = next_insn(pp, k)) {
+        if (f->insns[k].op != ARM_LABEL) skipped++;
+    }
+    if (skipped == 0 || skipped > MAX_CBZ_SKIP) return 0;
+    if (!flags_dead_from(pp, j + 1) || !flags_dead_from(pp, target)) return 0;
+
+    compare->op = branch->cond == ARM_EQ ? ARM_CBZ : ARM_CBNZ;
+    compare->imm = branch->imm;
+    compare->form = ARM_OPERAND_IMM;
+    f->insns[j].op = DELETED;  // Its label reference moves to the cbz
+    return 1;
+}
+
+// Remove the deleted instructions and the labels no branch uses
+static void compact(Peephole *pp) {
+    ArmFunction *f = pp->function;
+    int kept = 0;
+    for (int i = 0; i < f->num_insns; i++) {
+        const ArmInsn *insn = &f->insns[i];
+        if (insn->op == DELETED) continue;
+        if (insn->op == ARM_LABEL && pp->references[insn->imm] == 0) continue;
+        f->insns[kept++] = *insn;
+    }
+    f->num_insns = kept;
+}
+
+// Find the labels and count their branches
+static void index_labels(Peephole *pp) {
+    ArmFunction *f = pp->function;
+    for (int l = 0; l < f->num_labels; l++) {
+        pp->label_at[l] = -1;
+        pp->references[l] = 0;
+    }
+    for (int i = 0; i < f->num_insns; i++) {
+        const ArmInsn *insn = &f->insns[i];
+        if (insn->op == ARM_LABEL) pp->label_at[insn->imm] = i;
+        else if (is_branch(insn)) pp->references[insn->imm]++;
+    }
+}
+
+// Rule sets, applied in order so that branches are rewritten around clean code
+typedef enum {
+    PHASE_CLEANUP,
+    PHASE_IT,
+    PHASE_CBZ
+} Phase;
+
+// One pass of a rule set, returns whether anything changed
+static int sweep(Peephole *pp, Phase phase) {
+    ArmFunction *f = pp->function;
+    int changed = 0;
+    index_labels(pp);
+    for (int i = 0; i < f->num_insns; i++) {
+        if (f->insns[i].op == DELETED) continue;
+        switch (phase) {
+            case PHASE_CLEANUP:
+                if (remove_self_move(pp, i) || remove_reload(pp, i) || fold_copy(pp, i) ||
+                    remove_unreachable(pp, i) || remove_branch_to_next(pp, i)) {
+                    changed = 1;
+                }
+                break;
+            case PHASE_IT:
+                changed |= form_it_block(pp, i);
+                break;
+            case PHASE_CBZ:
+                changed |= form_cbz(pp, i);
+                break;
+        }
+    }
+    compact(pp);
+    return changed;
+}
+
+// Optimize the code of a function
+void peephole_function(ArmFunction *function) {
+    if (function->failed || function->num_insns == 0) return;
+
+    Peephole pp;
+    pp.function = function;
+    pp.stamp = 0;
+    int labels = function->num_labels > 0 ? function->num_labels : 1;
+    pp.label_at = (int*)malloc(labels * sizeof(int));
+    pp.references = (int*)malloc(labels * sizeof(int));
+    pp.visited = (int*)calloc(function->num_insns, sizeof(int));
+    if (pp.label_at && pp.references && pp.visited) {
+        while (sweep(&pp, PHASE_CLEANUP)) {}
+        if (sweep(&pp, PHASE_IT)) {
+            while (sweep(&pp, PHASE_CLEANUP)) {}
+        }
+        sweep(&pp, PHASE_CBZ);
+    }
+    free(pp.label_at);
+    free(pp.references);
+    free(pp.visited);
+}
+
+// Optimize every function of a module
+void peephole_module(ArmModule *module) {
+    for (int i = 0; i < module->num_functions; i++) peephole_function(&module->functions[i]);
+}
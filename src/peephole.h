@@ -0,0 +1,20 @@
+/**
+ * Peephole Optimizer Header
+ *
+ * Local clean-up of the ARM instruction buffers (arm.h) between code
+ * generation and output: useless moves, loads and branches go away, and
+ * short conditional branches become IT blocks or cbz/cbnz.
+ */
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "arm.h"
+
+// Optimize the code of a function in place
+void peephole_function(ArmFunction *function);
+
+// Optimize every function of a module
+void peephole_module(ArmModule *module);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,156 @@
+/**
+ * Thread Pool Implementation
+ *
+ * Workers are started per batch and joined at its end; the batches the
+ * compiler runs are large enough for the start-up cost not to matter.
+ * Every worker owns a range of job indices guarded by its own lock: the
+ * owner takes jobs from the front, thieves cut off the back half.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+// Jobs [head, tail) still owned by one worker
+typedef struct {
+    size_t head;
+    size_t tail;
+    pthread_mutex_t lock;
+} PoolQueue;
+
+// State shared by the workers of one batch
+typedef struct {
+    PoolJobFn fn;
+    void *context;
+    PoolQueue *queues;      // One per worker
+    int num_workers;
+} PoolBatch;
+
+// Worker arguments
+typedef struct {
+    PoolBatch *batch;
+    int worker;
+} PoolWorker;
+
+// Take the front job of a worker's own range
+static int take_job(PoolQueue *queue, size_t *job) {
+    pthread_mutex_lock(&queue->lock);
+    int found = queue->head < queue->tail;
+    if (found) *job = queue->head++;
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Move the back half of the largest other range into the thief's own range
+static int steal_jobs(PoolBatch *batch, int thief) {
+    for (;;) {
+        // Pick the fullest range, it may shrink before the cut below
+        int victim = -1;
+        size_t best = 0;
+        for (int i = 0; i < batch->num_workers; i++) {
+            PoolQueue *queue = &batch->queues[i];
+            pthread_mutex_lock(&queue->lock);
+            size_t left = queue->tail - queue->head;
+            pthread_mutex_unlock(&queue->lock);
+            if (i != thief && left > best) {
+                best = left;
+                victim = i;
+            }
+        }
+        if (victim < 0) return 0;
+        
+        PoolQueue *queue = &batch->queues[victim];
+        pthread_mutex_lock(&queue->lock);
+        size_t left = queue->tail - queue->head;
+        size_t count = (left + 1) / 2;
+        size_t start = queue->tail - count;
+        queue->tail = start;
+        pthread_mutex_unlock(&queue->lock);
+        if (count == 0) continue;  // Emptied meanwhile, look again
+        
+        PoolQueue *own = &batch->queues[thief];
+        pthread_mutex_lock(&own->lock);
+        own->head = start;
+        own->tail = start + count;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+}
+
+// Thread body: run own jobs, then stolen ones, until none are left
+static void* pool_worker(void *arg) {
+    PoolWorker *worker = (PoolWorker*)arg;
+    PoolBatch *batch = worker->batch;
+    PoolQueue *own = &batch->queues[worker->worker];
+    
+    for (;;) {
+        size_t job;
+        while (take_job(own, &job)) {
+            batch->fn(batch->context, job, worker->worker);
+        }
+        if (!steal_jobs(batch, worker->worker)) break;
+    }
+    return NULL;
+}
+
+// Run a batch of jobs and wait for all of them
+int pool_run(int num_threads, size_t num_jobs, PoolJobFn fn, void *context) {
+    if (num_threads < 1) num_threads = 1;
+    if ((size_t)num_threads > num_jobs) num_threads = num_jobs > 0 ? (int)num_jobs : 1;
+    
+    PoolQueue *queues = (PoolQueue*)malloc(num_threads * sizeof(PoolQueue));
+    PoolWorker *workers = (PoolWorker*)malloc(num_threads * sizeof(PoolWorker));
+    pthread_t *threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    if (!queues || !workers || !threads) {
+        // No memory for the pool: run everything on the caller
+        free(queues);
+        free(workers);
+        free(threads);
+        for (size_t job = 0; job < num_jobs; job++) fn(context, job, 0);
+        return 1;
+    }
+    
+    PoolBatch batch;
+    batch.fn = fn;
+    batch.context = context;
+    batch.queues = queues;
+    batch.num_workers = num_threads;
+    
+    // Contiguous initial ranges keep neighbouring jobs on one thread
+    for (int i = 0; i < num_threads; i++) {
+        queues[i].head = num_jobs * (size_t)i / (size_t)num_threads;
+        queues[i].tail = num_jobs * (size_t)(i + 1) / (size_t)num_threads;
+        pthread_mutex_init(&queues[i].lock, NULL);
+        workers[i].batch = &batch;
+        workers[i].worker = i;
+    }
+    
+    // Worker 0 is the calling thread
+    int started = 0;
+    for (int i = 1; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, pool_worker, &workers[i]) != 0) break;
+        started++;
+    }
+    pool_worker(&workers[0]);
+    
+    for (int i = 1; i <= started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    for (int i = 0; i < num_threads; i++) {
+        pthread_mutex_destroy(&queues[i].lock);
+    }
+    free(queues);
+    free(workers);
+    free(threads);
+    return started + 1;
+}
+
+// Number of online processors, at least 1
+int pool_cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
@@ -0,0 +1,26 @@
+/**
+ * Thread Pool Header
+ *
+ * Runs a batch of independent jobs on a fixed number of threads. Each
+ * worker starts with a contiguous range of job indices and runs it front
+ * to back; a worker that runs dry steals the back half of the largest
+ * range left, so long and short jobs balance themselves across workers.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// Job body: job is the job index, worker the index of the thread running it
+typedef void (*PoolJobFn)(void *context, size_t job, int worker);
+
+// Run num_jobs jobs on up to num_threads threads (the caller being worker 0)
+// and return once all are done, with the number of threads used. Jobs of
+// workers that cannot be started are stolen by the others.
+int pool_run(int num_threads, size_t num_jobs, PoolJobFn fn, void *context);
+
+// Number of online processors, at least 1
+int pool_cpu_count(void);
+
+#endif // POOL_H
@@ -0,0 +1,1111 @@
+/**
+ * Preprocessor Implementation
+ *
+ * Tokens are read through a stack of contexts: files (the main buffer and
+ * included headers), macro expansions, and the line of a condition being
+ * evaluated. A directive is a '#' starting a line, found from the gap the
+ * lexer leaves before it. Included headers are mapped into the unit's
+ * offset space with lexer_add_source, so their tokens keep pointing into
+ * the cached text and diagnostics name the header.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "preproc.h"
+#include "intern.h"
+#include "arena.h"
+#include "error.h"
+#include "stats.h"
+
+// Directory of the headers shipped with the compiler
+#ifndef CCOMP_INCLUDE_DIR
+#define CCOMP_INCLUDE_DIR "include"
+#endif
+
+#define CACHE_BUCKETS 256
+
+// Parameters of one function-like macro
+#define MAX_MACRO_PARAMS 64
+
+// One header of the cache, immutable once published except for its stat data
+typedef struct HeaderEntry {
+    const char *path;          // Canonical path (interned)
+    char *filename;            // Path it was first found as, for diagnostics
+    char *text;                // '\0'-terminated source text
+    unsigned size;
+    unsigned *line_starts;
+    size_t num_lines;
+    Token *tokens;             // Offsets local to text, the last token is EOF
+    size_t num_tokens;
+    DiagEngine *diag;          // Lexical errors, replayed into every unit including it
+    unsigned long long hash;   // FNV-1a of text
+    time_t mtime;              // Stat data the entry was last validated against
+    off_t file_size;
+    const char *guard;         // Include guard macro (interned), NULL if none
+    int pragma_once;
+    struct HeaderEntry *next;  // Next entry of the bucket (or of the retired list)
+} HeaderEntry;
+
+// Header cache shared by every compilation of the process
+static HeaderEntry *cache_buckets[CACHE_BUCKETS];
+static HeaderEntry *retired_headers;  // Replaced entries, still referenced by running units
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Macro definition
+typedef struct {
+    const char *name;          // Interned
+    unsigned length;
+    unsigned long long hash;
+    Token *body;               // Replacement list, unit offsets
+    int num_body;
+    Token *params;             // Parameter names of a function-like macro
+    int num_params;
+    int function_like;
+    int defined;               // 0 once #undef'd, the slot is kept
+    int active;                // Being expanded, so not expanded again
+} Macro;
+
+// Token source of the context stack
+typedef struct {
+    const Token *tokens;
+    size_t pos;
+    size_t count;
+    unsigned base;             // Added to the offsets of file tokens
+    const char *text;          // Text the offsets of file tokens index
+    const char *filename;      // File of the context, NULL otherwise
+    Macro *macro;              // Macro being expanded, NULL otherwise
+    int cond_floor;            // Conditionals open when the file was entered
+} PPContext;
+
+// Open #if group
+typedef struct {
+    int active;                // Tokens of the current branch are kept
+    int taken;                 // A branch was taken already, or the whole group is skipped
+    unsigned offset;           // Offset of the opening directive
+} Conditional;
+
+// Header mapped into the unit
+typedef struct {
+    const HeaderEntry *header;
+    unsigned base;
+} IncludedHeader;
+
+// Growable token array
+typedef struct {
+    Token *items;
+    size_t count;
+    size_t capacity;
+} TokenVec;
+
+// Preprocessing state of one unit
+typedef struct {
+    Lexer *lexer;
+    const PreprocOptions *options;
+    PPContext *contexts;
+    int num_contexts;
+    int contexts_capacity;
+    Conditional *conds;
+    int num_conds;
+    int conds_capacity;
+    Macro **macros;            // Open addressing by name hash
+    size_t macros_capacity;
+    size_t num_macros;
+    IncludedHeader *included;
+    int num_included;
+    int included_capacity;
+    TokenVec out;              // Preprocessed stream
+    TokenVec *target;          // Where expanded tokens go: out, or a condition being evaluated
+    TokenVec line;             // Tokens of the directive being run
+    Arena *arena;              // Macro definitions and expansions
+    unsigned synthetic_base;   // Base of the "0 1" text standing for defined(), 0 until needed
+    int include_depth;
+    int failed;                // Out of memory
+} Preprocessor;
+
+// Numbers produced by defined()
+static const char synthetic_text[] = "0 1";
+static const unsigned synthetic_lines[] = { 0 };
+
+static void run_contexts(Preprocessor *pp, int floor);
+
+// FNV-1a hash of a text slice
+static unsigned long long hash_text(const char *text, size_t length) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Append a token, growing the array as needed
+static int vec_push(TokenVec *vec, Token token) {
+    if (vec->count == vec->capacity) {
+        size_t capacity = vec->capacity ? vec->capacity * 2 : 64;
+        Token *items = (Token*)realloc(vec->items, capacity * sizeof(Token));
+        if (!items) return 0;
+        vec->items = items;
+        vec->capacity = capacity;
+    }
+    vec->items[vec->count++] = token;
+    return 1;
+}
+
+// Check whether token i of an array starts a line
+static int starts_line(const char *text, const Token *tokens, size_t i) {
+    if (i == 0) return 1;
+    const char *gap = text + tokens[i - 1].offset + tokens[i - 1].length;
+    return memchr(gap, '\n', text + tokens[i].offset - gap) != NULL;
+}
+
+// Compare the text of a token with a word
+static int text_is(const char *text, Token token, const char *word) {
+    size_t length = strlen(word);
+    return token.length == length && memcmp(text + token.offset, word, length) == 0;
+}
+
+// Compare the text of a unit token with a word
+static int token_is(const Lexer *lexer, Token token, const char *word) {
+    size_t length = strlen(word);
+    return token.length == length && memcmp(token_text(lexer, token), word, length) == 0;
+}
+
+// -- Header cache --
+
+// Check whether header token i is a '#' followed by word on the same line
+static int header_directive_is(const HeaderEntry *header, size_t i, const char *word) {
+    const Token *tokens = header->tokens;
+    size_t count = header->num_tokens - 1;
+    return i + 1 < count && tokens[i].type == TOKEN_POUND && starts_line(header->text, tokens, i)
+        && !starts_line(header->text, tokens, i + 1) && text_is(header->text, tokens[i + 1], word);
+}
+
+// Find "#ifndef X / #define X ... #endif" wrapping the whole header
+static void detect_guard(HeaderEntry *header) {
+    const Token *tokens = header->tokens;
+    const char *text = header->text;
+    size_t count = header->num_tokens - 1;
+    if (count < 8) return;
+
+    if (!header_directive_is(header, 0, "ifndef") || !header_directive_is(header, 3, "define")) return;
+    if (tokens[2].type != TOKEN_IDENTIFIER || starts_line(text, tokens, 2)) return;
+    if (tokens[5].type != TOKEN_IDENTIFIER || starts_line(text, tokens, 5)) return;
+    if (tokens[2].length != tokens[5].length
+        || memcmp(text + tokens[2].offset, text + tokens[5].offset, tokens[2].length) != 0) return;
+    if (!header_directive_is(header, count - 2, "endif")) return;
+
+    // The #ifndef group must close on the last line, with no #else branch of its own
+    int depth = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (header_directive_is(header, i, "if") || header_directive_is(header, i, "ifdef")
+            || header_directive_is(header, i, "ifndef")) {
+            depth++;
+        } else if (header_directive_is(header, i, "endif")) {
+            depth--;
+            if (depth == 0 && i != count - 2) return;
+        } else if (depth == 1 && (header_directive_is(header, i, "else")
+                                  || header_directive_is(header, i, "elif"))) {
+            return;
+        }
+    }
+
+    header->guard = intern_string(text + tokens[2].offset, tokens[2].length);
+}
+
+// Find a "#pragma once" line anywhere in the header
+static void detect_pragma_once(HeaderEntry *header) {
+    size_t count = header->num_tokens - 1;
+    for (size_t i = 0; i + 2 < count; i++) {
+        if (header_directive_is(header, i, "pragma")
+            && !starts_line(header->text, header->tokens, i + 2)
+            && text_is(header->text, header->tokens[i + 2], "once")) {
+            header->pragma_once = 1;
+            return;
+        }
+    }
+}
+
+// Free a header entry
+static void free_header(HeaderEntry *header) {
+    free(header->filename);
+    free(header->text);
+    free(header->line_starts);
+    free(header->tokens);
+    diag_destroy(header->diag);
+    free(header);
+}
+
+// Read and lex a header into *slot, reusing the current entry if its text did not change
+static HeaderEntry* load_header(HeaderEntry **slot, const char *path, const char *filename,
+                                const struct stat *info) {
+    FILE *file = fopen(path, "r");
+    if (!file) return NULL;
+
+    DiagEngine *diag = diag_create(NULL);
+    Lexer *lexer = diag ? init_lexer(file, (char*)filename, diag) : NULL;
+    HeaderEntry *entry = NULL;
+    if (!lexer) goto done;
+
+    // Touched but unchanged: the lexed tokens are still valid
+    unsigned long long hash = hash_text(lexer->buffer, (size_t)lexer->buffer_size);
+    HeaderEntry *old = *slot;
+    if (old && old->hash == hash && old->size == (unsigned)lexer->buffer_size) {
+        old->mtime = info->st_mtime;
+        old->file_size = info->st_size;
+        entry = old;
+        goto done;
+    }
+
+    diag_set_max_errors(diag, 0);
+    if (!lexer_lex_all(lexer, 1) || !lexer_index_lines(lexer)) goto done;
+    entry = (HeaderEntry*)calloc(1, sizeof(HeaderEntry));
+    if (!entry || !(entry->filename = strdup(filename))) {
+        free(entry);
+        entry = NULL;
+        goto done;
+    }
+
+    // Take the text, tokens and line table over from the lexer
+    entry->path = path;
+    entry->text = lexer->buffer;
+    entry->size = (unsigned)lexer->buffer_size;
+    entry->line_starts = lexer->line_starts;
+    entry->num_lines = lexer->num_lines;
+    entry->tokens = lexer->tokens;
+    entry->num_tokens = lexer->num_tokens_total;
+    entry->diag = diag;
+    entry->hash = hash;
+    entry->mtime = info->st_mtime;
+    entry->file_size = info->st_size;
+    lexer->buffer = NULL;
+    lexer->line_starts = NULL;
+    lexer->tokens = NULL;
+    diag = NULL;
+    detect_guard(entry);
+    detect_pragma_once(entry);
+
+    // Units still preprocessing may use the previous version
+    if (old) {
+        entry->next = old->next;
+        old->next = retired_headers;
+        retired_headers = old;
+    }
+    *slot = entry;
+
+done:
+    free_lexer(lexer);
+    diag_destroy(diag);
+    fclose(file);
+    return entry;
+}
+
+// Get the cached header at a canonical path, (re)loading it if it changed on disk
+static const HeaderEntry* cache_get(const char *canonical, const char *filename) {
+    struct stat info;
+    if (stat(canonical, &info) != 0) return NULL;
+
+    const char *path = intern_cstr(canonical);
+    if (!path) return NULL;
+    size_t bucket = ((uintptr_t)path >> 4) % CACHE_BUCKETS;
+
+    pthread_mutex_lock(&cache_lock);
+    HeaderEntry **slot = &cache_buckets[bucket];
+    while (*slot && (*slot)->path != path) slot = &(*slot)->next;
+
+    HeaderEntry *entry = *slot;
+    if (!entry || entry->mtime != info.st_mtime || entry->file_size != info.st_size) {
+        entry = load_header(slot, path, filename, &info);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return entry;
+}
+
+// Release the header cache (no preprocessing may be running)
+void free_include_cache(void) {
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        while (cache_buckets[i]) {
+            HeaderEntry *next = cache_buckets[i]->next;
+            free_header(cache_buckets[i]);
+            cache_buckets[i] = next;
+        }
+    }
+    while (retired_headers) {
+        HeaderEntry *next = retired_headers->next;
+        free_header(retired_headers);
+        retired_headers = next;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// -- Context stack --
+
+// Token i of a context, in unit offsets
+static Token context_token(const PPContext *ctx, size_t i) {
+    Token token = ctx->tokens[i];
+    token.offset += ctx->base;
+    return token;
+}
+
+// Push a token source
+static int push_context(Preprocessor *pp, const Token *tokens, size_t count, unsigned base,
+                        const char *text, const char *filename, Macro *macro) {
+    if (pp->num_contexts == pp->contexts_capacity) {
+        int capacity = pp->contexts_capacity ? pp->contexts_capacity * 2 : 16;
+        PPContext *contexts = (PPContext*)realloc(pp->contexts, capacity * sizeof(PPContext));
+        if (!contexts) {
+            pp->failed = 1;
+            return 0;
+        }
+        pp->contexts = contexts;
+        pp->contexts_capacity = capacity;
+    }
+
+    PPContext *ctx = &pp->contexts[pp->num_contexts++];
+    ctx->tokens = tokens;
+    ctx->pos = 0;
+    ctx->count = count;
+    ctx->base = base;
+    ctx->text = text;
+    ctx->filename = filename;
+    ctx->macro = macro;
+    ctx->cond_floor = pp->num_conds;
+    if (macro) macro->active = 1;
+    if (filename) pp->include_depth++;
+    return 1;
+}
+
+// Pop the top context, closing what it opened
+static void pop_context(Preprocessor *pp) {
+    PPContext *ctx = &pp->contexts[--pp->num_contexts];
+    if (ctx->macro) ctx->macro->active = 0;
+    if (ctx->filename) {
+        if (pp->num_conds > ctx->cond_floor) {
+            lexer_error_at(pp->lexer, pp->conds[pp->num_conds - 1].offset, DIAG_UNTERMINATED_CONDITIONAL);
+            pp->num_conds = ctx->cond_floor;
+        }
+        pp->include_depth--;
+    }
+}
+
+// Take the next token for a macro call, never running past a file, a condition line or a directive
+static int take_token(Preprocessor *pp, Token *token) {
+    for (;;) {
+        PPContext *ctx = &pp->contexts[pp->num_contexts - 1];
+        if (ctx->filename && ctx->pos < ctx->count && ctx->tokens[ctx->pos].type == TOKEN_POUND
+            && starts_line(ctx->text, ctx->tokens, ctx->pos)) {
+            return 0;
+        }
+        if (ctx->pos < ctx->count) {
+            *token = context_token(ctx, ctx->pos++);
+            return 1;
+        }
+        if (!ctx->macro) return 0;
+        pop_context(pp);
+    }
+}
+
+// Check whether the next token for a macro call is '('
+static int next_is_lparen(const Preprocessor *pp) {
+    for (int i = pp->num_contexts - 1; i >= 0; i--) {
+        const PPContext *ctx = &pp->contexts[i];
+        if (ctx->pos < ctx->count) return ctx->tokens[ctx->pos].type == TOKEN_LPAREN;
+        if (!ctx->macro) return 0;
+    }
+    return 0;
+}
+
+// Send a token to the current target
+static void emit(Preprocessor *pp, Token token) {
+    if (!vec_push(pp->target, token)) pp->failed = 1;
+}
+
+// Macro-expand a token list into dst
+static void expand_into(Preprocessor *pp, const Token *tokens, size_t count, TokenVec *dst) {
+    int floor = pp->num_contexts;
+    if (!push_context(pp, tokens, count, 0, NULL, NULL, NULL)) return;
+
+    TokenVec *target = pp->target;
+    pp->target = dst;
+    run_contexts(pp, floor);
+    pp->target = target;
+}
+
+// -- Macros --
+
+// Find the slot of a macro name, defined or #undef'd
+static Macro* find_slot(const Preprocessor *pp, const char *name, size_t length) {
+    if (pp->num_macros == 0) return NULL;
+
+    unsigned long long hash = hash_text(name, length);
+    size_t mask = pp->macros_capacity - 1;
+    for (size_t slot = (size_t)hash & mask; pp->macros[slot]; slot = (slot + 1) & mask) {
+        Macro *macro = pp->macros[slot];
+        if (macro->hash == hash && macro->length == length && memcmp(macro->name, name, length) == 0) {
+            return macro;
+        }
+    }
+    return NULL;
+}
+
+// Find a defined macro by name
+static Macro* lookup_macro(const Preprocessor *pp, const char *name, size_t length) {
+    Macro *macro = find_slot(pp, name, length);
+    return macro && macro->defined ? macro : NULL;
+}
+
+// Find the macro an identifier token names
+static Macro* find_macro(const Preprocessor *pp, Token token) {
+    return lookup_macro(pp, token_text(pp->lexer, token), token.length);
+}
+
+// Insert a macro slot, the table being at most half full
+static int insert_macro(Preprocessor *pp, Macro *macro) {
+    if ((pp->num_macros + 1) * 2 > pp->macros_capacity) {
+        size_t capacity = pp->macros_capacity ? pp->macros_capacity * 2 : 64;
+        Macro **macros = (Macro**)calloc(capacity, sizeof(Macro*));
+        if (!macros) return 0;
+        for (size_t i = 0; i < pp->macros_capacity; i++) {
+            Macro *moved = pp->macros[i];
+            if (!moved) continue;
+            size_t slot = (size_t)moved->hash & (capacity - 1);
+            while (macros[slot]) slot = (slot + 1) & (capacity - 1);
+            macros[slot] = moved;
+        }
+        free(pp->macros);
+        pp->macros = macros;
+        pp->macros_capacity = capacity;
+    }
+
+    size_t mask = pp->macros_capacity - 1;
+    size_t slot = (size_t)macro->hash & mask;
+    while (pp->macros[slot]) slot = (slot + 1) & mask;
+    pp->macros[slot] = macro;
+    pp->num_macros++;
+    return 1;
+}
+
+// Copy a token list into the arena
+static Token* copy_tokens(Preprocessor *pp, const Token *tokens, size_t count) {
+    if (count == 0) return NULL;
+    Token *copy = (Token*)arena_alloc(pp->arena, count * sizeof(Token));
+    if (!copy) {
+        pp->failed = 1;
+        return NULL;
+    }
+    memcpy(copy, tokens, count * sizeof(Token));
+    return copy;
+}
+
+// #define NAME body, or #define NAME(params) body
+static void define_macro(Preprocessor *pp, const Token *args, size_t count, unsigned offset) {
+    if (count == 0 || args[0].type != TOKEN_IDENTIFIER) {
+        lexer_error_at(pp->lexer, count ? args[0].offset : offset, DIAG_EXPECTED_MACRO_NAME);
+        return;
+    }
+
+    // Function-like only if '(' directly follows the name
+    Token params[MAX_MACRO_PARAMS];
+    int num_params = 0;
+    size_t i = 1;
+    int function_like = count > 1 && args[1].type == TOKEN_LPAREN
+                        && args[1].offset == args[0].offset + args[0].length;
+    if (function_like) {
+        i = 2;
+        while (i < count && args[i].type != TOKEN_RPAREN) {
+            if (args[i].type != TOKEN_IDENTIFIER || num_params == MAX_MACRO_PARAMS) {
+                lexer_error_at(pp->lexer, args[i].offset, DIAG_EXPECTED_TOKEN, "identifier",
+                               token_type_str(args[i].type));
+                return;
+            }
+            params[num_params++] = args[i++];
+            if (i < count && args[i].type == TOKEN_COMMA) i++;
+        }
+        if (i == count) {
+            lexer_error_at(pp->lexer, args[count - 1].offset, DIAG_EXPECTED_TOKEN, ")", "end of line");
+            return;
+        }
+        i++;  // ')'
+    }
+
+    // Redefinitions, and definitions after #undef, reuse the slot of the name
+    const char *text = token_text(pp->lexer, args[0]);
+    Macro *macro = find_slot(pp, text, args[0].length);
+    int is_new = 0;
+    if (!macro) {
+        macro = (Macro*)arena_alloc(pp->arena, sizeof(Macro));
+        if (!macro || !(macro->name = intern_string(text, args[0].length))) {
+            pp->failed = 1;
+            return;
+        }
+        macro->length = args[0].length;
+        macro->hash = hash_text(text, args[0].length);
+        macro->active = 0;
+        is_new = 1;
+    }
+
+    macro->body = copy_tokens(pp, args + i, count - i);
+    macro->num_body = (int)(count - i);
+    macro->params = copy_tokens(pp, params, (size_t)num_params);
+    macro->num_params = num_params;
+    macro->function_like = function_like;
+    macro->defined = 1;
+    if (is_new && !insert_macro(pp, macro)) pp->failed = 1;
+}
+
+// Index of the parameter an identifier names, -1 if none
+static int find_param(const Preprocessor *pp, const Macro *macro, Token token) {
+    const char *text = token_text(pp->lexer, token);
+    for (int i = 0; i < macro->num_params; i++) {
+        if (macro->params[i].length == token.length
+            && memcmp(token_text(pp->lexer, macro->params[i]), text, token.length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Expand a macro whose name was just read
+static void expand_macro(Preprocessor *pp, Macro *macro, Token name) {
+    if (!macro->function_like) {
+        push_context(pp, macro->body, (size_t)macro->num_body, 0, NULL, NULL, macro);
+        return;
+    }
+
+    // Without '(' the name of a function-like macro is an ordinary identifier
+    if (!next_is_lparen(pp)) {
+        emit(pp, name);
+        return;
+    }
+
+    // Collect the arguments back to back, an EOF token ending each one
+    TokenVec actuals = { NULL, 0, 0 };
+    Token token;
+    take_token(pp, &token);
+    int depth = 0;
+    int num_args = 1;
+    for (;;) {
+        if (!take_token(pp, &token)) {
+            lexer_error_at(pp->lexer, name.offset, DIAG_UNTERMINATED_MACRO_CALL, macro->name);
+            free(actuals.items);
+            return;
+        }
+        if (token.type == TOKEN_LPAREN) {
+            depth++;
+        } else if (token.type == TOKEN_RPAREN) {
+            if (depth == 0) break;
+            depth--;
+        } else if (token.type == TOKEN_COMMA && depth == 0) {
+            token.type = TOKEN_EOF;
+            num_args++;
+        }
+        if (!vec_push(&actuals, token)) pp->failed = 1;
+    }
+    Token end = { TOKEN_EOF, 0, 0 };
+    if (!vec_push(&actuals, end)) pp->failed = 1;
+    if (macro->num_params == 0 && actuals.count == 1) num_args = 0;
+    if (num_args != macro->num_params || pp->failed) {
+        if (!pp->failed) {
+            lexer_error_at(pp->lexer, name.offset, DIAG_MACRO_ARGUMENTS, macro->name,
+                           macro->num_params, num_args);
+        }
+        free(actuals.items);
+        return;
+    }
+
+    // Arguments are fully expanded before substitution
+    TokenVec expanded = { NULL, 0, 0 };
+    size_t *starts = (size_t*)malloc((num_args + 1) * sizeof(size_t));
+    if (!starts) pp->failed = 1;
+    size_t first = 0;
+    for (int arg = 0; starts && arg < num_args; arg++) {
+        size_t last = first;
+        while (actuals.items[last].type != TOKEN_EOF) last++;
+        starts[arg] = expanded.count;
+        expand_into(pp, actuals.items + first, last - first, &expanded);
+        first = last + 1;
+    }
+    if (starts) starts[num_args] = expanded.count;
+
+    TokenVec body = { NULL, 0, 0 };
+    for (int i = 0; starts && i < macro->num_body; i++) {
+        Token item = macro->body[i];
+        int param = item.type == TOKEN_IDENTIFIER ? find_param(pp, macro, item) : -1;
+        if (param < 0) {
+            if (!vec_push(&body, item)) pp->failed = 1;
+            continue;
+        }
+        for (size_t k = starts[param]; k < starts[param + 1]; k++) {
+            if (!vec_push(&body, expanded.items[k])) pp->failed = 1;
+        }
+    }
+
+    Token *replacement = copy_tokens(pp, body.items, body.count);
+    if (!pp->failed) push_context(pp, replacement, body.count, 0, NULL, NULL, macro);
+    free(actuals.items);
+    free(expanded.items);
+    free(body.items);
+    free(starts);
+}
+
+// -- Conditions --
+
+// State of a condition being evaluated
+typedef struct {
+    Preprocessor *pp;
+    const Token *tokens;
+    size_t pos;
+    size_t count;
+    int unevaluated;           // Inside the skipped side of && or ||
+    int error;
+} CondEval;
+
+// Binding power of a binary operator, 0 if the token is not one
+static int binary_precedence(TokenType type) {
+    switch (type) {
+        case TOKEN_STAR: case TOKEN_SLASH: case TOKEN_PERCENT: return 10;
+        case TOKEN_PLUS: case TOKEN_MINUS: return 9;
+        case TOKEN_SHL: case TOKEN_SHR: return 8;
+        case TOKEN_LT: case TOKEN_GT: case TOKEN_LTE: case TOKEN_GTE: return 7;
+        case TOKEN_EQ: case TOKEN_NEQ: return 6;
+        case TOKEN_BITAND: return 5;
+        case TOKEN_BITXOR: return 4;
+        case TOKEN_BITOR: return 3;
+        case TOKEN_AND: return 2;
+        case TOKEN_OR: return 1;
+        default: return 0;
+    }
+}
+
+static long long eval_binary(CondEval *ev, int min_precedence);
+
+// Evaluate a unary expression
+static long long eval_unary(CondEval *ev) {
+    if (ev->pos >= ev->count) {
+        ev->error = 1;
+        return 0;
+    }
+
+    Token token = ev->tokens[ev->pos++];
+    switch (token.type) {
+        case TOKEN_INTEGER: return token_int_value(ev->pp->lexer, token);
+        case TOKEN_CHARACTER: return token_char_value(ev->pp->lexer, token);
+        case TOKEN_PLUS: return eval_unary(ev);
+        case TOKEN_MINUS: return (long long)(0ULL - (unsigned long long)eval_unary(ev));
+        case TOKEN_NOT: return !eval_unary(ev);
+        case TOKEN_BITNOT: return ~eval_unary(ev);
+        case TOKEN_LPAREN: {
+            long long value = eval_binary(ev, 1);
+            if (ev->pos < ev->count && ev->tokens[ev->pos].type == TOKEN_RPAREN) {
+                ev->pos++;
+            } else {
+                ev->error = 1;
+            }
+            return value;
+        }
+        default:
+            // Identifiers and keywords left after expansion are 0
+            if (token.type == TOKEN_IDENTIFIER || (token.type >= TOKEN_INT && token.type <= TOKEN_RETURN)) {
+                return 0;
+            }
+            ev->error = 1;
+            return 0;
+    }
+}
+
+// Evaluate operators binding at least as tight as min_precedence
+static long long eval_binary(CondEval *ev, int min_precedence) {
+    long long left = eval_unary(ev);
+    while (!ev->error && ev->pos < ev->count) {
+        TokenType op = ev->tokens[ev->pos].type;
+        int precedence = binary_precedence(op);
+        if (precedence == 0 || precedence < min_precedence) break;
+        ev->pos++;
+
+        int skip = (op == TOKEN_AND && !left) || (op == TOKEN_OR && left);
+        ev->unevaluated += skip;
+        long long right = eval_binary(ev, precedence + 1);
+        ev->unevaluated -= skip;
+
+        unsigned long long a = (unsigned long long)left, b = (unsigned long long)right;
+        switch (op) {
+            case TOKEN_STAR: left = (long long)(a * b); break;
+            case TOKEN_SLASH:
+            case TOKEN_PERCENT:
+                if (right == 0 || (right == -1 && left == LLONG_MIN)) {
+                    if (!ev->unevaluated) ev->error = 1;
+                    left = 0;
+                } else {
+                    left = op == TOKEN_SLASH ? left / right : left % right;
+                }
+                break;
+            case TOKEN_PLUS: left = (long long)(a + b); break;
+            case TOKEN_MINUS: left = (long long)(a - b); break;
+            case TOKEN_SHL: left = (long long)(a << (b & 63)); break;
+            case TOKEN_SHR: left = left >> (b & 63); break;
+            case TOKEN_LT: left = left < right; break;
+            case TOKEN_GT: left = left > right; break;
+            case TOKEN_LTE: left = left <= right; break;
+            case TOKEN_GTE: left = left >= right; break;
+            case TOKEN_EQ: left = left == right; break;
+            case TOKEN_NEQ: left = left != right; break;
+            case TOKEN_BITAND: left = left & right; break;
+            case TOKEN_BITXOR: left = left ^ right; break;
+            case TOKEN_BITOR: left = left | right; break;
+            case TOKEN_AND: left = left && right; break;
+            case TOKEN_OR: left = left || right; break;
+            default: break;
+        }
+    }
+    return left;
+}
+
+// The "0" or "1" token defined() is replaced with
+static Token defined_value(Preprocessor *pp, int value) {
+    if (!pp->synthetic_base) {
+        SourceFile source = { synthetic_text, "<built-in>", 0, sizeof(synthetic_text) - 1,
+                              synthetic_lines, 1 };
+        pp->synthetic_base = lexer_add_source(pp->lexer, &source);
+        if (!pp->synthetic_base) pp->failed = 1;
+    }
+    Token token = { TOKEN_INTEGER, pp->synthetic_base + (value ? 2 : 0), 1 };
+    return token;
+}
+
+// Evaluate the condition of #if or #elif
+static int evaluate_condition(Preprocessor *pp, const Token *args, size_t count, unsigned offset) {
+    // defined X and defined(X) are resolved before macros expand
+    TokenVec line = { NULL, 0, 0 };
+    int error = 0;
+    for (size_t i = 0; i < count; i++) {
+        Token token = args[i];
+        if (token.type == TOKEN_IDENTIFIER && token_is(pp->lexer, token, "defined")) {
+            int parens = i + 1 < count && args[i + 1].type == TOKEN_LPAREN;
+            size_t name = i + 1 + parens;
+            if (name >= count || args[name].type != TOKEN_IDENTIFIER
+                || (parens && (name + 1 >= count || args[name + 1].type != TOKEN_RPAREN))) {
+                error = 1;
+                break;
+            }
+            token = defined_value(pp, find_macro(pp, args[name]) != NULL);
+            i = name + parens;
+        }
+        if (!vec_push(&line, token)) pp->failed = 1;
+    }
+
+    TokenVec expanded = { NULL, 0, 0 };
+    if (!error) expand_into(pp, line.items, line.count, &expanded);
+
+    CondEval ev = { pp, expanded.items, 0, expanded.count, 0, error };
+    long long value = ev.error ? 0 : eval_binary(&ev, 1);
+    if (ev.error || ev.pos != ev.count) {
+        lexer_error_at(pp->lexer, offset, DIAG_INVALID_CONDITION);
+        value = 0;
+    }
+
+    free(line.items);
+    free(expanded.items);
+    return value != 0;
+}
+
+// Open a conditional group
+static void push_conditional(Preprocessor *pp, int active, int taken, unsigned offset) {
+    if (pp->num_conds == pp->conds_capacity) {
+        int capacity = pp->conds_capacity ? pp->conds_capacity * 2 : 16;
+        Conditional *conds = (Conditional*)realloc(pp->conds, capacity * sizeof(Conditional));
+        if (!conds) {
+            pp->failed = 1;
+            return;
+        }
+        pp->conds = conds;
+        pp->conds_capacity = capacity;
+    }
+
+    Conditional *cond = &pp->conds[pp->num_conds++];
+    cond->active = active;
+    cond->taken = taken;
+    cond->offset = offset;
+}
+
+// Check whether tokens are being skipped
+static int skipping(const Preprocessor *pp) {
+    return pp->num_conds > 0 && !pp->conds[pp->num_conds - 1].active;
+}
+
+// -- Includes --
+
+// Find a header on the search path, returning its canonical path and the path it was found as
+static char* find_header(const Preprocessor *pp, const char *name, int quoted, const char *includer,
+                         char **found) {
+    int num_dirs = pp->options ? pp->options->num_include_dirs : 0;
+    for (int i = -1; i <= num_dirs; i++) {
+        char *path;
+        if (name[0] == '/') {
+            if (i > -1) break;
+            path = strdup(name);
+        } else if (i == -1) {
+            // Quoted names are looked up next to the including file first
+            if (!quoted) continue;
+            const char *slash = strrchr(includer, '/');
+            int dir_length = slash ? (int)(slash - includer) + 1 : 0;
+            path = (char*)malloc(dir_length + strlen(name) + 1);
+            if (path) sprintf(path, "%.*s%s", dir_length, includer, name);
+        } else {
+            const char *dir = i < num_dirs ? pp->options->include_dirs[i] : CCOMP_INCLUDE_DIR;
+            path = (char*)malloc(strlen(dir) + strlen(name) + 2);
+            if (path) sprintf(path, "%s/%s", dir, name);
+        }
+        if (!path) return NULL;
+
+        char *canonical = realpath(path, NULL);
+        if (canonical) {
+            *found = path;
+            return canonical;
+        }
+        free(path);
+    }
+    return NULL;
+}
+
+// Base of a header in the unit, mapping it on first use
+static unsigned map_header(Preprocessor *pp, const HeaderEntry *header, int *first) {
+    for (int i = 0; i < pp->num_included; i++) {
+        if (pp->included[i].header == header) {
+            *first = 0;
+            return pp->included[i].base;
+        }
+    }
+
+    if (pp->num_included == pp->included_capacity) {
+        int capacity = pp->included_capacity ? pp->included_capacity * 2 : 16;
+        IncludedHeader *included = (IncludedHeader*)realloc(pp->included, capacity * sizeof(IncludedHeader));
+        if (!included) return 0;
+        pp->included = included;
+        pp->included_capacity = capacity;
+    }
+
+    SourceFile source = { header->text, header->filename, 0, header->size,
+                          header->line_starts, header->num_lines };
+    unsigned base = lexer_add_source(pp->lexer, &source);
+    if (!base) return 0;
+    pp->included[pp->num_included].header = header;
+    pp->included[pp->num_included].base = base;
+    pp->num_included++;
+    *first = 1;
+    return base;
+}
+
+// #include "name" or #include <name>
+static void include_file(Preprocessor *pp, const Token *args, size_t count, unsigned offset) {
+    // Header name, <name> is rebuilt from the text between the brackets
+    char *name = NULL;
+    int quoted = 0;
+    if (count >= 1 && args[0].type == TOKEN_STRING) {
+        name = strndup(token_text(pp->lexer, args[0]) + 1, args[0].length - 2);
+        quoted = 1;
+    } else if (count >= 2 && args[0].type == TOKEN_LT) {
+        size_t close = 1;
+        while (close < count && args[close].type != TOKEN_GT) close++;
+        if (close < count) {
+            const char *start = token_text(pp->lexer, args[0]) + 1;
+            name = strndup(start, token_text(pp->lexer, args[close]) - start);
+        }
+    }
+    if (!name || !name[0]) {
+        lexer_error_at(pp->lexer, offset, DIAG_EXPECTED_HEADER_NAME);
+        free(name);
+        return;
+    }
+
+    if (pp->include_depth >= MAX_INCLUDE_DEPTH) {
+        lexer_error_at(pp->lexer, offset, DIAG_INCLUDE_DEPTH);
+        free(name);
+        return;
+    }
+
+    const PPContext *ctx = &pp->contexts[pp->num_contexts - 1];
+    char *found = NULL;
+    char *canonical = find_header(pp, name, quoted, ctx->filename, &found);
+    const HeaderEntry *header = canonical ? cache_get(canonical, found) : NULL;
+    free(canonical);
+    free(found);
+    if (!header) {
+        lexer_error_at(pp->lexer, offset, DIAG_INCLUDE_NOT_FOUND, name);
+        free(name);
+        return;
+    }
+    free(name);
+
+    // A guarded header whose guard is defined would expand to nothing
+    if (header->guard && lookup_macro(pp, header->guard, strlen(header->guard))) return;
+
+    int first = 1;
+    unsigned base = map_header(pp, header, &first);
+    if (!base) {
+        pp->failed = 1;
+        return;
+    }
+    if (!first && header->pragma_once) return;
+    // The entry is shared by every unit, so its records are copied, never moved
+    if (first) diag_replay(pp->lexer->diag, header->diag);
+
+    push_context(pp, header->tokens, header->num_tokens - 1, base, header->text, header->filename, NULL);
+}
+
+// -- Directives --
+
+// Run the directive starting at the '#' of the top file context
+static void run_directive(Preprocessor *pp) {
+    PPContext *ctx = &pp->contexts[pp->num_contexts - 1];
+    unsigned offset = ctx->tokens[ctx->pos].offset + ctx->base;
+
+    // The directive runs to the end of the line, none of it reaches the stream
+    pp->line.count = 0;
+    size_t end = ctx->pos + 1;
+    while (end < ctx->count && !starts_line(ctx->text, ctx->tokens, end)) {
+        if (!vec_push(&pp->line, context_token(ctx, end))) pp->failed = 1;
+        end++;
+    }
+    ctx->pos = end;
+    if (pp->line.count == 0) return;  // Null directive
+
+    Token name = pp->line.items[0];
+    const Token *args = pp->line.items + 1;
+    size_t count = pp->line.count - 1;
+    const char *text = token_text(pp->lexer, name);
+    int skip = skipping(pp);
+    int unmatched = pp->num_conds <= ctx->cond_floor;
+    Conditional *cond = unmatched ? NULL : &pp->conds[pp->num_conds - 1];
+
+    if (token_is(pp->lexer, name, "ifdef") || token_is(pp->lexer, name, "ifndef")) {
+        if (skip) {
+            push_conditional(pp, 0, 1, offset);
+        } else if (count == 0 || args[0].type != TOKEN_IDENTIFIER) {
+            lexer_error_at(pp->lexer, name.offset, DIAG_EXPECTED_MACRO_NAME);
+            push_conditional(pp, 0, 0, offset);
+        } else {
+            int active = (find_macro(pp, args[0]) != NULL) == token_is(pp->lexer, name, "ifdef");
+            push_conditional(pp, active, active, offset);
+        }
+    } else if (token_is(pp->lexer, name, "if")) {
+        int active = !skip && evaluate_condition(pp, args, count, name.offset);
+        push_conditional(pp, active, skip || active, offset);
+    } else if (token_is(pp->lexer, name, "elif") || token_is(pp->lexer, name, "else") || token_is(pp->lexer, name, "endif")) {
+        if (!cond) {
+            char directive[8];
+            snprintf(directive, sizeof(directive), "%.*s", (int)name.length, text);
+            lexer_error_at(pp->lexer, name.offset, DIAG_UNMATCHED_CONDITIONAL, directive);
+        } else if (token_is(pp->lexer, name, "endif")) {
+            pp->num_conds--;
+        } else if (cond->taken) {
+            cond->active = 0;
+        } else {
+            cond->active = token_is(pp->lexer, name, "else") || evaluate_condition(pp, args, count, name.offset);
+            cond->taken = cond->active;
+        }
+    } else if (skip) {
+        // Other directives of skipped groups are not looked at
+    } else if (token_is(pp->lexer, name, "define")) {
+        define_macro(pp, args, count, name.offset);
+    } else if (token_is(pp->lexer, name, "undef")) {
+        Macro *macro = count && args[0].type == TOKEN_IDENTIFIER ? find_macro(pp, args[0]) : NULL;
+        if (count == 0 || args[0].type != TOKEN_IDENTIFIER) {
+            lexer_error_at(pp->lexer, name.offset, DIAG_EXPECTED_MACRO_NAME);
+        } else if (macro) {
+            macro->defined = 0;
+        }
+    } else if (token_is(pp->lexer, name, "include")) {
+        include_file(pp, args, count, offset);
+    } else if (token_is(pp->lexer, name, "error")) {
+        const char *message = count ? token_text(pp->lexer, args[0]) : "";
+        int length = count ? (int)(token_text(pp->lexer, args[count - 1]) + args[count - 1].length - message) : 0;
+        lexer_error_at(pp->lexer, offset, DIAG_ERROR_DIRECTIVE, length, message);
+    } else if (token_is(pp->lexer, name, "pragma")) {
+        // #pragma once is found when the header is cached, other pragmas are ignored
+    } else {
+        lexer_error_at(pp->lexer, name.offset, DIAG_INVALID_DIRECTIVE, (int)name.length, text);
+    }
+}
+
+// Read contexts above floor, expanding macros into the target
+static void run_contexts(Preprocessor *pp, int floor) {
+    while (pp->num_contexts > floor && !pp->failed) {
+        PPContext *ctx = &pp->contexts[pp->num_contexts - 1];
+        if (ctx->pos >= ctx->count) {
+            pop_context(pp);
+            continue;
+        }
+
+        if (ctx->filename) {
+            if (ctx->tokens[ctx->pos].type == TOKEN_POUND && starts_line(ctx->text, ctx->tokens, ctx->pos)) {
+                run_directive(pp);
+                continue;
+            }
+            if (skipping(pp)) {
+                ctx->pos++;
+                continue;
+            }
+        }
+
+        Token token = context_token(ctx, ctx->pos++);
+        if (token.type == TOKEN_IDENTIFIER && pp->num_macros > 0) {
+            Macro *macro = find_macro(pp, token);
+            if (macro && !macro->active) {
+                expand_macro(pp, macro, token);
+                continue;
+            }
+        }
+        emit(pp, token);
+    }
+}
+
+// Preprocess a translation unit, lexing it up front first if it has directives
+int preprocess(Lexer *lexer, const PreprocOptions *options, int lex_threads) {
+    // Without a single '#' there is nothing to do and tokens keep being lexed on demand
+    if (!memchr(lexer->buffer, '#', (size_t)lexer->buffer_size)) return 1;
+    if (!lexer_lex_all(lexer, lex_threads)) return 0;
+
+    double start = lexer->stats ? stats_wall_clock() : 0.0;
+    Preprocessor pp;
+    memset(&pp, 0, sizeof(pp));
+    pp.lexer = lexer;
+    pp.options = options;
+    pp.target = &pp.out;
+    pp.arena = arena_create(0);
+    pp.failed = !pp.arena;
+
+    Token eof = lexer->tokens[lexer->num_tokens_total - 1];
+    if (!pp.failed) {
+        push_context(&pp, lexer->tokens, lexer->num_tokens_total - 1, 0, lexer->buffer, lexer->filename, NULL);
+        run_contexts(&pp, 0);
+    }
+    emit(&pp, eof);
+
+    int ok = !pp.failed;
+    if (ok) {
+        // The parser reads the preprocessed stream from the start
+        free(lexer->tokens);
+        lexer->tokens = pp.out.items;
+        lexer->num_tokens_total = pp.out.count;
+        lexer->next_token = 0;
+    } else {
+        free(pp.out.items);
+    }
+
+    free(pp.contexts);
+    free(pp.conds);
+    free(pp.macros);
+    free(pp.included);
+    free(pp.line.items);
+    arena_destroy(pp.arena);
+    if (lexer->stats) stats_add_wall(lexer->stats, PHASE_PREPROCESS, stats_wall_clock() - start);
+    return ok;
+}
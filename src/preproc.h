@@ -0,0 +1,35 @@
+/**
+ * Preprocessor Header
+ *
+ * Runs over the token array of a lexed translation unit and replaces it
+ * with the preprocessed stream: #include, #define/#undef, conditionals,
+ * #error and #pragma once. Headers are lexed once per process and kept
+ * in a shared cache keyed by canonical path, revalidated by modification
+ * time and content hash; headers wrapped in an include guard are skipped
+ * without being read again once their guard macro is defined.
+ */
+
+#ifndef PREPROC_H
+#define PREPROC_H
+
+#include "lexeme.h"
+
+// Nested #include limit
+#define MAX_INCLUDE_DEPTH 200
+
+// -I directories accepted on one command line
+#define MAX_INCLUDE_DIRS 64
+
+// Preprocessing options of a run
+typedef struct {
+    const char *include_dirs[MAX_INCLUDE_DIRS];  // Searched in order before the bundled one
+    int num_include_dirs;
+} PreprocOptions;
+
+// Preprocess a translation unit, lexing it up front first if it has directives
+int preprocess(Lexer *lexer, const PreprocOptions *options, int lex_threads);
+
+// Release the header cache (no preprocessing may be running)
+void free_include_cache(void);
+
+#endif // PREPROC_H
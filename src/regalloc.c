@@ -0,0 +1,271 @@
+/**
+ * Register Allocator Implementation
+ *
+ * Every virtual register gets one interval from its first to its last
+ * live position, with liveness solved over the blocks of ir.h (Poletto
+ * and Sarkar's linear scan). The scan walks the intervals by start; when no
+ * register is free, whichever of the current interval and the active one
+ * ending last goes to a stack slot.
+ *
+ * r7 stays the frame pointer, and ip and lr are left to the instruction
+ * selector as scratch registers for spilled operands and constants.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "regalloc.h"
+
+// Registers usable by intervals that do not cross a call, caller-saved first
+static const int any_registers[] = { 0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 11 };
+
+// Registers preserved across calls by the AAPCS
+static const int callee_saved[] = { 4, 5, 6, 8, 9, 10, 11 };
+
+#define NUM_ANY (int)(sizeof(any_registers) / sizeof(any_registers[0]))
+#define NUM_CALLEE_SAVED (int)(sizeof(callee_saved) / sizeof(callee_saved[0]))
+
+// Live range of one virtual register
+typedef struct {
+    int vreg;
+    int start;
+    int end;
+    int crosses_call;
+    int hint;            // Preferred register, -1 for none
+    int copy_of;         // Virtual register this one is first copied from, -1 for none
+    int reg;
+} Interval;
+
+// Grow an interval to cover a position
+static void extend(Interval *intervals, int vreg, int position) {
+    Interval *interval = &intervals[vreg];
+    if (position < interval->start) interval->start = position;
+    if (position > interval->end) interval->end = position;
+}
+
+// Grow the intervals of every member of a set to cover a position
+static void extend_set(Interval *intervals, const uint32_t *set, int words, int position) {
+    for (int w = 0; w < words; w++) {
+        uint32_t bits = set[w];
+        while (bits) {
+            int bit = __builtin_ctz(bits);
+            extend(intervals, w * 32 + bit, position);
+            bits &= bits - 1;
+        }
+    }
+}
+
+// Compute the live interval of every virtual register, 0 on allocation failure
+static int compute_intervals(const IRFunction *function, Interval *intervals) {
+    IRCfg cfg;
+    IRLiveness liveness;
+    if (!ir_build_cfg(function, &cfg)) return 0;
+    if (!ir_compute_liveness(function, &cfg, &liveness)) {
+        ir_free_cfg(&cfg);
+        return 0;
+    }
+
+    for (int v = 0; v < function->num_vregs; v++) {
+        intervals[v].vreg = v;
+        intervals[v].start = function->num_insns;
+        intervals[v].end = -1;
+        intervals[v].crosses_call = 0;
+        intervals[v].hint = -1;
+        intervals[v].copy_of = -1;
+        intervals[v].reg = REG_SPILLED;
+    }
+
+    // Live across a block border, the interval spans the border
+    int words = liveness.words;
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        extend_set(intervals, liveness.live_in + (size_t)b * words, words, cfg.blocks[b].first);
+        extend_set(intervals, liveness.live_out + (size_t)b * words, words, cfg.blocks[b].last);
+    }
+    for (int i = 0; i < function->num_insns; i++) {
+        const IRInsn *insn = &function->insns[i];
+        int reads = ir_reads(insn);
+        if (reads & IR_READS_A) extend(intervals, insn->a, i);
+        if (reads & IR_READS_B) extend(intervals, insn->b, i);
+        if (insn->op == IR_CALL) {
+            for (int j = 0; j < insn->imm; j++) extend(intervals, function->args[insn->a + j], i);
+        }
+        if (insn->dst != IR_NONE) extend(intervals, insn->dst, i);
+
+        // Parameters all arrive at once, so their intervals overlap
+        if (insn->op == IR_PARAM) {
+            extend(intervals, insn->dst, 0);
+            extend(intervals, insn->dst, function->num_params - 1);
+        }
+    }
+
+    ir_free_liveness(&liveness);
+    ir_free_cfg(&cfg);
+    return 1;
+}
+
+// Mark the intervals live across a call and record register preferences
+static void annotate_intervals(const IRFunction *function, Interval *intervals) {
+    // Calls in position order; an interval crosses one strictly inside it
+    int num_calls = 0;
+    int *calls = (int*)malloc((function->num_insns ? function->num_insns : 1) * sizeof(int));
+    for (int i = 0; i < function->num_insns; i++) {
+        const IRInsn *insn = &function->insns[i];
+        if (insn->op == IR_CALL) {
+            if (calls) calls[num_calls++] = i;
+            if (intervals[insn->dst].hint < 0) intervals[insn->dst].hint = insn->flags & IR_RESULT1 ? 1 : 0;
+            for (int j = 0; j < insn->imm && j < 4; j++) {
+                Interval *arg = &intervals[function->args[insn->a + j]];
+                if (arg->hint < 0) arg->hint = j;
+            }
+        } else if (insn->op == IR_PARAM && insn->imm < 4) {
+            if (intervals[insn->dst].hint < 0) intervals[insn->dst].hint = insn->imm;
+        } else if (insn->op == IR_COPY) {
+            if (intervals[insn->dst].copy_of < 0) intervals[insn->dst].copy_of = insn->a;
+        } else if (insn->op == IR_RETURN && insn->a != IR_NONE) {
+            if (intervals[insn->a].hint < 0) intervals[insn->a].hint = 0;
+        }
+    }
+
+    for (int v = 0; v < function->num_vregs; v++) {
+        Interval *interval = &intervals[v];
+        if (interval->end < 0) continue;
+        if (!calls) {
+            interval->crosses_call = 1;
+            continue;
+        }
+        // First call after the start
+        int low = 0;
+        int high = num_calls;
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (calls[mid] <= interval->start) low = mid + 1;
+            else high = mid;
+        }
+        interval->crosses_call = low < num_calls && calls[low] < interval->end;
+    }
+    free(calls);
+}
+
+// Order intervals by start, ties by register number
+static int compare_start(const void *a, const void *b) {
+    const Interval *x = *(const Interval* const*)a;
+    const Interval *y = *(const Interval* const*)b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->vreg < y->vreg ? -1 : x->vreg > y->vreg;
+}
+
+// Check that a register may hold an interval
+static int allowed(const Interval *interval, int reg) {
+    return !interval->crosses_call || reg >= 4;
+}
+
+// Send an interval to a new stack slot
+static void spill(Allocation *allocation, Interval *interval) {
+    interval->reg = REG_SPILLED;
+    allocation->slots[interval->vreg] = allocation->num_slots++;
+}
+
+// Assign registers to intervals sorted by start
+static void linear_scan(Interval *intervals, Interval **sorted, int count, Allocation *allocation) {
+    Interval *active[NUM_ANY];
+    int num_active = 0;
+    int is_free[16];
+    for (int r = 0; r < 16; r++) is_free[r] = 0;
+    for (int r = 0; r < NUM_ANY; r++) is_free[any_registers[r]] = 1;
+
+    for (int i = 0; i < count; i++) {
+        Interval *current = sorted[i];
+
+        // Expire intervals over by the time this one is written
+        for (int j = 0; j < num_active; ) {
+            if (active[j]->end <= current->start) {
+                is_free[active[j]->reg] = 1;
+                active[j] = active[--num_active];
+            } else {
+                j++;
+            }
+        }
+
+        // A copy whose source just died takes over the source's register
+        int reg = -1;
+        int source = current->copy_of >= 0 ? intervals[current->copy_of].reg : REG_SPILLED;
+        if (current->hint >= 0 && is_free[current->hint] && allowed(current, current->hint)) {
+            reg = current->hint;
+        } else if (source != REG_SPILLED && is_free[source] && allowed(current, source)) {
+            reg = source;
+        } else if (current->crosses_call) {
+            for (int r = 0; r < NUM_CALLEE_SAVED && reg < 0; r++) {
+                if (is_free[callee_saved[r]]) reg = callee_saved[r];
+            }
+        } else {
+            for (int r = 0; r < NUM_ANY && reg < 0; r++) {
+                if (is_free[any_registers[r]]) reg = any_registers[r];
+            }
+        }
+
+        if (reg < 0) {
+            // Whichever lives longer gives way
+            Interval *victim = NULL;
+            int victim_index = -1;
+            for (int j = 0; j < num_active; j++) {
+                if (!allowed(current, active[j]->reg)) continue;
+                if (!victim || active[j]->end > victim->end) {
+                    victim = active[j];
+                    victim_index = j;
+                }
+            }
+            if (!victim || victim->end <= current->end) {
+                spill(allocation, current);
+                continue;
+            }
+            reg = victim->reg;
+            spill(allocation, victim);
+            active[victim_index] = active[--num_active];
+        }
+
+        current->reg = reg;
+        is_free[reg] = 0;
+        allocation->used |= 1u << reg;
+        active[num_active++] = current;
+    }
+}
+
+// Allocate the registers of a function
+int regalloc_function(const IRFunction *function, Allocation *allocation) {
+    memset(allocation, 0, sizeof(Allocation));
+    int num_vregs = function->num_vregs;
+    allocation->registers = (int*)malloc((num_vregs ? num_vregs : 1) * sizeof(int));
+    allocation->slots = (int*)malloc((num_vregs ? num_vregs : 1) * sizeof(int));
+    Interval *intervals = (Interval*)malloc((num_vregs ? num_vregs : 1) * sizeof(Interval));
+    Interval **sorted = (Interval**)malloc((num_vregs ? num_vregs : 1) * sizeof(Interval*));
+    if (!allocation->registers || !allocation->slots || !intervals || !sorted ||
+        !compute_intervals(function, intervals)) {
+        free(intervals);
+        free(sorted);
+        regalloc_free(allocation);
+        return 0;
+    }
+    annotate_intervals(function, intervals);
+
+    // Registers never defined nor used need no location
+    int count = 0;
+    for (int v = 0; v < num_vregs; v++) {
+        allocation->slots[v] = -1;
+        if (intervals[v].end >= 0) sorted[count++] = &intervals[v];
+    }
+    qsort(sorted, count, sizeof(Interval*), compare_start);
+    linear_scan(intervals, sorted, count, allocation);
+
+    for (int v = 0; v < num_vregs; v++) allocation->registers[v] = intervals[v].reg;
+    free(intervals);
+    free(sorted);
+    return 1;
+}
+
+// Free the arrays of an allocation
+void regalloc_free(Allocation *allocation) {
+    free(allocation->registers);
+    free(allocation->slots);
+    allocation->registers = NULL;
+    allocation->slots = NULL;
+}
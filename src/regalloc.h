@@ -0,0 +1,32 @@
+/**
+ * Register Allocator Header
+ *
+ * Linear-scan allocation of the virtual registers of an IR function to
+ * the ARM core registers. Live intervals come from a liveness analysis
+ * over the blocks of the function; intervals that cross a call only get
+ * callee-saved registers, and the ones left over go to stack slots.
+ */
+
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ir.h"
+
+// Location of a virtual register that lives in a stack slot
+#define REG_SPILLED (-1)
+
+// Result of allocating one function
+typedef struct {
+    int *registers;   // Core register of each virtual register, or REG_SPILLED
+    int *slots;       // Stack slot of each spilled virtual register
+    int num_slots;
+    unsigned used;    // Mask of the core registers handed out
+} Allocation;
+
+// Allocate the registers of a function, 0 on allocation failure
+int regalloc_function(const IRFunction *function, Allocation *allocation);
+
+// Free the arrays of an allocation
+void regalloc_free(Allocation *allocation);
+
+#endif // REGALLOC_H
@@ -0,0 +1,269 @@
+/**
+ * Incremental Reparse Implementation
+ *
+ * The edits are grouped into regions of the new text: a region starts at
+ * the end of the last declaration kept before it and runs to the start of
+ * the first declaration kept after it, so the tokens of a region are the
+ * tokens a full lex would produce there. Each region is lexed on its own
+ * and parsed as a small program whose declarations replace the ones the
+ * region covered. Anything that breaks that model (directives, a token or
+ * comment running into a kept declaration, unusable spans) falls back to
+ * a full parse.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "reparse.h"
+#include "parser.h"
+
+// Stretch of the new text replacing the top-level declarations [first, last)
+typedef struct {
+    int first;
+    int last;
+    unsigned start;     // New offset of the region start
+    unsigned end;       // New offset of the region end
+    int to_eof;         // Region runs to the end of the text
+    Token *tokens;      // Tokens of the region, ended by EOF
+    size_t num_tokens;
+} Region;
+
+// Parse the whole text from scratch
+static ASTNode* full_parse(Lexer *lexer, Arena *arena, ReparseStats *stats) {
+    free(lexer->tokens);
+    lexer->tokens = NULL;
+    lexer->num_tokens_total = 0;
+    lexer->next_token = 0;
+    lexer->position = 0;
+    lexer->ring_head = 0;
+    lexer->ring_count = 0;
+
+    Parser *parser = init_parser(lexer, arena);
+    if (!parser) return NULL;
+    ASTNode *program = parse_program(parser);
+    free_parser(parser);
+
+    if (stats) {
+        stats->full = 1;
+        stats->reparsed = program ? program->num_children : 0;
+    }
+    return program;
+}
+
+// Check that the top-level declarations have ordered, non-empty spans
+static int spans_usable(const ASTNode *program) {
+    unsigned previous_end = 0;
+    for (int i = 0; i < program->num_children; i++) {
+        SourceSpan span = program->children[i]->span;
+        if (span.end <= span.start || span.start < previous_end) return 0;
+        previous_end = span.end;
+    }
+    return 1;
+}
+
+// Group the edits into regions; returns the number of regions, -1 if the edits are invalid
+static int find_regions(const ASTNode *program, const TextEdit *edits, int num_edits,
+                        unsigned new_size, Region *regions) {
+    ASTNode **children = program->children;
+    int n = program->num_children;
+    long long delta = 0;
+    int child = 0;
+    int num_regions = 0;
+
+    for (int i = 1; i < num_edits; i++) {
+        if (edits[i].start < edits[i - 1].end) return -1;
+    }
+
+    int e = 0;
+    while (e < num_edits) {
+        if (edits[e].end < edits[e].start) return -1;
+
+        // Declarations ending before the edit are kept
+        while (child < n && children[child]->span.end < edits[e].start) child++;
+
+        Region *region = &regions[num_regions++];
+        region->first = child;
+        unsigned old_start = child > 0 ? children[child - 1]->span.end : 0;
+        long long start = old_start + delta;
+
+        // Take in the declarations the edit touches, and the next edits while
+        // they reach the first declaration left out
+        for (;;) {
+            delta += (long long)edits[e].length - (edits[e].end - edits[e].start);
+            unsigned edit_end = edits[e].end;
+            e++;
+            while (child < n && children[child]->span.start <= edit_end) child++;
+            if (e < num_edits && (child == n || edits[e].start <= children[child]->span.end)) continue;
+            break;
+        }
+
+        region->last = child;
+        region->to_eof = child == n;
+        long long end = region->to_eof ? (long long)new_size : children[child]->span.start + delta;
+        if (start < 0 || end < start || end > new_size) return -1;
+        region->start = (unsigned)start;
+        region->end = (unsigned)end;
+        region->tokens = NULL;
+        region->num_tokens = 0;
+    }
+
+    return num_regions;
+}
+
+// Lex a region, 0 if its tokens would not match a full lex of the text
+static int lex_region(Lexer *lexer, Region *region) {
+    size_t capacity = 64;
+    region->tokens = (Token*)malloc(capacity * sizeof(Token));
+    if (!region->tokens) return 0;
+
+    lexer->position = (int)region->start;
+    for (;;) {
+        Token token = get_token(lexer);
+        int done = token.type == TOKEN_EOF || token.offset >= region->end;
+        if (done) {
+            // The region must end exactly where the next kept declaration starts
+            if (region->to_eof ? token.type != TOKEN_EOF : token.offset != region->end) return 0;
+            token.type = TOKEN_EOF;
+            token.length = 0;
+        } else if (token.offset + token.length > region->end) {
+            return 0;
+        }
+
+        if (region->num_tokens == capacity) {
+            capacity *= 2;
+            Token *tokens = (Token*)realloc(region->tokens, capacity * sizeof(Token));
+            if (!tokens) return 0;
+            region->tokens = tokens;
+        }
+        region->tokens[region->num_tokens++] = token;
+        if (done) break;
+    }
+
+    lexer->num_tokens += region->num_tokens;
+    return 1;
+}
+
+// Parse the tokens of a region as a program of its own
+static ASTNode* parse_region(Lexer *lexer, Arena *arena, Region *region) {
+    lexer->tokens = region->tokens;
+    lexer->num_tokens_total = region->num_tokens;
+    lexer->next_token = 0;
+    lexer->ring_head = 0;
+    lexer->ring_count = 0;
+
+    Parser *parser = init_parser(lexer, arena);
+    ASTNode *program = parser ? parse_program(parser) : NULL;
+    free_parser(parser);
+
+    lexer->tokens = NULL;
+    lexer->num_tokens_total = 0;
+    return program;
+}
+
+// Release the token arrays of the regions
+static void free_regions(Region *regions, int num_regions) {
+    for (int i = 0; i < num_regions; i++) {
+        free(regions[i].tokens);
+    }
+    free(regions);
+}
+
+// Reparse the top-level declarations touched by the edits
+ASTNode* reparse_program(ASTNode *program, const TextEdit *edits, int num_edits,
+                         Lexer *lexer, Arena *arena, ReparseStats *stats) {
+    if (stats) {
+        stats->reused = 0;
+        stats->reparsed = 0;
+        stats->full = 0;
+    }
+
+    int fresh = lexer->position == 0 && lexer->ring_count == 0 && !lexer->tokens;
+    if (!program || program->type != AST_PROGRAM || !fresh || !spans_usable(program)
+        || memchr(lexer->buffer, '#', lexer->buffer_size)) {
+        // Offsets of preprocessed units do not follow the text
+        return full_parse(lexer, arena, stats);
+    }
+
+    Region *regions = (Region*)malloc((num_edits > 0 ? num_edits : 1) * sizeof(Region));
+    if (!regions) return NULL;
+    int num_regions = find_regions(program, edits, num_edits, (unsigned)lexer->buffer_size, regions);
+    if (num_regions < 0) {
+        free(regions);
+        return full_parse(lexer, arena, stats);
+    }
+
+    // Lex every region first, into a separate engine so that a fallback
+    // does not report the same lexical errors twice
+    double start = lexer->stats ? stats_wall_clock() : 0.0;
+    DiagEngine *diag = lexer->diag;
+    DiagEngine *region_diag = diag_create(NULL);
+    int ok = region_diag != NULL;
+    if (ok) {
+        diag_set_max_errors(region_diag, diag->max_errors);
+        lexer->diag = region_diag;
+    }
+    for (int i = 0; ok && i < num_regions; i++) {
+        ok = lex_region(lexer, &regions[i]);
+    }
+    lexer->diag = diag;
+    if (lexer->stats) {
+        stats_add_wall(lexer->stats, PHASE_LEX, stats_wall_clock() - start);
+    }
+    if (!ok) {
+        diag_destroy(region_diag);
+        free_regions(regions, num_regions);
+        return full_parse(lexer, arena, stats);
+    }
+    diag_merge(diag, region_diag);
+    diag_destroy(region_diag);
+
+    ASTNode *result = create_ast_node(arena, AST_PROGRAM);
+    if (!result) {
+        free_regions(regions, num_regions);
+        return NULL;
+    }
+
+    // Kept declarations only move by the edits before them
+    long long delta = 0;
+    int child = 0;
+    int reused = 0;
+    int reparsed = 0;
+    for (int i = 0; i <= num_regions; i++) {
+        int last = i < num_regions ? regions[i].first : program->num_children;
+        for (; child < last; child++) {
+            ASTNode *node = program->children[child];
+            ast_shift_spans(node, (int)delta);
+            add_child(arena, result, node);
+            reused++;
+        }
+        if (i == num_regions) break;
+
+        Region *region = &regions[i];
+        ASTNode *parsed = parse_region(lexer, arena, region);
+        if (!parsed) {
+            free_regions(regions, num_regions);
+            return NULL;
+        }
+        for (int j = 0; j < parsed->num_children; j++) {
+            add_child(arena, result, parsed->children[j]);
+            reparsed++;
+        }
+        child = region->last;
+        if (!region->to_eof) {
+            delta = (long long)region->end - program->children[child]->span.start;
+        }
+    }
+    free_regions(regions, num_regions);
+
+    // The lexer is left at the end of the text, as after a full parse
+    lexer->position = lexer->buffer_size;
+
+    // Same span as a full parse gives the unit
+    result->span.start = 0;
+    if (result->num_children > 0) result->span.end = result->children[result->num_children - 1]->span.end;
+    if (stats) {
+        stats->reused = reused;
+        stats->reparsed = reparsed;
+    }
+    return result;
+}
@@ -0,0 +1,44 @@
+/**
+ * Incremental Reparse Header
+ *
+ * Updates the AST of a unit after text edits without parsing it again as
+ * a whole. Top-level declarations whose source span an edit touches are
+ * reparsed from the new text together with the gaps around them; every
+ * other declaration is kept as it is, its spans moved by the length change
+ * of the edits before it.
+ */
+
+#ifndef REPARSE_H
+#define REPARSE_H
+
+#include "ast.h"
+#include "lexeme.h"
+
+// Replacement of the old bytes [start, end) by length new bytes
+typedef struct {
+    unsigned start;
+    unsigned end;
+    unsigned length;
+} TextEdit;
+
+// Outcome of a reparse
+typedef struct {
+    int reused;       // Top-level declarations kept from the previous AST
+    int reparsed;     // Top-level declarations parsed from the new text
+    int full;         // Set when the whole unit had to be parsed again
+} ReparseStats;
+
+// Parse the lexer's text after edits (sorted, non-overlapping, in old offsets)
+// were applied to the text of program. The lexer must be fresh on the new
+// text. stats may be NULL.
+//
+// The kept subtrees are moved into the result, not copied: the result
+// points into the arena of the previous AST. That arena must not be reset
+// or destroyed while the result is in use, so a caller that resets its
+// arena for every input (as compile_file does) needs a separate arena for
+// the new nodes and keeps the previous one alive. test/reparseCheck.c
+// shows the pattern and checks the result against a full parse.
+ASTNode* reparse_program(ASTNode *program, const TextEdit *edits, int num_edits,
+                         Lexer *lexer, Arena *arena, ReparseStats *stats);
+
+#endif // REPARSE_H
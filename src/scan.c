@@ -0,0 +1,204 @@
+/**
+ * Fast Scanning Implementation
+ *
+ * Each instruction set provides a few block primitives that turn one
+ * block of text into a bit mask (one bit per byte, or four bits per byte
+ * on NEON). The scanners are written once on top of those masks, using
+ * count-trailing-zeros to find the end of a run and popcount to count
+ * newlines without a branch per character.
+ *
+ * Define SCAN_NO_SIMD to force the portable byte-at-a-time version.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "scan.h"
+
+#if !defined(SCAN_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_ISA "avx2"
+#define BLOCK_SIZE 32
+#define BYTE_BITS 1
+typedef __m256i Block;
+
+static inline Block load_block(const char *p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline uint64_t block_mask(Block cmp) { return (uint32_t)_mm256_movemask_epi8(cmp); }
+static inline Block block_eq(Block v, char c) { return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)); }
+static inline Block block_or(Block a, Block b) { return _mm256_or_si256(a, b); }
+// Bytes in [low, low + span] (unsigned compare through min)
+static inline Block block_range(Block v, char low, char span) {
+    Block t = _mm256_sub_epi8(v, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(span)), t);
+}
+static inline Block block_lower(Block v) { return _mm256_or_si256(v, _mm256_set1_epi8(0x20)); }
+
+#elif !defined(SCAN_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_ISA "sse2"
+#define BLOCK_SIZE 16
+#define BYTE_BITS 1
+typedef __m128i Block;
+
+static inline Block load_block(const char *p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline uint64_t block_mask(Block cmp) { return (uint32_t)_mm_movemask_epi8(cmp); }
+static inline Block block_eq(Block v, char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); }
+static inline Block block_or(Block a, Block b) { return _mm_or_si128(a, b); }
+static inline Block block_range(Block v, char low, char span) {
+    Block t = _mm_sub_epi8(v, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(span)), t);
+}
+static inline Block block_lower(Block v) { return _mm_or_si128(v, _mm_set1_epi8(0x20)); }
+
+#elif !defined(SCAN_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define SCAN_ISA "neon"
+#define BLOCK_SIZE 16
+#define BYTE_BITS 4
+typedef uint8x16_t Block;
+
+static inline Block load_block(const char *p) { return vld1q_u8((const uint8_t*)p); }
+// NEON has no movemask: narrowing each 16-bit lane by 4 keeps one nibble per byte
+static inline uint64_t block_mask(Block cmp) {
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+static inline Block block_eq(Block v, char c) { return vceqq_u8(v, vdupq_n_u8((uint8_t)c)); }
+static inline Block block_or(Block a, Block b) { return vorrq_u8(a, b); }
+static inline Block block_range(Block v, char low, char span) {
+    return vcleq_u8(vsubq_u8(v, vdupq_n_u8((uint8_t)low)), vdupq_n_u8((uint8_t)span));
+}
+static inline Block block_lower(Block v) { return vorrq_u8(v, vdupq_n_u8(0x20)); }
+
+#else
+#define SCAN_ISA "scalar"
+#endif
+
+#ifdef BLOCK_SIZE
+
+// Mask with the bits of every byte of a block set
+#define FULL_MASK (BLOCK_SIZE * BYTE_BITS == 64 ? ~(uint64_t)0 : (((uint64_t)1 << (BLOCK_SIZE * BYTE_BITS)) - 1))
+
+// Index of the first byte flagged in a non-zero mask
+static inline size_t first_byte(uint64_t mask) { return (size_t)__builtin_ctzll(mask) / BYTE_BITS; }
+
+// Number of bytes flagged in a mask
+static inline unsigned count_bytes(uint64_t mask) {
+    return (unsigned)__builtin_popcountll(mask) / BYTE_BITS;
+}
+
+// Whitespace is ' ' and '\t' through '\r', as isspace in the C locale
+static inline uint64_t whitespace_mask(Block v) {
+    return block_mask(block_or(block_eq(v, ' '), block_range(v, '\t', 4)));
+}
+
+// Identifier bytes are letters, digits and '_'
+static inline uint64_t identifier_mask(Block v) {
+    Block letters = block_range(block_lower(v), 'a', 25);
+    Block digits = block_range(v, '0', 9);
+    return block_mask(block_or(block_or(letters, digits), block_eq(v, '_')));
+}
+
+// Length of the run of whitespace starting at text
+size_t scan_whitespace(const char *text) {
+    for (size_t offset = 0;; offset += BLOCK_SIZE) {
+        uint64_t stop = ~whitespace_mask(load_block(text + offset)) & FULL_MASK;  // '\0' is not whitespace
+        if (stop) return offset + first_byte(stop);
+    }
+}
+
+// Length of a block comment body up to (not including) "*/", or up to '\0'
+size_t scan_block_comment(const char *text) {
+    for (size_t offset = 0;; offset += BLOCK_SIZE) {
+        const char *p = text + offset;
+        Block v = load_block(p);
+        uint64_t close = block_mask(block_eq(v, '*')) & block_mask(block_eq(load_block(p + 1), '/'));
+        uint64_t stop = close | block_mask(block_eq(v, '\0'));
+        if (stop) return offset + first_byte(stop);
+    }
+}
+
+// Find the end of a line comment: offset of the next '\n' or '\0'
+size_t scan_line_end(const char *text) {
+    for (size_t offset = 0;; offset += BLOCK_SIZE) {
+        Block v = load_block(text + offset);
+        uint64_t stop = block_mask(block_or(block_eq(v, '\n'), block_eq(v, '\0')));
+        if (stop) return offset + first_byte(stop);
+    }
+}
+
+// Length of the identifier starting at text
+size_t scan_identifier_length(const char *text) {
+    for (size_t offset = 0;; offset += BLOCK_SIZE) {
+        uint64_t stop = ~identifier_mask(load_block(text + offset)) & FULL_MASK;
+        if (stop) return offset + first_byte(stop);
+    }
+}
+
+// Count the newlines in the first length bytes of text
+size_t scan_count_newlines(const char *text, size_t length) {
+    size_t count = 0;
+    size_t offset = 0;
+    for (; offset + BLOCK_SIZE <= length; offset += BLOCK_SIZE) {
+        count += count_bytes(block_mask(block_eq(load_block(text + offset), '\n')));
+    }
+    for (; offset < length; offset++) {
+        count += text[offset] == '\n';
+    }
+    return count;
+}
+
+#else // Portable fallback
+
+// Whitespace test matching isspace in the C locale
+static inline int is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Identifier byte test
+static inline int is_identifier(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Length of the run of whitespace starting at text
+size_t scan_whitespace(const char *text) {
+    size_t length = 0;
+    while (is_space(text[length])) length++;
+    return length;
+}
+
+// Length of a block comment body up to (not including) "*/", or up to '\0'
+size_t scan_block_comment(const char *text) {
+    size_t length = 0;
+    while (text[length] != '\0' && !(text[length] == '*' && text[length + 1] == '/')) length++;
+    return length;
+}
+
+// Find the end of a line comment: offset of the next '\n' or '\0'
+size_t scan_line_end(const char *text) {
+    size_t offset = 0;
+    while (text[offset] != '\n' && text[offset] != '\0') offset++;
+    return offset;
+}
+
+// Length of the identifier starting at text
+size_t scan_identifier_length(const char *text) {
+    size_t length = 0;
+    while (is_identifier(text[length])) length++;
+    return length;
+}
+
+// Count the newlines in the first length bytes of text
+size_t scan_count_newlines(const char *text, size_t length) {
+    size_t count = 0;
+    for (size_t offset = 0; offset < length; offset++) {
+        count += text[offset] == '\n';
+    }
+    return count;
+}
+
+#endif
+
+// Name of the instruction set in use
+const char* scan_isa_name(void) {
+    return SCAN_ISA;
+}
@@ -0,0 +1,30 @@
+/**
+ * Fast Scanning Header
+ *
+ * Vectorised scanners for the lexer hot loops: whitespace runs, comment
+ * bodies and identifier tails are examined 16 to 32 bytes at a time.
+ *
+ * Every scanner stops at a '\0' byte and may read up to SCAN_PADDING
+ * bytes beyond it, so the scanned text must be followed by that many
+ * readable bytes (the lexer pads its buffer accordingly).
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// Readable bytes required after the terminating '\0'
+#define SCAN_PADDING 64
+
+// Scanning functions
+size_t scan_whitespace(const char *text);
+size_t scan_block_comment(const char *text);
+size_t scan_line_end(const char *text);
+size_t scan_identifier_length(const char *text);
+size_t scan_count_newlines(const char *text, size_t length);
+
+// Name of the instruction set in use
+const char* scan_isa_name(void);
+
+#endif // SCAN_H
@@ -0,0 +1,160 @@
+/**
+ * Compile Server Implementation
+ *
+ * Requests are handled one at a time; a request with several inputs is
+ * still compiled on the driver's thread pool. Socket connections are
+ * served in turn, each one for as many requests as the client sends.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "driver.h"
+
+#define MAX_REQUEST_WORDS 1024
+
+// Result of serving one stream of requests
+typedef enum {
+    SERVE_EOF,           // The client closed its side, or stopped reading replies
+    SERVE_QUIT           // The client asked the server to stop
+} ServeResult;
+
+// Compile one request line and write the framed reply, 0 if the reply could not be written
+static int handle_request(Driver *driver, char *line, FILE *reply) {
+    // Split the request into argv form, argv[0] standing for the program name
+    char *argv[MAX_REQUEST_WORDS + 1];
+    int argc = 0;
+    argv[argc++] = "CComp";
+    for (char *word = strtok(line, " \t\r\n"); word && argc < MAX_REQUEST_WORDS;
+         word = strtok(NULL, " \t\r\n")) {
+        argv[argc++] = word;
+    }
+    argv[argc] = NULL;
+    
+    char *out_text = NULL, *err_text = NULL;
+    size_t out_size = 0, err_size = 0;
+    FILE *out = open_memstream(&out_text, &out_size);
+    FILE *err = open_memstream(&err_text, &err_size);
+    int status = 1;
+    
+    if (out && err) {
+        CompileOptions options;
+        InputList inputs = { NULL, 0, 0 };
+        init_compile_options(&options);
+        if (parse_arguments(argc, argv, &options, &inputs, err)) {
+            status = driver_compile(driver, &options, &inputs, out, err);
+        }
+        free_input_list(&inputs);
+    }
+    if (out) fclose(out);
+    if (err) fclose(err);
+    
+    fprintf(reply, "status %d %zu %zu\n", status, out_size, err_size);
+    if (out_size) fwrite(out_text, 1, out_size, reply);
+    if (err_size) fwrite(err_text, 1, err_size, reply);
+    int written = fflush(reply) == 0 && !ferror(reply);
+    free(out_text);
+    free(err_text);
+    return written;
+}
+
+// Serve every request line of a stream
+static ServeResult serve_stream(Driver *driver, FILE *requests, FILE *reply) {
+    char *line = NULL;
+    size_t capacity = 0;
+    ServeResult result = SERVE_EOF;
+    
+    while (getline(&line, &capacity, requests) != -1) {
+        // Skip blank lines
+        char *text = line + strspn(line, " \t\r\n");
+        if (*text == '\0') continue;
+        
+        if (strncmp(text, "quit", 4) == 0 && text[4 + strspn(text + 4, " \t\r\n")] == '\0') {
+            result = SERVE_QUIT;
+            break;
+        }
+        if (!handle_request(driver, text, reply)) break;
+    }
+    
+    free(line);
+    return result;
+}
+
+// Serve requests from stdin, replies on stdout
+int run_server_stdio(void) {
+    Driver *driver = driver_create();
+    if (!driver) return 1;
+    
+    serve_stream(driver, stdin, stdout);
+    driver_destroy(driver);
+    return 0;
+}
+
+// Serve requests from connections to a Unix socket at path
+int run_server_socket(const char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "chemin de socket trop long : %s\n", path);
+        return 1;
+    }
+    
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return 1;
+    }
+    
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);  // A stale socket from a previous server would make bind fail
+    if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 16) < 0) {
+        perror(path);
+        close(listener);
+        return 1;
+    }
+    
+    // A client that leaves before reading its reply must not kill the server:
+    // the write fails instead, and only that connection ends
+    signal(SIGPIPE, SIG_IGN);
+    
+    Driver *driver = driver_create();
+    int status = driver ? 0 : 1;
+    
+    while (driver) {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            status = 1;
+            break;
+        }
+        
+        // One stream per direction so reads and writes do not share a buffer
+        int write_fd = dup(connection);
+        FILE *requests = fdopen(connection, "r");
+        FILE *reply = write_fd >= 0 ? fdopen(write_fd, "w") : NULL;
+        ServeResult result = SERVE_EOF;
+        if (requests && reply) {
+            result = serve_stream(driver, requests, reply);
+        }
+        if (requests) fclose(requests); else close(connection);
+        if (reply) fclose(reply); else if (write_fd >= 0) close(write_fd);
+        
+        if (result == SERVE_QUIT) break;
+    }
+    
+    driver_destroy(driver);
+    close(listener);
+    unlink(path);
+    return status;
+}
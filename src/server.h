@@ -0,0 +1,24 @@
+/**
+ * Compile Server Header
+ *
+ * Long-running mode answering compile requests over stdin/stdout or a
+ * Unix socket, keeping the interner and the driver arenas warm between
+ * requests.
+ *
+ * Protocol: a request is one line holding a command line (options, inputs
+ * and @response files, separated by blanks). The reply is the line
+ *     status <code> <out bytes> <err bytes>
+ * followed by exactly that many bytes of compiler stdout, then stderr.
+ * The request "quit" stops the server.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+// Serve requests from stdin, replies on stdout
+int run_server_stdio(void);
+
+// Serve requests from connections to a Unix socket at path
+int run_server_socket(const char *path);
+
+#endif // SERVER_H
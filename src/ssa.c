@@ -0,0 +1,644 @@
+/**
+ * SSA Form Implementation
+ *
+ * Construction follows Cytron et al.: dominators by the iterative
+ * algorithm of Cooper, Harvey and Kennedy, phis at the iterated dominance
+ * frontier of each register's definitions, pruned to where the register
+ * is live, then renaming along the dominator tree. Destruction gives each
+ * phi a fresh register that every predecessor sets last thing before
+ * leaving, which sidesteps both the lost-copy and the swap problem
+ * without splitting critical edges.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ssa.h"
+
+// Phi being placed, before it becomes an instruction
+typedef struct {
+    int vreg;            // Register it merges
+    int dst;             // New name, set while renaming
+    int args;            // Index of its arguments in the function's args
+    int next;            // Next phi of the same block, -1 for none
+} Phi;
+
+// State of one construction
+typedef struct {
+    IRFunction *function;
+    IRCfg cfg;
+    IRLiveness liveness;
+    int num_blocks;
+    int *number;         // Reverse postorder number of each block, -1 if unreachable
+    int *rpo;            // Reachable blocks in reverse postorder
+    int num_reachable;
+    int *idom;           // Immediate dominator, the entry being its own
+    int *phi_head;       // First phi of each block
+    Phi *phis;
+    int num_phis;
+    int phis_capacity;
+    int num_vregs;       // Registers before renaming
+    int *current;        // Name each original register has at this point of the walk
+    int *kept;           // Whether the original name went to a definition already
+    int *log;            // (register, previous name) pairs undone on leaving a block
+    int log_length;
+    int log_capacity;
+    int undefined;       // Register read where nothing is defined, IR_NONE until needed
+    int failed;
+} Builder;
+
+// Number the reachable blocks in reverse postorder with an explicit stack
+static int number_blocks(Builder *sb) {
+    int n = sb->num_blocks;
+    int *stack = (int*)malloc(n * sizeof(int));
+    int *next_succ = (int*)calloc(n, sizeof(int));
+    int *postorder = (int*)malloc(n * sizeof(int));
+    if (!stack || !next_succ || !postorder) {
+        free(stack);
+        free(next_succ);
+        free(postorder);
+        return 0;
+    }
+
+    for (int b = 0; b < n; b++) sb->number[b] = -1;
+    int depth = 0;
+    int count = 0;
+    stack[depth++] = 0;
+    sb->number[0] = 0;
+    while (depth > 0) {
+        int b = stack[depth - 1];
+        if (next_succ[b] < 2) {
+            int succ = sb->cfg.blocks[b].succ[next_succ[b]++];
+            if (succ >= 0 && sb->number[succ] < 0) {
+                sb->number[succ] = 0;
+                stack[depth++] = succ;
+            }
+            continue;
+        }
+        postorder[count++] = b;
+        depth--;
+    }
+
+    for (int i = 0; i < count; i++) {
+        sb->rpo[i] = postorder[count - 1 - i];
+        sb->number[sb->rpo[i]] = i;
+    }
+    sb->num_reachable = count;
+    free(stack);
+    free(next_succ);
+    free(postorder);
+    return 1;
+}
+
+// Closest common dominator of two processed blocks
+static int intersect(const Builder *sb, int a, int b) {
+    while (a != b) {
+        while (sb->number[a] > sb->number[b]) a = sb->idom[a];
+        while (sb->number[b] > sb->number[a]) b = sb->idom[b];
+    }
+    return a;
+}
+
+// Solve immediate dominators over the reachable blocks
+static void compute_dominators(Builder *sb) {
+    for (int b = 0; b < sb->num_blocks; b++) sb->idom[b] = -1;
+    sb->idom[0] = 0;
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int k = 1; k < sb->num_reachable; k++) {
+            int b = sb->rpo[k];
+            const IRBlock *block = &sb->cfg.blocks[b];
+            int dominator = -1;
+            for (int p = 0; p < block->num_preds; p++) {
+                int pred = block->preds[p];
+                if (sb->idom[pred] < 0) continue;
+                dominator = dominator < 0 ? pred : intersect(sb, pred, dominator);
+            }
+            if (sb->idom[b] != dominator) {
+                sb->idom[b] = dominator;
+                changed = 1;
+            }
+        }
+    }
+}
+
+// Reachable predecessors of a block
+static int reachable_preds(const Builder *sb, int b) {
+    int count = 0;
+    const IRBlock *block = &sb->cfg.blocks[b];
+    for (int p = 0; p < block->num_preds; p++) {
+        if (sb->number[block->preds[p]] >= 0) count++;
+    }
+    return count;
+}
+
+// Position of pred among the reachable predecessors of b
+static int pred_index(const Builder *sb, int b, int pred) {
+    int index = 0;
+    const IRBlock *block = &sb->cfg.blocks[b];
+    for (int p = 0; p < block->num_preds; p++) {
+        if (block->preds[p] == pred) return index;
+        if (sb->number[block->preds[p]] >= 0) index++;
+    }
+    return -1;
+}
+
+// Place a phi for vreg at the start of block b
+static int add_phi(Builder *sb, int b, int vreg) {
+    if (sb->num_phis == sb->phis_capacity) {
+        int capacity = sb->phis_capacity ? sb->phis_capacity * 2 : 64;
+        Phi *phis = (Phi*)realloc(sb->phis, capacity * sizeof(Phi));
+        if (!phis) return 0;
+        sb->phis = phis;
+        sb->phis_capacity = capacity;
+    }
+
+    int count = reachable_preds(sb, b);
+    int32_t none = IR_NONE;
+    int args = sb->function->num_args;
+    for (int j = 0; j < count; j++) ir_add_call_args(sb->function, &none, 1);
+    if (sb->function->failed) return 0;
+
+    Phi *phi = &sb->phis[sb->num_phis];
+    phi->vreg = vreg;
+    phi->dst = IR_NONE;
+    phi->args = args;
+    phi->next = sb->phi_head[b];
+    sb->phi_head[b] = sb->num_phis++;
+    return 1;
+}
+
+// Place the phis of every register at its iterated dominance frontier
+static int place_phis(Builder *sb) {
+    int n = sb->num_blocks;
+    const IRFunction *f = sb->function;
+
+    // Dominance frontiers as linked lists
+    int df_capacity = 2 * n;
+    int *df_head = (int*)malloc(n * sizeof(int));
+    int *df_next = (int*)malloc(df_capacity * sizeof(int));
+    int *df_block = (int*)malloc(df_capacity * sizeof(int));
+    int *stamp = (int*)malloc(n * sizeof(int));
+    int *has_phi = (int*)malloc(n * sizeof(int));
+    int *queued = (int*)malloc(n * sizeof(int));
+    int *work = (int*)malloc(n * sizeof(int));
+    int *def_head = (int*)malloc((sb->num_vregs ? sb->num_vregs : 1) * sizeof(int));
+    int *def_next = (int*)malloc((f->num_insns ? f->num_insns : 1) * sizeof(int));
+    int *def_block = (int*)malloc((f->num_insns ? f->num_insns : 1) * sizeof(int));
+    int ok = df_head && df_next && df_block && stamp && has_phi && queued && work &&
+             def_head && def_next && def_block;
+
+    int num_df = 0;
+    for (int b = 0; ok && b < n; b++) {
+        df_head[b] = -1;
+        stamp[b] = -1;
+        has_phi[b] = -1;
+        queued[b] = -1;
+    }
+    for (int b = 0; ok && b < n; b++) {
+        if (sb->number[b] < 0 || reachable_preds(sb, b) < 2) continue;
+        const IRBlock *block = &sb->cfg.blocks[b];
+        for (int p = 0; p < block->num_preds; p++) {
+            int runner = block->preds[p];
+            if (sb->number[runner] < 0) continue;
+            // Each (runner, b) pair is recorded once, and so are its dominators
+            while (ok && runner != sb->idom[b] && stamp[runner] != b) {
+                if (num_df == df_capacity) {
+                    df_capacity *= 2;
+                    int *next = (int*)realloc(df_next, df_capacity * sizeof(int));
+                    if (next) df_next = next;
+                    int *blocks = (int*)realloc(df_block, df_capacity * sizeof(int));
+                    if (blocks) df_block = blocks;
+                    ok = next && blocks;
+                    if (!ok) break;
+                }
+                stamp[runner] = b;
+                df_block[num_df] = b;
+                df_next[num_df] = df_head[runner];
+                df_head[runner] = num_df++;
+                runner = sb->idom[runner];
+            }
+        }
+    }
+
+    // Blocks defining each register, each block listed once per register
+    int num_defs = 0;
+    for (int v = 0; ok && v < sb->num_vregs; v++) def_head[v] = -1;
+    for (int b = 0; ok && b < n; b++) {
+        if (sb->number[b] < 0) continue;
+        for (int i = sb->cfg.blocks[b].first; i <= sb->cfg.blocks[b].last; i++) {
+            int dst = f->insns[i].dst;
+            if (dst == IR_NONE || (def_head[dst] >= 0 && def_block[def_head[dst]] == b)) continue;
+            def_block[num_defs] = b;
+            def_next[num_defs] = def_head[dst];
+            def_head[dst] = num_defs++;
+        }
+    }
+
+    for (int v = 0; ok && v < sb->num_vregs; v++) {
+        int count = 0;
+        for (int d = def_head[v]; d >= 0; d = def_next[d]) {
+            queued[def_block[d]] = v;
+            work[count++] = def_block[d];
+        }
+        while (ok && count > 0) {
+            int x = work[--count];
+            for (int e = df_head[x]; e >= 0; e = df_next[e]) {
+                int y = df_block[e];
+                if (has_phi[y] == v) continue;
+                // Pruned: no phi where the register is dead
+                if (!IR_LIVE(sb->liveness.live_in + (size_t)y * sb->liveness.words, v)) continue;
+                has_phi[y] = v;
+                if (!add_phi(sb, y, v)) {
+                    ok = 0;
+                    break;
+                }
+                if (queued[y] != v) {
+                    queued[y] = v;
+                    work[count++] = y;
+                }
+            }
+        }
+    }
+
+    free(df_head);
+    free(df_next);
+    free(df_block);
+    free(stamp);
+    free(has_phi);
+    free(queued);
+    free(work);
+    free(def_head);
+    free(def_next);
+    free(def_block);
+    return ok;
+}
+
+// Name a new definition of an original register
+static int name_definition(Builder *sb, int vreg) {
+    if (sb->log_length + 2 > sb->log_capacity) {
+        int capacity = sb->log_capacity ? sb->log_capacity * 2 : 256;
+        int *log = (int*)realloc(sb->log, capacity * sizeof(int));
+        if (!log) {
+            sb->failed = 1;
+            return vreg;
+        }
+        sb->log = log;
+        sb->log_capacity = capacity;
+    }
+    sb->log[sb->log_length++] = vreg;
+    sb->log[sb->log_length++] = sb->current[vreg];
+
+    // The first definition keeps the original number
+    int name = vreg;
+    if (sb->kept[vreg]) name = ir_new_vreg(sb->function);
+    sb->kept[vreg] = 1;
+    sb->current[vreg] = name;
+    return name;
+}
+
+// Name a read of an original register
+static int name_use(Builder *sb, int vreg) {
+    if (sb->current[vreg] != IR_NONE) return sb->current[vreg];
+    if (sb->undefined == IR_NONE) sb->undefined = ir_new_vreg(sb->function);
+    return sb->undefined;
+}
+
+// Rename the definitions and uses of one block, and its successors' phi arguments
+static void rename_block(Builder *sb, int b) {
+    IRFunction *f = sb->function;
+    const IRBlock *block = &sb->cfg.blocks[b];
+
+    for (int p = sb->phi_head[b]; p >= 0; p = sb->phis[p].next) {
+        sb->phis[p].dst = name_definition(sb, sb->phis[p].vreg);
+    }
+    for (int i = block->first; i <= block->last; i++) {
+        IRInsn *insn = &f->insns[i];
+        int reads = ir_reads(insn);
+        if (reads & IR_READS_A) insn->a = name_use(sb, insn->a);
+        if (reads & IR_READS_B) insn->b = name_use(sb, insn->b);
+        if (insn->op == IR_CALL) {
+            for (int j = 0; j < insn->imm; j++) f->args[insn->a + j] = name_use(sb, f->args[insn->a + j]);
+        }
+        if (insn->dst != IR_NONE) insn->dst = name_definition(sb, insn->dst);
+    }
+    for (int s = 0; s < 2; s++) {
+        int succ = block->succ[s];
+        if (succ < 0) continue;
+        int j = pred_index(sb, succ, b);
+        for (int p = sb->phi_head[succ]; p >= 0; p = sb->phis[p].next) {
+            f->args[sb->phis[p].args + j] = name_use(sb, sb->phis[p].vreg);
+        }
+    }
+}
+
+// Walk the dominator tree with an explicit stack, renaming on the way down
+static int rename_registers(Builder *sb) {
+    int n = sb->num_blocks;
+    int *child_head = (int*)malloc(n * sizeof(int));
+    int *child_next = (int*)malloc(n * sizeof(int));
+    int *stack = (int*)malloc(2 * n * sizeof(int));
+    int *marks = (int*)malloc(2 * n * sizeof(int));
+    if (!child_head || !child_next || !stack || !marks) {
+        free(child_head);
+        free(child_next);
+        free(stack);
+        free(marks);
+        return 0;
+    }
+
+    for (int b = 0; b < n; b++) child_head[b] = -1;
+    for (int k = sb->num_reachable - 1; k > 0; k--) {
+        int b = sb->rpo[k];
+        child_next[b] = child_head[sb->idom[b]];
+        child_head[sb->idom[b]] = b;
+    }
+
+    // A mark of -1 enters a block, any other one leaves it and undoes its names
+    int depth = 0;
+    stack[depth] = 0;
+    marks[depth++] = -1;
+    while (depth > 0 && !sb->failed) {
+        depth--;
+        int b = stack[depth];
+        int mark = marks[depth];
+        if (mark >= 0) {
+            while (sb->log_length > mark) {
+                sb->log_length -= 2;
+                sb->current[sb->log[sb->log_length]] = sb->log[sb->log_length + 1];
+            }
+            continue;
+        }
+        stack[depth] = b;
+        marks[depth++] = sb->log_length;
+        rename_block(sb, b);
+        for (int c = child_head[b]; c >= 0; c = child_next[c]) {
+            stack[depth] = c;
+            marks[depth++] = -1;
+        }
+    }
+
+    free(child_head);
+    free(child_next);
+    free(stack);
+    free(marks);
+    return !sb->failed && !sb->function->failed;
+}
+
+// Lay the reachable blocks out again with their phis
+static int rebuild(Builder *sb) {
+    IRFunction *f = sb->function;
+    int count = sb->num_phis + 1;
+    for (int k = 0; k < sb->num_reachable; k++) {
+        const IRBlock *block = &sb->cfg.blocks[sb->rpo[k]];
+        count += block->last - block->first + 1;
+    }
+    IRInsn *insns = (IRInsn*)malloc(count * sizeof(IRInsn));
+    if (!insns) return 0;
+
+    int length = 0;
+    for (int b = 0; b < sb->num_blocks; b++) {
+        if (sb->number[b] < 0) continue;
+        const IRBlock *block = &sb->cfg.blocks[b];
+        int i = block->first;
+        if (b == 0) {
+            // Parameters stay first; a read with no definition becomes 0
+            while (i <= block->last && f->insns[i].op == IR_PARAM) insns[length++] = f->insns[i++];
+            if (sb->undefined != IR_NONE) {
+                IRInsn *insn = &insns[length++];
+                memset(insn, 0, sizeof(IRInsn));
+                insn->op = IR_CONST;
+                insn->dst = sb->undefined;
+                insn->a = IR_NONE;
+                insn->b = IR_NONE;
+            }
+        } else if (f->insns[i].op == IR_LABEL) {
+            insns[length++] = f->insns[i++];
+        }
+        for (int p = sb->phi_head[b]; p >= 0; p = sb->phis[p].next) {
+            IRInsn *insn = &insns[length++];
+            memset(insn, 0, sizeof(IRInsn));
+            insn->op = IR_PHI;
+            insn->dst = sb->phis[p].dst;
+            insn->a = sb->phis[p].args;
+            insn->b = IR_NONE;
+            insn->imm = reachable_preds(sb, b);
+        }
+        while (i <= block->last) insns[length++] = f->insns[i++];
+    }
+
+    free(f->insns);
+    f->insns = insns;
+    f->num_insns = length;
+    f->capacity = count;
+    return 1;
+}
+
+// Free the state of a construction
+static void free_builder(Builder *sb) {
+    ir_free_liveness(&sb->liveness);
+    ir_free_cfg(&sb->cfg);
+    free(sb->number);
+    free(sb->rpo);
+    free(sb->idom);
+    free(sb->phi_head);
+    free(sb->phis);
+    free(sb->current);
+    free(sb->kept);
+    free(sb->log);
+}
+
+// Rename a function into pruned SSA form
+int ssa_construct(IRFunction *function) {
+    if (function->in_ssa) return 1;
+    if (function->num_insns == 0 || function->failed) return 0;
+
+    Builder sb;
+    memset(&sb, 0, sizeof(sb));
+    sb.function = function;
+    sb.num_vregs = function->num_vregs;
+    sb.undefined = IR_NONE;
+    if (!ir_build_cfg(function, &sb.cfg)) return 0;
+    // Parameters are defined on entry, so nothing may branch back to it
+    if (sb.cfg.blocks[0].num_preds > 0 || !ir_compute_liveness(function, &sb.cfg, &sb.liveness)) {
+        ir_free_cfg(&sb.cfg);
+        return 0;
+    }
+
+    int n = sb.num_blocks = sb.cfg.num_blocks;
+    int vregs = sb.num_vregs ? sb.num_vregs : 1;
+    sb.number = (int*)malloc(n * sizeof(int));
+    sb.rpo = (int*)malloc(n * sizeof(int));
+    sb.idom = (int*)malloc(n * sizeof(int));
+    sb.phi_head = (int*)malloc(n * sizeof(int));
+    sb.current = (int*)malloc(vregs * sizeof(int));
+    sb.kept = (int*)calloc(vregs, sizeof(int));
+    int ok = sb.number && sb.rpo && sb.idom && sb.phi_head && sb.current && sb.kept;
+    if (ok) {
+        for (int b = 0; b < n; b++) sb.phi_head[b] = -1;
+        for (int v = 0; v < sb.num_vregs; v++) sb.current[v] = IR_NONE;
+        ok = number_blocks(&sb);
+    }
+    if (ok) {
+        compute_dominators(&sb);
+        ok = place_phis(&sb);
+    }
+
+    // Renaming rewrites the instructions in place; past this point a
+    // failure leaves the function unusable
+    if (ok && !rename_registers(&sb)) function->failed = 1;
+    if (ok && !function->failed && !rebuild(&sb)) function->failed = 1;
+    if (ok && !function->failed) function->in_ssa = 1;
+
+    free_builder(&sb);
+    return ok && !function->failed;
+}
+
+// Final source of a register through chains of copies
+static int resolve_copy(int *source, int vreg) {
+    int root = vreg;
+    while (source[root] != root) root = source[root];
+    while (source[vreg] != root) {
+        int next = source[vreg];
+        source[vreg] = root;
+        vreg = next;
+    }
+    return root;
+}
+
+// Replace the uses of every copy by its source and drop the copies
+void ssa_propagate_copies(IRFunction *function) {
+    if (!function->in_ssa) return;
+    IRCfg cfg;
+    if (!ir_build_cfg(function, &cfg)) return;
+    int *source = (int*)malloc((function->num_vregs ? function->num_vregs : 1) * sizeof(int));
+    char *keep = (char*)calloc(function->num_insns ? function->num_insns : 1, 1);
+    if (!source || !keep) {
+        free(source);
+        free(keep);
+        ir_free_cfg(&cfg);
+        return;
+    }
+
+    // With one definition per register a copy is an alias everywhere
+    for (int v = 0; v < function->num_vregs; v++) source[v] = v;
+    for (int i = 0; i < function->num_insns; i++) {
+        const IRInsn *insn = &function->insns[i];
+        if (insn->op == IR_COPY) source[insn->dst] = insn->a;
+    }
+
+    // A block with no label and only copies would vanish, merging two
+    // edges the phis count apart; one dead copy keeps it
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        int only_copies = 1;
+        for (int i = cfg.blocks[b].first; i <= cfg.blocks[b].last; i++) {
+            if (function->insns[i].op != IR_COPY) only_copies = 0;
+        }
+        if (only_copies) keep[cfg.blocks[b].last] = 1;
+    }
+
+    int length = 0;
+    for (int i = 0; i < function->num_insns; i++) {
+        IRInsn *insn = &function->insns[i];
+        if (insn->op == IR_COPY && !keep[i]) continue;
+        int reads = ir_reads(insn);
+        if (reads & IR_READS_A) insn->a = resolve_copy(source, insn->a);
+        if (reads & IR_READS_B) insn->b = resolve_copy(source, insn->b);
+        if (insn->op == IR_CALL || insn->op == IR_PHI) {
+            for (int j = 0; j < insn->imm; j++) {
+                function->args[insn->a + j] = resolve_copy(source, function->args[insn->a + j]);
+            }
+        }
+        function->insns[length++] = *insn;
+    }
+    function->num_insns = length;
+    free(source);
+    free(keep);
+    ir_free_cfg(&cfg);
+}
+
+// Append a copy to an instruction array sized by the caller
+static void append_copy(IRInsn *insns, int *length, int dst, int src) {
+    IRInsn *insn = &insns[(*length)++];
+    memset(insn, 0, sizeof(IRInsn));
+    insn->op = IR_COPY;
+    insn->dst = dst;
+    insn->a = src;
+    insn->b = IR_NONE;
+}
+
+// Copies a predecessor makes for the phis of one successor
+static void append_edge_copies(const IRFunction *function, const IRCfg *cfg, const int *temp,
+                               int pred, int succ, IRInsn *insns, int *length) {
+    const IRBlock *block = &cfg->blocks[succ];
+    int j = 0;
+    while (j < block->num_preds && block->preds[j] != pred) j++;
+    for (int i = block->first; i <= block->last; i++) {
+        const IRInsn *insn = &function->insns[i];
+        if (insn->op == IR_LABEL) continue;
+        if (insn->op != IR_PHI) break;
+        append_copy(insns, length, temp[i], function->args[insn->a + j]);
+    }
+}
+
+// Turn the phis back into copies
+int ssa_destruct(IRFunction *function) {
+    if (!function->in_ssa) return 1;
+
+    IRCfg cfg;
+    if (!ir_build_cfg(function, &cfg)) return 0;
+
+    // Each phi gets a register of its own: one copy into it per
+    // predecessor, and one out of it where the phi was
+    int count = function->num_insns;
+    int *temp = (int*)malloc((function->num_insns ? function->num_insns : 1) * sizeof(int));
+    if (!temp) {
+        ir_free_cfg(&cfg);
+        return 0;
+    }
+    for (int i = 0; i < function->num_insns; i++) {
+        temp[i] = IR_NONE;
+        if (function->insns[i].op != IR_PHI) continue;
+        temp[i] = ir_new_vreg(function);
+        count += function->insns[i].imm;
+    }
+    IRInsn *insns = (IRInsn*)malloc((count ? count : 1) * sizeof(IRInsn));
+    if (!insns) {
+        free(temp);
+        ir_free_cfg(&cfg);
+        return 0;
+    }
+
+    int length = 0;
+    for (int b = 0; b < cfg.num_blocks; b++) {
+        const IRBlock *block = &cfg.blocks[b];
+        for (int i = block->first; i <= block->last; i++) {
+            const IRInsn *insn = &function->insns[i];
+            // Temporaries are only read at the phis, so the copies may go
+            // before the branch that leaves the block
+            IROp op = (IROp)insn->op;
+            if (i == block->last && (op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN)) {
+                for (int s = 0; s < 2; s++) {
+                    if (block->succ[s] >= 0) append_edge_copies(function, &cfg, temp, b, block->succ[s], insns, &length);
+                }
+            }
+            if (op == IR_PHI) append_copy(insns, &length, insn->dst, temp[i]);
+            else insns[length++] = *insn;
+        }
+        IROp last = (IROp)function->insns[block->last].op;
+        if (last != IR_JUMP && last != IR_BRANCH && last != IR_RETURN && block->succ[0] >= 0) {
+            append_edge_copies(function, &cfg, temp, b, block->succ[0], insns, &length);
+        }
+    }
+
+    free(function->insns);
+    function->insns = insns;
+    function->num_insns = length;
+    function->capacity = count;
+    function->in_ssa = 0;
+    free(temp);
+    ir_free_cfg(&cfg);
+    return 1;
+}
@@ -0,0 +1,24 @@
+/**
+ * SSA Form Header
+ *
+ * Conversion of IR functions (ir.h) to static single assignment form and
+ * back. In SSA form every virtual register has exactly one definition and
+ * joins go through IR_PHI, which is what the IR passes build on.
+ */
+
+#ifndef SSA_H
+#define SSA_H
+
+#include "ir.h"
+
+// Rename a function into pruned SSA form, dropping unreachable blocks;
+// returns 0 (the function left as it was) when it cannot be converted
+int ssa_construct(IRFunction *function);
+
+// Replace the uses of every copy by its source and drop the copies
+void ssa_propagate_copies(IRFunction *function);
+
+// Turn the phis back into copies, returns 0 on allocation failure
+int ssa_destruct(IRFunction *function);
+
+#endif // SSA_H
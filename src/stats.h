@@ -0,0 +1,55 @@
+/**
+ * Compilation Statistics Header
+ *
+ * Per-phase wall/CPU timers and counters reported by -ftime-report.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Compilation phases
+typedef enum {
+    PHASE_READ,
+    PHASE_LEX,
+    PHASE_PREPROCESS,
+    PHASE_PARSE,
+    PHASE_DUMP,
+    PHASE_CODEGEN,
+    PHASE_COUNT
+} CompilePhase;
+
+// Accumulated time of one phase, in seconds
+typedef struct {
+    double wall;
+    double cpu;
+} PhaseTime;
+
+// Statistics of one compilation
+typedef struct {
+    PhaseTime phases[PHASE_COUNT];
+    unsigned long tokens;         // Tokens handed to the parser
+    unsigned long bytes_scanned;  // Source bytes read
+    unsigned long buffer_reads;   // read calls needed to load the source
+    unsigned long ast_nodes;      // Nodes in the final AST
+    unsigned long cache_hits;     // Units loaded from the AST cache
+    size_t peak_bytes;            // Peak bytes held by source, AST arena and interner
+} CompileStats;
+
+// Running timer
+typedef struct {
+    double wall;
+    double cpu;
+} StatsTimer;
+
+// Statistics functions
+void init_stats(CompileStats *stats);
+StatsTimer stats_timer_start(void);
+void stats_timer_stop(CompileStats *stats, CompilePhase phase, StatsTimer timer);
+double stats_wall_clock(void);
+void stats_add_wall(CompileStats *stats, CompilePhase phase, double seconds);
+void stats_report(const CompileStats *stats, FILE *out);
+
+#endif // STATS_H
@@ -0,0 +1,117 @@
+/**
+ * Symbol Table Implementation
+ *
+ * Keys are never removed from the hash table: a name that goes out of
+ * scope keeps its slot with no binding, so probe sequences stay intact
+ * and redeclaring it, which is common for loop counters and the like,
+ * finds the slot again. The slots are only compacted when they grow.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symtab.h"
+
+// Slot of a key, or the free slot where it would go
+static int find_slot(const SymbolTable *table, const char *name) {
+    unsigned mask = (unsigned)table->keys_capacity - 1;
+    unsigned slot = (unsigned)(((uintptr_t)name >> 3) * 2654435761u) & mask;
+    while (table->keys[slot] && table->keys[slot] != name) slot = (slot + 1) & mask;
+    return (int)slot;
+}
+
+// Rebuild the hash table with room for more keys, 0 on allocation failure
+static int grow_keys(SymbolTable *table) {
+    int capacity = table->keys_capacity ? table->keys_capacity * 2 : 64;
+    const char **old_keys = table->keys;
+    int *old_bindings = table->bindings;
+    int old_capacity = table->keys_capacity;
+
+    table->keys = (const char**)calloc(capacity, sizeof(const char*));
+    table->bindings = (int*)malloc(capacity * sizeof(int));
+    if (!table->keys || !table->bindings) {
+        free(table->keys);
+        free(table->bindings);
+        table->keys = old_keys;
+        table->bindings = old_bindings;
+        return 0;
+    }
+    table->keys_capacity = capacity;
+    table->num_keys = 0;
+
+    // Names without a binding are dropped on the way
+    for (int i = 0; i < old_capacity; i++) {
+        if (!old_keys[i] || old_bindings[i] < 0) continue;
+        int slot = find_slot(table, old_keys[i]);
+        table->keys[slot] = old_keys[i];
+        table->bindings[slot] = old_bindings[i];
+        table->num_keys++;
+    }
+    free(old_keys);
+    free(old_bindings);
+    return 1;
+}
+
+// Initialize an empty table
+void symtab_init(SymbolTable *table) {
+    memset(table, 0, sizeof(SymbolTable));
+}
+
+// Free the arrays of a table
+void symtab_free(SymbolTable *table) {
+    free(table->symbols);
+    free(table->keys);
+    free(table->bindings);
+    symtab_init(table);
+}
+
+// Declare a name in the innermost scope
+Symbol* symtab_declare(SymbolTable *table, const char *name, SymbolKind kind) {
+    if (table->num_symbols == table->symbols_capacity) {
+        int capacity = table->symbols_capacity ? table->symbols_capacity * 2 : 64;
+        Symbol *symbols = (Symbol*)realloc(table->symbols, capacity * sizeof(Symbol));
+        if (!symbols) return NULL;
+        table->symbols = symbols;
+        table->symbols_capacity = capacity;
+    }
+    // Keep the load factor at or below one half
+    if (2 * (table->num_keys + 1) > table->keys_capacity && !grow_keys(table)) return NULL;
+
+    int slot = find_slot(table, name);
+    if (!table->keys[slot]) {
+        table->keys[slot] = name;
+        table->bindings[slot] = -1;
+        table->num_keys++;
+    }
+
+    int index = table->num_symbols++;
+    Symbol *symbol = &table->symbols[index];
+    memset(symbol, 0, sizeof(Symbol));
+    symbol->name = name;
+    symbol->kind = kind;
+    symbol->shadowed = table->bindings[slot];
+    table->bindings[slot] = index;
+    return symbol;
+}
+
+// Innermost declaration of a name
+Symbol* symtab_lookup(const SymbolTable *table, const char *name) {
+    if (table->keys_capacity == 0) return NULL;
+    int slot = find_slot(table, name);
+    if (!table->keys[slot] || table->bindings[slot] < 0) return NULL;
+    return &table->symbols[table->bindings[slot]];
+}
+
+// Open a scope
+int symtab_open_scope(const SymbolTable *table) {
+    return table->num_symbols;
+}
+
+// Close every scope opened since a mark
+void symtab_close_scope(SymbolTable *table, int mark) {
+    while (table->num_symbols > mark) {
+        Symbol *symbol = &table->symbols[--table->num_symbols];
+        table->bindings[find_slot(table, symbol->name)] = symbol->shadowed;
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * Symbol Table Header
+ *
+ * Scoped table of the names visible at a point of a translation unit.
+ * Symbols live on one stack, and a single open-addressing hash table
+ * keyed by the interned name maps each name to its innermost binding.
+ * Opening a scope only records a mark; releasing it pops the symbols
+ * declared since and brings back the bindings they hid.
+ */
+
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "ast.h"
+
+// Kind of a named entity
+typedef enum {
+    SYM_LOCAL,
+    SYM_GLOBAL,
+    SYM_FUNCTION
+} SymbolKind;
+
+// Named entity
+typedef struct {
+    const char *name;    // Interned, compared by pointer
+    SymbolKind kind;
+    DataType type;
+    int is_array;        // Array object, its name stands for its address
+    int is_pointer;      // Array parameter, holds the address of the array
+    int vreg;            // Register of a scalar local or array parameter
+    int offset;          // Array area offset of a local array
+    int is_defined;      // Function whose body was seen
+    int shadowed;        // Binding this one hides, -1 if none
+} Symbol;
+
+// Scope stack and name index
+typedef struct {
+    Symbol *symbols;       // Outermost scope first
+    int num_symbols;
+    int symbols_capacity;
+    const char **keys;     // Hash slots, NULL when free
+    int *bindings;         // Innermost symbol of each key, -1 once out of scope
+    int num_keys;
+    int keys_capacity;     // Power of two
+} SymbolTable;
+
+// Initialize an empty table
+void symtab_init(SymbolTable *table);
+
+// Free the arrays of a table
+void symtab_free(SymbolTable *table);
+
+// Declare a name in the innermost scope, NULL on allocation failure;
+// the pointer stays valid until the next declaration
+Symbol* symtab_declare(SymbolTable *table, const char *name, SymbolKind kind);
+
+// Innermost declaration of an interned name, NULL if there is none
+Symbol* symtab_lookup(const SymbolTable *table, const char *name);
+
+// Open a scope, returns the mark that releases it
+int symtab_open_scope(const SymbolTable *table);
+
+// Close every scope opened since a mark
+void symtab_close_scope(SymbolTable *table, int mark);
+
+#endif // SYMTAB_H
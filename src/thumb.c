@@ -0,0 +1,442 @@
+/**
+ * Thumb-2 Encoder Implementation
+ *
+ * An instruction takes its 16-bit encoding only when one has exactly the
+ * effect of the unified syntax the assembly writer prints, flags
+ * included: outside IT blocks most 16-bit arithmetic sets the flags, so
+ * those stay 32-bit while moves, loads and stores, compares and stack
+ * lists shrink. Branches always use the long forms, so no size depends
+ * on a label offset and one pass places every label.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "thumb.h"
+
+// Range of the conditional branch, and of the unconditional one
+#define B_COND_RANGE (1 << 20)
+#define B_RANGE (1 << 24)
+
+// Farthest cbz/cbnz target, past the instruction after it
+#define CBZ_RANGE 126
+
+// Shift types of the shift encodings
+#define SHIFT_LSL 0
+#define SHIFT_LSR 1
+#define SHIFT_ASR 2
+
+// Encoder state of one function
+typedef struct {
+    ThumbCode *code;
+    const ArmFunction *function;
+    uint32_t *label_offsets;   // From the start of the function
+    uint32_t offset;           // Of the instruction being encoded
+} Encoder;
+
+// Initialize an empty code buffer
+void thumb_code_init(ThumbCode *code) {
+    memset(code, 0, sizeof(ThumbCode));
+}
+
+// Free the arrays of a code buffer
+void thumb_code_free(ThumbCode *code) {
+    free(code->bytes);
+    free(code->relocs);
+    thumb_code_init(code);
+}
+
+// Encoding of the op field of data processing instructions, -1 if none
+static int data_opcode(ArmOp op) {
+    switch (op) {
+        case ARM_AND: return 0;
+        case ARM_ORR: return 2;
+        case ARM_EOR: return 4;
+        case ARM_ADD: return 8;
+        case ARM_SUB: return 13;
+        case ARM_RSB: return 14;
+        default: return -1;
+    }
+}
+
+// Shift type of a shift operation
+static int shift_type(ArmOp op) {
+    return op == ARM_LSL ? SHIFT_LSL : op == ARM_LSR ? SHIFT_LSR : SHIFT_ASR;
+}
+
+// i:imm3:imm8 field of a modified immediate, -1 if the value has none
+static int modified_imm(uint32_t value) {
+    uint32_t low = value & 0xff;
+    uint32_t second = (value >> 8) & 0xff;
+    if (value <= 0xff) return (int)value;
+    if (value == (low | low << 16)) return (int)(0x100 | low);
+    if (value == (second << 8 | second << 24)) return (int)(0x200 | second);
+    if (value == low * 0x01010101u) return (int)(0x300 | low);
+    // An 8-bit value with its top bit set, rotated right by 8 to 31
+    for (int rotation = 8; rotation < 32; rotation++) {
+        uint32_t unrotated = value << rotation | value >> (32 - rotation);
+        if ((unrotated & ~0x7fu) == 0x80) return (int)((uint32_t)rotation << 7 | (unrotated & 0x7f));
+    }
+    return -1;
+}
+
+// Check whether a register is one of r0-r7
+static int is_low(int reg) {
+    return reg < 8;
+}
+
+// 16-bit encoding of an instruction that has one with the same effect,
+// flags included, -1 if it takes a 32-bit one
+static int32_t short_encoding(const ArmInsn *insn) {
+    uint32_t mask = (uint32_t)insn->imm;
+    uint32_t imm = (uint32_t)insn->imm;
+    int word = insn->op == ARM_LDR || insn->op == ARM_STR;
+    int low = is_low(insn->rd) && is_low(insn->rn) && (insn->form == ARM_OPERAND_IMM || is_low(insn->rm));
+
+    switch ((ArmOp)insn->op) {
+        case ARM_MOV:
+            // Unlike the other 16-bit moves, this one sets no flags and takes any register
+            if (insn->form != ARM_OPERAND_REG) return -1;
+            return (int32_t)(0x4600 | (uint32_t)(insn->rd >> 3) << 7 | (uint32_t)insn->rm << 3 | (insn->rd & 7));
+        case ARM_PUSH:
+            if ((mask & ~0x40ffu) != 0) return -1;
+            return (int32_t)(0xb400 | ((mask >> ARM_LR) & 1) << 8 | (mask & 0xff));
+        case ARM_POP:
+            if ((mask & ~0x80ffu) != 0) return -1;
+            return (int32_t)(0xbc00 | ((mask >> ARM_PC) & 1) << 8 | (mask & 0xff));
+        case ARM_CMP:
+            if (insn->form == ARM_OPERAND_IMM) {
+                return is_low(insn->rn) && imm <= 0xff ? (int32_t)(0x2800 | (uint32_t)insn->rn << 8 | imm) : -1;
+            }
+            if (is_low(insn->rn) && is_low(insn->rm)) return (int32_t)(0x4280 | (uint32_t)insn->rm << 3 | insn->rn);
+            if (insn->rn == ARM_PC || insn->rm == ARM_PC) return -1;
+            return (int32_t)(0x4500 | (uint32_t)(insn->rn >> 3) << 7 | (uint32_t)insn->rm << 3 | (insn->rn & 7));
+        case ARM_ADD:
+        case ARM_SUB:
+            if (insn->form == ARM_OPERAND_IMM) {
+                // add/sub sp, sp, #imm
+                if (insn->rd != ARM_SP || insn->rn != ARM_SP || imm > 508 || imm % 4 != 0) return -1;
+                return (int32_t)((insn->op == ARM_ADD ? 0xb000 : 0xb080) | imm / 4);
+            }
+            // add rdn, rm, which sets no flags, either operand order
+            if (insn->op != ARM_ADD || (insn->rd != insn->rn && insn->rd != insn->rm)) return -1;
+            if (insn->rd == ARM_PC || insn->rn == ARM_PC || insn->rm == ARM_PC) return -1;
+            if (insn->rd == ARM_SP && insn->rm == ARM_SP) return -1;
+            {
+                int other = insn->rd == insn->rn ? insn->rm : insn->rn;
+                return (int32_t)(0x4400 | (uint32_t)(insn->rd >> 3) << 7 | (uint32_t)other << 3 | (insn->rd & 7));
+            }
+        case ARM_LDR:
+        case ARM_STR:
+        case ARM_LDRB:
+        case ARM_STRB: {
+            int load = insn->op == ARM_LDR || insn->op == ARM_LDRB;
+            if (insn->form == ARM_OPERAND_REG) {
+                if (!low) return -1;
+                uint32_t base = word ? (load ? 0x5800 : 0x5000) : (load ? 0x5c00 : 0x5400);
+                return (int32_t)(base | (uint32_t)insn->rm << 6 | (uint32_t)insn->rn << 3 | insn->rd);
+            }
+            if (word && insn->rn == ARM_SP && is_low(insn->rd) && imm <= 1020 && imm % 4 == 0) {
+                return (int32_t)((load ? 0x9800 : 0x9000) | (uint32_t)insn->rd << 8 | imm / 4);
+            }
+            uint32_t scale = word ? 4 : 1;
+            if (!low || imm > 31 * scale || imm % scale != 0) return -1;
+            uint32_t base = word ? (load ? 0x6800 : 0x6000) : (load ? 0x7800 : 0x7000);
+            return (int32_t)(base | imm / scale << 6 | (uint32_t)insn->rn << 3 | insn->rd);
+        }
+        default:
+            return -1;
+    }
+}
+
+// Size in bytes of the encoding of an instruction
+static uint32_t insn_size(const ArmInsn *insn) {
+    switch ((ArmOp)insn->op) {
+        case ARM_LABEL:
+            return 0;
+        case ARM_IT:
+        case ARM_CBZ:
+        case ARM_CBNZ:
+            return 2;
+        default:
+            return short_encoding(insn) >= 0 ? 2 : 4;
+    }
+}
+
+// Grow the byte buffer to hold size more bytes
+static int reserve(ThumbCode *code, uint32_t size) {
+    if (code->size + size <= code->capacity) return 1;
+    uint32_t capacity = code->capacity ? code->capacity : 4096;
+    while (capacity < code->size + size) capacity *= 2;
+    uint8_t *bytes = (uint8_t*)realloc(code->bytes, capacity);
+    if (!bytes) return 0;
+    code->bytes = bytes;
+    code->capacity = capacity;
+    return 1;
+}
+
+// Append a halfword, the buffer having room for it
+static void put16(ThumbCode *code, uint32_t halfword) {
+    code->bytes[code->size++] = (uint8_t)halfword;
+    code->bytes[code->size++] = (uint8_t)(halfword >> 8);
+}
+
+// Append a 32-bit instruction, first halfword first
+static int put32(ThumbCode *code, uint32_t first, uint32_t second) {
+    put16(code, first);
+    put16(code, second);
+    return 1;
+}
+
+// Record a reference to a symbol at the current offset
+static int add_reloc(ThumbCode *code, ThumbRelocKind kind, const char *symbol) {
+    if (code->num_relocs == code->relocs_capacity) {
+        int capacity = code->relocs_capacity ? code->relocs_capacity * 2 : 64;
+        ThumbReloc *relocs = (ThumbReloc*)realloc(code->relocs, capacity * sizeof(ThumbReloc));
+        if (!relocs) {
+            code->failed = 1;
+            return 0;
+        }
+        code->relocs = relocs;
+        code->relocs_capacity = capacity;
+    }
+    ThumbReloc *reloc = &code->relocs[code->num_relocs++];
+    reloc->offset = code->size;
+    reloc->symbol = symbol;
+    reloc->kind = kind;
+    return 1;
+}
+
+// Offset of a label from the pc value of the current instruction
+static int32_t branch_offset(const Encoder *enc, int label) {
+    return (int32_t)enc->label_offsets[label] - (int32_t)(enc->offset + 4);
+}
+
+// b label or b<cond>.w label
+static int encode_branch(Encoder *enc, const ArmInsn *insn) {
+    int32_t offset = branch_offset(enc, insn->imm);
+    uint32_t bits = (uint32_t)offset;
+    uint32_t sign = offset < 0;
+    uint32_t imm11 = (bits >> 1) & 0x7ff;
+
+    if (insn->cond == ARM_AL) {
+        if (offset < -B_RANGE || offset >= B_RANGE) return 0;
+        uint32_t j1 = !(((bits >> 23) & 1) ^ sign);
+        uint32_t j2 = !(((bits >> 22) & 1) ^ sign);
+        return put32(enc->code, 0xf000 | sign << 10 | ((bits >> 12) & 0x3ff),
+                     0x9000 | j1 << 13 | j2 << 11 | imm11);
+    }
+    if (offset < -B_COND_RANGE || offset >= B_COND_RANGE) return 0;
+    uint32_t j1 = (bits >> 18) & 1;
+    uint32_t j2 = (bits >> 19) & 1;
+    return put32(enc->code, 0xf000 | sign << 10 | (uint32_t)insn->cond << 6 | ((bits >> 12) & 0x3f),
+                 0x8000 | j1 << 13 | j2 << 11 | imm11);
+}
+
+// cbz/cbnz rn, label
+static int encode_cbz(Encoder *enc, const ArmInsn *insn) {
+    int32_t offset = branch_offset(enc, insn->imm);
+    if (offset < 0 || offset > CBZ_RANGE || insn->rn > 7) return 0;
+    put16(enc->code, 0xb100 | (insn->op == ARM_CBNZ) << 11 | (uint32_t)(offset >> 6) << 9 |
+                     (uint32_t)((offset >> 1) & 0x1f) << 3 | insn->rn);
+    return 1;
+}
+
+// it<x<y<z>>> cond
+static int encode_it(Encoder *enc, const ArmInsn *insn) {
+    int count = insn->rn;
+    if (count < 1 || count > 4 || insn->cond == ARM_AL) return 0;
+    uint32_t first = insn->cond & 1;
+    uint32_t mask = 1u << (4 - count);
+    for (int k = 1; k < count; k++) {
+        uint32_t slot = insn->imm & (1 << k) ? !first : first;
+        mask |= slot << (4 - k);
+    }
+    put16(enc->code, 0xbf00 | (uint32_t)insn->cond << 4 | mask);
+    return 1;
+}
+
+// movw/movt rd, #imm16, or of the address of a symbol
+static int encode_move_wide(Encoder *enc, const ArmInsn *insn) {
+    uint32_t imm = (uint32_t)insn->imm;
+    if (insn->symbol) {
+        // The addend stays in the instruction, as REL relocations expect
+        if (!add_reloc(enc->code, insn->op == ARM_MOVW ? THUMB_RELOC_MOVW : THUMB_RELOC_MOVT, insn->symbol)) {
+            return 0;
+        }
+        imm = 0;
+    }
+    if (imm > 0xffff) return 0;
+    uint32_t base = insn->op == ARM_MOVT ? 0xf2c0 : 0xf240;
+    return put32(enc->code, base | ((imm >> 11) & 1) << 10 | imm >> 12,
+                 ((imm >> 8) & 7) << 12 | (uint32_t)insn->rd << 8 | (imm & 0xff));
+}
+
+// Loads and stores, [rn, #imm] or [rn, rm]
+static int encode_memory(Encoder *enc, const ArmInsn *insn) {
+    uint32_t base;
+    switch ((ArmOp)insn->op) {
+        case ARM_LDR: base = 0xf850; break;
+        case ARM_LDRB: base = 0xf810; break;
+        case ARM_STR: base = 0xf840; break;
+        default: base = 0xf800; break;
+    }
+    uint32_t rt = (uint32_t)insn->rd << 12;
+    if (insn->form == ARM_OPERAND_REG) return put32(enc->code, base | insn->rn, rt | insn->rm);
+    if (insn->imm >= 0 && insn->imm <= 0xfff) {
+        return put32(enc->code, base | 0x80 | insn->rn, rt | (uint32_t)insn->imm);
+    }
+    // Negative offsets with the 8-bit form
+    if (insn->imm < 0 && insn->imm >= -0xff) {
+        return put32(enc->code, base | insn->rn, rt | 0xc00 | (uint32_t)-insn->imm);
+    }
+    return 0;
+}
+
+// push.w/pop.w {list}, for lists with high registers
+static int encode_stack(Encoder *enc, const ArmInsn *insn) {
+    uint32_t mask = (uint32_t)insn->imm;
+    if (mask & (1u << ARM_SP)) return 0;
+    if (insn->op == ARM_PUSH) {
+        if (mask & (1u << ARM_PC)) return 0;
+        return put32(enc->code, 0xe92d, mask);
+    }
+    if ((mask & (1u << ARM_PC)) && (mask & (1u << ARM_LR))) return 0;
+    return put32(enc->code, 0xe8bd, mask);
+}
+
+// Data processing with an immediate operand
+static int encode_data_imm(Encoder *enc, const ArmInsn *insn) {
+    ArmOp op = (ArmOp)insn->op;
+    uint32_t rd = (uint32_t)insn->rd << 8;
+    if (op == ARM_LSL || op == ARM_LSR || op == ARM_ASR) {
+        uint32_t amount = (uint32_t)insn->imm;
+        if (amount > 31) return 0;
+        return put32(enc->code, 0xea4f,
+                     (amount >> 2) << 12 | rd | (amount & 3) << 6 | (uint32_t)shift_type(op) << 4 | insn->rn);
+    }
+
+    int opcode;
+    uint32_t rn = insn->rn;
+    uint32_t flags = 0;
+    switch (op) {
+        case ARM_MOV: opcode = 2; rn = 15; break;   // orr with no first operand
+        case ARM_MVN: opcode = 3; rn = 15; break;   // orn with no first operand
+        case ARM_CMP: opcode = 13; rd = 0xf00; flags = 0x10; break;
+        default: opcode = data_opcode(op); break;
+    }
+    if (opcode < 0) return 0;
+
+    int imm12 = modified_imm((uint32_t)insn->imm);
+    if (imm12 >= 0) {
+        uint32_t field = (uint32_t)imm12;
+        return put32(enc->code, 0xf000 | (field >> 11) << 10 | (uint32_t)opcode << 5 | flags | rn,
+                     ((field >> 8) & 7) << 12 | rd | (field & 0xff));
+    }
+
+    // Plain 12-bit forms: addw, subw, and movw for a mov
+    uint32_t imm = (uint32_t)insn->imm;
+    uint32_t base;
+    if ((op == ARM_ADD || op == ARM_SUB) && imm <= 0xfff) base = op == ARM_ADD ? 0xf200 | rn : 0xf2a0 | rn;
+    else if (op == ARM_MOV && imm <= 0xffff) base = 0xf240 | imm >> 12;
+    else return 0;
+    return put32(enc->code, base | ((imm >> 11) & 1) << 10, ((imm >> 8) & 7) << 12 | rd | (imm & 0xff));
+}
+
+// Data processing with a register operand
+static int encode_data_reg(Encoder *enc, const ArmInsn *insn) {
+    ArmOp op = (ArmOp)insn->op;
+    uint32_t rd = (uint32_t)insn->rd << 8;
+    switch (op) {
+        case ARM_MVN:
+            return put32(enc->code, 0xea6f, rd | insn->rm);
+        case ARM_CMP:
+            return put32(enc->code, 0xebb0 | insn->rn, 0x0f00 | insn->rm);
+        case ARM_CLZ:
+            return put32(enc->code, 0xfab0 | insn->rm, 0xf080 | rd | insn->rm);
+        case ARM_MUL:
+            return put32(enc->code, 0xfb00 | insn->rn, 0xf000 | rd | insn->rm);
+        case ARM_LSL:
+        case ARM_LSR:
+        case ARM_ASR:
+            return put32(enc->code, 0xfa00 | (uint32_t)shift_type(op) << 5 | insn->rn, 0xf000 | rd | insn->rm);
+        default: {
+            int opcode = data_opcode(op);
+            if (opcode < 0) return 0;
+            return put32(enc->code, 0xea00 | (uint32_t)opcode << 5 | insn->rn, rd | insn->rm);
+        }
+    }
+}
+
+// Encode one instruction at the end of the code
+static int encode_insn(Encoder *enc, const ArmInsn *insn) {
+    int32_t halfword = short_encoding(insn);
+    if (halfword >= 0) {
+        put16(enc->code, (uint32_t)halfword);
+        return 1;
+    }
+    switch ((ArmOp)insn->op) {
+        case ARM_LABEL:
+            return 1;
+        case ARM_IT:
+            return encode_it(enc, insn);
+        case ARM_B:
+            return encode_branch(enc, insn);
+        case ARM_CBZ:
+        case ARM_CBNZ:
+            return encode_cbz(enc, insn);
+        case ARM_BL:
+            // bl with the -4 addend, resolved by the linker
+            if (!add_reloc(enc->code, THUMB_RELOC_CALL, insn->symbol)) return 0;
+            return put32(enc->code, 0xf7ff, 0xfffe);
+        case ARM_MOVW:
+        case ARM_MOVT:
+            return encode_move_wide(enc, insn);
+        case ARM_LDR:
+        case ARM_LDRB:
+        case ARM_STR:
+        case ARM_STRB:
+            return encode_memory(enc, insn);
+        case ARM_PUSH:
+        case ARM_POP:
+            return encode_stack(enc, insn);
+        default:
+            return insn->form == ARM_OPERAND_IMM ? encode_data_imm(enc, insn) : encode_data_reg(enc, insn);
+    }
+}
+
+// Append the code of a function
+int thumb_encode_function(ThumbCode *code, const ArmFunction *function) {
+    if (code->failed || function->failed) return 0;
+
+    Encoder enc;
+    enc.code = code;
+    enc.function = function;
+    enc.label_offsets = (uint32_t*)calloc(function->num_labels > 0 ? function->num_labels : 1, sizeof(uint32_t));
+    if (!enc.label_offsets) {
+        code->failed = 1;
+        return 0;
+    }
+
+    // Sizes do not depend on offsets, so one pass places every label
+    uint32_t size = 0;
+    for (int i = 0; i < function->num_insns; i++) {
+        const ArmInsn *insn = &function->insns[i];
+        if (insn->op == ARM_LABEL) enc.label_offsets[insn->imm] = size;
+        size += insn_size(insn);
+    }
+
+    int ok = reserve(code, size);
+    if (!ok) code->failed = 1;
+    uint32_t start = code->size;
+    enc.offset = 0;
+    for (int i = 0; ok && i < function->num_insns; i++) {
+        const ArmInsn *insn = &function->insns[i];
+        ok = encode_insn(&enc, insn);
+        enc.offset += insn_size(insn);
+    }
+    if (ok && code->size - start != size) ok = 0;
+
+    free(enc.label_offsets);
+    return ok;
+}
@@ -0,0 +1,50 @@
+/**
+ * Thumb-2 Encoder Header
+ *
+ * Turns the instruction buffers of the ARM backend (arm.h) into machine
+ * code. Every instruction has a size known before encoding, so label
+ * offsets come from one pass over the buffer and branches are encoded
+ * right away in a second; only references to symbols are left to the
+ * object writer as relocations.
+ */
+
+#ifndef THUMB_H
+#define THUMB_H
+
+#include <stdint.h>
+#include "arm.h"
+
+// Kind of a reference to a symbol left in the code
+typedef enum {
+    THUMB_RELOC_CALL,    // bl symbol
+    THUMB_RELOC_MOVW,    // movw rd, #:lower16:symbol
+    THUMB_RELOC_MOVT     // movt rd, #:upper16:symbol
+} ThumbRelocKind;
+
+// Reference to a symbol at an offset of the code
+typedef struct {
+    uint32_t offset;
+    const char *symbol;  // Interned
+    ThumbRelocKind kind;
+} ThumbReloc;
+
+// Machine code of a section, appended to function by function
+typedef struct {
+    uint8_t *bytes;
+    uint32_t size;
+    uint32_t capacity;
+    ThumbReloc *relocs;
+    int num_relocs;
+    int relocs_capacity;
+    int failed;          // Set when memory ran out
+} ThumbCode;
+
+// Code buffer lifetime
+void thumb_code_init(ThumbCode *code);
+void thumb_code_free(ThumbCode *code);
+
+// Append the code of a function, returns 0 if an instruction has no
+// encoding (out of range offset or immediate) or memory ran out
+int thumb_encode_function(ThumbCode *code, const ArmFunction *function);
+
+#endif // THUMB_H
@@ -0,0 +1,55 @@
+// Short conditional forms: it/ite blocks and cbz/cbnz
+int max(int a, int b) {
+    int m = b;
+    if (a > b) m = a;
+    return m;
+}
+
+int sign(int x) {
+    int s;
+    if (x < 0) s = -1;
+    else s = 1;
+    return s;
+}
+
+int nonzero(int x) {
+    if (x == 0) return 7;
+    return x + 1;
+}
+
+int first(int x, int y) {
+    if (x != 0) return y;
+    return y * 3;
+}
+
+// Too long for an it block: cbnz skips the body
+int update(int x, int y) {
+    if (x == 0) {
+        y = y * 5 + 3;
+        y = y ^ 9;
+        y = y - 4;
+        y = y * y;
+    }
+    return y;
+}
+
+// And cbz when the test is x != 0
+int adjust(int x, int y) {
+    if (x != 0) {
+        y = y * 7 + x;
+        y = y ^ x;
+        y = y - 2;
+        y = y * x;
+    }
+    return y;
+}
+
+// The loop branches backward, which cbz cannot
+int count(int n) {
+    int i = 0;
+    while (n != 0) {
+        n = n / 2;
+        i = i + 1;
+    }
+    return i;
+}
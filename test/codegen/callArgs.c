@@ -0,0 +1,8 @@
+// The fifth and sixth arguments go on the stack
+int six(int a, int b, int c, int d, int e, int f) {
+    return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6;
+}
+
+int call(int x) {
+    return six(x, x + 1, x + 2, x + 3, x + 4, x + 5);
+}
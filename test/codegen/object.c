@@ -0,0 +1,16 @@
+// One of each section, symbol kind and relocation of the ELF writer
+#include <stdio.h>
+
+int counter = 5;
+int table[4];
+char letter = 104;
+
+int twice(int x) {
+    return x * 2;
+}
+
+int main() {
+    table[1] = twice(counter);
+    printf("%c %d\n", letter, table[1]);
+    return 0;
+}
@@ -0,0 +1,11 @@
+// i and total change in the loop, so both get a phi at its head
+int triangle(int n) {
+    int total = 0;
+    int i = 0;
+    while (i < n) {
+        if (i % 2 == 0) total = total + i;
+        else total = total - 1;
+        i = i + 1;
+    }
+    return total;
+}
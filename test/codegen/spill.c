@@ -0,0 +1,19 @@
+// More values live at once than there are registers, across a call
+int id(int x) {
+    return x;
+}
+
+int pressure(int x) {
+    int a = x + 1;
+    int b = x + 2;
+    int c = x + 3;
+    int d = x + 4;
+    int e = x + 5;
+    int f = x + 6;
+    int g = x + 7;
+    int h = x + 8;
+    int i = x + 9;
+    int j = x + 10;
+    int k = id(a) + id(b);
+    return a * b + c * d + e * f + g * h + i * j + k + a * j;
+}
@@ -0,0 +1,19 @@
+int counter;
+
+int square(int x) {
+    return x * x;
+}
+
+int sum(int n) {
+    int total = 0;
+    while (n > 0) {
+        total = total + n;
+        n = n - 1;
+    }
+    return total;
+}
+
+int main() {
+    counter = square(3) + sum(4);
+    return counter;
+}
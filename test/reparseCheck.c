@@ -0,0 +1,118 @@
+/**
+ * Incremental Reparse Check
+ *
+ * usage: reparseCheck before.c after.c
+ * Parses before.c, then gets the AST of after.c twice: through
+ * reparse_program with the single edit that turns one text into the
+ * other, and by a full parse. Both must dump to the same JSON, spans
+ * included, and the reparse must have kept at least one declaration.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "ast_dump.h"
+#include "emit.h"
+#include "error.h"
+#include "intern.h"
+#include "lexeme.h"
+#include "parser.h"
+#include "reparse.h"
+
+// Lexer over a file, NULL if it cannot be read
+static Lexer* open_lexer(const char *path, DiagEngine *diag, FILE **file) {
+    *file = fopen(path, "r");
+    if (!*file) {
+        fprintf(stderr, "impossible d'ouvrir %s\n", path);
+        return NULL;
+    }
+    return init_lexer(*file, (char*)path, diag);
+}
+
+// Parse the whole text of a lexer
+static ASTNode* parse_all(Lexer *lexer, Arena *arena) {
+    Parser *parser = init_parser(lexer, arena);
+    if (!parser) return NULL;
+    ASTNode *program = parse_program(parser);
+    free_parser(parser);
+    return program;
+}
+
+// The edit replacing what differs between two texts
+static TextEdit single_edit(const Lexer *before, const Lexer *after) {
+    unsigned old_size = (unsigned)before->buffer_size;
+    unsigned new_size = (unsigned)after->buffer_size;
+    unsigned prefix = 0;
+    while (prefix < old_size && prefix < new_size && before->buffer[prefix] == after->buffer[prefix]) prefix++;
+    unsigned suffix = 0;
+    while (suffix < old_size - prefix && suffix < new_size - prefix &&
+           before->buffer[old_size - 1 - suffix] == after->buffer[new_size - 1 - suffix]) {
+        suffix++;
+    }
+    TextEdit edit = { prefix, old_size - suffix, new_size - suffix - prefix };
+    return edit;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage : %s avant.c apres.c\n", argv[0]);
+        return 2;
+    }
+
+    DiagEngine *diag = diag_create(stderr);
+    // The AST of before.c stays in its own arena: the reparse moves its kept
+    // subtrees into the result, so that arena must outlive the result
+    Arena *before_arena = arena_create(0);
+    Arena *reparse_arena = arena_create(0);
+    Arena *full_arena = arena_create(0);
+    Emitter *reparsed_dump = emitter_create(-1);
+    Emitter *full_dump = emitter_create(-1);
+    FILE *files[3] = { NULL, NULL, NULL };
+    Lexer *before = open_lexer(argv[1], diag, &files[0]);
+    Lexer *after = open_lexer(argv[2], diag, &files[1]);
+    Lexer *after_full = open_lexer(argv[2], diag, &files[2]);
+
+    int status = 1;
+    if (diag && before_arena && reparse_arena && full_arena && reparsed_dump && full_dump &&
+        before && after && after_full) {
+        ASTNode *old_program = parse_all(before, before_arena);
+        TextEdit edit = single_edit(before, after);
+        ReparseStats stats;
+        ASTNode *reparsed = reparse_program(old_program, &edit, 1, after, reparse_arena, &stats);
+        ASTNode *full = parse_all(after_full, full_arena);
+
+        ast_dump_json(reparsed_dump, argv[2], reparsed);
+        ast_dump_json(full_dump, argv[2], full);
+        int same = reparsed_dump->length == full_dump->length &&
+                   memcmp(reparsed_dump->buffer, full_dump->buffer, full_dump->length) == 0;
+        printf("gardés %d, réanalysés %d%s\n", stats.reused, stats.reparsed, stats.full ? ", analyse complète" : "");
+        if (!reparsed || !full || diag_error_count(diag) > 0) {
+            fprintf(stderr, "analyse échouée\n");
+        } else if (!same) {
+            fprintf(stderr, "l'AST réanalysé diffère de l'analyse complète\n");
+        } else if (stats.full || stats.reused == 0) {
+            fprintf(stderr, "aucune déclaration gardée\n");
+        } else {
+            status = 0;
+        }
+    }
+
+    if (before) free_lexer(before);
+    if (after) free_lexer(after);
+    if (after_full) free_lexer(after_full);
+    for (int i = 0; i < 3; i++) {
+        if (files[i]) fclose(files[i]);
+    }
+    if (reparsed_dump) emitter_destroy(reparsed_dump);
+    if (full_dump) emitter_destroy(full_dump);
+    if (full_arena) arena_destroy(full_arena);
+    if (reparse_arena) arena_destroy(reparse_arena);
+    if (before_arena) arena_destroy(before_arena);
+    if (diag) {
+        diag_flush(diag);
+        diag_destroy(diag);
+    }
+    free_interner();
+    return status;
+}